@@ -1872,7 +1872,7 @@ int obtain_gain_index(int32 sd_id,short gain_index[15])
     return ret_value;
 }
 
-int readThenWrite_ASTER_HR_LatLon(hid_t SWIRgeoGroupID,hid_t TIRgeoGroupID,hid_t VNIRgeoGroupID,char*latname,char*lonname,int32 h4_type,hid_t h5_type,int32 inFileID, hid_t outputFileID, char* granuleAppend )
+static int doReadThenWrite_ASTER_HR_LatLon(hid_t SWIRgeoGroupID,hid_t TIRgeoGroupID,hid_t VNIRgeoGroupID,char*latname,char*lonname,int32 h4_type,hid_t h5_type,int32 inFileID, hid_t outputFileID, char* granuleAppend )
 {
 
     int retVal = 0;
@@ -2011,9 +2011,96 @@ int readThenWrite_ASTER_HR_LatLon(hid_t SWIRgeoGroupID,hid_t TIRgeoGroupID,hid_t
             FATAL_MSG("Cannot allocate lon_swir_buffer.\n");
             goto cleanupFail;
         }
+    }
 
-        asterLatLonSpherical(latBuffer,lonBuffer,lat_swir_buffer,lon_swir_buffer,nSWIR_ImageLine,nSWIR_ImagePixel);
+    // TIR
+    if ( TIRgeoGroupID )
+    {
+        TIR_ImageLine_DimID = H5Dopen2(outputFileID,ll_tir_dimnames[0],H5P_DEFAULT);
+        nTIR_ImageLine = obtainDimSize(TIR_ImageLine_DimID);
+        TIR_ImagePixel_DimID = H5Dopen2(outputFileID,ll_tir_dimnames[1],H5P_DEFAULT);
+        nTIR_ImagePixel = obtainDimSize(TIR_ImagePixel_DimID);
+
+
+        lat_tir_buffer = (double*)malloc(sizeof(double)*nTIR_ImageLine*nTIR_ImagePixel);
+        if(lat_tir_buffer == NULL)
+        {
+            FATAL_MSG("Cannot allocate lat_tir_buffer.\n");
+            goto cleanupFail;
+        }
+
+        lon_tir_buffer = (double*)malloc(sizeof(double)*nTIR_ImageLine*nTIR_ImagePixel);
+        if(lon_tir_buffer == NULL)
+        {
+            FATAL_MSG("Cannot allocate lon_tir_buffer.\n");
+            goto cleanupFail;
+        }
+    }
+
+    // Possible VNIR
+    if(VNIRgeoGroupID!=0)
+    {
 
+        VNIR_ImageLine_DimID = H5Dopen2(outputFileID,ll_vnir_dimnames[0],H5P_DEFAULT);
+        nVNIR_ImageLine = obtainDimSize(VNIR_ImageLine_DimID);
+        VNIR_ImagePixel_DimID = H5Dopen2(outputFileID,ll_vnir_dimnames[1],H5P_DEFAULT);
+        nVNIR_ImagePixel = obtainDimSize(VNIR_ImagePixel_DimID);
+
+
+        lat_vnir_buffer = (double*)malloc(sizeof(double)*nVNIR_ImageLine*nVNIR_ImagePixel);
+        if(lat_vnir_buffer == NULL)
+        {
+            FATAL_MSG("Cannot allocate lat_vnir_buffer.\n");
+            goto cleanupFail;
+        }
+
+        lon_vnir_buffer = (double*)malloc(sizeof(double)*nVNIR_ImageLine*nVNIR_ImagePixel);
+        if(lon_vnir_buffer == NULL)
+        {
+            FATAL_MSG("Cannot allocate lon_vnir_buffer.\n");
+            goto cleanupFail;
+        }
+    }
+
+    /* The three subsystems are interpolated together. The interpolation does not touch the HDF libraries. */
+    {
+        double* lat_buffers[3];
+        double* lon_buffers[3];
+        int nLines[3];
+        int nPixels[3];
+        int nGrids = 0;
+
+        if ( SWIRgeoGroupID )
+        {
+            lat_buffers[nGrids] = lat_swir_buffer;
+            lon_buffers[nGrids] = lon_swir_buffer;
+            nLines[nGrids] = nSWIR_ImageLine;
+            nPixels[nGrids] = nSWIR_ImagePixel;
+            nGrids++;
+        }
+        if ( TIRgeoGroupID )
+        {
+            lat_buffers[nGrids] = lat_tir_buffer;
+            lon_buffers[nGrids] = lon_tir_buffer;
+            nLines[nGrids] = nTIR_ImageLine;
+            nPixels[nGrids] = nTIR_ImagePixel;
+            nGrids++;
+        }
+        if ( VNIRgeoGroupID )
+        {
+            lat_buffers[nGrids] = lat_vnir_buffer;
+            lon_buffers[nGrids] = lon_vnir_buffer;
+            nLines[nGrids] = nVNIR_ImageLine;
+            nPixels[nGrids] = nVNIR_ImagePixel;
+            nGrids++;
+        }
+
+        asterLatLonSphericalMulti(latBuffer,lonBuffer,nGrids,lat_buffers,lon_buffers,nLines,nPixels,interpThreadCount());
+    }
+
+    // SWIR
+    if ( SWIRgeoGroupID )
+    {
         // SWIR Latitude
         if (Generate2D_Dataset(SWIRgeoGroupID,latname,h5_type,lat_swir_buffer,SWIR_ImageLine_DimID,SWIR_ImagePixel_DimID,nSWIR_ImageLine,nSWIR_ImagePixel)<0)
         {
@@ -2046,28 +2133,6 @@ int readThenWrite_ASTER_HR_LatLon(hid_t SWIRgeoGroupID,hid_t TIRgeoGroupID,hid_t
     // TIR
     if ( TIRgeoGroupID )
     {
-        TIR_ImageLine_DimID = H5Dopen2(outputFileID,ll_tir_dimnames[0],H5P_DEFAULT);
-        nTIR_ImageLine = obtainDimSize(TIR_ImageLine_DimID);
-        TIR_ImagePixel_DimID = H5Dopen2(outputFileID,ll_tir_dimnames[1],H5P_DEFAULT);
-        nTIR_ImagePixel = obtainDimSize(TIR_ImagePixel_DimID);
-
-
-        lat_tir_buffer = (double*)malloc(sizeof(double)*nTIR_ImageLine*nTIR_ImagePixel);
-        if(lat_tir_buffer == NULL)
-        {
-            FATAL_MSG("Cannot allocate lat_tir_buffer.\n");
-            goto cleanupFail;
-        }
-
-        lon_tir_buffer = (double*)malloc(sizeof(double)*nTIR_ImageLine*nTIR_ImagePixel);
-        if(lon_tir_buffer == NULL)
-        {
-            FATAL_MSG("Cannot allocate lon_tir_buffer.\n");
-            goto cleanupFail;
-        }
-
-        asterLatLonSpherical(latBuffer,lonBuffer,lat_tir_buffer,lon_tir_buffer,nTIR_ImageLine,nTIR_ImagePixel);
-
         // TIR Latitude
         if (Generate2D_Dataset(TIRgeoGroupID,latname,h5_type,lat_tir_buffer,TIR_ImageLine_DimID,TIR_ImagePixel_DimID,nTIR_ImageLine,nTIR_ImagePixel)<0)
         {
@@ -2100,29 +2165,6 @@ int readThenWrite_ASTER_HR_LatLon(hid_t SWIRgeoGroupID,hid_t TIRgeoGroupID,hid_t
     // Possible VNIR
     if(VNIRgeoGroupID!=0)
     {
-
-        VNIR_ImageLine_DimID = H5Dopen2(outputFileID,ll_vnir_dimnames[0],H5P_DEFAULT);
-        nVNIR_ImageLine = obtainDimSize(VNIR_ImageLine_DimID);
-        VNIR_ImagePixel_DimID = H5Dopen2(outputFileID,ll_vnir_dimnames[1],H5P_DEFAULT);
-        nVNIR_ImagePixel = obtainDimSize(VNIR_ImagePixel_DimID);
-
-
-        lat_vnir_buffer = (double*)malloc(sizeof(double)*nVNIR_ImageLine*nVNIR_ImagePixel);
-        if(lat_vnir_buffer == NULL)
-        {
-            FATAL_MSG("Cannot allocate lat_vnir_buffer.\n");
-            goto cleanupFail;
-        }
-
-        lon_vnir_buffer = (double*)malloc(sizeof(double)*nVNIR_ImageLine*nVNIR_ImagePixel);
-        if(lon_vnir_buffer == NULL)
-        {
-            FATAL_MSG("Cannot allocate lon_vnir_buffer.\n");
-            goto cleanupFail;
-        }
-
-        asterLatLonSpherical(latBuffer,lonBuffer,lat_vnir_buffer,lon_vnir_buffer,nVNIR_ImageLine,nVNIR_ImagePixel);
-
         // VNIR Latitude
         if (Generate2D_Dataset(VNIRgeoGroupID,latname,h5_type,lat_vnir_buffer,VNIR_ImageLine_DimID,VNIR_ImagePixel_DimID,nVNIR_ImageLine,nVNIR_ImagePixel)<0)
         {
@@ -2186,3 +2228,13 @@ cleanupFail:
     return EXIT_SUCCESS;
 
 }
+
+/* Runs doReadThenWrite_ASTER_HR_LatLon() inside a timing record (see timing.c) */
+int readThenWrite_ASTER_HR_LatLon(hid_t SWIRgeoGroupID,hid_t TIRgeoGroupID,hid_t VNIRgeoGroupID,char*latname,char*lonname,int32 h4_type,hid_t h5_type,int32 inFileID, hid_t outputFileID, char* granuleAppend )
+{
+    int timer = timingBegin("readThenWrite_ASTER_HR_LatLon", latname, NULL);
+    int ret = doReadThenWrite_ASTER_HR_LatLon( SWIRgeoGroupID, TIRgeoGroupID, VNIRgeoGroupID, latname, lonname, h4_type,
+                                               h5_type, inFileID, outputFileID, granuleAppend );
+    timingEnd(timer);
+    return ret;
+}
@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mfhdf.h>
 #include <hdf.h>    // hdf4
 #include <hdf5.h>   // hdf5
 #include "libTERRA.h"
+#include "kernels/unpackKernels.h"
 #define XMAX 2
 #define YMAX 720
 #define DIM_MAX 10
@@ -11,6 +13,223 @@
 int obtain_start_end_index(int* sindex_ptr,int* endex_ptr,double *jd,int32 size,OInfo_t orbit_info);
 herr_t CERESinsertAttrs( hid_t objectID, char* long_nameVal, char* unitsVal, float valid_rangeMin, float valid_rangeMax );
 
+/* The subset reader of CERES(): all fields of a granule are read through one set of SDS ids
+   and one scratch buffer */
+#define CERES_MAX_FIELDS 16
+
+typedef struct CERESbatch
+{
+    int32 numFields;
+    const char* names[CERES_MAX_FIELDS];
+    int32 sdsID[CERES_MAX_FIELDS];
+    int32 rank[CERES_MAX_FIELDS];
+    int32 ntype[CERES_MAX_FIELDS];
+    int32 count[CERES_MAX_FIELDS][DIM_MAX];     // subset of the field, the whole field after dim 0
+    int32 subsetStart;
+    void* scratch;
+
+} CERESbatch_t;
+
+static void CERESbatchClose( CERESbatch_t* batch );
+
+/*
+                    CERESbatchOpen
+    DESCRIPTION:
+        Selects the given fields of a CERES granule, checks their types and allocates one
+        scratch buffer for the subset of the largest field.
+
+    ARGUMENTS:
+        CERESbatch_t* batch   -- Receives the open fields
+        int32 fileID          -- SD interface ID of the CERES granule
+        const char** names    -- Names of the SDS
+        const int32* types    -- Their expected HDF4 types
+        int32 numFields       -- Number of fields (at most CERES_MAX_FIELDS)
+        int32 subsetStart     -- First footprint of the subset
+        int32 subsetCount     -- Number of footprints of the subset
+
+    EFFECTS:
+        The batch must be closed with CERESbatchClose(), also when this function fails.
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise.
+*/
+static herr_t CERESbatchOpen( CERESbatch_t* batch, int32 fileID, const char** names, const int32* types,
+                              int32 numFields, int32 subsetStart, int32 subsetCount )
+{
+    int32 dims[DIM_MAX];
+    int32 num_attrs;
+    size_t scratchSize = 0;
+
+    memset(batch, 0, sizeof(CERESbatch_t));
+    batch->subsetStart = subsetStart;
+
+    if ( numFields > CERES_MAX_FIELDS )
+    {
+        FATAL_MSG("Too many CERES fields.\n");
+        return FATAL_ERR;
+    }
+
+    for ( int32 k = 0; k < numFields; k++ )
+    {
+        int32 sds_index = SDnametoindex( fileID, names[k] );
+        if ( sds_index < 0 )
+        {
+            FATAL_MSG("SDnametoindex: Failed to find \"%s\".\n", names[k]);
+            return FATAL_ERR;
+        }
+
+        batch->sdsID[k] = SDselect( fileID, sds_index );
+        if ( batch->sdsID[k] < 0 )
+        {
+            batch->sdsID[k] = 0;
+            FATAL_MSG("SDselect: Failed to select \"%s\".\n", names[k]);
+            return FATAL_ERR;
+        }
+        batch->names[k] = names[k];
+        batch->numFields = k + 1;
+
+        if ( SDgetinfo( batch->sdsID[k], NULL, &batch->rank[k], dims, &batch->ntype[k], &num_attrs ) < 0 ||
+             batch->rank[k] < 1 || batch->rank[k] > DIM_MAX )
+        {
+            FATAL_MSG("SDgetinfo: Failed to get info from \"%s\".\n", names[k]);
+            return FATAL_ERR;
+        }
+
+        if ( batch->ntype[k] != types[k] )
+        {
+            FATAL_MSG("The number type of \"%s\" is not the expected one.\n", names[k]);
+            return FATAL_ERR;
+        }
+
+        if ( subsetStart + subsetCount > dims[0] )
+        {
+            FATAL_MSG("The subset is outside of \"%s\".\n", names[k]);
+            return FATAL_ERR;
+        }
+
+        size_t fieldSize = (size_t) DFKNTsize(batch->ntype[k]);
+        for ( int32 i = 0; i < batch->rank[k]; i++ )
+        {
+            batch->count[k][i] = ( i == 0 ) ? subsetCount : dims[i];
+            fieldSize *= batch->count[k][i];
+        }
+        scratchSize = max(scratchSize, fieldSize);
+    }
+
+    batch->scratch = malloc( scratchSize );
+    if ( batch->scratch == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        return FATAL_ERR;
+    }
+    timingBuffer( scratchSize );
+
+    return RET_SUCCESS;
+}
+
+/* Ends the access to the fields of the batch and frees the scratch buffer */
+static void CERESbatchClose( CERESbatch_t* batch )
+{
+    for ( int32 k = 0; k < batch->numFields; k++ )
+        if ( batch->sdsID[k] ) SDendaccess(batch->sdsID[k]);
+
+    if ( batch->scratch ) free(batch->scratch);
+    memset(batch, 0, sizeof(CERESbatch_t));
+}
+
+/*
+                    CERESbatchWrite
+    DESCRIPTION:
+        Reads the subset of one field of the batch into the scratch buffer and writes it to
+        the output file. Replaces readThenWriteSubset() for CERES.
+
+    ARGUMENTS:
+        CERESbatch_t* batch       -- The open fields
+        const char* inDatasetName -- Name of the field, one of the names given to CERESbatchOpen()
+        int CER_LATLON            -- Non-zero to convert the colatitude/longitude of the field
+                                     to latitude/longitude (see readThenWriteSubset())
+        const char* outDatasetName -- Name of the output dataset
+        hid_t outputGroupID       -- Group of the output dataset
+        hid_t outputDataType      -- HDF5 type of the output dataset
+
+    EFFECTS:
+        The caller must close the returned dataset with H5Dclose().
+
+    RETURN:
+        The output dataset ID, FATAL_ERR on failure.
+*/
+static hid_t CERESbatchWrite( CERESbatch_t* batch, const char* inDatasetName, int CER_LATLON,
+                              const char* outDatasetName, hid_t outputGroupID, hid_t outputDataType )
+{
+    int32 start[DIM_MAX] = {0};
+    hsize_t dims[DIM_MAX];
+    size_t numElems = 1;
+    int32 k;
+    intn statusn;
+    hid_t datasetID;
+    int timer = timingBegin("readThenWriteSubset", outDatasetName, NULL);
+
+    for ( k = 0; k < batch->numFields; k++ )
+        if ( strcmp(batch->names[k], inDatasetName) == 0 )
+            break;
+
+    if ( k == batch->numFields )
+    {
+        FATAL_MSG("\"%s\" is not a field of the batch.\n", inDatasetName);
+        timingEnd(timer);
+        return FATAL_ERR;
+    }
+
+    start[0] = batch->subsetStart;
+    for ( int32 i = 0; i < batch->rank[k]; i++ )
+    {
+        dims[i] = (hsize_t) batch->count[k][i];
+        numElems *= batch->count[k][i];
+    }
+
+    statusn = SDreaddata( batch->sdsID[k], start, NULL, batch->count[k], batch->scratch );
+
+    if ( statusn < 0 )
+    {
+        FATAL_MSG("SDreaddata: Failed to read \"%s\".\n", inDatasetName);
+        timingEnd(timer);
+        return FATAL_ERR;
+    }
+    timingAddRead( numElems * DFKNTsize(batch->ntype[k]) );
+
+    /* latitude = 90 - colatitude, longitude in [-180, 180] */
+    if ( CER_LATLON )
+    {
+        float* geo = (float*) batch->scratch;
+
+        if ( batch->ntype[k] != DFNT_FLOAT32 )
+        {
+            FATAL_MSG("The CERES geolocation must be a float32 dataset.\n");
+            timingEnd(timer);
+            return FATAL_ERR;
+        }
+
+        if ( strstr(outDatasetName, "Latitude") )
+            colatitudeToLatitude( geo, geo, numElems );
+        else if ( strstr(outDatasetName, "Longitude") )
+            wrapLongitude( geo, geo, numElems );
+        else
+        {
+            FATAL_MSG("The CERES_LATLON argument was given as non-zero, but neither a Latitude nor Longitude\n\tdataset was transferred!\n");
+            timingEnd(timer);
+            return FATAL_ERR;
+        }
+    }
+
+    datasetID = insertDataset( &outputFile, &outputGroupID, 1, batch->rank[k], dims, outputDataType,
+                               outDatasetName, batch->scratch );
+    if ( datasetID == FATAL_ERR )
+        FATAL_MSG("Error writing \"%s\" dataset.\n", outDatasetName);
+
+    timingEnd(timer);
+    return datasetID;
+}
+
 /*      CERES()
  *
  *  DESCRIPTION:
@@ -22,13 +241,13 @@ herr_t CERESinsertAttrs( hid_t objectID, char* long_nameVal, char* unitsVal, flo
  *      argv[2]         -- CERES file name
  *      index           -- 1 if FM1, 2 if FM2
  *      ceres_fm_count  -- Number of index FM1 or FM2 files (denoted by index) that have been processed
- *      c_start         -- The starting subset index
- *      c_stride        -- The HDF5 subsetting stride
- *      c_count         -- The number of elements remaining after subsetting 
+ *      granule         -- The granule opened by CERESopenGranule(). Its file and time array are
+ *                         used for the transfer, its startIndex/endIndex give the subset.
+ *                         The caller keeps the ownership of the granule.
  *
  *  TODO: Finish this description
  */
-int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_stride,int32*c_count)
+int CERES( char* argv[],int index,int ceres_fm_count,CERESgranule_t* granule )
 {
 
 #define NUM_TIME 3
@@ -40,7 +259,6 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
      * VARIABLES *
      *************/
     int32 fileID = 0;
-    int32 h4Type;
     hid_t h5Type;
     hid_t rootCERES_g = 0;
     hid_t granuleID_g = 0;
@@ -95,9 +313,21 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
 
     char cameraName[4] = {0};
 
-    /* open the input file */
-    fileID = SDstart( argv[2], DFACC_READ );
-    if ( fileID < 0 )
+    /* The subset of the granule within the orbit */
+    int32 subsetStart = granule->startIndex;
+    int32 subsetCount = granule->endIndex - granule->startIndex + 1;
+    int32* c_count = &subsetCount;
+
+    /* All fields but the time of observation, read through one batch */
+    CERESbatch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    const char* batchNames[NUM_TIME-1+NUM_VIEWING+NUM_FILT+NUM_UNFILT];
+    int32 batchTypes[NUM_TIME-1+NUM_VIEWING+NUM_FILT+NUM_UNFILT];
+    int32 numBatch = 0;
+
+    /* the input file is already open */
+    fileID = granule->fileID;
+    if ( fileID <= 0 || granule->julianDate == NULL || subsetStart < 0 || subsetCount <= 0 )
     {
         WARN_MSG("Unable to open CERES file.\n\t%s\n", argv[2]);
         fileID = 0;
@@ -236,6 +466,34 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
         sprintf( dimSuffix, "_FM2_g%s", fileTime );
     }
 
+    /* Select all fields once */
+    for ( int k = 1; k < NUM_TIME; k++ )
+    {
+        batchNames[numBatch] = inTimePosName[k];
+        batchTypes[numBatch++] = DFNT_FLOAT32;
+    }
+    for ( int k = 0; k < NUM_VIEWING; k++ )
+    {
+        batchNames[numBatch] = inViewingAngles[k];
+        batchTypes[numBatch++] = DFNT_FLOAT32;
+    }
+    for ( int k = 0; k < NUM_FILT; k++ )
+    {
+        batchNames[numBatch] = inFilteredRadiance[k];
+        batchTypes[numBatch++] = ( k == 3 ) ? DFNT_INT32 : DFNT_FLOAT32;
+    }
+    for ( int k = 0; k < NUM_UNFILT; k++ )
+    {
+        batchNames[numBatch] = inUnfilteredRadiance[k];
+        batchTypes[numBatch++] = DFNT_FLOAT32;
+    }
+
+    if ( CERESbatchOpen( &batch, fileID, batchNames, batchTypes, numBatch, subsetStart, subsetCount ) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to select the CERES fields.\n");
+        goto cleanupFail;
+    }
+
     /************************
      * Time and Position *
      ************************/
@@ -247,15 +505,12 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
         switch ( i )
         {
         case 0:
-            h4Type = DFNT_FLOAT64;
             h5Type = H5T_NATIVE_DOUBLE;
             break;
         case 1:
-            h4Type = DFNT_FLOAT32;
             h5Type = H5T_NATIVE_FLOAT;
             break;
         case 2:
-            h4Type = DFNT_FLOAT32;
             h5Type = H5T_NATIVE_FLOAT;
             break;
         default:
@@ -263,16 +518,21 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
             goto cleanupFail;
         }
 
+        /* The time array was read by CERESopenGranule(), write the subset from there */
+        if ( i == 0 )
+        {
+            hsize_t timeDims[1] = { (hsize_t) subsetCount };
+            generalDsetID_d = insertDataset( &outputFile, &geolocationID_g, 1, 1, timeDims, h5Type,
+                                             outTimePosName[i], granule->julianDate + subsetStart );
+        }
         /* Only do the CERES geolocation unit conversion if transferring lat or lon */
-        if ( strstr("Latitude", outTimePosName[i] ) || strstr("Longitude", outTimePosName[i]) )
-            generalDsetID_d = readThenWriteSubset( 1, outTimePosName[i], geolocationID_g, inTimePosName[i], h4Type, h5Type,
-                                               fileID,c_start,c_stride,c_count);
+        else if ( strstr("Latitude", outTimePosName[i] ) || strstr("Longitude", outTimePosName[i]) )
+            generalDsetID_d = CERESbatchWrite( &batch, inTimePosName[i], 1, outTimePosName[i], geolocationID_g, h5Type );
         else
-            generalDsetID_d = readThenWriteSubset( 0, outTimePosName[i], geolocationID_g, inTimePosName[i], h4Type, h5Type,
-                                               fileID,c_start,c_stride,c_count);
+            generalDsetID_d = CERESbatchWrite( &batch, inTimePosName[i], 0, outTimePosName[i], geolocationID_g, h5Type );
 
 
-        if ( generalDsetID_d == EXIT_FAILURE )
+        if ( generalDsetID_d == FATAL_ERR )
         {
             FATAL_MSG("Failed to insert CERES %s dataset.\n", inTimePosName[i]);
             generalDsetID_d = 0;
@@ -342,11 +602,10 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
 
     for ( i = 0; i < NUM_VIEWING; i++ )
     {
-        h4Type = DFNT_FLOAT32;
         h5Type = H5T_NATIVE_FLOAT;
 
-        generalDsetID_d = readThenWriteSubset( 0, outViewingAngles[i], viewingAngleID_g, inViewingAngles[i], h4Type, h5Type, fileID,c_start,c_stride,c_count);
-        if ( generalDsetID_d == EXIT_FAILURE )
+        generalDsetID_d = CERESbatchWrite( &batch, inViewingAngles[i], 0, outViewingAngles[i], viewingAngleID_g, h5Type );
+        if ( generalDsetID_d == FATAL_ERR )
         {
             FATAL_MSG("Failed to insert \"%s\" dataset.\n", inViewingAngles[i]);
             generalDsetID_d = 0;
@@ -378,18 +637,12 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
     for ( i = 0; i < NUM_FILT; i++ )
     {
         if ( i >=0 && i <=2 )
-        {
-            h4Type = DFNT_FLOAT32;
             h5Type = H5T_NATIVE_FLOAT;
-        }
-        else if ( i == 3 )
-        {
-            h4Type = DFNT_INT32;
+        else
             h5Type = H5T_NATIVE_INT;
-        }
 
-        generalDsetID_d = readThenWriteSubset( 0, outFilteredRadiance[i], radianceID_g, inFilteredRadiance[i], h4Type, h5Type, fileID,c_start,c_stride,c_count);
-        if ( generalDsetID_d == EXIT_FAILURE )
+        generalDsetID_d = CERESbatchWrite( &batch, inFilteredRadiance[i], 0, outFilteredRadiance[i], radianceID_g, h5Type );
+        if ( generalDsetID_d == FATAL_ERR )
         {
             FATAL_MSG("Failed to insert \"%s\" dataset.\n", inFilteredRadiance[i]);
             generalDsetID_d = 0;
@@ -420,11 +673,10 @@ int CERES( char* argv[],int index,int ceres_fm_count,int32*c_start,int32*c_strid
 
     for ( i = 0; i < NUM_UNFILT; i++ )
     {
-        h4Type = DFNT_FLOAT32;
         h5Type = H5T_NATIVE_FLOAT;
 
-        generalDsetID_d = readThenWriteSubset( 0, outUnfilteredRadiance[i], radianceID_g, inUnfilteredRadiance[i], h4Type, h5Type, fileID,c_start,c_stride,c_count);
-        if ( generalDsetID_d == EXIT_FAILURE )
+        generalDsetID_d = CERESbatchWrite( &batch, inUnfilteredRadiance[i], 0, outUnfilteredRadiance[i], radianceID_g, h5Type );
+        if ( generalDsetID_d == FATAL_ERR )
         {
             FATAL_MSG("Failed to insert \"%s\" dataset.\n", inUnfilteredRadiance[i]);
             generalDsetID_d = 0;
@@ -459,7 +711,7 @@ cleanupFail:
 cleanupFO:
         retVal = FAIL_OPEN;
     }
-    if ( fileID )           SDend(fileID);
+    CERESbatchClose(&batch);
     if ( fileTime )         free(fileTime);
     if ( rootCERES_g )      H5Gclose(rootCERES_g);
     if ( granuleID_g)       H5Gclose(granuleID_g);
@@ -475,11 +727,29 @@ cleanupFO:
     return retVal;
 }
 
-int CERES_OrbitInfo(char*argv[],int* start_index_ptr,int* end_index_ptr,OInfo_t orbit_info)
+/*
+                    CERESopenGranule
+    DESCRIPTION:
+        Opens a CERES granule for the whole conversion: reads its "Time of observation"
+        array once and finds the subset of the granule within the orbit. CERES() then uses
+        the open file and the cached time array, so the file is opened and the time array
+        is read only once.
+
+    ARGUMENTS:
+        char* fileName          -- CERES file name
+        OInfo_t orbit_info      -- The current orbit
+        CERESgranule_t* granule -- Receives the open granule
+
+    EFFECTS:
+        The granule must be closed with CERESfreeGranule(), also when this function fails.
+        startIndex and endIndex are negative if the granule is outside of the orbit.
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise.
+*/
+herr_t CERESopenGranule( char* fileName, OInfo_t orbit_info, CERESgranule_t* granule )
 {
-
-    /* open the input file */
-    int32 sd_id,sds_id, sds_index,status;
+    int32 sds_id, sds_index,status;
     int32 rank;
     int32 dimsizes[DIM_MAX];
     int32 start[DIM_MAX] = {0};
@@ -487,28 +757,33 @@ int CERES_OrbitInfo(char*argv[],int* start_index_ptr,int* end_index_ptr,OInfo_t
     int32 num_attrs;                // number of attributes
 
     char* datasetName = "Time of observation";
-    sd_id = SDstart( argv[2], DFACC_READ );
-    if ( sd_id < 0 )
+
+    memset(granule, 0, sizeof(CERESgranule_t));
+    granule->startIndex = -1;
+    granule->endIndex = -1;
+
+    /* open the input file */
+    granule->fileID = SDstart( fileName, DFACC_READ );
+    if ( granule->fileID < 0 )
     {
-        FATAL_MSG("Unable to open CERES file.\n\t%s\n", argv[2]);
-        return (EXIT_FAILURE);
+        FATAL_MSG("Unable to open CERES file.\n\t%s\n", fileName);
+        granule->fileID = 0;
+        return FATAL_ERR;
     }
 
     /* get the index of the dataset from the dataset's name */
-    sds_index = SDnametoindex( sd_id, datasetName );
+    sds_index = SDnametoindex( granule->fileID, datasetName );
     if( sds_index < 0 )
     {
-        printf("SDnametoindex\n");
-        SDend(sd_id);
-        return EXIT_FAILURE;
+        FATAL_MSG("SDnametoindex: Failed to find \"%s\".\n", datasetName);
+        return FATAL_ERR;
     }
 
-    sds_id = SDselect( sd_id, sds_index );
+    sds_id = SDselect( granule->fileID, sds_index );
     if ( sds_id < 0 )
     {
-        printf("SDselect\n");
-        SDend(sd_id);
-        return EXIT_FAILURE;
+        FATAL_MSG("SDselect: Failed to select \"%s\".\n", datasetName);
+        return FATAL_ERR;
     }
 
 
@@ -523,8 +798,7 @@ int CERES_OrbitInfo(char*argv[],int* start_index_ptr,int* end_index_ptr,OInfo_t
     {
         FATAL_MSG("SDgetinfo: Failed to get info from dataset.\n");
         SDendaccess(sds_id);
-        SDend(sd_id);
-        return EXIT_FAILURE;
+        return FATAL_ERR;
     }
 
 
@@ -532,47 +806,50 @@ int CERES_OrbitInfo(char*argv[],int* start_index_ptr,int* end_index_ptr,OInfo_t
     {
         FATAL_MSG("the time dimension rank must be 1 and the datatype must be double.\n");
         SDendaccess(sds_id);
-        SDend(sd_id);
-        return EXIT_FAILURE;
+        return FATAL_ERR;
     }
 
-    double *julian_date = malloc(sizeof julian_date *dimsizes[0]);
+    granule->julianDate = malloc(sizeof(double) * dimsizes[0]);
+    if ( granule->julianDate == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
+    granule->numTimes = dimsizes[0];
 
-    status = SDreaddata( sds_id, start, NULL, dimsizes, (VOIDP)julian_date);
+    status = SDreaddata( sds_id, start, NULL, dimsizes, (VOIDP)granule->julianDate);
+    SDendaccess(sds_id);
 
     if ( status < 0 )
     {
         FATAL_MSG("SDreaddata: Failed to read data.\n");
-        SDendaccess(sds_id);
-        SDend(sd_id);
-        if ( julian_date != NULL ) free(julian_date);
-        return EXIT_FAILURE;
+        return FATAL_ERR;
     }
 
 
-    if(obtain_start_end_index(start_index_ptr,end_index_ptr,julian_date,dimsizes[0],orbit_info) == EXIT_FAILURE)
+    if(obtain_start_end_index(&granule->startIndex,&granule->endIndex,granule->julianDate,dimsizes[0],orbit_info) == EXIT_FAILURE)
     {
         FATAL_MSG("Obtain_start_end_index: Failed to obtain the start and end index.\n");
-        SDendaccess(sds_id);
-        SDend(sd_id);
-        if ( julian_date != NULL ) free(julian_date);
-        return EXIT_FAILURE;
-
-
+        return FATAL_ERR;
     }
 #if DEBUG
-    printf("starting index is %d\n",*start_index_ptr);
-    printf("ending index is %d\n",*end_index_ptr);
+    printf("starting index is %d\n",granule->startIndex);
+    printf("ending index is %d\n",granule->endIndex);
 #endif
 
+    return RET_SUCCESS;
+}
 
-
-    SDendaccess(sds_id);
-    SDend(sd_id);
-    if ( julian_date != NULL ) free(julian_date);
-    return 0;
-
+/* Closes the file of a CERES granule and frees its time array. Does nothing for a closed granule. */
+void CERESfreeGranule( CERESgranule_t* granule )
+{
+    if ( granule->fileID )      SDend(granule->fileID);
+    if ( granule->julianDate )  free(granule->julianDate);
+    granule->fileID = 0;
+    granule->julianDate = NULL;
 }
+
 herr_t CERESinsertAttrs( hid_t objectID, char* long_nameVal, char* unitsVal, float valid_rangeMin, float valid_rangeMax )
 {
 
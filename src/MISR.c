@@ -1,21 +1,201 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <hdf.h>
 #include <hdf5.h>
 #include "libTERRA.h"
 
 /* MT 2016-12-20, mostly re-write the handling of MISR */
-float Obtain_scale_factor(int32 h4_file_id, char* band_name);
+static herr_t MISRindexScaleFactors( int32 h4_file_id, char** band_name, int numBands, float* scale_factor );
 /* May provide a list for all MISR group and variable names */
 
+/*
+    Unpacking of the 9 camera x 4 band radiances on TERRA_MISR_THREADS threads.
+
+    The MISR thread stays the only thread that calls HDF4 and HDF5: it reads the packed
+    radiances (MISRreadRadiance), hands them to the unpack threads (MISRunpackRadiance)
+    and writes the results (MISRwriteRadiance) in the camera/band order of the serial
+    conversion, so the output file is the same. Radiance k is read while the threads
+    unpack radiances k-numThreads .. k-1; at most numThreads+1 radiances are in memory.
+*/
+#define MISR_NUM_RADIANCES 36
+
+enum { MISR_RAD_EMPTY = 0, MISR_RAD_READ, MISR_RAD_UNPACKED, MISR_RAD_FAILED };
+
+typedef struct
+{
+    MISRradiance_t rad[MISR_NUM_RADIANCES];     // camera i, band j is rad[i*4+j]
+    int state[MISR_NUM_RADIANCES];
+    int numRead;                                // radiances read so far
+    int nextUnpack;                             // next radiance to unpack
+    int stop;
+    int numThreads;
+    pthread_t* threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+} misrUnpackPool_t;
+
+static void* misrUnpackThread( void* arg )
+{
+    misrUnpackPool_t* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while ( 1 )
+    {
+        while ( !pool->stop && pool->nextUnpack >= pool->numRead )
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if ( pool->stop )
+            break;
+
+        int k = pool->nextUnpack++;
+        pthread_mutex_unlock(&pool->lock);
+
+        herr_t status = MISRunpackRadiance(&pool->rad[k]);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->state[k] = ( status == FATAL_ERR ) ? MISR_RAD_FAILED : MISR_RAD_UNPACKED;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/*
+                    misrPoolStart
+    DESCRIPTION:
+        Starts the unpack threads.
+
+    ARGUMENTS:
+        misrUnpackPool_t* pool      -- Zeroed pool
+        int numThreads              -- Number of unpack threads
+        const float* scale_factor   -- Scale factors of the 36 radiances
+        char** radiance_name        -- SDS names of the 4 bands
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise. The pool must be stopped with
+        misrPoolStop() in both cases.
+*/
+static herr_t misrPoolStart( misrUnpackPool_t* pool, int numThreads, const float* scale_factor,
+                             char** radiance_name )
+{
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    numThreads = min(numThreads, MISR_NUM_RADIANCES);
+
+    for ( int k = 0; k < MISR_NUM_RADIANCES; k++ )
+    {
+        pool->rad[k].datasetName = radiance_name[k % 4];
+        pool->rad[k].scale_factor = scale_factor[k];
+    }
+
+    pool->threads = calloc(numThreads, sizeof(pthread_t));
+    if ( pool->threads == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        return FATAL_ERR;
+    }
+
+    for ( int t = 0; t < numThreads; t++ )
+    {
+        if ( pthread_create(&pool->threads[t], NULL, misrUnpackThread, pool) != 0 )
+        {
+            FATAL_MSG("Failed to start a MISR unpack thread.\n");
+            return FATAL_ERR;
+        }
+        pool->numThreads++;
+    }
+
+    return RET_SUCCESS;
+}
+
+/*
+                    misrPoolNext
+    DESCRIPTION:
+        Reads the radiances up to k+numThreads, waits until radiance k is unpacked and
+        writes it into outputGroupID. Must be called with k = 0, 1, ..., 35 in order.
+
+    ARGUMENTS:
+        misrUnpackPool_t* pool  -- Started pool
+        int k                   -- Radiance index (camera*4 + band)
+        int32* h4FileID         -- SD interface IDs of the 9 camera files
+        hid_t outputGroupID     -- Data Fields group of the camera
+        char** correctedNamePtr -- Set to the output dataset name (caller must free)
+
+    RETURN:
+        The dataset identifier, FATAL_ERR on failure.
+*/
+static hid_t misrPoolNext( misrUnpackPool_t* pool, int k, int32* h4FileID, hid_t outputGroupID,
+                           char** correctedNamePtr )
+{
+    int readEnd = min(k + pool->numThreads + 1, MISR_NUM_RADIANCES);
+    int state;
+    hid_t datasetID = 0;
+
+    while ( pool->numRead < readEnd )
+    {
+        int r = pool->numRead;
+        if ( MISRreadRadiance(h4FileID[r / 4], &pool->rad[r]) == FATAL_ERR )
+            return FATAL_ERR;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->state[r] = MISR_RAD_READ;
+        pool->numRead++;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while ( pool->state[k] == MISR_RAD_READ )
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    state = pool->state[k];
+    pthread_mutex_unlock(&pool->lock);
+
+    if ( state == MISR_RAD_FAILED )
+    {
+        FATAL_MSG("Failed to unpack %s.\n", pool->rad[k].datasetName);
+        return FATAL_ERR;
+    }
+
+    datasetID = MISRwriteRadiance(outputGroupID, &pool->rad[k], correctedNamePtr);
+    MISRfreeRadiance(&pool->rad[k]);
+
+    return datasetID;
+}
+
+/* Stops the unpack threads and frees all radiances that are still in the pool */
+static void misrPoolStop( misrUnpackPool_t* pool )
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for ( int t = 0; t < pool->numThreads; t++ )
+        pthread_join(pool->threads[t], NULL);
+
+    for ( int k = 0; k < MISR_NUM_RADIANCES; k++ )
+        MISRfreeRadiance(&pool->rad[k]);
+
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    memset(pool, 0, sizeof(misrUnpackPool_t));
+}
+
 /*
  * argv[1] through argv[9]: GRP
  * argv[10]: AGP
  * argv[11]: GP
  * argv[12]: HRLL
+ * orbit_info: the current orbit. Used to trim the blocks outside of the orbit when
+ *             TERRA_ORBIT_TRIM is set to 1 (see orbitWindow.c). Files without any block
+ *             within the orbit are then skipped.
  */
-int MISR( char* argv[],int unpack )
+int MISR( char* argv[],int unpack, OInfo_t orbit_info )
 {
     /****************************************
      *      VARIABLES       *
@@ -96,6 +276,12 @@ int MISR( char* argv[],int unpack )
     hid_t h5DataFieldID = 0;
     hid_t h5SensorGeomFieldID = 0;
 
+    /* Scale factors of the 36 radiances, camera i, band j is scaleFactors[i*4+j] */
+    float scaleFactors[36] = {0};
+    /* Radiance unpack threads (TERRA_MISR_THREADS) */
+    misrUnpackPool_t unpackPool;
+    memset(&unpackPool, 0, sizeof(misrUnpackPool_t));
+
     /* First, make an attempt to open all the files. If any fail to open, skip
      * this entire granule.
      */
@@ -151,6 +337,47 @@ int MISR( char* argv[],int unpack )
 
     if ( openFail ) goto cleanupFO;
 
+    /* Initialize the V interface of all cameras and index the scale factors of all bands */
+    for( i = 0; i<9; i++)
+    {
+        h4_status = Vstart (inHFileID[i]);
+        if (h4_status < 0)
+        {
+            FATAL_MSG("Failed to start the V interface.\n");
+            goto cleanupFail;
+        }
+
+        if ( unpack == 1 && MISRindexScaleFactors(inHFileID[i], band_name, 4, &scaleFactors[i*4]) == FATAL_ERR )
+        {
+            FATAL_MSG("Failed to obtain scale factor for MISR.\n");
+            goto cleanupFail;
+        }
+    }
+
+    /* Keep only the blocks within the orbit. All cameras have the blocks of the AN camera. */
+    if ( orbitTrimEnabled() )
+    {
+        int32 numBlocks = 0;
+        int32 firstBlock = 0;
+        int32 blockCount = 0;
+
+        if ( MISRorbitWindow( inHFileID[2], orbit_info, &numBlocks, &firstBlock, &blockCount ) == FATAL_ERR )
+            WARN_MSG("Failed to find the blocks within the orbit. The file will not be trimmed.\n");
+        else if ( blockCount == 0 )
+        {
+            /* The whole file belongs to the neighbouring orbit */
+            WARN_MSG("No block of the file is within the orbit. The files are skipped.\n\t%s\n", argv[3]);
+            if ( orbitGranuleSkip( &argv[1], 12 ) == FATAL_ERR )
+            {
+                FATAL_MSG("Failed to record the skipped files.\n");
+                goto cleanupFail;
+            }
+            goto cleanupSkip;
+        }
+        else if ( blockCount < numBlocks )
+            orbitWindowSet( "SOMBlockDim", numBlocks, firstBlock, blockCount );
+    }
+
     createGroup( &outputFile, &MISRrootGroupID, "MISR" );
     if ( MISRrootGroupID == FATAL_ERR )
     {
@@ -460,20 +687,19 @@ int MISR( char* argv[],int unpack )
      *                  RADIANCE DATASETS                       *
      ************************************************************/
 
-    /* Loop all 9 cameras */
-    for( i = 0; i<9; i++)
+    if ( unpack == 1 && misrThreadCount() > 1 )
     {
-
-        /*
-         *          *    * Initialize the V interface.
-         *                   *       */
-        h4_status = Vstart (inHFileID[i]);
-        if (h4_status < 0)
+        errStatus = misrPoolStart(&unpackPool, misrThreadCount(), scaleFactors, radiance_name);
+        if ( errStatus == FATAL_ERR )
         {
-            FATAL_MSG("Failed to start the V interface.\n");
+            FATAL_MSG("Failed to start the MISR unpack threads.\n");
             goto cleanupFail;
         }
+    }
 
+    /* Loop all 9 cameras */
+    for( i = 0; i<9; i++)
+    {
 
         createGroup(&MISRrootGroupID, &h5GroupID, camera_name[i]);
         if ( h5GroupID == FATAL_ERR )
@@ -496,18 +722,21 @@ int MISR( char* argv[],int unpack )
         {
 
             // If we choose to unpack the data.
-            if(unpack == 1)
+            if(unpack == 1 && unpackPool.threads)
             {
-
-                float scale_factor = -1.;
-                scale_factor = Obtain_scale_factor(inHFileID[i],band_name[j]);
-                if ( scale_factor < 0.0 )
+                h5DataFieldID = misrPoolNext(&unpackPool, i*4+j, h4FileID, h5DataGroupID, &correctedName);
+                if ( h5DataFieldID == FATAL_ERR )
                 {
-                    FATAL_MSG("Failed to obtain scale factor for MISR.\n)");
+                    FATAL_MSG("MISR unpack threads failed.\n");
+                    h5DataFieldID = 0;
                     goto cleanupFail;
                 }
+            }
+            else if(unpack == 1)
+            {
+
                 h5DataFieldID =  readThenWrite_MISR_Unpack( h5DataGroupID, radiance_name[j],  &correctedName,DFNT_UINT16,
-                                 h4FileID[i],scale_factor);
+                                 h4FileID[i],scaleFactors[i*4+j]);
                 if ( h5DataFieldID == FATAL_ERR )
                 {
                     FATAL_MSG("MISR readThenWrite Unpacking function failed.\n");
@@ -653,7 +882,9 @@ cleanupFO:
         retVal = FAIL_OPEN;
     }
 
-
+cleanupSkip:
+    if ( unpackPool.threads )   misrPoolStop(&unpackPool);
+    orbitWindowClear();
     if (MISRrootGroupID)        H5Gclose(MISRrootGroupID);
     if ( geoFileID )            SDend(geoFileID);
     if ( hgeoFileID )           SDend(hgeoFileID);
@@ -690,10 +921,10 @@ cleanupFO:
 }
 
 
-float Obtain_scale_factor(int32 h4_file_id, char* band_name)
+/* Reads the "Scale factor" Vdata in the "Grid Attributes" Vgroup of a MISR band Vgroup */
+static float MISRreadScaleFactor(int32 h4_file_id, int32 band_group_ref)
 {
 
-    int32 band_group_ref = -1;
     int32 sub_group_ref = -1;
     int32 sub_group_tag = -1;
     int32 sub_group_obj_ref = -1;
@@ -710,11 +941,6 @@ float Obtain_scale_factor(int32 h4_file_id, char* band_name)
 
     int32 status = -1;
 
-    /* Obtain the vgroup reference number of this band */
-    band_group_ref = H4ObtainLoneVgroupRef(h4_file_id,band_name);
-    assert(band_group_ref >0);
-
-
     band_group_id = Vattach(h4_file_id, band_group_ref, "r");
     num_gobjects = Vntagrefs(band_group_id);
     assert(num_gobjects >0);
@@ -869,6 +1095,10 @@ float Obtain_scale_factor(int32 h4_file_id, char* band_name)
                                 return -1.0;
                             }
 
+                            // No need to attach the remaining Vdata
+                            VSdetach(vdata_id);
+                            break;
+
                         } // end if
                         VSdetach(vdata_id);
 
@@ -892,77 +1122,100 @@ float Obtain_scale_factor(int32 h4_file_id, char* band_name)
     return (float)sc;
 }
 
-#if 0
-//float Obtain_scale_factor(int32 h4_file_id, char* band_name, char *radiance_name) {
-float Obtain_scale_factor(int32 h4_file_id, char* band_name)
+/*
+                    MISRindexScaleFactors
+    DESCRIPTION:
+        Obtains the scale factors of several bands of one MISR file. The lone Vgroups of
+        the file are scanned once for all bands instead of once per band. The V interface
+        must be started.
+
+    ARGUMENTS:
+        int32 h4_file_id    -- H interface ID of the MISR file
+        char** band_name    -- Vgroup names of the bands, e.g. "RedBand"
+        int numBands        -- Number of bands
+        float* scale_factor -- Receives the scale factor of every band
+
+    RETURN:
+        FATAL_ERR if a band is not found or its scale factor cannot be read, RET_SUCCESS
+        otherwise.
+*/
+static herr_t MISRindexScaleFactors( int32 h4_file_id, char** band_name, int numBands, float* scale_factor )
 {
-
-    int32 band_group_ref = -1;
-    int32 sub_group_ref = -1;
-    int32 sub_group_tag = -1;
-    float sc = 0;
-    int num_gobjects = 0;
-    int32 band_group_id  = 0;
-    int32 sub_group_id =0;
-    char* sub_group_name = NULL;
-    char* grid_attr_group_name = "Grid Attributes";
-    char* scale_factor_name = "Scale factor";
-    intn  sc_attr_index = -1;
+    int32 num_of_lones = 0;
+    int32* ref_array = NULL;
+    int32* band_group_ref = NULL;
+    int32 vgroup_id = 0;
+    char* vgroup_name = NULL;
     uint16 name_len = 0;
+    herr_t retVal = RET_SUCCESS;
 
-    int32 status = -1;
-
-    /* Obtain the vgroup reference number of this band */
-    band_group_ref = H4ObtainLoneVgroupRef(h4_file_id,band_name);
-    assert(band_group_ref >0);
-
-    band_group_id = Vattach(h4_file_id, band_group_ref, "r");
-    num_gobjects = Vntagrefs(band_group_id);
-    assert(num_gobjects >0);
-
-    for (int i = 0; i < num_gobjects; i++)
+    band_group_ref = calloc(numBands, sizeof(int32));
+    if ( band_group_ref == NULL )
     {
+        FATAL_MSG("Failed to allocate memory.\n");
+        return FATAL_ERR;
+    }
 
-
-        if (Vgettagref (band_group_id, i, &sub_group_tag, &sub_group_ref) == FAIL)
+    num_of_lones = Vlone (h4_file_id, NULL, num_of_lones );
+    if ( num_of_lones > 0 )
+    {
+        ref_array = malloc(sizeof(int32) * num_of_lones);
+        if ( ref_array == NULL )
         {
-            Vdetach (band_group_id);
-            return -1.0;
+            FATAL_MSG("Failed to allocate memory.\n");
+            free(band_group_ref);
+            return FATAL_ERR;
         }
+        num_of_lones = Vlone (h4_file_id, ref_array, num_of_lones);
+    }
 
-        if (Visvg (band_group_id, sub_group_ref) == TRUE)
+    /* One pass over the lone Vgroups for all bands. Same name matching as H4ObtainLoneVgroupRef. */
+    for ( int32 l = 0; l < num_of_lones; l++ )
+    {
+        vgroup_id = Vattach (h4_file_id, ref_array[l], "r");
+        if ( vgroup_id == FAIL || Vgetnamelen(vgroup_id, &name_len) == FAIL )
         {
+            FATAL_MSG("Failed to obtain name length.\n");
+            if ( vgroup_id != FAIL ) Vdetach(vgroup_id);
+            retVal = FATAL_ERR;
+            break;
+        }
+        vgroup_name = calloc(name_len+1, 1);
+        if ( vgroup_name == NULL || Vgetname (vgroup_id, vgroup_name) == FAIL )
+        {
+            FATAL_MSG("Failed to obtain V group name.\n");
+            free(vgroup_name);
+            Vdetach(vgroup_id);
+            retVal = FATAL_ERR;
+            break;
+        }
+        Vdetach(vgroup_id);
 
-            sub_group_id = Vattach (h4_file_id, sub_group_ref, "r");
-            status = Vgetnamelen(sub_group_id, &name_len);
-            sub_group_name = (char *) HDmalloc(sizeof(char *) * (name_len+1));
-            if (sub_group_name == NULL)
-            {
-                fprintf(stderr, "Not enough memory for vgroup_name!\n");
-                return -1.0;
-            }
-            status = Vgetname (sub_group_id, sub_group_name);
-            if(strncmp(sub_group_name,grid_attr_group_name,strlen(grid_attr_group_name))==0)
-            {
-                sc_attr_index = Vfindattr(sub_group_id,scale_factor_name);
-                assert(sc_attr_index !=FAIL);
-                status = Vgetattr(sub_group_id,sc_attr_index,&sc);
-                assert(status!=FAIL);
-            }
+        for ( int b = 0; b < numBands; b++ )
+            if ( band_group_ref[b] == 0 && strncmp(vgroup_name,band_name[b],strlen(vgroup_name))==0 )
+                band_group_ref[b] = ref_array[l];
 
-            free(sub_group_name);
-            Vdetach(sub_group_id);
+        free(vgroup_name);
+        vgroup_name = NULL;
+    }
 
+    for ( int b = 0; b < numBands && retVal == RET_SUCCESS; b++ )
+    {
+        if ( band_group_ref[b] <= 0 )
+        {
+            FATAL_MSG("Failed to find the %s Vgroup.\n", band_name[b]);
+            retVal = FATAL_ERR;
             break;
         }
-
+        scale_factor[b] = MISRreadScaleFactor(h4_file_id, band_group_ref[b]);
+        if ( scale_factor[b] < 0.0 )
+        {
+            FATAL_MSG("Failed to obtain scale factor for MISR.\n");
+            retVal = FATAL_ERR;
+        }
     }
-    Vdetach(band_group_id);
 
-    return sc;
+    free(ref_array);
+    free(band_group_ref);
+    return retVal;
 }
-#endif
-
-
-
-
@@ -41,6 +41,9 @@ int readThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGr
     argv[6]     = output filename (already exists);
     modis_count = The granule's index
     unpack      = A boolean value that specifies if unpacking should be performed
+    orbit_info  = The current orbit. Used to trim the scans outside of the orbit when
+                  TERRA_ORBIT_TRIM is set to 1 (see orbitWindow.c). A granule without any
+                  scan within the orbit is then skipped.
 
  EFFECTS:
     Modifies the output HDF5 file (already exists, the identifier is a global variable) to contain the proper MODIS data.
@@ -52,7 +55,7 @@ int readThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGr
     FAIL_OPEN       -- Some input file failed to open
 */
 
-int MODIS( char* argv[],int modis_count, int unpack)
+int MODIS( char* argv[],int modis_count, int unpack, OInfo_t orbit_info)
 {
     /*************
      * VARIABLES *
@@ -229,6 +232,30 @@ int MODIS( char* argv[],int modis_count, int unpack)
 
     if ( openFailed ) goto cleanupFO;
 
+    /* Keep only the scans within the orbit */
+    if ( orbitTrimEnabled() )
+    {
+        int32 numScans = 0;
+        int32 firstScan = 0;
+        int32 scanCount = 0;
+
+        if ( MODISorbitWindow( MOD03FileID, orbit_info, &numScans, &firstScan, &scanCount ) == FATAL_ERR )
+            WARN_MSG("Failed to find the scans within the orbit. The granule will not be trimmed.\n");
+        else if ( scanCount == 0 )
+        {
+            /* The whole granule belongs to the neighbouring orbit */
+            WARN_MSG("No scan of the granule is within the orbit. The granule is skipped.\n\t%s\n", argv[4]);
+            if ( orbitGranuleSkip( &argv[1], 4 ) == FATAL_ERR )
+            {
+                FATAL_MSG("Failed to record the skipped granule.\n");
+                goto cleanupFail;
+            }
+            goto cleanupSkip;
+        }
+        else if ( scanCount < numScans )
+            orbitWindowSet( "nscans", numScans, firstScan, scanCount );
+    }
+
 
     /********************************************************************************
      *                                GROUP CREATION                                *
@@ -1955,6 +1982,9 @@ cleanupFO:
         retVal = FAIL_OPEN;
     }
 
+cleanupSkip:
+    orbitWindowClear();
+
     /* release associated identifiers */
     if (latitudeAttrID !=0 ) status = H5Aclose(latitudeAttrID);
     if ( status < 0 ) WARN_MSG("H5Aclose\n");
@@ -2056,7 +2086,7 @@ cleanupFO:
     return retVal;
 }
 
-int readThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGroupID,char* latname,char* lonname,int32 h4_type,hid_t h5_type,int32 MOD03FileID,hid_t outputFileID)
+static int doReadThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGroupID,char* latname,char* lonname,int32 h4_type,hid_t h5_type,int32 MOD03FileID,hid_t outputFileID)
 {
 
     hid_t dummy_output_file_id = 0;
@@ -2065,26 +2095,18 @@ int readThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGr
     int32 lonDimSizes[DIM_MAX];
     float* latBuffer = NULL;
     float* lonBuffer = NULL;
-    hid_t datasetID;
+    hid_t datasetID = 0;
     herr_t status;
+    int retVal = 0;
 
     int i = 0;
     int nRow_1km = 0;
     int nCol_1km = 0;
-    int nRow_500m = 0;
-    int nCol_500m = 0;
     int scanSize  = 10;
-    int nRow_250m = 0;
-    int nCol_250m = 0;
-
-    double* lat_1km_buffer = NULL;
-    double* lon_1km_buffer = NULL;
-    double* lat_500m_buffer = NULL;
-    double* lon_500m_buffer = NULL;
-    double* lat_250m_buffer = NULL;
-    double* lon_250m_buffer = NULL;
-
 
+    /* The 500m and 250m output. The interpolation writes them directly in float (see
+     * upscaleLatLonSphericalFloat), there are no double copies of any resolution.
+     */
     float* lat_output_500m_buffer = NULL;
     float* lon_output_500m_buffer = NULL;
     float* lat_output_250m_buffer = NULL;
@@ -2092,15 +2114,23 @@ int readThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGr
 
     char* ll_500m_dimnames[2]= {"_20_nscans_MODIS_SWATH_Type_L1B","_2_Max_EV_frames_MODIS_SWATH_Type_L1B"};
     char* ll_250m_dimnames[2]= {"_40_nscans_MODIS_SWATH_Type_L1B","_4_Max_EV_frames_MODIS_SWATH_Type_L1B"};
+    hid_t groupID[2] = { MODIS500mgeoGroupID, MODIS250mgeoGroupID };
+    char** dimnames[2] = { ll_500m_dimnames, ll_250m_dimnames };
+    float** outLat[2] = { &lat_output_500m_buffer, &lat_output_250m_buffer };
+    float** outLon[2] = { &lon_output_500m_buffer, &lon_output_250m_buffer };
 
+    if ( h4_type != DFNT_FLOAT32 )
+    {
+        FATAL_MSG("The MODIS latitude and longitude must be float32.\n");
+        return -1;
+    }
 
     status = H4readData( MOD03FileID, latname,
                          (void**)&latBuffer, &latRank, latDimSizes, h4_type,NULL,NULL,NULL );
     if ( status < 0 )
     {
         FATAL_MSG("Unable to read %s data.\n",  latname );
-        if ( latBuffer != NULL ) free(latBuffer);
-        return -1;
+        goto cleanupFail;
     }
 
     status = H4readData( MOD03FileID, lonname,
@@ -2108,817 +2138,112 @@ int readThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGr
     if ( status < 0 )
     {
         FATAL_MSG("Unable to read %s data.\n",  lonname );
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        return -1;
+        goto cleanupFail;
     }
     if(latRank !=2 || lonRank!=2)
     {
         FATAL_MSG("The latitude and longitude array rank must be 2.\n");
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        return -1;
+        goto cleanupFail;
     }
     if(latDimSizes[0]!=lonDimSizes[0] || latDimSizes[1]!=lonDimSizes[1])
     {
         FATAL_MSG("The latitude and longitude array rank must share the same dimension sizes.\n");
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        return -1;
+        goto cleanupFail;
     }
 
     /* END READ DATA. BEGIN Computing DATA */
-    /* first 500 m */
     nRow_1km = latDimSizes[0];
     nCol_1km = latDimSizes[1];
 
-    lat_1km_buffer = (double*)malloc(sizeof(double)*nRow_1km*nCol_1km);
-    if(lat_1km_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lat_1km_buffer.\n");
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        return -1;
-    }
-
-
-    lon_1km_buffer = (double*)malloc(sizeof(double)*nRow_1km*nCol_1km);
-    if(lon_1km_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lon_1km_buffer.\n");
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        if (lat_1km_buffer !=NULL) free(lat_1km_buffer);
-        return -1;
-    }
-
-    nRow_500m = 2*nRow_1km;
-    nCol_500m = 2*nCol_1km;
-    lat_500m_buffer = (double*)malloc(sizeof(double)*nRow_500m*nCol_500m);
-    if(lat_500m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lat_500m_buffer.\n");
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        if (lat_1km_buffer !=NULL) free(lat_1km_buffer);
-        if (lon_1km_buffer !=NULL) free(lon_1km_buffer);
-        return -1;
-    }
-
-
-    lon_500m_buffer = (double*)malloc(sizeof(double)*4*nRow_500m*nCol_500m);
-    if(lon_500m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lon_500m_buffer.\n");
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        if (lat_1km_buffer !=NULL) free(lat_1km_buffer);
-        if (lon_1km_buffer !=NULL) free(lon_1km_buffer);
-        if (lat_500m_buffer !=NULL) free(lat_500m_buffer);
-        return -1;
-    }
-
-    // Float to double
-    for (i = 0; i <nRow_1km*nCol_1km; i++)
-    {
-        lat_1km_buffer[i] = (double)latBuffer[i];
-        lon_1km_buffer[i] = (double)lonBuffer[i];
-    }
-    upscaleLatLonSpherical(lat_1km_buffer, lon_1km_buffer, nRow_1km, nCol_1km, scanSize, lat_500m_buffer, lon_500m_buffer);
-
-
-    lat_output_500m_buffer = (float*)malloc(sizeof(float)*nRow_500m*nCol_500m);
-    if(lat_output_500m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lon_500m_buffer.\n");
-        if ( latBuffer != NULL ) free(latBuffer);
-        if ( lonBuffer != NULL ) free(lonBuffer);
-        if (lat_1km_buffer !=NULL) free(lat_1km_buffer);
-        if (lon_1km_buffer !=NULL) free(lon_1km_buffer);
-        if (lat_500m_buffer !=NULL) free(lat_500m_buffer);
-        if (lon_500m_buffer !=NULL) free(lon_500m_buffer);
-        return -1;
-    }
-    for (i = 0; i <nRow_500m*nCol_500m; i++)
-        lat_output_500m_buffer[i] = (float)lat_500m_buffer[i];
-
-    hsize_t temp[DIM_MAX];
-    for ( i = 0; i < DIM_MAX; i++ )
-        temp[i] = (hsize_t) (2*latDimSizes[i]);
-
-    datasetID = insertDataset( &dummy_output_file_id, &MODIS500mgeoGroupID, 1, latRank,
-                               temp, h5_type, latname, lat_output_500m_buffer );
-
-    if ( datasetID == FATAL_ERR )
-    {
-        FATAL_MSG("Error writing %s dataset.\n", latname );
-        free(latBuffer);
-        free(lonBuffer);
-        free(lat_1km_buffer);
-        free(lon_1km_buffer);
-        free(lat_500m_buffer);
-        free(lat_output_500m_buffer);
-        return -1;
-    }
-    // semi-hard-code here.
-    if(attachDimension(outputFileID,ll_500m_dimnames[0],datasetID,0) <0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n",ll_500m_dimnames[0] );
-        free(latBuffer);
-        free(lonBuffer);
-        free(lat_1km_buffer);
-        free(lon_1km_buffer);
-        free(lat_500m_buffer);
-        free(lat_output_500m_buffer);
-        return -1;
-    }
-    if(attachDimension(outputFileID,ll_500m_dimnames[1],datasetID,1)<0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n", ll_500m_dimnames[1] );
-        free(latBuffer);
-        free(lonBuffer);
-        free(lat_1km_buffer);
-        free(lon_1km_buffer);
-        free(lat_500m_buffer);
-        free(lat_output_500m_buffer);
-        return -1;
-    }
-
-    H5Dclose(datasetID);
-
-
-    lon_output_500m_buffer = (float*)malloc(sizeof(float)*nRow_500m*nCol_500m);
-    if(lon_output_500m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lon_500m_buffer.\n");
-        free(latBuffer);
-        free(lonBuffer);
-        free(lat_1km_buffer);
-        free(lon_1km_buffer);
-        free(lat_500m_buffer);
-        free(lon_500m_buffer);
-        free(lat_output_500m_buffer);
-        return -1;
-    }
-    for (i = 0; i <nRow_500m*nCol_500m; i++)
-        lon_output_500m_buffer[i] = (float)lon_500m_buffer[i];
-
-
-    datasetID = insertDataset( &dummy_output_file_id, &MODIS500mgeoGroupID, 1, lonRank,
-                               temp, h5_type, lonname, lon_output_500m_buffer );
-
-    if ( datasetID == FATAL_ERR )
-    {
-        FATAL_MSG("Error writing %s dataset.\n", lonname );
-        free(latBuffer);
-        free(lonBuffer);
-        free(lat_1km_buffer);
-        free(lon_1km_buffer);
-        free(lat_500m_buffer);
-        free(lon_500m_buffer);
-        free(lat_output_500m_buffer);
-        free(lon_output_500m_buffer);
-        return -1;
-    }
-    // semi-hard-code here.
-    if(attachDimension(outputFileID,ll_500m_dimnames[0],datasetID,0) <0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n",ll_500m_dimnames[0] );
-        free(latBuffer);
-        free(lonBuffer);
-        free(lat_1km_buffer);
-        free(lon_1km_buffer);
-        free(lat_500m_buffer);
-        free(lon_500m_buffer);
-        free(lat_output_500m_buffer);
-        free(lon_output_500m_buffer);
-        return -1;
-    }
-    if(attachDimension(outputFileID,ll_500m_dimnames[1],datasetID,1)<0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n", ll_500m_dimnames[1] );
-        free(latBuffer);
-        free(lonBuffer);
-        free(lat_1km_buffer);
-        free(lon_1km_buffer);
-        free(lat_500m_buffer);
-        free(lon_500m_buffer);
-        free(lat_output_500m_buffer);
-        free(lon_output_500m_buffer);
-        return -1;
-    }
-
-    H5Dclose(datasetID);
-
-    // Nor used anymore, free.
-    free(latBuffer);
-    free(lonBuffer);
-    free(lat_1km_buffer);
-    free(lon_1km_buffer);
-    free(lat_output_500m_buffer);
-    free(lon_output_500m_buffer);
-
-
-    nRow_250m = 2*nRow_500m;
-    nCol_250m = 2*nCol_500m;
-    lat_250m_buffer = (double*)malloc(sizeof(double)*nRow_250m*nCol_250m);
-    if(lat_250m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lat_250m_buffer.\n");
-        free(lat_500m_buffer);
-        free(lon_500m_buffer);
-        return -1;
-    }
-
-    lon_250m_buffer = (double*)malloc(sizeof(double)*nRow_250m*nCol_250m);
-    if(lon_250m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lon_250m_buffer.\n");
-        free(lat_500m_buffer);
-        free(lon_500m_buffer);
-        free(lat_250m_buffer);
-        return -1;
-    }
-
-    upscaleLatLonSpherical(lat_500m_buffer, lon_500m_buffer, nRow_500m, nCol_500m, scanSize, lat_250m_buffer, lon_250m_buffer);
-
-    free(lat_500m_buffer);
-    free(lon_500m_buffer);
-    lat_output_250m_buffer = (float*)malloc(sizeof(float)*nRow_250m*nCol_250m);
-    if(lat_output_250m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lat_output_250m_buffer.\n");
-        free(lat_250m_buffer);
-        free(lon_250m_buffer);
-        return -1;
-    }
-
-    lon_output_250m_buffer = (float*)malloc(sizeof(float)*nRow_250m*nCol_250m);
-    if(lon_output_500m_buffer == NULL)
-    {
-        FATAL_MSG("Cannot allocate lon_output_250m_buffer.\n");
-        free(lat_250m_buffer);
-        free(lon_250m_buffer);
-        free(lat_output_250m_buffer);
-        return -1;
-    }
-
-    for (i = 0; i <nRow_250m*nCol_250m; i++)
-    {
-        lon_output_250m_buffer[i] = (float)lon_250m_buffer[i];
-        lat_output_250m_buffer[i] = (float)lat_250m_buffer[i];
-    }
-
-    free(lat_250m_buffer);
-    free(lon_250m_buffer);
-
-    for ( i = 0; i < DIM_MAX; i++ )
-        temp[i] = (hsize_t) (4*latDimSizes[i]);
-
-    datasetID = insertDataset( &dummy_output_file_id, &MODIS250mgeoGroupID, 1, latRank,
-                               temp, h5_type, latname, lat_output_250m_buffer );
-
-    if ( datasetID == FATAL_ERR )
-    {
-        FATAL_MSG("Error writing %s dataset.\n", latname );
-        free(lat_output_250m_buffer);
-        free(lon_output_250m_buffer);
-        return -1;
-    }
-
-    free(lat_output_250m_buffer);
-
-    if(attachDimension(outputFileID,ll_250m_dimnames[0],datasetID,0) <0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n",ll_250m_dimnames[0] );
-        free(lon_250m_buffer);
-        return -1;
-    }
-    if(attachDimension(outputFileID,ll_250m_dimnames[1],datasetID,1)<0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n", ll_250m_dimnames[1] );
-        free(lon_250m_buffer);
-        return -1;
-    }
-
-    H5Dclose(datasetID);
-
-    datasetID = insertDataset( &dummy_output_file_id, &MODIS250mgeoGroupID, 1, lonRank,
-                               temp, h5_type, lonname, lon_output_250m_buffer );
-
-    if ( datasetID == FATAL_ERR )
-    {
-        FATAL_MSG("Error writing %s dataset.\n", latname );
-        free(lon_output_250m_buffer);
-        return -1;
-    }
-
-    free(lon_output_250m_buffer);
-
-    if(attachDimension(outputFileID,ll_250m_dimnames[0],datasetID,0) <0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n",ll_250m_dimnames[0] );
-        return -1;
-    }
-    if(attachDimension(outputFileID,ll_250m_dimnames[1],datasetID,1)<0)
-    {
-        FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n", ll_250m_dimnames[1] );
-        return -1;
-    }
-
-    H5Dclose(datasetID);
-
-    return 0;
-
-}
-
-/** The following two routines were written by Yizhao Gao <ygao29@illinois.edu>. */
-#if 0
-/*
- * NAME:    upscaleLatLonPlanar
- * DESCRIPTION: calculate the latitude and longitude of MODIS cell centers at finner resolution based on coarser resolution cell locations, using a planer cooridnate system
- * PARAMETERS:
- *  double * oriLat:    the latitudes of input cells at coarser resolution
- *  double * oriLon:    the longitudes of input cells at coarser resolution
- *  int nRow:       the number of rows of input raster
- *  int nRol:       the number of columns of input raster
- *  int scanSize:       the number of cells in a scan
- *  double * newLat:    the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- *  double * newLon:    the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- * RETURN:
- *  TYPE:   float *
- *  VALUE:  An array of density value at each cell
- */
-
-void upscaleLatLonPlanar(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon)
-{
-
-    if(0 != nRow % scanSize)
+    lat_output_500m_buffer = (float*)malloc(sizeof(float)*4*nRow_1km*nCol_1km);
+    lon_output_500m_buffer = (float*)malloc(sizeof(float)*4*nRow_1km*nCol_1km);
+    lat_output_250m_buffer = (float*)malloc(sizeof(float)*16*nRow_1km*nCol_1km);
+    lon_output_250m_buffer = (float*)malloc(sizeof(float)*16*nRow_1km*nCol_1km);
+    if(lat_output_500m_buffer == NULL || lon_output_500m_buffer == NULL ||
+       lat_output_250m_buffer == NULL || lon_output_250m_buffer == NULL)
     {
-        printf("nRows:%d is not a multiple of scanSize: %d\n", nRow, scanSize);
-        exit(1);
-    }
-
-    double * step1Lat;
-    double * step1Lon;
-
-    if(NULL == (step1Lat = (double *)malloc(sizeof(double) * 2 * nRow * nCol)))
-    {
-        printf("Out of memeory for step1Lat\n");
-        exit(1);
-    }
-
-    if(NULL == (step1Lon = (double *)malloc(sizeof(double) * 2 * nRow * nCol)))
-    {
-        printf("Out of memeory for step1Lon\n");
-        exit(1);
+        FATAL_MSG("Cannot allocate the 500m and 250m output buffers.\n");
+        goto cleanupFail;
     }
+    timingBuffer( sizeof(float) * 40 * nRow_1km * nCol_1km );
 
-    int i, j;
-
-    // First step for bilinear interpolation
-    for(i = 0; i < nRow; i++)
-    {
-        for(j = 0; j < nCol; j++)
-        {
-
-            step1Lat[i * 2 * nCol + 2 * j] = oriLat[i * nCol + j];
-            step1Lon[i * 2 * nCol + 2 * j] = oriLon[i * nCol + j];
-
-            if(j == nCol - 1)
-            {
-                step1Lat[i * 2 * nCol + 2 * j + 1] = 1.5 * oriLat[i * nCol + j] - 0.5 * oriLat[i * nCol + j - 1];
-
-                if(oriLon[i * nCol + j] > 90 && oriLon[i * nCol + j - 1] < -90)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] = 1.5 * oriLon[i * nCol + j] - 0.5 * (oriLon[i * nCol + j - 1] + 360);
-                }
-                else if(oriLon[i * nCol + j] < -90 && oriLon[i * nCol + j - 1] > 90)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] = 1.5 * (oriLon[i * nCol + j] + 360) - 0.5 * oriLon[i * nCol + j - 1];
-                }
-                else
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] = 1.5 * oriLon[i * nCol + j] - 0.5 * oriLon[i * nCol + j - 1];
-                }
-                if(step1Lon[i * 2 * nCol + 2 * j + 1] > 180)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] -= 360;
-                }
-                else if(step1Lon[i * 2 * nCol + 2 * j + 1] < -180)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] += 360;
-                }
-            }
-            else
-            {
-                step1Lat[i * 2 * nCol + 2 * j + 1] = (oriLat[i * nCol + j] + oriLat[i * nCol + j + 1]) / 2;
-
-                if(oriLon[i * nCol + j] > 90 && oriLon[i * nCol + j + 1] < -90)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] = (oriLon[i * nCol + j] + oriLon[i * nCol + j + 1] + 360) / 2;
-                }
-                else if(oriLon[i * nCol + j] < -90 && oriLon[i * nCol + j + 1] > 90)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] = (oriLon[i * nCol + j] + oriLon[i * nCol + j + 1] + 360) / 2;
-                }
-                else
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] = (oriLon[i * nCol + j] + oriLon[i * nCol + j + 1]) / 2;
-                }
-                if(step1Lon[i * 2 * nCol + 2 * j + 1] > 180)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] -= 360;
-                }
-                else if(step1Lon[i * 2 * nCol + 2 * j + 1] < -180)
-                {
-                    step1Lon[i * 2 * nCol + 2 * j + 1] += 360;
-                }
-            }
-        }
-    }
+    /* The interpolation does not touch the HDF libraries. The 250m values are upscaled
+     * from the 500m ones of the same scan, in double, so they are the same as upscaling
+     * the whole 500m granule.
+     */
+    upscaleLatLonSphericalFloat(latBuffer, lonBuffer, nRow_1km, nCol_1km, scanSize,
+                                lat_output_500m_buffer, lon_output_500m_buffer,
+                                lat_output_250m_buffer, lon_output_250m_buffer, interpThreadCount());
 
-    // Second step for bilinear interpolation
+    free(latBuffer); latBuffer = NULL;
+    free(lonBuffer); lonBuffer = NULL;
 
-    int k = 0;
-    for(k = 0; k < nRow; k += scanSize)
+    /* Write the 500m (r = 0) and then the 250m (r = 1) latitude and longitude */
+    for ( int r = 0; r < 2; r++ )
     {
+        hsize_t temp[DIM_MAX];
+        for ( i = 0; i < DIM_MAX; i++ )
+            temp[i] = (hsize_t) ((2 << r)*latDimSizes[i]);
 
-        //  Processing the first row in a scan
-        i = k;
-        for(j = 0; j < 2 * nCol; j++)
+        for ( int l = 0; l < 2; l++ )
         {
-            newLat[(i * 2) * 2 * nCol + j] = 1.25 * step1Lat[i * 2 * nCol + j] - 0.25 * step1Lat[(i + 1) * 2 * nCol + j];
-
-            if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i + 1) * 2 * nCol + j] < -90)
-            {
-                newLon[(i * 2) * 2 * nCol + j] = 1.25 * step1Lon[(i + 1) * 2 * nCol + j] - 0.25 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
-            }
-            else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[2 * nCol + j] > 90)
-            {
-                newLon[(i * 2) * 2 * nCol + j] = 1.25 * (step1Lon[i * 2 * nCol + j] + 360) - 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
-            }
-            else
-            {
-                newLon[(i * 2) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
-            }
-            if(newLon[j] > 180)
-            {
-                newLon[(i * 2) * 2 * nCol + j] -= 360;
-            }
-            else if(newLon[(i * 2) * 2 * nCol + j] < -180)
-            {
-                newLon[(i * 2) * 2 * nCol + j] += 360;
-            }
-        }
+            char* name = l ? lonname : latname;
+            float** buffer = l ? outLon[r] : outLat[r];
 
-        //  Processing intermediate rows in a scan
-        for(i = k; i < k + scanSize - 1; i ++)
-        {
-            for(j = 0; j < 2 * nCol; j++)
+            datasetID = insertDataset( &dummy_output_file_id, &groupID[r], 1, latRank,
+                                       temp, h5_type, name, *buffer );
+            if ( datasetID == FATAL_ERR )
             {
-                newLat[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lat[i * 2 * nCol + j] + 0.25 * step1Lat[(i + 1) * 2 * nCol + j];
-                newLat[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lat[i * 2 * nCol + j] + 0.75 * step1Lat[(i + 1) * 2 * nCol + j];
-
-                if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i + 1) * 2 * nCol + j] < -90)
-                {
-                    newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lon[i * 2 * nCol + j] + 0.25 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
-                    newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lon[i * 2 * nCol + j] + 0.75 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
-                }
-                else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[(i + 1) * 2 * nCol + j] > 90)
-                {
-                    newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * (step1Lon[i * 2 * nCol + j] + 360) + 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
-                    newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * (step1Lon[i * 2 * nCol + j] + 360) + 0.75 * step1Lon[(i + 1) * 2 * nCol + j];
-                }
-                else
-                {
-                    newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lon[i * 2 * nCol + j] + 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
-                    newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lon[i * 2 * nCol + j] + 0.75 * step1Lon[(i + 1) * 2 * nCol + j];
-                }
-
-                if(newLon[(i * 2 + 1) * 2 * nCol + j] > 180)
-                {
-                    newLon[(i * 2 + 1) * 2 * nCol + j] -= 360;
-                }
-                else if(newLon[(i * 2 + 1) * 2 * nCol + j] < -180)
-                {
-                    newLon[(i * 2 + 1) * 2 * nCol + j] += 360;
-                }
-                if(newLon[(i * 2 + 2) * 2 * nCol + j] > 180)
-                {
-                    newLon[(i * 2 + 2) * 2 * nCol + j] -= 360;
-                }
-                else if(newLon[(i * 2 + 2) * 2 * nCol + j] < -180)
-                {
-                    newLon[(i * 2 + 2) * 2 * nCol + j] += 360;
-                }
+                FATAL_MSG("Error writing %s dataset.\n", name );
+                datasetID = 0;
+                goto cleanupFail;
             }
-        }
 
-        //  Processing the last row in a scan
-        i = k + scanSize - 1;
-        for(j = 0; j < 2 * nCol; j++)
-        {
-            newLat[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lat[(nRow - 1) * 2 * nCol + j] - 0.25 * step1Lat[(nRow - 2) * 2 * nCol + j];
+            /* Not used anymore, free. */
+            free(*buffer);
+            *buffer = NULL;
 
-            if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i - 1) * 2 * nCol + j] < -90)
-            {
-                newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * (step1Lon[(i - 1) * 2 * nCol + j] + 360);
-            }
-            else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[(i - 1) * 2 * nCol + j] > 90)
-            {
-                newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * (step1Lon[i * 2 * nCol + j] + 360) - 0.25 * step1Lon[(i - 1) * 2 * nCol + j];
-            }
-            else
-            {
-                newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * step1Lon[(i - 1) * 2 * nCol + j];
-            }
-            if(newLon[(2 * i + 1) * 2 * nCol + j] > 180)
-            {
-                newLon[(2 * i + 1) * 2 * nCol + j] -= 360;
-            }
-            else if(newLon[(2 * i + 1) * 2 * nCol + j] < -180)
+            // semi-hard-code here.
+            if(attachDimension(outputFileID,dimnames[r][0],datasetID,0) <0)
             {
-                newLon[(2 * i + 1) * 2 * nCol + j] += 360;
-            }
-        }
-    }
-    /*
-        for(i = 0; i < nRow; i++) {
-            for(j = 0; j < 2 * nCol; j++) {
-                printf("%lf,%lf\n", step1Lat[i * 2 * nCol + j], step1Lon[i * 2 * nCol + j]);
-            }
-        }
-    */
-    free(step1Lat);
-    free(step1Lon);
-
-
-    return;
-}
-#endif
-
-#if 0
-/**
- * NAME:    upscaleLatLonSpherical
- * DESCRIPTION: calculate the latitude and longitude of MODIS cell centers at finner resolution based on coarser resolution cell locations, using a planer cooridnate system
- * PARAMETERS:
- *  double * oriLat:    the latitudes of input cells at coarser resolution
- *  double * oriLon:    the longitudes of input cells at coarser resolution
- *  int nRow:       the number of rows of input raster
- *  int nRol:       the number of columns of input raster
- *  int scanSize:       the number of cells in a scan
- *  double * newLat:    the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- *  double * newLon:    the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- * RETURN:
- *  TYPE:   float *
- *  VALUE:  An array of density value at each cell
- */
-
-void upscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon)
-{
-
-    if(0 != nRow % scanSize)
-    {
-        printf("nRows:%d is not a multiple of scanSize: %d\n", nRow, scanSize);
-        exit(1);
-    }
-
-    double * step1Lat;
-    double * step1Lon;
-
-    if(NULL == (step1Lat = (double *)malloc(sizeof(double) * 2 * nRow * nCol)))
-    {
-        printf("Out of memeory for step1Lat\n");
-        exit(1);
-    }
-
-    if(NULL == (step1Lon = (double *)malloc(sizeof(double) * 2 * nRow * nCol)))
-    {
-        printf("Out of memeory for step1Lon\n");
-        exit(1);
-    }
-
-    int i, j;
-
-
-    // Convert oriLat and oriLon to radians
-    for(i = 0; i < nRow; i++)
-    {
-        for(j = 0; j < nCol; j++)
-        {
-            oriLat[i * nCol + j] = oriLat[i * nCol + j] * M_PI / 180;
-            oriLon[i * nCol + j] = oriLon[i * nCol + j] * M_PI / 180;
-        }
-    }
-
-    double phi1, phi2, phi3, lambda1, lambda2, lambda3, bX, bY;
-    double dPhi, dLambda;
-    double a, b, x, y, z, f, delta;
-    double f1, f2;
-
-
-    // First step for bilinear interpolation
-    f = 1.5;
-    for(i = 0; i < nRow; i++)
-    {
-        for(j = 0; j < nCol; j++)
-        {
-
-            step1Lat[i * 2 * nCol + 2 * j] = oriLat[i * nCol + j];
-            step1Lon[i * 2 * nCol + 2 * j] = oriLon[i * nCol + j];
-
-            if(j == nCol - 1)
-            {
-
-                phi1 = oriLat[i * nCol + j - 1];
-                phi2 = oriLat[i * nCol + j];
-                lambda1 = oriLon[i * nCol + j - 1];
-                lambda2 = oriLon[i * nCol + j];
-
-                dPhi = (phi2 - phi1);
-                dLambda = (lambda2 - lambda1);
-
-                a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-                delta = 2 * atan2(sqrt(a), sqrt(1-a));
-
-                a = sin((1-f) * delta) / sin(delta);
-                b = sin(f * delta) / sin(delta);
-
-                x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-                y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-                z = a * sin(phi1) + b * sin(phi2);
-
-                phi3 = atan2(z, sqrt(x * x + y * y));
-                lambda3 = atan2(y, x);
-
-                step1Lat[i * 2 * nCol + 2 * j + 1] = phi3;
-                step1Lon[i * 2 * nCol + 2 * j + 1] = lambda3;
-            }
-
-            else
-            {
-
-                phi1 = oriLat[i * nCol + j];
-                phi2 = oriLat[i * nCol + j + 1];
-                lambda1 = oriLon[i * nCol + j];
-                lambda2 = oriLon[i * nCol + j + 1];
-
-                bX = cos(phi2) * cos(lambda2 - lambda1);
-                bY = cos(phi2) * sin(lambda2 - lambda1);
-
-                phi3 = atan2(sin(phi1) + sin(phi2), sqrt((cos(phi1) + bX) * (cos(phi1) + bX) + bY * bY));
-                step1Lat[i * 2 * nCol + 2 * j + 1] = phi3;
-
-                lambda3 = lambda1 + atan2(bY, cos(phi1) + bX) + 3 * M_PI;
-                lambda3 = lambda3 - (int)(lambda3 / (2 * M_PI)) * 2 * M_PI - M_PI;
-
-                step1Lon[i * 2 * nCol + 2 * j + 1] = lambda3;
+                FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n",dimnames[r][0] );
+                goto cleanupFail;
             }
-        }
-    }
-
-    // Second step for bilinear interpolation
-    f = 1.25;
-    f1 = 0.25;
-    f2 = 0.75;
-
-    int k = 0;
-    for(k = 0; k < nRow; k += scanSize)
-    {
-
-        //  Processing the first row in a scan
-        i = k;
-        for(j = 0; j < 2 * nCol; j++)
-        {
-            phi1 = step1Lat[(i + 1) * 2 * nCol + j];
-            phi2 = step1Lat[i * 2 * nCol + j];
-            lambda1 = step1Lon[(i + 1) * 2 * nCol + j];
-            lambda2 = step1Lon[i * 2 * nCol + j];
-
-            dPhi = (phi2 - phi1);
-            dLambda = (lambda2 - lambda1);
-
-            a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-            delta = 2 * atan2(sqrt(a), sqrt(1-a));
-
-            a = sin((1-f) * delta) / sin(delta);
-            b = sin(f * delta) / sin(delta);
-
-            x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-            y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-            z = a * sin(phi1) + b * sin(phi2);
-
-            phi3 = atan2(z, sqrt(x * x + y * y));
-            lambda3 = atan2(y, x);
-
-            newLat[(i * 2) * 2 * nCol + j] = phi3;
-            newLon[(i * 2) * 2 * nCol + j] = lambda3;
-        }
-
-        //  Processing intermediate rows in a scan
-        for(i = k; i < k + scanSize - 1; i ++)
-        {
-            for(j = 0; j < 2 * nCol; j++)
+            if(attachDimension(outputFileID,dimnames[r][1],datasetID,1)<0)
             {
-
-                phi1 = step1Lat[i * 2 * nCol + j];
-                phi2 = step1Lat[(i + 1) * 2 * nCol + j];
-                lambda1 = step1Lon[i * 2 * nCol + j];
-                lambda2 = step1Lon[(i + 1) * 2 * nCol + j];
-
-                dPhi = (phi2 - phi1);
-                dLambda = (lambda2 - lambda1);
-
-                a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-                delta = 2 * atan2(sqrt(a), sqrt(1-a));
-
-                //Interpolate the first intermediate point
-                a = sin((1-f1) * delta) / sin(delta);
-                b = sin(f1 * delta) / sin(delta);
-
-                x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-                y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-                z = a * sin(phi1) + b * sin(phi2);
-
-                phi3 = atan2(z, sqrt(x * x + y * y));
-                lambda3 = atan2(y, x);
-
-                newLat[(i * 2 + 1) * 2 * nCol + j] = phi3;
-                newLon[(i * 2 + 1) * 2 * nCol + j] = lambda3;
-
-                //Interpolate the second intermediate point
-                a = sin((1-f2) * delta) / sin(delta);
-                b = sin(f2 * delta) / sin(delta);
-
-                x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-                y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-                z = a * sin(phi1) + b * sin(phi2);
-
-                phi3 = atan2(z, sqrt(x * x + y * y));
-                lambda3 = atan2(y, x);
-
-                newLat[(i * 2 + 2) * 2 * nCol + j] = phi3;
-                newLon[(i * 2 + 2) * 2 * nCol + j] = lambda3;
+                FATAL_MSG("Error  opening dimension dataset ID %s dataset.\n", dimnames[r][1] );
+                goto cleanupFail;
             }
-        }
-
-        //  Processing the last row in a scan
-        i = k + scanSize - 1;
-        for(j = 0; j < 2 * nCol; j++)
-        {
-            phi1 = step1Lat[(i - 1) * 2 * nCol + j];
-            phi2 = step1Lat[i * 2 * nCol + j];
-            lambda1 = step1Lon[(i - 1) * 2 * nCol + j];
-            lambda2 = step1Lon[i * 2 * nCol + j];
-
-            dPhi = (phi2 - phi1);
-            dLambda = (lambda2 - lambda1);
-
-            a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-            delta = 2 * atan2(sqrt(a), sqrt(1-a));
-
-            a = sin((1-f) * delta) / sin(delta);
-            b = sin(f * delta) / sin(delta);
 
-            x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-            y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-            z = a * sin(phi1) + b * sin(phi2);
-
-            phi3 = atan2(z, sqrt(x * x + y * y));
-            lambda3 = atan2(y, x);
-
-            newLat[(2 * i + 1) * 2 * nCol + j] = phi3;
-            newLon[(2 * i + 1) * 2 * nCol + j] = lambda3;
+            H5Dclose(datasetID);
+            datasetID = 0;
         }
     }
 
-    /*
-        for(i = 0; i < nRow; i++) {
-            for(j = 0; j < 2 * nCol; j++) {
-                printf("%lf,%lf\n", step1Lat[i * 2 * nCol + j], step1Lon[i * 2 * nCol + j]);
-            }
-        }
-    */
-
-    // Convert newLat and newLon to degrees
-    for(i = 0; i < 2 * nRow; i++)
+    if ( 0 )
     {
-        for(j = 0; j < 2 * nCol; j++)
-        {
-            newLat[i * 2 * nCol + j] = newLat[i * 2 * nCol + j] * 180 / M_PI;
-            newLon[i * 2 * nCol + j] = newLon[i * 2 * nCol + j] * 180 / M_PI;
-        }
+cleanupFail:
+        retVal = -1;
     }
 
-    free(step1Lat);
-    free(step1Lon);
-
-
-    return;
-
+    if ( datasetID ) H5Dclose(datasetID);
+    if ( latBuffer ) free(latBuffer);
+    if ( lonBuffer ) free(lonBuffer);
+    if ( lat_output_500m_buffer ) free(lat_output_500m_buffer);
+    if ( lon_output_500m_buffer ) free(lon_output_500m_buffer);
+    if ( lat_output_250m_buffer ) free(lat_output_250m_buffer);
+    if ( lon_output_250m_buffer ) free(lon_output_250m_buffer);
 
+    return retVal;
 
 }
 
-#endif
+/* Runs doReadThenWrite_MODIS_HR_LatLon() inside a timing record (see timing.c) */
+int readThenWrite_MODIS_HR_LatLon(hid_t MODIS500mgeoGroupID,hid_t MODIS250mgeoGroupID,char* latname,char* lonname,int32 h4_type,hid_t h5_type,int32 MOD03FileID,hid_t outputFileID)
+{
+    int timer = timingBegin("readThenWrite_MODIS_HR_LatLon", latname, NULL);
+    int ret = doReadThenWrite_MODIS_HR_LatLon( MODIS500mgeoGroupID, MODIS250mgeoGroupID, latname, lonname, h4_type, h5_type,
+                                               MOD03FileID, outputFileID );
+    timingEnd(timer);
+    return ret;
+}
@@ -0,0 +1,1080 @@
+/*
+
+    DESCRIPTION:
+        Synthetic-granule benchmark of the instrument converters.
+
+        benchGranules writes one synthetic granule set per instrument, with the SDS names,
+        types, shapes, dimension names and attributes the converters read:
+
+            MOPITT  -- MOP01 HDF5 file (one track per second around the orbit)
+            CERES   -- CERES SSF FM1 hourly file
+            MODIS   -- MOD021KM, MOD02HKM, MOD02QKM and MOD03
+            ASTER   -- AST_L1T with VNIR, SWIR and TIR
+            MISR    -- the nine GRP cameras, AGP, GP and HRLL
+
+        The data is a deterministic pseudo random sequence, with smooth lat/lon fields so
+        the interpolation works on realistic input. The granules are only generated if they
+        do not exist yet, so repeated runs read the same files.
+
+        Every instrument function is then timed end to end: creation of the output file,
+        MOPITT()/CERES()/MODIS()/ASTER()/MISR() and closing of the output file. For each run
+        the wall time, the process CPU time (including the interpolation threads), the input
+        and output size and the input throughput are printed. With TERRA_TIMING=1 the
+        per-dataset records of all runs are written to <dir>/s<scale>/benchGranules.timing.json
+        (see timing.c). The other environment options (TERRA_PIPELINE, TERRA_SIMD, ...)
+        apply as in the main program.
+
+    USAGE:
+        benchGranules [-d dir] [-s scale] [-r repeats] [-g] [instrument ...]
+
+            -d dir      -- directory of the synthetic granules and the outputs (default: .)
+            -s scale    -- divide the along-track size of all granules by scale (default: 1,
+                           the real granule sizes; the MISR files alone are about 6.5 GB)
+            -r repeats  -- number of timed runs per instrument (default: 1)
+            -g          -- regenerate the granules even if they exist
+            instrument  -- any of MOPITT CERES MODIS ASTER MISR (default: all)
+
+*/
+
+#define _POSIX_C_SOURCE 199309L
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define BENCH_PATH_LEN 1024
+#define BENCH_MAX_FILES 12
+#define BENCH_SLAB_ELEMS (4*1024*1024)
+
+/* Fill patterns of the synthetic SDS */
+enum { FILL_RANDOM = 0, FILL_LAT, FILL_LON, FILL_RAMP };
+
+typedef struct benchSDS
+{
+    const char* name;
+    int32 type;
+    int32 rank;                         // 1 to 3
+    int32 dims[3];
+    const char* dimNames[3];
+    int fill;
+    double lo;                          // value range of the fill pattern
+    double hi;
+
+} benchSDS_t;
+
+typedef struct benchInstr
+{
+    const char* name;
+    int nFiles;
+    char files[BENCH_MAX_FILES][BENCH_PATH_LEN];
+    herr_t (*generate)( struct benchInstr* instr );
+    int (*run)( struct benchInstr* instr, char* outputName );
+    int selected;
+
+} benchInstr_t;
+
+/* The synthetic orbit: 2007-08-10 00:30:00 to 02:08:53 UTC */
+static const OInfo_t benchOrbit = { 38650, 2007, 8, 10, 0, 30, 0, 2007, 8, 10, 2, 8, 53 };
+#define BENCH_ORBIT_SECONDS 5933.0
+#define BENCH_JULIAN_DAY 2454322.5      // 2007-08-10 00:00 UTC
+#define BENCH_TAI93_DAY 460857600.0     // 2007-08-10 00:00 UTC
+
+static int benchScale = 1;
+static int unpack = 1;
+static unsigned int randState = 20070810;
+
+static double benchRandom()
+{
+    randState = randState * 1103515245u + 12345u;
+    return (double) (randState >> 8) / 16777216.0;
+}
+
+static double clockSeconds( clockid_t clk )
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+static int scaled( int size, int minSize )
+{
+    return max(size / benchScale, minSize);
+}
+
+static double fileMB( const char* name )
+{
+    struct stat st;
+    if ( stat(name, &st) != 0 )
+        return 0.0;
+    return (double) st.st_size / (1024.0 * 1024.0);
+}
+
+static void storeValue( void* buffer, int32 type, size_t i, double value )
+{
+    switch ( type )
+    {
+    case DFNT_UINT8:
+        ((uint8*) buffer)[i] = (uint8) value;
+        break;
+    case DFNT_UINT16:
+        ((uint16*) buffer)[i] = (uint16) value;
+        break;
+    case DFNT_INT16:
+        ((int16*) buffer)[i] = (int16) value;
+        break;
+    case DFNT_INT32:
+        ((int32*) buffer)[i] = (int32) value;
+        break;
+    case DFNT_FLOAT32:
+        ((float32*) buffer)[i] = (float32) value;
+        break;
+    default:
+        ((float64*) buffer)[i] = value;
+        break;
+    }
+}
+
+/*
+                    createSDS
+    DESCRIPTION:
+        Creates an SDS with the name, type, shape and dimension names of sds and fills it
+        with its fill pattern. The data is written in slabs of whole rows so the memory
+        stays bounded for the large MISR and MODIS SDS.
+
+    ARGUMENTS:
+        int32 sdID              -- SD interface ID of the file
+        const benchSDS_t* sds   -- Description of the SDS
+
+    RETURN:
+        The SDS ID (the caller adds attributes and calls SDendaccess), FATAL_ERR on failure.
+*/
+static int32 createSDS( int32 sdID, const benchSDS_t* sds )
+{
+    int32 sdsID = 0;
+    int32 dims[3];
+    int32 start[3] = {0};
+    int32 edges[3];
+    size_t nCols, nRows, nOuter, slabRows;
+    size_t elemSize = DFKNTsize(sds->type);
+    void* buffer = NULL;
+
+    memcpy(dims, sds->dims, sizeof(dims));
+    memcpy(edges, sds->dims, sizeof(edges));
+
+    sdsID = SDcreate(sdID, sds->name, sds->type, sds->rank, dims);
+    if ( sdsID < 0 )
+    {
+        FATAL_MSG("SDcreate -- Failed to create the %s SDS.\n", sds->name);
+        return FATAL_ERR;
+    }
+
+    for ( int i = 0; i < sds->rank; i++ )
+    {
+        if ( SDsetdimname(SDgetdimid(sdsID, i), sds->dimNames[i]) < 0 )
+        {
+            FATAL_MSG("SDsetdimname -- Failed to name dimension %d of %s.\n", i, sds->name);
+            goto cleanupFail;
+        }
+    }
+
+    /* View the SDS as nOuter x nRows x nCols */
+    nCols = sds->dims[sds->rank-1];
+    nRows = sds->rank > 1 ? sds->dims[sds->rank-2] : 1;
+    nOuter = sds->rank > 2 ? sds->dims[0] : 1;
+    slabRows = max(1, min(nRows, BENCH_SLAB_ELEMS / nCols));
+
+    buffer = malloc(elemSize * slabRows * nCols);
+    if ( buffer == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        goto cleanupFail;
+    }
+
+    for ( size_t outer = 0; outer < nOuter; outer++ )
+    {
+        for ( size_t row = 0; row < nRows; row += slabRows )
+        {
+            size_t curRows = min(slabRows, nRows - row);
+
+            for ( size_t r = 0; r < curRows; r++ )
+            {
+                double globalRow = (double) (outer * nRows + row + r);
+                for ( size_t c = 0; c < nCols; c++ )
+                {
+                    double frac;
+                    switch ( sds->fill )
+                    {
+                    case FILL_LAT:
+                        frac = globalRow / (double) max(1, nOuter * nRows - 1);
+                        break;
+                    case FILL_LON:
+                        frac = (double) c / (double) max(1, nCols - 1);
+                        break;
+                    case FILL_RAMP:
+                        frac = (globalRow * nCols + c) / (double) max(1, nOuter * nRows * nCols - 1);
+                        break;
+                    default:
+                        frac = benchRandom();
+                        break;
+                    }
+                    storeValue(buffer, sds->type, r * nCols + c, sds->lo + frac * (sds->hi - sds->lo));
+                }
+            }
+
+            if ( sds->rank > 1 )
+            {
+                start[sds->rank-2] = (int32) row;
+                edges[sds->rank-2] = (int32) curRows;
+            }
+            if ( sds->rank > 2 )
+            {
+                start[0] = (int32) outer;
+                edges[0] = 1;
+            }
+
+            if ( SDwritedata(sdsID, start, NULL, edges, buffer) < 0 )
+            {
+                FATAL_MSG("SDwritedata -- Failed to write the %s SDS.\n", sds->name);
+                goto cleanupFail;
+            }
+        }
+    }
+
+    free(buffer);
+    return sdsID;
+
+cleanupFail:
+    if ( buffer ) free(buffer);
+    SDendaccess(sdsID);
+    return FATAL_ERR;
+}
+
+/* Sets a float32 attribute of n equal values */
+static herr_t setFloatAttr( int32 sdsID, const char* name, int32 n, float value )
+{
+    float values[32];
+
+    for ( int i = 0; i < n; i++ )
+        values[i] = value;
+
+    if ( SDsetattr(sdsID, name, DFNT_FLOAT32, n, values) < 0 )
+    {
+        FATAL_MSG("SDsetattr -- Failed to set the %s attribute.\n", name);
+        return FATAL_ERR;
+    }
+    return RET_SUCCESS;
+}
+
+/* Creates all SDS of a table in an open file and closes them */
+static herr_t createSDSTable( int32 sdID, const benchSDS_t* table, int n )
+{
+    for ( int i = 0; i < n; i++ )
+    {
+        int32 sdsID = createSDS(sdID, &table[i]);
+        if ( sdsID == FATAL_ERR )
+            return FATAL_ERR;
+        SDendaccess(sdsID);
+    }
+    return RET_SUCCESS;
+}
+
+/*
+                    createLoneVgroups
+    DESCRIPTION:
+        Creates lone Vgroups with the given names in an existing HDF4 file. If scaleFactor
+        is not NULL, every Vgroup gets a "Grid Attributes" sub-Vgroup holding a "Scale factor"
+        Vdata with the field "AttrValues", as the MISR GRP band Vgroups.
+
+    ARGUMENTS:
+        const char* fileName    -- HDF4 file
+        const char** names      -- Vgroup names
+        int n                   -- Number of Vgroups
+        const double* scaleFactor -- n scale factors or NULL
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise.
+*/
+static herr_t createLoneVgroups( const char* fileName, const char** names, int n, const double* scaleFactor )
+{
+    int32 fileID = 0;
+    herr_t retVal = RET_SUCCESS;
+
+    fileID = Hopen(fileName, DFACC_WRITE, 0);
+    if ( fileID < 0 )
+    {
+        FATAL_MSG("Hopen -- Failed to open %s.\n", fileName);
+        return FATAL_ERR;
+    }
+    Vstart(fileID);
+
+    for ( int i = 0; i < n && retVal == RET_SUCCESS; i++ )
+    {
+        int32 vgroupID = Vattach(fileID, -1, "w");
+        if ( vgroupID < 0 || Vsetname(vgroupID, names[i]) < 0 )
+        {
+            FATAL_MSG("Failed to create the %s Vgroup.\n", names[i]);
+            retVal = FATAL_ERR;
+            break;
+        }
+
+        if ( scaleFactor )
+        {
+            int32 attrGroupID = Vattach(fileID, -1, "w");
+            int32 vdataID = VSattach(fileID, -1, "w");
+
+            if ( attrGroupID < 0 || vdataID < 0
+                    || Vsetname(attrGroupID, "Grid Attributes") < 0
+                    || VSsetname(vdataID, "Scale factor") < 0
+                    || VSfdefine(vdataID, "AttrValues", DFNT_FLOAT64, 1) < 0
+                    || VSsetfields(vdataID, "AttrValues") < 0
+                    || VSwrite(vdataID, (uint8*) &scaleFactor[i], 1, FULL_INTERLACE) != 1
+                    || Vinsert(attrGroupID, vdataID) < 0
+                    || Vinsert(vgroupID, attrGroupID) < 0 )
+            {
+                FATAL_MSG("Failed to create the scale factor of the %s Vgroup.\n", names[i]);
+                retVal = FATAL_ERR;
+            }
+            if ( vdataID >= 0 ) VSdetach(vdataID);
+            if ( attrGroupID >= 0 ) Vdetach(attrGroupID);
+        }
+        Vdetach(vgroupID);
+    }
+
+    Vend(fileID);
+    Hclose(fileID);
+    return retVal;
+}
+
+/********
+ * MODIS *
+ ********/
+
+/* Creates one MODIS L1B radiance SDS and its _Uncert_Indexes companion */
+static herr_t createMODISRadiance( int32 sdID, const char* name, int32 nBands, const char* bandDim, int32 nRows,
+                                   int32 nCols, const char* rowDim, const char* colDim )
+{
+    char uncertName[128];
+    benchSDS_t radiance = { name, DFNT_UINT16, 3, {nBands, nRows, nCols}, {bandDim, rowDim, colDim},
+                            FILL_RANDOM, 0.0, 32767.0 };
+    benchSDS_t uncert = radiance;
+    int32 sdsID;
+
+    snprintf(uncertName, sizeof(uncertName), "%s_Uncert_Indexes", name);
+    uncert.name = uncertName;
+    uncert.type = DFNT_UINT8;
+    uncert.hi = 15.0;
+
+    sdsID = createSDS(sdID, &radiance);
+    if ( sdsID == FATAL_ERR )
+        return FATAL_ERR;
+    if ( setFloatAttr(sdsID, "radiance_scales", nBands, 0.0264617f) || setFloatAttr(sdsID, "radiance_offsets", nBands, 316.9722f) )
+    {
+        SDendaccess(sdsID);
+        return FATAL_ERR;
+    }
+    SDendaccess(sdsID);
+
+    sdsID = createSDS(sdID, &uncert);
+    if ( sdsID == FATAL_ERR )
+        return FATAL_ERR;
+    if ( setFloatAttr(sdsID, "scaling_factor", nBands, 7.0f) || setFloatAttr(sdsID, "specified_uncertainty", nBands, 1.5f) )
+    {
+        SDendaccess(sdsID);
+        return FATAL_ERR;
+    }
+    SDendaccess(sdsID);
+
+    return RET_SUCCESS;
+}
+
+static herr_t generateMODIS( benchInstr_t* instr )
+{
+    int32 nScans = scaled(203, 1);
+    int32 sdID = 0;
+    const char* rowDim[3] = { "10*nscans:MODIS_SWATH_Type_L1B", "20*nscans:MODIS_SWATH_Type_L1B",
+                              "40*nscans:MODIS_SWATH_Type_L1B" };
+    const char* colDim[3] = { "Max_EV_frames:MODIS_SWATH_Type_L1B", "2*Max_EV_frames:MODIS_SWATH_Type_L1B",
+                              "4*Max_EV_frames:MODIS_SWATH_Type_L1B" };
+    const char* refSBDim = "Band_1KM_RefSB:MODIS_SWATH_Type_L1B";
+    const char* emissiveDim = "Band_1KM_Emissive:MODIS_SWATH_Type_L1B";
+    const char* _250mDim = "Band_250M:MODIS_SWATH_Type_L1B";
+    const char* _500mDim = "Band_500M:MODIS_SWATH_Type_L1B";
+    const char* geoRowDim = "nscans*10:MODIS_Swath_Type_GEO";
+    const char* geoScanDim = "nscans:MODIS_Swath_Type_GEO";
+    const char* geoColDim = "mframes:MODIS_Swath_Type_GEO";
+    herr_t status = RET_SUCCESS;
+
+    /* MOD021KM */
+    sdID = SDstart(instr->files[0], DFACC_CREATE);
+    if ( sdID < 0 )
+        goto cleanupFail;
+    status |= createMODISRadiance(sdID, "EV_1KM_RefSB", 15, refSBDim, 10*nScans, 1354, rowDim[0], colDim[0]);
+    status |= createMODISRadiance(sdID, "EV_1KM_Emissive", 16, emissiveDim, 10*nScans, 1354, rowDim[0], colDim[0]);
+    status |= createMODISRadiance(sdID, "EV_250_Aggr1km_RefSB", 2, _250mDim, 10*nScans, 1354, rowDim[0], colDim[0]);
+    status |= createMODISRadiance(sdID, "EV_500_Aggr1km_RefSB", 5, _500mDim, 10*nScans, 1354, rowDim[0], colDim[0]);
+    SDend(sdID);
+
+    /* MOD02HKM */
+    sdID = SDstart(instr->files[1], DFACC_CREATE);
+    if ( sdID < 0 )
+        goto cleanupFail;
+    status |= createMODISRadiance(sdID, "EV_250_Aggr500_RefSB", 2, _250mDim, 20*nScans, 2708, rowDim[1], colDim[1]);
+    status |= createMODISRadiance(sdID, "EV_500_RefSB", 5, _500mDim, 20*nScans, 2708, rowDim[1], colDim[1]);
+    SDend(sdID);
+
+    /* MOD02QKM */
+    sdID = SDstart(instr->files[2], DFACC_CREATE);
+    if ( sdID < 0 )
+        goto cleanupFail;
+    status |= createMODISRadiance(sdID, "EV_250_RefSB", 2, _250mDim, 40*nScans, 5416, rowDim[2], colDim[2]);
+    SDend(sdID);
+
+    /* MOD03 */
+    {
+        const benchSDS_t geo[] =
+        {
+            { "Latitude", DFNT_FLOAT32, 2, {10*nScans, 1354}, {geoRowDim, geoColDim}, FILL_LAT, 48.0, 30.0 },
+            { "Longitude", DFNT_FLOAT32, 2, {10*nScans, 1354}, {geoRowDim, geoColDim}, FILL_LON, -100.0, -75.0 },
+            { "SensorZenith", DFNT_INT16, 2, {10*nScans, 1354}, {geoRowDim, geoColDim}, FILL_RANDOM, 0.0, 6500.0 },
+            { "SensorAzimuth", DFNT_INT16, 2, {10*nScans, 1354}, {geoRowDim, geoColDim}, FILL_RANDOM, -18000.0, 18000.0 },
+            { "SolarZenith", DFNT_INT16, 2, {10*nScans, 1354}, {geoRowDim, geoColDim}, FILL_RANDOM, 2000.0, 7000.0 },
+            { "SolarAzimuth", DFNT_INT16, 2, {10*nScans, 1354}, {geoRowDim, geoColDim}, FILL_RANDOM, -18000.0, 18000.0 },
+            /* 00:27:30 to 00:32:30, so TERRA_ORBIT_TRIM=1 drops the scans before the orbit start */
+            { "EV start time", DFNT_FLOAT64, 1, {nScans}, {geoScanDim}, FILL_RAMP, BENCH_TAI93_DAY + 1650.0,
+              BENCH_TAI93_DAY + 1950.0 }
+        };
+
+        sdID = SDstart(instr->files[3], DFACC_CREATE);
+        if ( sdID < 0 )
+            goto cleanupFail;
+        status |= createSDSTable(sdID, geo, sizeof(geo) / sizeof(geo[0]));
+        SDend(sdID);
+    }
+
+    return status ? FATAL_ERR : RET_SUCCESS;
+
+cleanupFail:
+    FATAL_MSG("SDstart -- Failed to create a MODIS granule.\n");
+    return FATAL_ERR;
+}
+
+static int runMODIS( benchInstr_t* instr, char* outputName )
+{
+    char* args[7] = { "benchGranules", instr->files[0], instr->files[1], instr->files[2], instr->files[3],
+                      "granule1", outputName };
+
+    return MODIS(args, 1, unpack, benchOrbit);
+}
+
+/*********
+ * ASTER *
+ *********/
+
+static herr_t generateASTER( benchInstr_t* instr )
+{
+    int32 tirLines = scaled(700, 10);
+    int32 sdID = 0;
+    const char* vgroups[3] = { "VNIR", "SWIR", "TIR" };
+    const char* vnirDim[2] = { "ImageLine:VNIR_Swath", "ImagePixel:VNIR_Swath" };
+    const char* swirDim[2] = { "ImageLine:SWIR_Swath", "ImagePixel:SWIR_Swath" };
+    const char* tirDim[2] = { "ImageLine:TIR_Swath", "ImagePixel:TIR_Swath" };
+    const char* geoDim[2] = { "GeoTrack:ASTER_Geolocation", "GeoXtrack:ASTER_Geolocation" };
+    herr_t status = RET_SUCCESS;
+    const benchSDS_t image[] =
+    {
+        { "ImageData1", DFNT_UINT8, 2, {6*tirLines, 4980}, {vnirDim[0], vnirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData2", DFNT_UINT8, 2, {6*tirLines, 4980}, {vnirDim[0], vnirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData3N", DFNT_UINT8, 2, {6*tirLines, 4980}, {vnirDim[0], vnirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData4", DFNT_UINT8, 2, {3*tirLines, 2490}, {swirDim[0], swirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData5", DFNT_UINT8, 2, {3*tirLines, 2490}, {swirDim[0], swirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData6", DFNT_UINT8, 2, {3*tirLines, 2490}, {swirDim[0], swirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData7", DFNT_UINT8, 2, {3*tirLines, 2490}, {swirDim[0], swirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData8", DFNT_UINT8, 2, {3*tirLines, 2490}, {swirDim[0], swirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData9", DFNT_UINT8, 2, {3*tirLines, 2490}, {swirDim[0], swirDim[1]}, FILL_RANDOM, 0.0, 255.0 },
+        { "ImageData10", DFNT_UINT16, 2, {tirLines, 830}, {tirDim[0], tirDim[1]}, FILL_RANDOM, 0.0, 4095.0 },
+        { "ImageData11", DFNT_UINT16, 2, {tirLines, 830}, {tirDim[0], tirDim[1]}, FILL_RANDOM, 0.0, 4095.0 },
+        { "ImageData12", DFNT_UINT16, 2, {tirLines, 830}, {tirDim[0], tirDim[1]}, FILL_RANDOM, 0.0, 4095.0 },
+        { "ImageData13", DFNT_UINT16, 2, {tirLines, 830}, {tirDim[0], tirDim[1]}, FILL_RANDOM, 0.0, 4095.0 },
+        { "ImageData14", DFNT_UINT16, 2, {tirLines, 830}, {tirDim[0], tirDim[1]}, FILL_RANDOM, 0.0, 4095.0 },
+        { "Latitude", DFNT_FLOAT64, 2, {11, 11}, {geoDim[0], geoDim[1]}, FILL_LAT, 40.3, 39.7 },
+        { "Longitude", DFNT_FLOAT64, 2, {11, 11}, {geoDim[0], geoDim[1]}, FILL_LON, -88.6, -87.9 }
+    };
+
+    /* The parts of productmetadata.0 the converter parses */
+    const char* metadata =
+        "GROUP                  = PRODUCTSPECIFICMETADATA\n\n"
+        "  GROUP                  = GAININFORMATION\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"1\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"01\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"2\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"02\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"3\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"3N\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"4\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"3B\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"5\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"04\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"6\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"05\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"7\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"06\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"8\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"07\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"9\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"08\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "    OBJECT                 = GAIN\n      CLASS                = \"10\"\n      NUM_VAL              = 2\n"
+        "      VALUE                = (\"09\", \"NOR\")\n    END_OBJECT             = GAIN\n\n"
+        "  END_GROUP              = GAININFORMATION\n\n"
+        "  GROUP                  = POINTINGANGLES\n\n"
+        "    OBJECT                 = POINTINGANGLE\n      CLASS                = \"1\"\n\n"
+        "      OBJECT                 = SENSORNAME\n        VALUE                = \"VNIR\"\n"
+        "      END_OBJECT             = SENSORNAME\n\n"
+        "      OBJECT                 = POINTINGANGLE\n        VALUE                = 2.789\n"
+        "      END_OBJECT             = POINTINGANGLE\n\n"
+        "    END_OBJECT             = POINTINGANGLE\n\n"
+        "    OBJECT                 = POINTINGANGLE\n      CLASS                = \"2\"\n\n"
+        "      OBJECT                 = SENSORNAME\n        VALUE                = \"SWIR\"\n"
+        "      END_OBJECT             = SENSORNAME\n\n"
+        "      OBJECT                 = POINTINGANGLE\n        VALUE                = 2.808\n"
+        "      END_OBJECT             = POINTINGANGLE\n\n"
+        "    END_OBJECT             = POINTINGANGLE\n\n"
+        "    OBJECT                 = POINTINGANGLE\n      CLASS                = \"3\"\n\n"
+        "      OBJECT                 = SENSORNAME\n        VALUE                = \"TIR\"\n"
+        "      END_OBJECT             = SENSORNAME\n\n"
+        "      OBJECT                 = POINTINGANGLE\n        VALUE                = 2.792\n"
+        "      END_OBJECT             = POINTINGANGLE\n\n"
+        "    END_OBJECT             = POINTINGANGLE\n\n"
+        "  END_GROUP              = POINTINGANGLES\n\n"
+        "  OBJECT                 = SOLARDIRECTION\n    NUM_VAL              = 2\n"
+        "    VALUE                = (144.817631, 52.418546)\n  END_OBJECT             = SOLARDIRECTION\n\n"
+        "END_GROUP              = PRODUCTSPECIFICMETADATA\n\nEND\n";
+
+    sdID = SDstart(instr->files[0], DFACC_CREATE);
+    if ( sdID < 0 )
+    {
+        FATAL_MSG("SDstart -- Failed to create the ASTER granule.\n");
+        return FATAL_ERR;
+    }
+    status |= createSDSTable(sdID, image, sizeof(image) / sizeof(image[0]));
+    if ( SDsetattr(sdID, "productmetadata.0", DFNT_CHAR, (int32) strlen(metadata), metadata) < 0 )
+    {
+        FATAL_MSG("SDsetattr -- Failed to set productmetadata.0.\n");
+        status = FATAL_ERR;
+    }
+    SDend(sdID);
+
+    if ( status == RET_SUCCESS )
+        status = createLoneVgroups(instr->files[0], vgroups, 3, NULL);
+
+    return status ? FATAL_ERR : RET_SUCCESS;
+}
+
+static int runASTER( benchInstr_t* instr, char* outputName )
+{
+    char* args[4] = { "benchGranules", instr->files[0], NULL, outputName };
+
+    return ASTER(args, 1, unpack);
+}
+
+/********
+ * MISR *
+ ********/
+
+static herr_t generateMISR( benchInstr_t* instr )
+{
+    int32 nBlocks = scaled(180, 1);
+    int32 sdID = 0;
+    herr_t status = RET_SUCCESS;
+    const char* bandName[4] = { "RedBand", "BlueBand", "GreenBand", "NIRBand" };
+    const char* radianceName[4] = { "Red Radiance/RDQI", "Blue Radiance/RDQI", "Green Radiance/RDQI",
+                                    "NIR Radiance/RDQI" };
+    const double scaleFactor[4] = { 0.0470313, 0.0472621, 0.0444867, 0.0309422 };
+    const char* cameraGeom[4] = { "Azimuth", "Glitter", "Scatter", "Zenith" };
+    const char* cameraPrefix[9] = { "Aa", "Af", "An", "Ba", "Bf", "Ca", "Cf", "Da", "Df" };
+    const char* agpDim[3] = { "SOMBlockDim:Standard", "XDim:Standard", "YDim:Standard" };
+    const char* gpDim[3] = { "SOMBlockDim:GeometricParameters", "XDim:GeometricParameters",
+                             "YDim:GeometricParameters" };
+    const char* hrDim[3] = { "SOMBlockDim:HRGeolocation", "XDim:HRGeolocation", "YDim:HRGeolocation" };
+
+    /* GRP: the AN camera has all bands at 275 m, the other cameras only the red band */
+    for ( int cam = 0; cam < 9 && status == RET_SUCCESS; cam++ )
+    {
+        sdID = SDstart(instr->files[cam], DFACC_CREATE);
+        if ( sdID < 0 )
+        {
+            FATAL_MSG("SDstart -- Failed to create a MISR GRP granule.\n");
+            return FATAL_ERR;
+        }
+        for ( int b = 0; b < 4 && status == RET_SUCCESS; b++ )
+        {
+            char dimNames[3][64];
+            int highRes = ( cam == 2 || b == 0 );
+            benchSDS_t radiance = { radianceName[b], DFNT_UINT16, 3,
+                                    {nBlocks, highRes ? 512 : 128, highRes ? 2048 : 512},
+                                    {dimNames[0], dimNames[1], dimNames[2]}, FILL_RANDOM, 0.0, 65535.0 };
+
+            snprintf(dimNames[0], sizeof(dimNames[0]), "SOMBlockDim:%s", bandName[b]);
+            snprintf(dimNames[1], sizeof(dimNames[1]), "XDim:%s", bandName[b]);
+            snprintf(dimNames[2], sizeof(dimNames[2]), "YDim:%s", bandName[b]);
+            status |= createSDSTable(sdID, &radiance, 1);
+        }
+        SDend(sdID);
+
+        if ( status == RET_SUCCESS )
+            status = createLoneVgroups(instr->files[cam], bandName, 4, scaleFactor);
+    }
+
+    /* AGP */
+    {
+        const benchSDS_t agp[] =
+        {
+            { "GeoLatitude", DFNT_FLOAT32, 3, {nBlocks, 128, 512}, {agpDim[0], agpDim[1], agpDim[2]}, FILL_LAT, 80.0, -80.0 },
+            { "GeoLongitude", DFNT_FLOAT32, 3, {nBlocks, 128, 512}, {agpDim[0], agpDim[1], agpDim[2]}, FILL_LON, -110.0, -70.0 }
+        };
+
+        sdID = SDstart(instr->files[9], DFACC_CREATE);
+        if ( sdID < 0 )
+        {
+            FATAL_MSG("SDstart -- Failed to create the MISR AGP granule.\n");
+            return FATAL_ERR;
+        }
+        status |= createSDSTable(sdID, agp, 2);
+        SDend(sdID);
+    }
+
+    /* GP */
+    sdID = SDstart(instr->files[10], DFACC_CREATE);
+    if ( sdID < 0 )
+    {
+        FATAL_MSG("SDstart -- Failed to create the MISR GP granule.\n");
+        return FATAL_ERR;
+    }
+    for ( int i = 0; i < 2 + 36 && status == RET_SUCCESS; i++ )
+    {
+        char name[32];
+        double fillValue = -555.0;
+        benchSDS_t geom = { name, DFNT_FLOAT64, 3, {nBlocks, 8, 32}, {gpDim[0], gpDim[1], gpDim[2]},
+                            FILL_RANDOM, 0.0, 180.0 };
+        int32 sdsID;
+
+        if ( i < 2 )
+            strcpy(name, i == 0 ? "SolarAzimuth" : "SolarZenith");
+        else
+            snprintf(name, sizeof(name), "%s%s", cameraPrefix[(i-2) / 4], cameraGeom[(i-2) % 4]);
+
+        sdsID = createSDS(sdID, &geom);
+        if ( sdsID == FATAL_ERR )
+        {
+            status = FATAL_ERR;
+            break;
+        }
+        if ( SDsetattr(sdsID, "_FillValue", DFNT_FLOAT64, 1, &fillValue) < 0 )
+        {
+            FATAL_MSG("SDsetattr -- Failed to set the _FillValue of %s.\n", name);
+            status = FATAL_ERR;
+        }
+        SDendaccess(sdsID);
+    }
+    SDend(sdID);
+
+    /* HRLL */
+    {
+        const benchSDS_t hrll[] =
+        {
+            { "GeoLatitude", DFNT_FLOAT32, 3, {nBlocks, 512, 2048}, {hrDim[0], hrDim[1], hrDim[2]}, FILL_LAT, 80.0, -80.0 },
+            { "GeoLongitude", DFNT_FLOAT32, 3, {nBlocks, 512, 2048}, {hrDim[0], hrDim[1], hrDim[2]}, FILL_LON, -110.0, -70.0 }
+        };
+
+        sdID = SDstart(instr->files[11], DFACC_CREATE);
+        if ( sdID < 0 )
+        {
+            FATAL_MSG("SDstart -- Failed to create the MISR HRLL granule.\n");
+            return FATAL_ERR;
+        }
+        status |= createSDSTable(sdID, hrll, 2);
+        SDend(sdID);
+    }
+
+    return status ? FATAL_ERR : RET_SUCCESS;
+}
+
+static int runMISR( benchInstr_t* instr, char* outputName )
+{
+    char* args[13];
+
+    args[0] = "benchGranules";
+    for ( int i = 0; i < 12; i++ )
+        args[i+1] = instr->files[i];
+
+    return MISR(args, unpack, benchOrbit);
+}
+
+/*********
+ * CERES *
+ *********/
+
+static int32 ceresFootprints()
+{
+    return scaled(66000, 100);
+}
+
+static herr_t generateCERES( benchInstr_t* instr )
+{
+    int32 n = ceresFootprints();
+    int32 sdID = 0;
+    herr_t status = RET_SUCCESS;
+    const char* dim[1] = { "Footprints:CERES_SSF" };
+    const benchSDS_t ssf[] =
+    {
+        { "Time of observation", DFNT_FLOAT64, 1, {n}, {dim[0]}, FILL_RAMP, BENCH_JULIAN_DAY, BENCH_JULIAN_DAY + 1.0/24.0 },
+        { "Colatitude of CERES FOV at surface", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RAMP, 10.0, 170.0 },
+        { "Longitude of CERES FOV at surface", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 360.0 },
+        { "CERES viewing zenith at surface", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 90.0 },
+        { "CERES solar zenith at surface", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 180.0 },
+        { "CERES relative azimuth at surface", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 360.0 },
+        { "CERES viewing azimuth at surface wrt North", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 360.0 },
+        { "CERES TOT filtered radiance - upwards", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 700.0 },
+        { "CERES SW filtered radiance - upwards", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 510.0 },
+        { "CERES WN filtered radiance - upwards", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 50.0 },
+        { "Radiance and Mode flags", DFNT_INT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 2147483647.0 },
+        { "CERES SW radiance - upwards", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 510.0 },
+        { "CERES LW radiance - upwards", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 200.0 },
+        { "CERES WN radiance - upwards", DFNT_FLOAT32, 1, {n}, {dim[0]}, FILL_RANDOM, 0.0, 50.0 }
+    };
+
+    sdID = SDstart(instr->files[0], DFACC_CREATE);
+    if ( sdID < 0 )
+    {
+        FATAL_MSG("SDstart -- Failed to create the CERES granule.\n");
+        return FATAL_ERR;
+    }
+    status = createSDSTable(sdID, ssf, sizeof(ssf) / sizeof(ssf[0]));
+    SDend(sdID);
+
+    return status;
+}
+
+static int runCERES( benchInstr_t* instr, char* outputName )
+{
+    char* args[4] = { "benchGranules", outputName, instr->files[0], NULL };
+    CERESgranule_t granule;
+    int status;
+
+    if ( CERESopenGranule(instr->files[0], benchOrbit, &granule) == FATAL_ERR )
+    {
+        CERESfreeGranule(&granule);
+        return FATAL_ERR;
+    }
+
+    /* Transfer the whole granule, whatever the synthetic times are */
+    granule.startIndex = 0;
+    granule.endIndex = ceresFootprints() - 1;
+
+    status = CERES(args, 1, 1, &granule);
+    CERESfreeGranule(&granule);
+    return status;
+}
+
+/**********
+ * MOPITT *
+ **********/
+
+static herr_t generateMOPITT( benchInstr_t* instr )
+{
+    GDateInfo_t date = { benchOrbit.start_year, benchOrbit.start_month, benchOrbit.start_day,
+                         benchOrbit.start_hour, benchOrbit.start_minute, (double) benchOrbit.start_second };
+    double orbitStart = 0.0;
+    double span = BENCH_ORBIT_SECONDS + 3600.0;     // the orbit and 30 minutes on both sides
+    hsize_t nTrack = (hsize_t) scaled((int) span, 100);
+    hsize_t radDims[5] = { nTrack, 29, 4, 8, 2 };
+    hsize_t geoDims[3] = { nTrack, 29, 4 };
+    size_t nRad = nTrack * 29 * 4 * 8 * 2;
+    size_t nGeo = nTrack * 29 * 4;
+    float* radiance = NULL;
+    float* lat = NULL;
+    float* lon = NULL;
+    double* trackTime = NULL;
+    float missing[2] = { -9999.0f, -8888.0f };
+    hid_t fileID = 0;
+    hid_t lcpl = 0;
+    hid_t groupID = 0;
+    herr_t retVal = RET_SUCCESS;
+
+    if ( getTAI93(date, &orbitStart) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to get the TAI93 time of the orbit.\n");
+        return FATAL_ERR;
+    }
+
+    radiance = malloc(sizeof(float) * nRad);
+    lat = malloc(sizeof(float) * nGeo);
+    lon = malloc(sizeof(float) * nGeo);
+    trackTime = malloc(sizeof(double) * nTrack);
+    if ( radiance == NULL || lat == NULL || lon == NULL || trackTime == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        goto cleanupFail;
+    }
+
+    for ( size_t i = 0; i < nRad; i++ )
+        radiance[i] = (float) (benchRandom() * 10.0);
+    for ( size_t i = 0; i < nGeo; i++ )
+    {
+        lat[i] = (float) (-80.0 + 160.0 * (double) (i / 116) / (double) nTrack);
+        lon[i] = (float) (-180.0 + 360.0 * benchRandom());
+    }
+    for ( hsize_t i = 0; i < nTrack; i++ )
+        trackTime[i] = orbitStart - 1800.0 + span * (double) i / (double) nTrack;
+
+    fileID = H5Fcreate(instr->files[0], H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if ( fileID < 0 )
+    {
+        FATAL_MSG("H5Fcreate -- Failed to create the MOPITT granule.\n");
+        fileID = 0;
+        goto cleanupFail;
+    }
+
+    lcpl = H5Pcreate(H5P_LINK_CREATE);
+    H5Pset_create_intermediate_group(lcpl, 1);
+    groupID = H5Gcreate2(fileID, "HDFEOS/SWATHS/MOP01/Data Fields", lcpl, H5P_DEFAULT, H5P_DEFAULT);
+    if ( groupID >= 0 ) H5Gclose(groupID);
+    groupID = H5Gcreate2(fileID, "HDFEOS/SWATHS/MOP01/Geolocation Fields", lcpl, H5P_DEFAULT, H5P_DEFAULT);
+    if ( groupID >= 0 ) H5Gclose(groupID);
+    groupID = 0;
+
+    if ( H5LTset_attribute_float(fileID, "HDFEOS/SWATHS/MOP01", "missing_invalid", &missing[0], 1) < 0
+            || H5LTset_attribute_float(fileID, "HDFEOS/SWATHS/MOP01", "missing_nodata", &missing[1], 1) < 0
+            || H5LTmake_dataset_float(fileID, "HDFEOS/SWATHS/MOP01/Data Fields/MOPITTRadiances", 5, radDims, radiance) < 0
+            || H5LTmake_dataset_float(fileID, "HDFEOS/SWATHS/MOP01/Geolocation Fields/Latitude", 3, geoDims, lat) < 0
+            || H5LTmake_dataset_float(fileID, "HDFEOS/SWATHS/MOP01/Geolocation Fields/Longitude", 3, geoDims, lon) < 0
+            || H5LTmake_dataset_double(fileID, "HDFEOS/SWATHS/MOP01/Geolocation Fields/Time", 1, &nTrack, trackTime) < 0 )
+    {
+        FATAL_MSG("Failed to write the MOPITT granule.\n");
+        goto cleanupFail;
+    }
+
+    if ( 0 )
+    {
+cleanupFail:
+        retVal = FATAL_ERR;
+    }
+
+    if ( lcpl ) H5Pclose(lcpl);
+    if ( fileID ) H5Fclose(fileID);
+    if ( radiance ) free(radiance);
+    if ( lat ) free(lat);
+    if ( lon ) free(lon);
+    if ( trackTime ) free(trackTime);
+    return retVal;
+}
+
+static int runMOPITT( benchInstr_t* instr, char* outputName )
+{
+    char* args[3] = { "benchGranules", instr->files[0], outputName };
+
+    return MOPITT(args, benchOrbit);
+}
+
+/*
+                    main
+    DESCRIPTION:
+        Parses the arguments, generates the missing granules and times the selected
+        instruments. See the description at the top of the file.
+
+    RETURN:
+        0 if all runs succeeded, 1 otherwise.
+*/
+int main( int argc, char* argv[] )
+{
+    const char* dir = ".";
+    int repeats = 1;
+    int regenerate = 0;
+    int failed = 0;
+    int anySelected = 0;
+    char granuleDir[BENCH_PATH_LEN];
+    char outputName[BENCH_PATH_LEN];
+    const char* s = NULL;
+
+    benchInstr_t instr[5] =
+    {
+        { "MOPITT", 1, {"MOP01-20070810-L1V3.50.0.he5"}, generateMOPITT, runMOPITT, 0 },
+        { "CERES", 1, {"CER_SSF_Terra-FM1-MODIS_Edition4A_400403.2007081000"}, generateCERES, runCERES, 0 },
+        { "MODIS", 4, {"MOD021KM.A2007222.0050.006.2014227042129.hdf", "MOD02HKM.A2007222.0050.006.2014227042129.hdf",
+                       "MOD02QKM.A2007222.0050.006.2014227042129.hdf", "MOD03.A2007222.0050.006.2012265184025.hdf"},
+          generateMODIS, runMODIS, 0 },
+        { "ASTER", 1, {"AST_L1T_00308102007004055_20150520134020_120113.hdf"}, generateASTER, runASTER, 0 },
+        { "MISR", 12, {"MISR_AM1_GRP_TERRAIN_GM_P022_O038650_AA_F03_0024.hdf", "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_AF_F03_0024.hdf",
+                       "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_AN_F03_0024.hdf", "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_BA_F03_0024.hdf",
+                       "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_BF_F03_0024.hdf", "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_CA_F03_0024.hdf",
+                       "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_CF_F03_0024.hdf", "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_DA_F03_0024.hdf",
+                       "MISR_AM1_GRP_TERRAIN_GM_P022_O038650_DF_F03_0024.hdf", "MISR_AM1_AGP_P022_F01_24.hdf",
+                       "MISR_AM1_GP_GMP_P022_O038650_F03_0013.hdf", "MISR_HRLL_P022.hdf"},
+          generateMISR, runMISR, 0 }
+    };
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( strcmp(argv[i], "-d") == 0 && i+1 < argc )
+            dir = argv[++i];
+        else if ( strcmp(argv[i], "-s") == 0 && i+1 < argc )
+            benchScale = max(1, atoi(argv[++i]));
+        else if ( strcmp(argv[i], "-r") == 0 && i+1 < argc )
+            repeats = max(1, atoi(argv[++i]));
+        else if ( strcmp(argv[i], "-g") == 0 )
+            regenerate = 1;
+        else
+        {
+            int found = 0;
+            for ( int j = 0; j < 5; j++ )
+            {
+                if ( strcmp(argv[i], instr[j].name) == 0 )
+                {
+                    instr[j].selected = 1;
+                    found = 1;
+                }
+            }
+            if ( !found )
+            {
+                fprintf(stderr, "Usage: %s [-d dir] [-s scale] [-r repeats] [-g] [MOPITT|CERES|MODIS|ASTER|MISR ...]\n", argv[0]);
+                return 1;
+            }
+            anySelected = 1;
+        }
+    }
+
+    s = getenv("TERRA_DATA_PACK");
+    if ( s && isdigit((int)*s) && strtol(s, NULL, 10) == 1 )
+        unpack = 0;
+
+    timingInit();
+
+    /* The granules of each scale live in their own directory */
+    if ( snprintf(granuleDir, sizeof(granuleDir), "%s/s%d", dir, benchScale) >= (int) sizeof(granuleDir) )
+    {
+        FATAL_MSG("The granule directory name \"%s\" is too long.\n", dir);
+        return 1;
+    }
+    mkdir(dir, 0755);
+    mkdir(granuleDir, 0755);
+
+    for ( int i = 0; i < 5; i++ )
+    {
+        for ( int f = 0; f < instr[i].nFiles; f++ )
+        {
+            char name[BENCH_PATH_LEN];
+            strncpy(name, instr[i].files[f], sizeof(name)-1);
+            name[sizeof(name)-1] = '\0';
+            if ( snprintf(instr[i].files[f], BENCH_PATH_LEN, "%s/%s", granuleDir, name) >= BENCH_PATH_LEN )
+            {
+                FATAL_MSG("The granule directory name \"%s\" is too long.\n", dir);
+                return 1;
+            }
+        }
+        if ( !anySelected )
+            instr[i].selected = 1;
+    }
+
+    printf("%-7s %4s %10s %10s %10s %10s %10s\n", "instr", "run", "wall s", "cpu s", "in MB", "out MB", "in MB/s");
+
+    for ( int i = 0; i < 5; i++ )
+    {
+        double inMB = 0.0;
+        double best = -1.0;
+        int missing = 0;
+
+        if ( !instr[i].selected )
+            continue;
+
+        for ( int f = 0; f < instr[i].nFiles; f++ )
+        {
+            struct stat st;
+            if ( stat(instr[i].files[f], &st) != 0 )
+                missing = 1;
+        }
+
+        if ( missing || regenerate )
+        {
+            double t0 = clockSeconds(CLOCK_MONOTONIC);
+
+            printf("Generating the %s granules...", instr[i].name);
+            fflush(stdout);
+            for ( int f = 0; f < instr[i].nFiles; f++ )
+                remove(instr[i].files[f]);
+            if ( instr[i].generate(&instr[i]) == FATAL_ERR )
+            {
+                FATAL_MSG("Failed to generate the %s granules.\n", instr[i].name);
+                failed = 1;
+                continue;
+            }
+            printf("done (%.1f s)\n", clockSeconds(CLOCK_MONOTONIC) - t0);
+        }
+
+        for ( int f = 0; f < instr[i].nFiles; f++ )
+            inMB += fileMB(instr[i].files[f]);
+
+        if ( snprintf(outputName, sizeof(outputName), "%s/bench_%s.h5", granuleDir, instr[i].name) >= (int) sizeof(outputName) )
+        {
+            FATAL_MSG("The granule directory name \"%s\" is too long.\n", dir);
+            failed = 1;
+            continue;
+        }
+
+        for ( int r = 0; r < repeats; r++ )
+        {
+            double wall, cpu;
+            int status;
+            int record;
+
+            remove(outputName);
+
+            wall = clockSeconds(CLOCK_MONOTONIC);
+            cpu = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+
+            if ( createOutputFile(&outputFile, outputName) )
+            {
+                FATAL_MSG("Unable to create the output file %s.\n", outputName);
+                outputFile = 0;
+                failed = 1;
+                break;
+            }
+
+            record = timingBegin("instrument", instr[i].name, instr[i].files[0]);
+            chunkPolicySet(i);      // instr[] is in INSTR_* order
+            status = instr[i].run(&instr[i], outputName);
+            chunkPolicySet(-1);
+            timingEnd(record);
+
+            H5Fclose(outputFile);
+            outputFile = 0;
+
+            wall = clockSeconds(CLOCK_MONOTONIC) - wall;
+            cpu = clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+            if ( status == FATAL_ERR )
+            {
+                FATAL_MSG("%s failed on the synthetic granules.\n", instr[i].name);
+                failed = 1;
+                break;
+            }
+
+            printf("%-7s %4d %10.3f %10.3f %10.1f %10.1f %10.1f\n", instr[i].name, r+1, wall, cpu, inMB,
+                   fileMB(outputName), inMB / wall);
+            if ( best < 0.0 || wall < best )
+                best = wall;
+        }
+
+        if ( repeats > 1 && best > 0.0 )
+            printf("%-7s %4s %10.3f %10s %10.1f %10s %10.1f\n", instr[i].name, "best", best, "", inMB, "", inMB / best);
+    }
+
+    if ( snprintf(outputName, sizeof(outputName), "%s/benchGranules", granuleDir) >= (int) sizeof(outputName) )
+        WARN_MSG("The granule directory name \"%s\" is too long for the timing report.\n", dir);
+    else if ( timingWrite(outputName, failed) == FATAL_ERR )
+        WARN_MSG("Failed to write the timing report.\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,638 @@
+/*
+
+    DESCRIPTION:
+        Resumable conversion of an orbit.
+
+        When the environment variable TERRA_RESUME is set to 1, the progress of an orbit is
+        recorded in the checkpoint file <output file>.checkpoint, one line per completed
+        instrument ("MOPITT", "CERES", "MODIS", "ASTER", "MISR") and "COMPLETE" once the
+        output file is closed. With TERRA_ORBIT_TRIM=1, the granules an instrument skipped
+        as outside of the orbit (orbitGranuleSkip() in orbitWindow.c) are recorded as
+        "SKIPPED <file>" lines before the instrument, as a resumed orbit does not convert
+        the instrument again but still has to leave them out of its InputGranules. After the last job of an instrument, main() dispatches a
+        checkpoint job (dispatchCheckpoint() in parallel.c), which runs once all the jobs of
+        the instrument succeeded: it flushes the output file, syncs it
+        to disk and appends the instrument to the checkpoint file.
+
+        With TERRA_CORE_VFD=1 the output file is only written when it is closed, and a flush
+        would write the whole in-memory file each time. The instruments are then not
+        recorded, only COMPLETE, so a failed orbit is converted again from scratch.
+
+        A rerun of a failed or killed orbit then reopens the output file instead of
+        recreating it, drops the root group of every instrument that is not in the
+        checkpoint file (it may hold a partial conversion, see checkpointDropGroup()) and
+        skips the jobs of the completed ones (checkpointResume()), whose skipped granules
+        it records again from the checkpoint file. An orbit marked COMPLETE
+        is not converted again.
+
+        The file is written without SWMR, so a writer killed in the middle of an instrument
+        can leave its metadata half updated even though H5Fopen() succeeds. Before anything
+        is dropped, checkpointValidate() opens every object of the file and reads the first
+        and the last element of every dataset. If the output file cannot be reopened, is
+        found damaged or a group cannot be dropped, the orbit is converted from scratch.
+
+        The unit is the instrument because granule groups are shared between jobs (CERES FM1
+        and FM2 write into the same granule group) and ASTER and MISR create their root
+        group in their first job. The dimension scales are created at the file root, so the
+        datasets of a dropped group are detached from them first and the scales left without
+        any dataset are deleted too; the rerun then creates and attaches them as a fresh run
+        does. The space of the dropped objects is not reclaimed (h5repack does).
+
+*/
+
+#define _POSIX_C_SOURCE 200112L     // fileno and fsync with -std=c99
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#define CHECKPOINT_SUFFIX ".checkpoint"
+#define CHECKPOINT_LINE_LEN 1024
+#define CHECKPOINT_SKIPPED "SKIPPED "
+#define CHECKPOINT_NAME_LEN 1024
+
+/* Paths of the dimension scales detached by checkpointDropGroup() */
+typedef struct
+{
+    char** names;
+    size_t count;
+    size_t capacity;
+    int failed;
+} scaleList_t;
+
+/*
+                    checkpointEnabled
+    DESCRIPTION:
+        Returns non-zero if the environment variable TERRA_RESUME is set to 1.
+*/
+int checkpointEnabled()
+{
+    const char *s;
+    s = getenv("TERRA_RESUME");
+
+    if(s && isdigit((int)*s))
+        if((unsigned int)strtol(s,NULL,10) == 1)
+            return 1;
+
+    return 0;
+}
+
+/*
+                    checkpointName
+    DESCRIPTION:
+        Returns the name of the checkpoint file of an output file. The caller must free it.
+        Returns NULL if the memory cannot be allocated.
+*/
+char* checkpointName( const char* outputFileName )
+{
+    char* name = calloc(strlen(outputFileName) + strlen(CHECKPOINT_SUFFIX) + 1, 1);
+    if ( name == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        return NULL;
+    }
+
+    strcpy(name, outputFileName);
+    strcat(name, CHECKPOINT_SUFFIX);
+    return name;
+}
+
+/*
+                    checkpointDone
+    DESCRIPTION:
+        Returns non-zero if key (an instrument name or "COMPLETE") is recorded in the
+        checkpoint file. A missing checkpoint file records nothing.
+*/
+int checkpointDone( const char* checkpointFile, const char* key )
+{
+    FILE* fp = fopen(checkpointFile, "r");
+    char line[CHECKPOINT_LINE_LEN];
+    int done = 0;
+
+    if ( fp == NULL )
+        return 0;
+
+    while ( !done && fgets(line, CHECKPOINT_LINE_LEN, fp) )
+    {
+        line[strcspn(line, "\n")] = '\0';
+        done = ( strcmp(line, key) == 0 );
+    }
+
+    fclose(fp);
+    return done;
+}
+
+/*
+                    checkpointSync
+    DESCRIPTION:
+        Flushes the output file and waits until its data is on disk. H5Fflush() only hands
+        the data to the operating system, which may lose it in a node crash after the
+        checkpoint that names it was recorded. Expects the default (sec2) driver, whose VFD
+        handle is the file descriptor.
+
+    RETURN:
+        FATAL_ERR if the output file cannot be flushed or synced, RET_SUCCESS otherwise.
+*/
+herr_t checkpointSync( hid_t file )
+{
+    void* handle = NULL;
+
+    if ( H5Fflush(file, H5F_SCOPE_GLOBAL) < 0 )
+    {
+        FATAL_MSG("Failed to flush the output file.\n");
+        return FATAL_ERR;
+    }
+
+    if ( H5Fget_vfd_handle(file, H5P_DEFAULT, &handle) < 0 || handle == NULL || fsync(*(int*) handle) != 0 )
+    {
+        FATAL_MSG("Failed to sync the output file to disk.\n");
+        return FATAL_ERR;
+    }
+
+    return RET_SUCCESS;
+}
+
+/*
+                    checkpointRecord
+    DESCRIPTION:
+        Appends key to the checkpoint file and waits until it is on disk. The caller must
+        have synced the output file before (checkpointSync()).
+
+    RETURN:
+        FATAL_ERR if the checkpoint file cannot be written, RET_SUCCESS otherwise.
+*/
+herr_t checkpointRecord( const char* checkpointFile, const char* key )
+{
+    FILE* fp = fopen(checkpointFile, "a");
+    if ( fp == NULL )
+    {
+        FATAL_MSG("Unable to open the checkpoint file \"%s\".\n", checkpointFile);
+        return FATAL_ERR;
+    }
+
+    if ( fprintf(fp, "%s\n", key) < 0 || fflush(fp) != 0 || fsync(fileno(fp)) != 0 )
+    {
+        FATAL_MSG("Unable to write the checkpoint file \"%s\".\n", checkpointFile);
+        fclose(fp);
+        return FATAL_ERR;
+    }
+
+    if ( fclose(fp) != 0 )
+    {
+        FATAL_MSG("Unable to write the checkpoint file \"%s\".\n", checkpointFile);
+        return FATAL_ERR;
+    }
+
+    return RET_SUCCESS;
+}
+
+/*
+                    checkpointRecordSkipped
+    DESCRIPTION:
+        Appends the granules recorded by orbitGranuleSkip() that are not in the checkpoint
+        file yet, one "SKIPPED <file>" line each, and waits until they are on disk. Called
+        before an instrument is recorded (checkpointRecord()), so that a completed
+        instrument never misses its skipped granules.
+
+    RETURN:
+        FATAL_ERR if the checkpoint file cannot be written, RET_SUCCESS otherwise.
+*/
+herr_t checkpointRecordSkipped( const char* checkpointFile )
+{
+    char key[CHECKPOINT_LINE_LEN];
+    char* skipped = orbitGranuleSkipped();
+    const char* entry = skipped;
+    FILE* fp = NULL;
+    herr_t retVal = RET_SUCCESS;
+
+    if ( skipped == NULL )
+        return FATAL_ERR;
+
+    while ( *entry && retVal == RET_SUCCESS )
+    {
+        int len = (int) strcspn(entry, ",");
+
+        if ( len > 0 )
+        {
+            if ( snprintf(key, CHECKPOINT_LINE_LEN, "%s%.*s", CHECKPOINT_SKIPPED, len, entry) >= CHECKPOINT_LINE_LEN - 1 )
+            {
+                FATAL_MSG("The name of the skipped granule %.*s is too long.\n", len, entry);
+                retVal = FATAL_ERR;
+            }
+            else if ( !checkpointDone( checkpointFile, key ) )
+            {
+                if ( fp == NULL )
+                    fp = fopen(checkpointFile, "a");
+                if ( fp == NULL || fprintf(fp, "%s\n", key) < 0 )
+                {
+                    FATAL_MSG("Unable to write the checkpoint file \"%s\".\n", checkpointFile);
+                    retVal = FATAL_ERR;
+                }
+                /* checkpointDone() reads the file, so the line must have reached it */
+                else if ( fflush(fp) != 0 )
+                {
+                    FATAL_MSG("Unable to write the checkpoint file \"%s\".\n", checkpointFile);
+                    retVal = FATAL_ERR;
+                }
+            }
+        }
+        entry += len;
+        if ( *entry == ',' )
+            entry++;
+    }
+    free(skipped);
+
+    if ( fp != NULL )
+    {
+        if ( retVal == RET_SUCCESS && fsync(fileno(fp)) != 0 )
+        {
+            FATAL_MSG("Unable to write the checkpoint file \"%s\".\n", checkpointFile);
+            retVal = FATAL_ERR;
+        }
+        if ( fclose(fp) != 0 && retVal == RET_SUCCESS )
+        {
+            FATAL_MSG("Unable to write the checkpoint file \"%s\".\n", checkpointFile);
+            retVal = FATAL_ERR;
+        }
+    }
+
+    return retVal;
+}
+
+/*
+                    checkpointLoadSkipped
+    DESCRIPTION:
+        Records the granules of the "SKIPPED <file>" lines of the checkpoint file with
+        orbitGranuleSkip(), so that the InputGranules list of a resumed orbit leaves out
+        the granules skipped by the instruments of the earlier run.
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise (also when there is no checkpoint file).
+*/
+herr_t checkpointLoadSkipped( const char* checkpointFile )
+{
+    FILE* fp = fopen(checkpointFile, "r");
+    char line[CHECKPOINT_LINE_LEN];
+    size_t prefixLen = strlen(CHECKPOINT_SKIPPED);
+    herr_t retVal = RET_SUCCESS;
+
+    if ( fp == NULL )
+        return RET_SUCCESS;
+
+    while ( retVal == RET_SUCCESS && fgets(line, CHECKPOINT_LINE_LEN, fp) )
+    {
+        char* name = line + prefixLen;
+
+        line[strcspn(line, "\n")] = '\0';
+        if ( strncmp(line, CHECKPOINT_SKIPPED, prefixLen) == 0 && *name )
+            retVal = orbitGranuleSkip( &name, 1 );
+    }
+
+    fclose(fp);
+    return retVal;
+}
+
+/* Adds a path to the list unless it is there already. Returns -1 on failure. */
+static int addScale( scaleList_t* list, const char* name )
+{
+    for ( size_t i = 0; i < list->count; i++ )
+        if ( strcmp(list->names[i], name) == 0 )
+            return 0;
+
+    if ( list->count == list->capacity )
+    {
+        size_t capacity = list->capacity ? 2 * list->capacity : 16;
+        char** names = realloc(list->names, capacity * sizeof(char*));
+        if ( names == NULL )
+        {
+            list->failed = 1;
+            return -1;
+        }
+        list->names = names;
+        list->capacity = capacity;
+    }
+
+    list->names[list->count] = malloc(strlen(name) + 1);
+    if ( list->names[list->count] == NULL )
+    {
+        list->failed = 1;
+        return -1;
+    }
+    strcpy(list->names[list->count++], name);
+
+    return 0;
+}
+
+static void freeScales( scaleList_t* list )
+{
+    for ( size_t i = 0; i < list->count; i++ )
+        free(list->names[i]);
+    free(list->names);
+    memset(list, 0, sizeof(*list));
+}
+
+/* H5DSiterate_scales() callback: records the path of a scale attached to the dimension */
+static herr_t collectScale( hid_t dset, unsigned dim, hid_t scale, void* data )
+{
+    char name[CHECKPOINT_NAME_LEN];
+    (void) dset;
+    (void) dim;
+
+    if ( H5Iget_name(scale, name, CHECKPOINT_NAME_LEN) <= 0 )
+    {
+        ((scaleList_t*) data)->failed = 1;
+        return -1;
+    }
+
+    return addScale( (scaleList_t*) data, name );
+}
+
+/* H5Lvisit() callback: detaches a dataset of the dropped group from all its dimension scales */
+static herr_t detachDataset( hid_t group, const char* name, const H5L_info_t* info, void* data )
+{
+    scaleList_t* detached = (scaleList_t*) data;
+    hid_t dset;
+    hid_t space;
+    int rank;
+
+    if ( info->type != H5L_TYPE_HARD )
+        return 0;
+
+    dset = H5Oopen(group, name, H5P_DEFAULT);
+    if ( dset < 0 )
+        return -1;
+    if ( H5Iget_type(dset) != H5I_DATASET || H5Aexists(dset, "DIMENSION_LIST") <= 0 )
+    {
+        H5Oclose(dset);
+        return 0;
+    }
+
+    space = H5Dget_space(dset);
+    rank = space < 0 ? -1 : H5Sget_simple_extent_ndims(space);
+    if ( space >= 0 ) H5Sclose(space);
+    if ( rank < 0 )
+        detached->failed = 1;
+
+    for ( int dim = 0; dim < rank && !detached->failed; dim++ )
+    {
+        scaleList_t scales;
+        memset(&scales, 0, sizeof(scales));
+
+        /* Collect first, detaching while iterating would change the list being iterated */
+        if ( H5DSiterate_scales(dset, (unsigned) dim, NULL, collectScale, &scales) < 0 || scales.failed )
+            detached->failed = 1;
+
+        for ( size_t i = 0; i < scales.count && !detached->failed; i++ )
+        {
+            hid_t scale = H5Dopen2(group, scales.names[i], H5P_DEFAULT);
+            if ( scale < 0 || H5DSdetach_scale(dset, scale, (unsigned) dim) < 0 )
+                detached->failed = 1;
+            if ( scale >= 0 ) H5Dclose(scale);
+            addScale(detached, scales.names[i]);
+        }
+        freeScales(&scales);
+    }
+
+    H5Oclose(dset);
+    return detached->failed ? -1 : 0;
+}
+
+/*
+                    checkpointDropGroup
+    DESCRIPTION:
+        Deletes the root group of an instrument that a failed run left behind, so that a
+        rerun converts it into the same structure as a fresh run. The datasets of the group
+        are detached from their dimension scales first; the scales outside of the group
+        that no dataset is attached to any more are then deleted too.
+
+    ARGUMENTS:
+        hid_t file       -- The reopened output file
+        const char* name -- Name of the root group of the instrument
+
+    RETURN:
+        FATAL_ERR if the group cannot be dropped, RET_SUCCESS otherwise (also when the
+        group does not exist).
+*/
+herr_t checkpointDropGroup( hid_t file, const char* name )
+{
+    scaleList_t detached;
+    size_t nameLen = strlen(name);
+    herr_t retVal = RET_SUCCESS;
+    hid_t group;
+
+    if ( H5Lexists(file, name, H5P_DEFAULT) <= 0 )
+        return RET_SUCCESS;
+
+    group = H5Gopen2(file, name, H5P_DEFAULT);
+    if ( group < 0 )
+    {
+        FATAL_MSG("Unable to open the %s group.\n", name);
+        return FATAL_ERR;
+    }
+
+    memset(&detached, 0, sizeof(detached));
+    if ( H5Lvisit(group, H5_INDEX_NAME, H5_ITER_NATIVE, detachDataset, &detached) < 0 || detached.failed )
+    {
+        FATAL_MSG("Unable to detach the datasets of the %s group from their dimension scales.\n", name);
+        retVal = FATAL_ERR;
+    }
+    H5Gclose(group);
+
+    /* The scales of the group itself go with it */
+    for ( size_t i = 0; i < detached.count && retVal == RET_SUCCESS; i++ )
+    {
+        const char* scaleName = detached.names[i];
+        hid_t scale;
+        htri_t referenced;
+
+        if ( strncmp(scaleName + 1, name, nameLen) == 0 && scaleName[nameLen + 1] == '/' )
+            continue;
+
+        scale = H5Dopen2(file, scaleName, H5P_DEFAULT);
+        referenced = scale < 0 ? -1 : H5Aexists(scale, "REFERENCE_LIST");
+        if ( scale >= 0 ) H5Dclose(scale);
+
+        if ( referenced < 0 || ( referenced == 0 && H5Ldelete(file, scaleName, H5P_DEFAULT) < 0 ) )
+        {
+            FATAL_MSG("Unable to delete the dimension scale %s.\n", scaleName);
+            retVal = FATAL_ERR;
+        }
+    }
+    freeScales(&detached);
+
+    if ( retVal == RET_SUCCESS && H5Ldelete(file, name, H5P_DEFAULT) < 0 )
+    {
+        FATAL_MSG("Unable to delete the %s group.\n", name);
+        retVal = FATAL_ERR;
+    }
+
+    return retVal;
+}
+
+/* H5Ovisit() callback: reads the first and the last element of every dataset */
+static herr_t validateObject( hid_t file, const char* name, const H5O_info_t* info, void* data )
+{
+    hsize_t dims[H5S_MAX_RANK];
+    hsize_t points[2*H5S_MAX_RANK];
+    hsize_t two = 2;
+    hid_t dset, space, fileType = -1, memType = -1, memSpace = -1;
+    void* buffer = NULL;
+    herr_t retVal = -1;
+    int rank;
+    (void) data;
+
+    if ( info->type != H5O_TYPE_DATASET )
+        return 0;
+
+    dset = H5Dopen2(file, name, H5P_DEFAULT);
+    if ( dset < 0 )
+        return -1;
+
+    space = H5Dget_space(dset);
+    rank = space < 0 ? -1 : H5Sget_simple_extent_dims(space, dims, NULL);
+    if ( rank < 0 )
+        goto done;
+
+    for ( int i = 0; i < rank; i++ )
+        if ( dims[i] == 0 )
+        {
+            retVal = 0;
+            goto done;
+        }
+
+    /* Variable length data would allocate memory; their presence is enough */
+    fileType = H5Dget_type(dset);
+    if ( fileType < 0 )
+        goto done;
+    if ( H5Tget_class(fileType) == H5T_VLEN || H5Tis_variable_str(fileType) > 0 )
+    {
+        retVal = 0;
+        goto done;
+    }
+
+    memType = H5Tget_native_type(fileType, H5T_DIR_ASCEND);
+    buffer = memType < 0 ? NULL : malloc(2 * H5Tget_size(memType));
+    if ( buffer == NULL )
+        goto done;
+
+    for ( int i = 0; i < rank; i++ )
+    {
+        points[i] = 0;
+        points[rank + i] = dims[i] - 1;
+    }
+    if ( rank == 0 )
+        retVal = H5Dread(dset, memType, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer);
+    else
+    {
+        memSpace = H5Screate_simple(1, &two, NULL);
+        if ( memSpace >= 0 && H5Sselect_elements(space, H5S_SELECT_SET, 2, points) >= 0 )
+            retVal = H5Dread(dset, memType, memSpace, space, H5P_DEFAULT, buffer);
+    }
+    retVal = retVal < 0 ? -1 : 0;
+
+done:
+    if ( retVal < 0 )
+        FATAL_MSG("Unable to read the dataset %s.\n", name);
+    free(buffer);
+    if ( memSpace >= 0 ) H5Sclose(memSpace);
+    if ( memType >= 0 ) H5Tclose(memType);
+    if ( fileType >= 0 ) H5Tclose(fileType);
+    if ( space >= 0 ) H5Sclose(space);
+    H5Dclose(dset);
+    return retVal;
+}
+
+/*
+                    checkpointValidate
+    DESCRIPTION:
+        Checks that a reopened output file can be continued: the root group of every
+        instrument recorded in the checkpoint file opens, every object of the file opens
+        and the first and the last element of every dataset read. This walks the group
+        B-trees, object headers and chunk indexes a killed writer may have left half
+        updated. It does not read the whole data.
+
+    ARGUMENTS:
+        hid_t file                 -- The reopened output file
+        const char* checkpointFile -- Its checkpoint file
+
+    RETURN:
+        FATAL_ERR if the file is damaged, RET_SUCCESS otherwise.
+*/
+herr_t checkpointValidate( hid_t file, const char* checkpointFile )
+{
+    for ( int i = INSTR_MOPITT; i <= INSTR_MISR; i++ )
+    {
+        const char* name = instrumentNameOf(i);
+        hid_t group;
+
+        if ( !checkpointDone( checkpointFile, name ) )
+            continue;
+
+        group = H5Lexists(file, name, H5P_DEFAULT) > 0 ? H5Gopen2(file, name, H5P_DEFAULT) : -1;
+        if ( group < 0 )
+        {
+            FATAL_MSG("The converted %s group cannot be opened.\n", name);
+            return FATAL_ERR;
+        }
+        H5Gclose(group);
+    }
+
+    if ( H5Ovisit(file, H5_INDEX_NAME, H5_ITER_NATIVE, validateObject, NULL) < 0 )
+    {
+        FATAL_MSG("Unable to read all the objects of the output file.\n");
+        return FATAL_ERR;
+    }
+
+    return RET_SUCCESS;
+}
+
+/*
+                    checkpointResume
+    DESCRIPTION:
+        Prepares a reopened output file for the rerun of an orbit: validates it
+        (checkpointValidate()), then drops the root group of every instrument that is not
+        recorded in the checkpoint file (checkpointDropGroup()) and records the granules
+        skipped by the earlier run again (checkpointLoadSkipped()).
+
+    ARGUMENTS:
+        hid_t file                 -- The reopened output file
+        const char* checkpointFile -- Its checkpoint file
+        int* skipMask              -- Receives the instruments to skip, for instrumentSkipSet()
+
+    RETURN:
+        FATAL_ERR if the file cannot be continued and must be converted from scratch,
+        RET_SUCCESS otherwise.
+*/
+herr_t checkpointResume( hid_t file, const char* checkpointFile, int* skipMask )
+{
+    *skipMask = 0;
+
+    if ( checkpointValidate( file, checkpointFile ) == FATAL_ERR )
+        return FATAL_ERR;
+
+    for ( int i = INSTR_MOPITT; i <= INSTR_MISR; i++ )
+    {
+        const char* name = instrumentNameOf(i);
+        if ( checkpointDone( checkpointFile, name ) )
+        {
+            printf("_____%s ALREADY CONVERTED_____\n", name);
+            *skipMask |= 1 << i;
+        }
+        else if ( checkpointDropGroup( file, name ) == FATAL_ERR )
+        {
+            FATAL_MSG("Unable to drop the partial %s group.\n", name);
+            return FATAL_ERR;
+        }
+    }
+
+    if ( checkpointLoadSkipped( checkpointFile ) == FATAL_ERR )
+    {
+        FATAL_MSG("Unable to read the skipped granules of the checkpoint file.\n");
+        orbitGranuleSkipReset();
+        return FATAL_ERR;
+    }
+
+    return RET_SUCCESS;
+}
@@ -0,0 +1,387 @@
+/*
+
+    DESCRIPTION:
+        Chunk shapes and filters of the output datasets.
+
+        With USE_CHUNK=1 every dataset created by insertDataset(), insertDataset_comp(), the
+        pipeline (pipeline.c) and the MODIS radiance streaming is chunked with the shape
+        chosen here and compressed according to USE_GZIP. The shape depends on the
+        instrument that writes the dataset, so that a reader of one scan, tile or block
+        only decompresses that part of the band:
+
+            MODIS  -- one scan (10 rows at 1km, 20 at 500m, 40 at 250m) of all columns,
+                      one band at a time
+            ASTER  -- 1024 x 1024 tiles, one band at a time
+            MISR   -- one SOM block
+            others -- about CHUNK_TARGET_BYTES of whole rows of the first dimension
+
+        The instrument is set by chunkPolicySet() (runJob() in parallel.c does it for
+        every instrument). Before, insertDataset_comp() used the whole
+        dataset as one chunk, so reading one scan of a band decompressed the whole band,
+        and datasets above 4 GB could not be chunked at all.
+
+        The filters of the chunks are given by TERRA_FILTERS_<instrument> (e.g.
+        TERRA_FILTERS_MODIS) or else TERRA_FILTERS, a comma separated list applied in order:
+
+            shuffle              -- byte shuffle
+            deflate[:level]      -- deflate, level 1 to 9 (default: USE_GZIP, else 6)
+            szip[:pixels]        -- szip nearest neighbour, pixels per block (default 16)
+            scaleoffset[:digits] -- scale-offset. Integers are packed losslessly; floats are
+                                    rounded to the given number of decimal digits and are
+                                    left alone without one.
+            <id>[:v1:v2...]      -- the registered filter <id> with the client values v1..
+
+        e.g. TERRA_FILTERS=shuffle,deflate:4. Filters that this HDF5 library cannot apply
+        (no szip encoder, filter plugin not found) are skipped with a warning. Without
+        TERRA_FILTERS, the chunks are compressed with deflate at the level of USE_GZIP.
+
+*/
+
+#define _POSIX_C_SOURCE 200112L     // strtok_r with -std=c99
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define CHUNK_TARGET_BYTES ((size_t) 1 << 20)
+#define CHUNK_MAX_BYTES ((size_t) 1 << 30)          // well below the 4 GB limit of HDF5
+#define MODIS_CHUNK_FRAMES 1354                     // columns of a 1km MODIS scan
+#define MODIS_CHUNK_SCAN_ROWS 10                    // rows of a 1km MODIS scan
+#define ASTER_CHUNK_TILE 1024
+#define FILTER_SPEC_LEN 256
+#define FILTER_MAX_VALUES 8                         // client data values of a registered filter
+#define SZIP_DEFAULT_PIXELS 16
+#define DEFLATE_DEFAULT_LEVEL 6
+
+static __thread int chunkInstrument = -1;
+
+static const char* filterEnvName[INSTR_MISR+1] = { "TERRA_FILTERS_MOPITT", "TERRA_FILTERS_CERES",
+                                                   "TERRA_FILTERS_MODIS", "TERRA_FILTERS_ASTER",
+                                                   "TERRA_FILTERS_MISR" };
+
+/*
+                    chunkPolicySet
+    DESCRIPTION:
+        Sets the instrument (one of the INSTR_* values, -1 for none) whose chunk shapes the
+        datasets created by the calling thread get.
+*/
+void chunkPolicySet( int instrument )
+{
+    chunkInstrument = instrument;
+}
+
+/* Returns non-zero if the environment variable USE_CHUNK is set to 1 */
+int chunkPolicyEnabled()
+{
+    const char *s;
+    s = getenv("USE_CHUNK");
+
+    if(s && isdigit((int)*s))
+        if((unsigned int)strtol(s,NULL,0) == 1)
+            return 1;
+
+    return 0;
+}
+
+/* The deflate level given by USE_GZIP, 0 for no compression */
+static short chunkGzipLevel()
+{
+    short gzip_comp_level = 0;
+
+    //Set compression level,USE_GZIP must be a number
+    const char *s;
+    s = getenv("USE_GZIP");
+    if(s && isdigit((int)*s))
+        if((unsigned int)strtol(s,NULL,0) >0)
+            gzip_comp_level= (unsigned int)strtol(s,NULL,0);
+
+    // GZIP is only valid when the level is between 1 and 9
+    if ( gzip_comp_level > 9 )
+        gzip_comp_level = 0;
+
+    return gzip_comp_level;
+}
+
+/*
+                    chunkPolicyShape
+    DESCRIPTION:
+        Computes the chunk shape of a dataset written by the instrument of the calling thread.
+
+    ARGUMENTS:
+        int rank             -- Rank of the dataset
+        const hsize_t* dims  -- Its dimension sizes
+        size_t elemSize      -- Size of one element in bytes
+        hsize_t* chunkDims   -- Receives the chunk shape
+
+    RETURN:
+        0 if the dataset cannot be chunked (rank 0 or an empty dimension), 1 otherwise.
+*/
+int chunkPolicyShape( int rank, const hsize_t* dims, size_t elemSize, hsize_t* chunkDims )
+{
+    size_t chunkBytes = elemSize;
+
+    if ( rank < 1 || rank > DIM_MAX )
+        return 0;
+
+    for ( int i = 0; i < rank; i++ )
+    {
+        if ( dims[i] == 0 )
+            return 0;
+        chunkDims[i] = dims[i];
+    }
+
+    if ( chunkInstrument == INSTR_MODIS && rank >= 2 )
+    {
+        hsize_t cols = dims[rank-1];
+        hsize_t scanRows = MODIS_CHUNK_SCAN_ROWS;
+        if ( cols % MODIS_CHUNK_FRAMES == 0 )
+            scanRows *= cols / MODIS_CHUNK_FRAMES;
+
+        for ( int i = 0; i < rank - 2; i++ )
+            chunkDims[i] = 1;
+        chunkDims[rank-2] = min(scanRows, dims[rank-2]);
+    }
+    else if ( chunkInstrument == INSTR_ASTER && rank >= 2 )
+    {
+        for ( int i = 0; i < rank - 2; i++ )
+            chunkDims[i] = 1;
+        chunkDims[rank-2] = min((hsize_t) ASTER_CHUNK_TILE, dims[rank-2]);
+        chunkDims[rank-1] = min((hsize_t) ASTER_CHUNK_TILE, dims[rank-1]);
+    }
+    else if ( chunkInstrument == INSTR_MISR && rank == 3 )
+    {
+        /* block x along-track x cross-track */
+        chunkDims[0] = 1;
+    }
+    else
+    {
+        size_t rowBytes = elemSize;
+        for ( int i = 1; i < rank; i++ )
+            rowBytes *= (size_t) dims[i];
+        chunkDims[0] = max((hsize_t) 1, min(dims[0], (hsize_t) (CHUNK_TARGET_BYTES / max(rowBytes, (size_t) 1))));
+    }
+
+    /* Keep the chunks of very large rows below the HDF5 limit */
+    for ( int i = 0; i < rank; i++ )
+        chunkBytes *= (size_t) chunkDims[i];
+    for ( int i = 0; i < rank && chunkBytes > CHUNK_MAX_BYTES; i++ )
+    {
+        while ( chunkDims[i] > 1 && chunkBytes > CHUNK_MAX_BYTES )
+        {
+            chunkBytes = chunkBytes / chunkDims[i] * ((chunkDims[i] + 1) / 2);
+            chunkDims[i] = (chunkDims[i] + 1) / 2;
+        }
+    }
+
+    return 1;
+}
+
+/* Returns non-zero if filter can encode with this HDF5 library */
+static int filterCanEncode( H5Z_filter_t filter )
+{
+    unsigned int config = 0;
+
+    if ( H5Zfilter_avail(filter) <= 0 )
+        return 0;
+    if ( H5Zget_filter_info(filter, &config) < 0 )
+        return 0;
+
+    return ( config & H5Z_FILTER_CONFIG_ENCODE_ENABLED ) != 0;
+}
+
+/*
+                    chunkPolicyFilters
+    DESCRIPTION:
+        Adds the filters of a TERRA_FILTERS specification (see the top of this file) to a
+        dataset creation property list.
+
+    ARGUMENTS:
+        hid_t plist       -- The dataset creation property list. It must be chunked.
+        hid_t dataType    -- HDF5 type of the dataset
+        const char* spec  -- The filter specification
+
+    RETURN:
+        FATAL_ERR if the specification is invalid or a filter cannot be set, RET_SUCCESS
+        otherwise.
+*/
+static herr_t chunkPolicyFilters( hid_t plist, hid_t dataType, const char* spec )
+{
+    char buffer[FILTER_SPEC_LEN];
+    char* savePtr = NULL;
+    char* token;
+    H5T_class_t typeClass = H5Tget_class(dataType);
+    int numeric = ( typeClass == H5T_INTEGER || typeClass == H5T_FLOAT );
+
+    if ( strlen(spec) >= FILTER_SPEC_LEN )
+    {
+        FATAL_MSG("The filter specification \"%s\" is too long.\n", spec);
+        return FATAL_ERR;
+    }
+    strcpy(buffer, spec);
+
+    for ( token = strtok_r(buffer, ", ", &savePtr); token; token = strtok_r(NULL, ", ", &savePtr) )
+    {
+        unsigned int values[FILTER_MAX_VALUES];
+        size_t numValues = 0;
+        char* name = token;
+        char* arg = strchr(token, ':');
+        herr_t status = 0;
+
+        /* Split "name:v1:v2..." */
+        if ( arg ) *arg++ = '\0';
+        while ( arg && *arg )
+        {
+            char* end = NULL;
+            if ( numValues == FILTER_MAX_VALUES || !isdigit((int)*arg) )
+            {
+                FATAL_MSG("Invalid arguments of the filter \"%s\" in \"%s\".\n", name, spec);
+                return FATAL_ERR;
+            }
+            values[numValues++] = (unsigned int) strtoul(arg, &end, 0);
+            arg = ( *end == ':' ) ? end + 1 : end;
+            if ( *end != ':' && *end != '\0' )
+            {
+                FATAL_MSG("Invalid arguments of the filter \"%s\" in \"%s\".\n", name, spec);
+                return FATAL_ERR;
+            }
+        }
+
+        if ( strcmp(name, "shuffle") == 0 )
+        {
+            status = H5Pset_shuffle(plist);
+        }
+        else if ( strcmp(name, "deflate") == 0 || strcmp(name, "gzip") == 0 )
+        {
+            unsigned int level = numValues > 0 ? values[0] : (unsigned int) chunkGzipLevel();
+            if ( level == 0 ) level = DEFLATE_DEFAULT_LEVEL;
+            if ( level > 9 )
+            {
+                FATAL_MSG("Invalid deflate level %u in \"%s\".\n", level, spec);
+                return FATAL_ERR;
+            }
+            status = H5Pset_deflate(plist, level);
+        }
+        else if ( strcmp(name, "szip") == 0 )
+        {
+            unsigned int pixels = numValues > 0 ? values[0] : SZIP_DEFAULT_PIXELS;
+            if ( pixels < 2 || pixels > 32 || pixels % 2 != 0 )
+            {
+                FATAL_MSG("Invalid szip pixels per block %u in \"%s\".\n", pixels, spec);
+                return FATAL_ERR;
+            }
+            if ( !numeric )
+                continue;
+            if ( !filterCanEncode(H5Z_FILTER_SZIP) )
+            {
+                WARN_MSG("The HDF5 library cannot encode szip, the filter is skipped.\n");
+                continue;
+            }
+            status = H5Pset_szip(plist, H5_SZIP_NN_OPTION_MASK, pixels);
+        }
+        else if ( strcmp(name, "scaleoffset") == 0 )
+        {
+            if ( typeClass == H5T_INTEGER )
+                status = H5Pset_scaleoffset(plist, H5Z_SO_INT, H5Z_SO_INT_MINBITS_DEFAULT);
+            else if ( typeClass == H5T_FLOAT && numValues > 0 )
+                status = H5Pset_scaleoffset(plist, H5Z_SO_FLOAT_DSCALE, (int) values[0]);
+        }
+        else if ( isdigit((int)*name) )
+        {
+            H5Z_filter_t filter = (H5Z_filter_t) strtol(name, NULL, 0);
+            if ( !filterCanEncode(filter) )
+            {
+                WARN_MSG("The HDF5 filter %d is not available, the filter is skipped.\n", (int) filter);
+                continue;
+            }
+            status = H5Pset_filter(plist, filter, H5Z_FLAG_OPTIONAL, numValues, values);
+        }
+        else
+        {
+            FATAL_MSG("Unknown filter \"%s\" in \"%s\".\n", name, spec);
+            return FATAL_ERR;
+        }
+
+        if ( status < 0 )
+        {
+            FATAL_MSG("Cannot set the filter \"%s\" for the HDF5 dataset creation property list.\n", name);
+            return FATAL_ERR;
+        }
+    }
+
+    return RET_SUCCESS;
+}
+
+/*
+                    chunkPolicyPlist
+    DESCRIPTION:
+        Creates the dataset creation property list of a dataset: the chunk shape of
+        chunkPolicyShape() and the filters of TERRA_FILTERS or USE_GZIP.
+
+    ARGUMENTS:
+        int rank             -- Rank of the dataset
+        const hsize_t* dims  -- Its dimension sizes
+        hid_t dataType       -- HDF5 type of the dataset
+        int force            -- Non-zero to chunk the dataset even if USE_CHUNK is not 1
+                                (e.g. for datasets written in hyperslabs)
+
+    EFFECTS:
+        The caller must close the property list with H5Pclose() unless it is H5P_DEFAULT.
+
+    RETURN:
+        H5P_DEFAULT if the dataset is not chunked, FATAL_ERR on failure, the property list
+        otherwise.
+*/
+hid_t chunkPolicyPlist( int rank, const hsize_t* dims, hid_t dataType, int force )
+{
+    hsize_t chunkDims[DIM_MAX];
+    short gzip_comp_level = 0;
+    const char* filters = NULL;
+    hid_t plist;
+
+    if ( !force && !chunkPolicyEnabled() )
+        return H5P_DEFAULT;
+
+    if ( !chunkPolicyShape(rank, dims, H5Tget_size(dataType), chunkDims) )
+        return H5P_DEFAULT;
+
+    plist = H5Pcreate(H5P_DATASET_CREATE);
+    if ( plist < 0 )
+    {
+        FATAL_MSG("Cannot create the HDF5 dataset creation property list.\n");
+        return FATAL_ERR;
+    }
+
+    if ( H5Pset_chunk(plist, rank, chunkDims) < 0 )
+    {
+        FATAL_MSG("Cannot set chunk for the HDF5 dataset creation property list.\n");
+        H5Pclose(plist);
+        return FATAL_ERR;
+    }
+
+    /* The filters of the instrument, else those of all instruments, else USE_GZIP */
+    if ( chunkInstrument >= 0 && chunkInstrument <= INSTR_MISR )
+        filters = getenv(filterEnvName[chunkInstrument]);
+    if ( filters == NULL )
+        filters = getenv("TERRA_FILTERS");
+
+    if ( filters != NULL )
+    {
+        if ( chunkPolicyFilters(plist, dataType, filters) == FATAL_ERR )
+        {
+            H5Pclose(plist);
+            return FATAL_ERR;
+        }
+        return plist;
+    }
+
+    gzip_comp_level = chunkGzipLevel();
+    if ( gzip_comp_level > 0 && H5Pset_deflate(plist, gzip_comp_level) < 0 )
+    {
+        FATAL_MSG("Cannot set deflate for the HDF5 dataset creation property list.\n");
+        H5Pclose(plist);
+        return FATAL_ERR;
+    }
+
+    return plist;
+}
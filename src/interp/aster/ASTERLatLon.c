@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include "ASTERLatLon.h"
 
 #ifndef M_PI
 #    define M_PI 3.14159265358979323846
@@ -259,158 +261,282 @@ void asterLatLonPlanarOLD(double * inLat, double * inLon, double * cLat, double
 
 }
 
-/**
- * NAME:	asterLatLonSpherical
- * DESCRIPTION:	calculate the latitude and longitude of ASTER cell centers at finner resolution using a Spherical cooridnate system
- * PARAMETERS:
- * 	double * inLat:		the input 11 * 11 latitudes
- * 	double * inLon:		the input 11 * 11 longitudes
- * 	double * cLat:		the output latitudes of cells
- * 	double * cLon:		the ouput longitudes of cells
- * 	int nRow:		the number of rows of output raster
- * 	int nCol:		the number of columns of output raster
- * Output:
- * 	double * cLat:		the output latitudes of cells
- * 	double * cLon:		the ouput longitudes of cells
+/* Interpolation between two points given by the sin/cos of their latitude and longitude. delta and sinDelta
+ * are the angular distance between the points and its sine. Same expressions as the original per-pixel code.
  */
+#define SLERP_POINT(f, delta, sinDelta, sinPhi1, cosPhi1, sinLambda1, cosLambda1, sinPhi2, cosPhi2, sinLambda2, cosLambda2, phi3, lambda3) \
+	do { \
+		double a_ = sin((1-(f)) * (delta)) / (sinDelta); \
+		double b_ = sin((f) * (delta)) / (sinDelta); \
+		double x_ = a_ * (cosPhi1) * (cosLambda1) + b_ * (cosPhi2) * (cosLambda2); \
+		double y_ = a_ * (cosPhi1) * (sinLambda1) + b_ * (cosPhi2) * (sinLambda2); \
+		double z_ = a_ * (sinPhi1) + b_ * (sinPhi2); \
+		(phi3) = atan2(z_, sqrt(x_ * x_ + y_ * y_)); \
+		(lambda3) = atan2(y_, x_); \
+	} while(0)
+
+/* Angular distance between two points */
+static double angularDistance(double phi1, double phi2, double lambda1, double lambda2, double cosPhi1, double cosPhi2) {
+	double dPhi = (phi2 - phi1);
+	double dLambda = (lambda2 - lambda1);
+	double a = sin(dPhi/2) * sin(dPhi/2) + cosPhi1 * cosPhi2 * sin(dLambda/2) * sin(dLambda/2);
+	return 2 * atan2(sqrt(a), sqrt(1-a));
+}
 
-void asterLatLonSpherical(double * inLat, double * inLon, double * cLat, double * cLon, int nRow, int nCol) {
-
-//Bilinear interpolation
-	double dL = ((double)nRow - 1) / 10;
-	double dS = ((double)nCol - 1) / 10;
-
-	int r;
-	int c;
-
-	double lr, lr1, sc, sc1;
-
-	double phi1, phi2, phi3, lambda1, lambda2, lambda3, bX, bY;
-	double dPhi, dLambda;
-	double a, b, x, y, z, f, delta;
-
-
-	double * step1Lat;
+/* The values of one output raster that do not depend on the output row */
+typedef struct {
+	double * cLat;
+	double * cLon;
+	int nRow;
+	int nCol;
+	double dL;
+	double * step1Lat;	// 11 * nCol, the 11 control rows interpolated to the output columns
 	double * step1Lon;
+	double * sinLat;	// sin/cos of step1Lat and step1Lon
+	double * cosLat;
+	double * sinLon;
+	double * cosLon;
+	double * delta;		// 10 * nCol, angular distance between control rows r and r + 1
+	double * sinDelta;
+} asterGrid;
+
+/* All the rasters of one scene, and the next rows to be interpolated */
+typedef struct {
+	asterGrid * grids;
+	int nGrids;
+	int nextGrid;
+	int nextRow;
+	pthread_mutex_t lock;
+} asterScene;
+
+#define ASTER_ROWS_PER_TASK 16
+
+/* Step 1 and the per column precomputation of a raster. The control point trig values are shared by all rasters. */
+static void asterPrepareGrid(asterGrid * g, const double * iLat, const double * iLon, const double * ctlSinLat, const double * ctlCosLat,
+                             const double * ctlSinLon, const double * ctlCosLon, const double * ctlDelta, const double * ctlSinDelta) {
+
+	int nCol = g->nCol;
+	double dS = ((double)nCol - 1) / 10;
+	double * buffer;
 
-	if(NULL == (step1Lat = (double *)(malloc(sizeof(double) * 11 * nCol)))) {
+	if(NULL == (buffer = (double *)malloc(sizeof(double) * 86 * nCol))) {
 		printf("Out of memeory for step1Lat\n");
-		exit(1);	
-	}
-
-	if(NULL == (step1Lon = (double *)(malloc(sizeof(double) * 11 * nCol)))) {
-		printf("Out of memeory for step1Lon\n");
-		exit(1);	
-	}
-	
-	double iLat[121];
-	double iLon[121];
-	
-	// Convert oriLat and oriLon to radians
-	for(int i = 0; i < 11 * 11; i++) {
-		iLat[i] = inLat[i] * M_PI / 180; 
-		iLon[i] = inLon[i] * M_PI / 180; 
+		exit(1);
 	}
+	g->step1Lat = buffer;
+	g->step1Lon = buffer + 11 * nCol;
+	g->sinLat = buffer + 22 * nCol;
+	g->cosLat = buffer + 33 * nCol;
+	g->sinLon = buffer + 44 * nCol;
+	g->cosLon = buffer + 55 * nCol;
+	g->delta = buffer + 66 * nCol;
+	g->sinDelta = buffer + 76 * nCol;
+	g->dL = ((double)g->nRow - 1) / 10;
 
 //Step 1
 	for(int s = 0; s < nCol - 1; s++) {
-		
-		c = s / dS;
-		sc = c * dS;
-		sc1 = (c + 1) * dS;
 
-		f = (s - sc) / dS;
+		int c = s / dS;
+		double sc = c * dS;
+		double f = (s - sc) / dS;
 
 		for(int l = 0; l < 11; l++) {
-			
-			phi1 = iLat[l * 11 + c];
-			phi2 = iLat[l * 11 + c + 1];
-			lambda1 = iLon[l * 11 + c];
-			lambda2 = iLon[l * 11 + c + 1];
+			int p1 = l * 11 + c;
+			int p2 = l * 11 + c + 1;
+			SLERP_POINT(f, ctlDelta[p1], ctlSinDelta[p1], ctlSinLat[p1], ctlCosLat[p1], ctlSinLon[p1], ctlCosLon[p1],
+			            ctlSinLat[p2], ctlCosLat[p2], ctlSinLon[p2], ctlCosLon[p2], g->step1Lat[l * nCol + s], g->step1Lon[l * nCol + s]);
+		}
+	}
 
-			dPhi = (phi2 - phi1);
-			dLambda = (lambda2 - lambda1);
+	for(int l = 0; l < 11; l++) {
+		g->step1Lat[l * nCol + nCol - 1] = iLat[l * 11 + 10];
+		g->step1Lon[l * nCol + nCol - 1] = iLon[l * 11 + 10];
+	}
 
-			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-			delta = 2 * atan2(sqrt(a), sqrt(1-a));
+	for(int i = 0; i < 11 * nCol; i++) {
+		g->sinLat[i] = sin(g->step1Lat[i]);
+		g->cosLat[i] = cos(g->step1Lat[i]);
+		g->sinLon[i] = sin(g->step1Lon[i]);
+		g->cosLon[i] = cos(g->step1Lon[i]);
+	}
 
-			a = sin((1-f) * delta) / sin(delta);
-			b = sin(f * delta) / sin(delta);
+	for(int i = 0; i < 10 * nCol; i++) {
+		g->delta[i] = angularDistance(g->step1Lat[i], g->step1Lat[i + nCol], g->step1Lon[i], g->step1Lon[i + nCol], g->cosLat[i], g->cosLat[i + nCol]);
+		g->sinDelta[i] = sin(g->delta[i]);
+	}
+}
 
-			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-			z = a * sin(phi1) + b * sin(phi2);
+//Step 2, for the rows [l0, l1)
+static void asterInterpolateRows(const asterGrid * g, int l0, int l1) {
 
-			phi3 = atan2(z, sqrt(x * x + y * y));
-			lambda3 = atan2(y, x);
+	int nCol = g->nCol;
 
-			step1Lat[l * nCol + s] = phi3;
-			step1Lon[l * nCol + s] = lambda3;
+	for(int l = l0; l < l1; l++) {
 
+		if(l == g->nRow - 1) {
+			for(int s = 0; s < nCol; s++) {
+				g->cLat[l * nCol + s] = g->step1Lat[10 * nCol + s] * 180 / M_PI;
+				g->cLon[l * nCol + s] = g->step1Lon[10 * nCol + s] * 180 / M_PI;
+			}
+			continue;
 		}
-	}
 
-	for(int l = 0; l < 11; l++) {
-		step1Lat[l * nCol + nCol - 1] = iLat[l * 11 + 10];
-		step1Lon[l * nCol + nCol - 1] = iLon[l * 11 + 10];
-	}
-
-//Step 2
-	for(int l = 0; l < nRow - 1; l++) {
-		
-		r = l / dL;
-		lr = r * dL;
-		lr1 = (r + 1) * dL;
-
-		f = (l - lr) / dL;
+		int r = l / g->dL;
+		double lr = r * g->dL;
+		double f = (l - lr) / g->dL;
+		int p1 = r * nCol;
+		int p2 = (r + 1) * nCol;
 
 		for(int s = 0; s < nCol; s++) {
-			
-			cLat[l * nCol+ s] = (1 - y) * step1Lat[r * nCol + s] + y * step1Lat[(r + 1) * nCol + s];
-			cLon[l * nCol+ s] = (1 - y) * step1Lon[r * nCol + s] + y * step1Lon[(r + 1) * nCol + s];
+			double phi3, lambda3;
+			SLERP_POINT(f, g->delta[p1 + s], g->sinDelta[p1 + s],
+			            g->sinLat[p1 + s], g->cosLat[p1 + s], g->sinLon[p1 + s], g->cosLon[p1 + s],
+			            g->sinLat[p2 + s], g->cosLat[p2 + s], g->sinLon[p2 + s], g->cosLon[p2 + s], phi3, lambda3);
+			// Convert to degrees
+			g->cLat[l * nCol + s] = phi3 * 180 / M_PI;
+			g->cLon[l * nCol + s] = lambda3 * 180 / M_PI;
+		}
+	}
+}
 
-			phi1 = step1Lat[r * nCol + s];
-			phi2 = step1Lat[(r + 1) * nCol + s];
-			lambda1 = step1Lon[r * nCol + s];
-			lambda2 = step1Lon[(r + 1) * nCol + s];
+static void * asterSceneWorker(void * arg) {
 
-			dPhi = (phi2 - phi1);
-			dLambda = (lambda2 - lambda1);
+	asterScene * scene = (asterScene *)arg;
 
-			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-			delta = 2 * atan2(sqrt(a), sqrt(1-a));
+	for(;;) {
+		int g, l0, l1;
 
-			a = sin((1-f) * delta) / sin(delta);
-			b = sin(f * delta) / sin(delta);
+		pthread_mutex_lock(&scene->lock);
+		while(scene->nextGrid < scene->nGrids && scene->nextRow >= scene->grids[scene->nextGrid].nRow) {
+			scene->nextGrid++;
+			scene->nextRow = 0;
+		}
+		if(scene->nextGrid == scene->nGrids) {
+			pthread_mutex_unlock(&scene->lock);
+			return NULL;
+		}
+		g = scene->nextGrid;
+		l0 = scene->nextRow;
+		l1 = l0 + ASTER_ROWS_PER_TASK;
+		if(l1 > scene->grids[g].nRow)
+			l1 = scene->grids[g].nRow;
+		scene->nextRow = l1;
+		pthread_mutex_unlock(&scene->lock);
+
+		asterInterpolateRows(&scene->grids[g], l0, l1);
+	}
+}
 
-			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-			z = a * sin(phi1) + b * sin(phi2);
+/**
+ * NAME:	asterLatLonSphericalMulti
+ * DESCRIPTION:	asterLatLonSpherical for several rasters of the same scene (e.g. SWIR, TIR and VNIR) at once. The sin/cos of the
+ * 		control points are computed once for the scene, and the rows of all rasters are shared by nThreads threads.
+ * PARAMETERS:
+ * 	double * inLat:		the input 11 * 11 latitudes
+ * 	double * inLon:		the input 11 * 11 longitudes
+ * 	int nGrids:		the number of output rasters
+ * 	double ** cLat:		the output latitudes of cells of each raster
+ * 	double ** cLon:		the ouput longitudes of cells of each raster
+ * 	int * nRow:		the number of rows of each output raster
+ * 	int * nCol:		the number of columns of each output raster
+ * 	int nThreads:		the number of threads (including the calling one)
+ * Output:
+ * 	double ** cLat:		the output latitudes of cells
+ * 	double ** cLon:		the ouput longitudes of cells
+ */
 
-			phi3 = atan2(z, sqrt(x * x + y * y));
-			lambda3 = atan2(y, x);
+void asterLatLonSphericalMulti(const double * inLat, const double * inLon, int nGrids, double ** cLat, double ** cLon, const int * nRow, const int * nCol, int nThreads) {
 
-			cLat[l * nCol+ s] = phi3;
-			cLon[l * nCol+ s] = lambda3;
+	double iLat[121];
+	double iLon[121];
+	double ctlSinLat[121], ctlCosLat[121], ctlSinLon[121], ctlCosLon[121];
+	double ctlDelta[121], ctlSinDelta[121];
 
+	// Convert oriLat and oriLon to radians
+	for(int i = 0; i < 11 * 11; i++) {
+		iLat[i] = inLat[i] * M_PI / 180;
+		iLon[i] = inLon[i] * M_PI / 180;
+		ctlSinLat[i] = sin(iLat[i]);
+		ctlCosLat[i] = cos(iLat[i]);
+		ctlSinLon[i] = sin(iLon[i]);
+		ctlCosLon[i] = cos(iLon[i]);
+	}
 
+	// Angular distance between each control point and the next one in its row
+	for(int l = 0; l < 11; l++) {
+		for(int c = 0; c < 10; c++) {
+			int p = l * 11 + c;
+			ctlDelta[p] = angularDistance(iLat[p], iLat[p + 1], iLon[p], iLon[p + 1], ctlCosLat[p], ctlCosLat[p + 1]);
+			ctlSinDelta[p] = sin(ctlDelta[p]);
 		}
 	}
 
-	for(int s = 0; s < nCol; s++) {
-	
-		cLat[(nRow - 1) * nCol + s] = step1Lat[10 * nCol + s];
-		cLon[(nRow - 1) * nCol + s] = step1Lon[10 * nCol + s];
+	asterScene scene;
+	int nTasks = 0;
+
+	if(NULL == (scene.grids = (asterGrid *)malloc(sizeof(asterGrid) * (nGrids > 0 ? nGrids : 1)))) {
+		printf("Out of memeory for the ASTER rasters\n");
+		exit(1);
+	}
+	scene.nGrids = nGrids;
+	scene.nextGrid = 0;
+	scene.nextRow = 0;
+	pthread_mutex_init(&scene.lock, NULL);
+
+	for(int g = 0; g < nGrids; g++) {
+		scene.grids[g].cLat = cLat[g];
+		scene.grids[g].cLon = cLon[g];
+		scene.grids[g].nRow = nRow[g];
+		scene.grids[g].nCol = nCol[g];
+		asterPrepareGrid(&scene.grids[g], iLat, iLon, ctlSinLat, ctlCosLat, ctlSinLon, ctlCosLon, ctlDelta, ctlSinDelta);
+		nTasks += (nRow[g] + ASTER_ROWS_PER_TASK - 1) / ASTER_ROWS_PER_TASK;
 	}
 
-	free(step1Lat);
-	free(step1Lon);
-	
-	// Convert newLat and newLon to degrees
-	for(int i = 0; i < nRow * nCol; i++) {
-		cLat[i] = cLat[i] * 180 / M_PI;			
-		cLon[i] = cLon[i] * 180 / M_PI;
+	if(nThreads > nTasks)
+		nThreads = nTasks;
+	if(nThreads < 1)
+		nThreads = 1;
+
+	pthread_t * threads;
+	int * started;
+	if(NULL == (threads = (pthread_t *)malloc(sizeof(pthread_t) * nThreads)) ||
+	   NULL == (started = (int *)calloc(nThreads, sizeof(int)))) {
+		printf("Out of memeory for the interpolation threads\n");
+		exit(1);
 	}
 
+	// The calling thread works as well. Threads that cannot be started are simply not needed.
+	for(int t = 1; t < nThreads; t++)
+		started[t] = (0 == pthread_create(&threads[t], NULL, asterSceneWorker, &scene));
+	asterSceneWorker(&scene);
+	for(int t = 1; t < nThreads; t++) {
+		if(started[t])
+			pthread_join(threads[t], NULL);
+	}
 
+	for(int g = 0; g < nGrids; g++)
+		free(scene.grids[g].step1Lat);
+	free(scene.grids);
+	free(threads);
+	free(started);
+	pthread_mutex_destroy(&scene.lock);
+}
+
+/**
+ * NAME:	asterLatLonSpherical
+ * DESCRIPTION:	calculate the latitude and longitude of ASTER cell centers at finner resolution using a Spherical cooridnate system
+ * PARAMETERS:
+ * 	double * inLat:		the input 11 * 11 latitudes
+ * 	double * inLon:		the input 11 * 11 longitudes
+ * 	double * cLat:		the output latitudes of cells
+ * 	double * cLon:		the ouput longitudes of cells
+ * 	int nRow:		the number of rows of output raster
+ * 	int nCol:		the number of columns of output raster
+ * Output:
+ * 	double * cLat:		the output latitudes of cells
+ * 	double * cLon:		the ouput longitudes of cells
+ */
+
+void asterLatLonSpherical(double * inLat, double * inLon, double * cLat, double * cLon, int nRow, int nCol) {
+	asterLatLonSphericalMulti(inLat, inLon, 1, &cLat, &cLon, &nRow, &nCol, 1);
 }
@@ -4,5 +4,6 @@
 void asterLatLonPlanar(double * inLat, double * inLon, double * cLat, double * cLon, int nRow, int nCol);
 void asterLatLonPlanarOLD(double * inLat, double * inLon, double * cLat, double * cLon, int nRow, int nCol);
 void asterLatLonSpherical(double * inLat, double * inLon, double * cLat, double * cLon, int nRow, int nCol);
+void asterLatLonSphericalMulti(const double * inLat, const double * inLon, int nGrids, double ** cLat, double ** cLon, const int * nRow, const int * nCol, int nThreads);
 
 #endif
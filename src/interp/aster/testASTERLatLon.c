@@ -6,9 +6,159 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include <sys/time.h>
 #include "ASTERLatLon.h"
 
+#ifndef M_PI
+#    define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * NAME:	referenceAsterLatLonSpherical
+ * DESCRIPTION:	copy of the original per-pixel asterLatLonSpherical, kept as the reference for the multi raster version
+ */
+static void referenceAsterLatLonSpherical(double * inLat, double * inLon, double * cLat, double * cLon, int nRow, int nCol) {
+
+//Bilinear interpolation
+	double dL = ((double)nRow - 1) / 10;
+	double dS = ((double)nCol - 1) / 10;
+
+	int r;
+	int c;
+
+	double lr, lr1, sc, sc1;
+
+	double phi1, phi2, phi3, lambda1, lambda2, lambda3, bX, bY;
+	double dPhi, dLambda;
+	double a, b, x, y, z, f, delta;
+
+
+	double * step1Lat;
+	double * step1Lon;
+
+	if(NULL == (step1Lat = (double *)(malloc(sizeof(double) * 11 * nCol)))) {
+		printf("Out of memeory for step1Lat\n");
+		exit(1);	
+	}
+
+	if(NULL == (step1Lon = (double *)(malloc(sizeof(double) * 11 * nCol)))) {
+		printf("Out of memeory for step1Lon\n");
+		exit(1);	
+	}
+	
+	double iLat[121];
+	double iLon[121];
+	
+	// Convert oriLat and oriLon to radians
+	for(int i = 0; i < 11 * 11; i++) {
+		iLat[i] = inLat[i] * M_PI / 180; 
+		iLon[i] = inLon[i] * M_PI / 180; 
+	}
+
+//Step 1
+	for(int s = 0; s < nCol - 1; s++) {
+		
+		c = s / dS;
+		sc = c * dS;
+		sc1 = (c + 1) * dS;
+
+		f = (s - sc) / dS;
+
+		for(int l = 0; l < 11; l++) {
+			
+			phi1 = iLat[l * 11 + c];
+			phi2 = iLat[l * 11 + c + 1];
+			lambda1 = iLon[l * 11 + c];
+			lambda2 = iLon[l * 11 + c + 1];
+
+			dPhi = (phi2 - phi1);
+			dLambda = (lambda2 - lambda1);
+
+			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+			delta = 2 * atan2(sqrt(a), sqrt(1-a));
+
+			a = sin((1-f) * delta) / sin(delta);
+			b = sin(f * delta) / sin(delta);
+
+			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+			z = a * sin(phi1) + b * sin(phi2);
+
+			phi3 = atan2(z, sqrt(x * x + y * y));
+			lambda3 = atan2(y, x);
+
+			step1Lat[l * nCol + s] = phi3;
+			step1Lon[l * nCol + s] = lambda3;
+
+		}
+	}
+
+	for(int l = 0; l < 11; l++) {
+		step1Lat[l * nCol + nCol - 1] = iLat[l * 11 + 10];
+		step1Lon[l * nCol + nCol - 1] = iLon[l * 11 + 10];
+	}
+
+//Step 2
+	for(int l = 0; l < nRow - 1; l++) {
+		
+		r = l / dL;
+		lr = r * dL;
+		lr1 = (r + 1) * dL;
+
+		f = (l - lr) / dL;
+
+		for(int s = 0; s < nCol; s++) {
+			
+			cLat[l * nCol+ s] = (1 - y) * step1Lat[r * nCol + s] + y * step1Lat[(r + 1) * nCol + s];
+			cLon[l * nCol+ s] = (1 - y) * step1Lon[r * nCol + s] + y * step1Lon[(r + 1) * nCol + s];
+
+			phi1 = step1Lat[r * nCol + s];
+			phi2 = step1Lat[(r + 1) * nCol + s];
+			lambda1 = step1Lon[r * nCol + s];
+			lambda2 = step1Lon[(r + 1) * nCol + s];
+
+			dPhi = (phi2 - phi1);
+			dLambda = (lambda2 - lambda1);
+
+			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+			delta = 2 * atan2(sqrt(a), sqrt(1-a));
+
+			a = sin((1-f) * delta) / sin(delta);
+			b = sin(f * delta) / sin(delta);
+
+			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+			z = a * sin(phi1) + b * sin(phi2);
+
+			phi3 = atan2(z, sqrt(x * x + y * y));
+			lambda3 = atan2(y, x);
+
+			cLat[l * nCol+ s] = phi3;
+			cLon[l * nCol+ s] = lambda3;
+
+
+		}
+	}
+
+	for(int s = 0; s < nCol; s++) {
+	
+		cLat[(nRow - 1) * nCol + s] = step1Lat[10 * nCol + s];
+		cLon[(nRow - 1) * nCol + s] = step1Lon[10 * nCol + s];
+	}
+
+	free(step1Lat);
+	free(step1Lon);
+	
+	// Convert newLat and newLon to degrees
+	for(int i = 0; i < nRow * nCol; i++) {
+		cLat[i] = cLat[i] * 180 / M_PI;			
+		cLon[i] = cLon[i] * 180 / M_PI;
+	}
+
+
+}
+
 int main(int argc, char ** argv) {
 
 	double inLat[121] = {
@@ -40,7 +190,7 @@ int main(int argc, char ** argv) {
 	};
 
 //The second test cut across +180/-180 longitude
-/*	double inLat[121] = {
+	double amLat[121] = {
 	-15.33625688735907, -15.33729712035207, -15.338311122548136, -15.339298885135484, -15.340260399528923, -15.341195657370038, -15.342104650527391, -15.342987371096672, -15.343843811400898, -15.344673963990566, -15.345477821643811,
 -15.401501587703745, -15.4025464581311, -15.403564980865957, -15.404557147053941, -15.405522948068354, -15.406462375510385, -15.407375421209283, -15.408262077222524, -15.409122335836019, -15.40995618956424, -15.41076363115041,
 -15.466745847767022, -15.467795358409424, -15.468818404394248, -15.469814976824463, -15.470785067031796, -15.471728666576972, -15.472645767249857, -15.473536361069666, -15.474400440285118, -15.47523799737462, -15.47604902504643,
@@ -54,7 +204,7 @@ int main(int argc, char ** argv) {
 -15.988683868415485, -15.989770602593017, -15.990829933847255, -15.99186185293728, -15.992866350859781, -15.993843418849274, -15.994793048378268, -15.995715231157472, -15.996609959135968, -15.997477224501393, -15.998317019680103
 	};
 
-	double inLon[121] = {
+	double amLon[121] = {
 	179.93365787633113, -179.98972914477142, -179.91311040948253, -179.83648606470385, -179.75985625739605, -179.68322113457742, -179.6065808433222, -179.52993553075908, -179.4532853440695, -179.37663043048636, -179.29997093729213,
 179.93270302787312, -179.9906602240368, -179.91401771110696, -179.83736958045327, -179.76071597925082, -179.6840570547326, -179.60739295418762, -179.53072382495958, -179.45404981444509, -179.37737107009232, -179.30068773939934,
 179.93174362619172, -179.991595743264, -179.91492933938517, -179.83825730950304, -179.7615798010084, -179.68489696135003, -179.60820893803293, -179.53151587861691, -179.45481793071508, -179.37811524199202, -179.30140796016246,
@@ -67,48 +217,70 @@ int main(int argc, char ** argv) {
 179.92489975599838, -179.99826925091412, -179.92143242371264, -179.84458991126982, -179.7677418625192, -179.69088842645354, -179.6140297521233, -179.53716598863488, -179.46029728514924, -179.38342379088013, -179.30654565509255,
 179.92390368391452, -179.99924052840643, -179.92237889774088, -179.84551157318643, -179.76863870390181, -179.69176043910517, -179.61487692807256, -179.5379883201362, -179.46109476468294, -179.38419641115266, -179.30729340903667
 	};
-*/
-	int nRow = 847;
-	int nCol = 949;
-
-	double * cLat;
-	double * cLon;
+	// Scene sizes: the test raster, TIR, a small one and one cell per input point
+	int nSizes = 4;
+	int sizeRow[4] = {847, 700, 211, 11};
+	int sizeCol[4] = {949, 830, 249, 11};
+	double * grids[2][2] = {{inLat, inLon}, {amLat, amLon}};
 
-	if(NULL == (cLat = (double *)malloc(sizeof(double) * nRow * nCol))) {
-		printf("Out of memeory for cLat\n");
-		exit(1);
-	}
-	if(NULL == (cLon = (double *)malloc(sizeof(double) * nRow * nCol))) {
-		printf("Out of memeory for cLon\n");
-		exit(1);
-	}
-/*	
-	printf("lat,lon\n");
-	for(int i = 0; i < 121; i++) {
-		printf("%lf,%lf\n", inLat[i], inLon[i]);
-	}
-*/
 	struct timeval tBegin;
 	struct timeval tEnd;
-	
-	gettimeofday(&tBegin, NULL);
-	
-	//asterLatLonPlanar(inLat, inLon, cLat, cLon, nRow, nCol);
-	
-	asterLatLonSpherical(inLat, inLon, cLat, cLon, nRow, nCol);
 
-	gettimeofday(&tEnd, NULL);
-	printf("Time:\t%lfms\n", ((&tEnd)->tv_sec - (&tBegin)->tv_sec) * 1000 + (double)((&tEnd)->tv_usec - (&tBegin)->tv_usec) / 1000);
+	double * refLat[4];
+	double * refLon[4];
+	double * mLat[4];
+	double * mLon[4];
 
+	for(int k = 0; k < nSizes; k++) {
+		size_t n = (size_t)sizeRow[k] * sizeCol[k];
+		if(NULL == (refLat[k] = (double *)malloc(sizeof(double) * n)) ||
+		   NULL == (refLon[k] = (double *)malloc(sizeof(double) * n)) ||
+		   NULL == (mLat[k] = (double *)malloc(sizeof(double) * n)) ||
+		   NULL == (mLon[k] = (double *)malloc(sizeof(double) * n))) {
+			printf("Out of memeory for the output\n");
+			exit(1);
+		}
+	}
 
-/*
-	printf("lat,lon\n");
-	for(int i = 0; i < nRow * nCol; i++) {
-		printf("%lf,%lf\n", cLat[i], cLon[i]);
+	for(int g = 0; g < 2; g++) {
+
+		for(int k = 0; k < nSizes; k++) {
+			referenceAsterLatLonSpherical(grids[g][0], grids[g][1], refLat[k], refLon[k], sizeRow[k], sizeCol[k]);
+		}
+
+		// One raster on one thread must give the values of the original algorithm
+		for(int k = 0; k < nSizes; k++) {
+			asterLatLonSpherical(grids[g][0], grids[g][1], mLat[k], mLon[k], sizeRow[k], sizeCol[k]);
+			for(int i = 0; i < sizeRow[k] * sizeCol[k]; i++) {
+				if(mLat[k][i] != refLat[k][i] || mLon[k][i] != refLon[k][i]) {
+					printf("Output of grid %d, %dx%d differs from the original algorithm at %d\n", g, sizeRow[k], sizeCol[k], i);
+					exit(1);
+				}
+			}
+		}
+
+		// So must all the rasters together on several threads
+		gettimeofday(&tBegin, NULL);
+		asterLatLonSphericalMulti(grids[g][0], grids[g][1], nSizes, mLat, mLon, sizeRow, sizeCol, 4);
+		gettimeofday(&tEnd, NULL);
+		printf("Time (%d rasters, 4 threads):\t%lfms\n", nSizes, ((&tEnd)->tv_sec - (&tBegin)->tv_sec) * 1000 + (double)((&tEnd)->tv_usec - (&tBegin)->tv_usec) / 1000);
+
+		for(int k = 0; k < nSizes; k++) {
+			for(int i = 0; i < sizeRow[k] * sizeCol[k]; i++) {
+				if(mLat[k][i] != refLat[k][i] || mLon[k][i] != refLon[k][i]) {
+					printf("Multi raster output of grid %d, %dx%d differs from the original algorithm at %d\n", g, sizeRow[k], sizeCol[k], i);
+					exit(1);
+				}
+			}
+		}
+	}
+
+	for(int k = 0; k < nSizes; k++) {
+		free(refLat[k]);
+		free(refLon[k]);
+		free(mLat[k]);
+		free(mLon[k]);
 	}
-*/
-	free(cLat);
-	free(cLon);
 
 	return 0;
 }
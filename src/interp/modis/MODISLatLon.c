@@ -2,55 +2,49 @@
  * MODISLatLon.c
  * Authors: Yizhao Gao <ygao29@illinois.edu>
  * Date: {05/22/2017}
+ *
+ * The interpolation is done one scan at a time. The first (column) step of a scan only
+ * needs the rows of that scan, so a scan sized intermediate is enough, and the scans are
+ * independent of each other, so they are spread over threads. Every output value is
+ * computed with the same expressions as before, so the output does not depend on the
+ * number of threads.
+ *
+ * The float version (upscaleLatLonSphericalFloat) reads the float geolocation of the file
+ * and also does the second upscaling (e.g. 500m to 250m) scan by scan: the finer scan only
+ * needs the rows of one coarser scan, so the intermediate resolution is never stored in
+ * double.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include "MODISLatLon.h"
 
 #ifndef M_PI
 #    define M_PI 3.14159265358979323846
 #endif
+
 /**
- * NAME:	upscaleLatLonPlanar
- * DESCRIPTION:	calculate the latitude and longitude of MODIS cell centers at finner resolution based on coarser resolution cell locations, using a planer cooridnate system
+ * NAME:	planarScan
+ * DESCRIPTION:	the planar interpolation of one scan
  * PARAMETERS:
- * 	double * oriLat:	the latitudes of input cells at coarser resolution
- * 	double * oriLon:	the longitudes of input cells at coarser resolution
- * 	int nRow:		the number of rows of input raster
- * 	int nRol:		the number of columns of input raster
+ * 	double * oriLat:	the latitudes of the first row of the scan at coarser resolution
+ * 	double * oriLon:	the longitudes of the first row of the scan at coarser resolution
+ * 	int nCol:		the number of columns of input raster
  * 	int scanSize:		the number of cells in a scan
- * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * 	double * step1Lat:	room for scanSize * 2 * nCol values
+ * 	double * step1Lon:	room for scanSize * 2 * nCol values
  * Output:
- * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * 	double * newLat:	the 2 * scanSize rows of latitudes of the scan at finer resolution
+ * 	double * newLon:	the 2 * scanSize rows of longitudes of the scan at finer resolution
  */
-
-void upscaleLatLonPlanar(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon) {
-
-	if(0 != nRow % scanSize) {
-		printf("nRows:%d is not a multiple of scanSize: %d\n", nRow, scanSize);
-		exit(1);
-	}
-
-	double * step1Lat;
-	double * step1Lon;
-
-	if(NULL == (step1Lat = (double *)malloc(sizeof(double) * 2 * nRow * nCol))) {
-		printf("Out of memeory for step1Lat\n");
-		exit(1);
-	}
-
-	if(NULL == (step1Lon = (double *)malloc(sizeof(double) * 2 * nRow * nCol))) {
-		printf("Out of memeory for step1Lon\n");
-		exit(1);
-	}
+static void planarScan(const double * oriLat, const double * oriLon, int nCol, int scanSize, double * step1Lat, double * step1Lon, double * newLat, double * newLon) {
 
 	int i, j;
 
 	// First step for bilinear interpolation
-	for(i = 0; i < nRow; i++) {
+	for(i = 0; i < scanSize; i++) {
 		for(j = 0; j < nCol; j++) {
 
 			step1Lat[i * 2 * nCol + 2 * j] = oriLat[i * nCol + j];
@@ -95,184 +89,125 @@ void upscaleLatLonPlanar(double * oriLat, double * oriLon, int nRow, int nCol, i
 				}
 			}
 		}
-	}	
+	}
 
 	// Second step for bilinear interpolation
-	
-	int k = 0;
-	for(k = 0; k < nRow; k += scanSize) {
 
-		//  Processing the first row in a scan
-		i = k;
+	//  Processing the first row in a scan
+	i = 0;
+	for(j = 0; j < 2 * nCol; j++) {
+		newLat[(i * 2) * 2 * nCol + j] = 1.25 * step1Lat[i * 2 * nCol + j] - 0.25 * step1Lat[(i + 1) * 2 * nCol + j];
+
+		if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i + 1) * 2 * nCol + j] < -90) {
+			newLon[(i * 2) * 2 * nCol + j] = 1.25 * step1Lon[(i + 1) * 2 * nCol + j] - 0.25 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
+		}
+		else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[(i + 1) * 2 * nCol + j] > 90) {
+			newLon[(i * 2) * 2 * nCol + j] = 1.25 * (step1Lon[i * 2 * nCol + j] + 360) - 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
+		}
+		else {
+			newLon[(i * 2) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
+		}
+		if(newLon[(i * 2) * 2 * nCol + j] > 180) {
+			newLon[(i * 2) * 2 * nCol + j] -= 360;
+		}
+		else if(newLon[(i * 2) * 2 * nCol + j] < -180) {
+			newLon[(i * 2) * 2 * nCol + j] += 360;
+		}
+	}
+
+	//  Processing intermediate rows in a scan
+	for(i = 0; i < scanSize - 1; i ++) {
 		for(j = 0; j < 2 * nCol; j++) {
-			newLat[(i * 2) * 2 * nCol + j] = 1.25 * step1Lat[i * 2 * nCol + j] - 0.25 * step1Lat[(i + 1) * 2 * nCol + j];
-		
+			newLat[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lat[i * 2 * nCol + j] + 0.25 * step1Lat[(i + 1) * 2 * nCol + j];
+			newLat[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lat[i * 2 * nCol + j] + 0.75 * step1Lat[(i + 1) * 2 * nCol + j];
+
 			if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i + 1) * 2 * nCol + j] < -90) {
-				newLon[(i * 2) * 2 * nCol + j] = 1.25 * step1Lon[(i + 1) * 2 * nCol + j] - 0.25 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
+				newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lon[i * 2 * nCol + j] + 0.25 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
+				newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lon[i * 2 * nCol + j] + 0.75 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
 			}
 			else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[(i + 1) * 2 * nCol + j] > 90) {
-				newLon[(i * 2) * 2 * nCol + j] = 1.25 * (step1Lon[i * 2 * nCol + j] + 360) - 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
+				newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * (step1Lon[i * 2 * nCol + j] + 360) + 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
+				newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * (step1Lon[i * 2 * nCol + j] + 360) + 0.75 * step1Lon[(i + 1) * 2 * nCol + j];
 			}
-			else {
-				newLon[(i * 2) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
-			}
-			if(newLon[(i * 2) * 2 * nCol + j] > 180) {
-				newLon[(i * 2) * 2 * nCol + j] -= 360;
-			}
-			else if(newLon[(i * 2) * 2 * nCol + j] < -180) {
-				newLon[(i * 2) * 2 * nCol + j] += 360;
-			}
-		}
-
-		//  Processing intermediate rows in a scan
-		for(i = k; i < k + scanSize - 1; i ++) {
-			for(j = 0; j < 2 * nCol; j++) {
-				newLat[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lat[i * 2 * nCol + j] + 0.25 * step1Lat[(i + 1) * 2 * nCol + j];
-				newLat[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lat[i * 2 * nCol + j] + 0.75 * step1Lat[(i + 1) * 2 * nCol + j];
-	
-				if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i + 1) * 2 * nCol + j] < -90) {
-					newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lon[i * 2 * nCol + j] + 0.25 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
-					newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lon[i * 2 * nCol + j] + 0.75 * (step1Lon[(i + 1) * 2 * nCol + j] + 360);
-				}
-				else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[(i + 1) * 2 * nCol + j] > 90) {
-					newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * (step1Lon[i * 2 * nCol + j] + 360) + 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
-					newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * (step1Lon[i * 2 * nCol + j] + 360) + 0.75 * step1Lon[(i + 1) * 2 * nCol + j];
-				}
-				else{
-					newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lon[i * 2 * nCol + j] + 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
-					newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lon[i * 2 * nCol + j] + 0.75 * step1Lon[(i + 1) * 2 * nCol + j];
-				}
-
-				if(newLon[(i * 2 + 1) * 2 * nCol + j] > 180) {
-					newLon[(i * 2 + 1) * 2 * nCol + j] -= 360;
-				}
-				else if(newLon[(i * 2 + 1) * 2 * nCol + j] < -180) {
-					newLon[(i * 2 + 1) * 2 * nCol + j] += 360;
-				}
-				if(newLon[(i * 2 + 2) * 2 * nCol + j] > 180) {
-					newLon[(i * 2 + 2) * 2 * nCol + j] -= 360;
-				}
-				else if(newLon[(i * 2 + 2) * 2 * nCol + j] < -180) {
-					newLon[(i * 2 + 2) * 2 * nCol + j] += 360;
-				}
+			else{
+				newLon[(i * 2 + 1) * 2 * nCol + j] = 0.75 * step1Lon[i * 2 * nCol + j] + 0.25 * step1Lon[(i + 1) * 2 * nCol + j];
+				newLon[(i * 2 + 2) * 2 * nCol + j] = 0.25 * step1Lon[i * 2 * nCol + j] + 0.75 * step1Lon[(i + 1) * 2 * nCol + j];
 			}
-		}	
 
-		//  Processing the last row in a scan
-		i = k + scanSize - 1;
-		for(j = 0; j < 2 * nCol; j++) {
-			newLat[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lat[i * 2 * nCol + j] - 0.25 * step1Lat[(i - 1) * 2 * nCol + j];
-
-			if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i - 1) * 2 * nCol + j] < -90) {
-				newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * (step1Lon[(i - 1) * 2 * nCol + j] + 360);
-			}
-			else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[(i - 1) * 2 * nCol + j] > 90) {
-				newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * (step1Lon[i * 2 * nCol + j] + 360) - 0.25 * step1Lon[(i - 1) * 2 * nCol + j];
+			if(newLon[(i * 2 + 1) * 2 * nCol + j] > 180) {
+				newLon[(i * 2 + 1) * 2 * nCol + j] -= 360;
 			}
-			else {
-				newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * step1Lon[(i - 1) * 2 * nCol + j];
+			else if(newLon[(i * 2 + 1) * 2 * nCol + j] < -180) {
+				newLon[(i * 2 + 1) * 2 * nCol + j] += 360;
 			}
-			if(newLon[(2 * i + 1) * 2 * nCol + j] > 180) {
-				newLon[(2 * i + 1) * 2 * nCol + j] -= 360;
+			if(newLon[(i * 2 + 2) * 2 * nCol + j] > 180) {
+				newLon[(i * 2 + 2) * 2 * nCol + j] -= 360;
 			}
-			else if(newLon[(2 * i + 1) * 2 * nCol + j] < -180) {
-				newLon[(2 * i + 1) * 2 * nCol + j] += 360;
+			else if(newLon[(i * 2 + 2) * 2 * nCol + j] < -180) {
+				newLon[(i * 2 + 2) * 2 * nCol + j] += 360;
 			}
 		}
 	}
-/*
-	for(i = 0; i < nRow; i++) {
-		for(j = 0; j < 2 * nCol; j++) {
-			printf("%lf,%lf\n", step1Lat[i * 2 * nCol + j], step1Lon[i * 2 * nCol + j]);
+
+	//  Processing the last row in a scan
+	i = scanSize - 1;
+	for(j = 0; j < 2 * nCol; j++) {
+		newLat[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lat[i * 2 * nCol + j] - 0.25 * step1Lat[(i - 1) * 2 * nCol + j];
+
+		if(step1Lon[i * 2 * nCol + j] > 90 && step1Lon[(i - 1) * 2 * nCol + j] < -90) {
+			newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * (step1Lon[(i - 1) * 2 * nCol + j] + 360);
+		}
+		else if(step1Lon[i * 2 * nCol + j] < -90 && step1Lon[(i - 1) * 2 * nCol + j] > 90) {
+			newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * (step1Lon[i * 2 * nCol + j] + 360) - 0.25 * step1Lon[(i - 1) * 2 * nCol + j];
+		}
+		else {
+			newLon[(2 * i + 1) * 2 * nCol + j] = 1.25 * step1Lon[i * 2 * nCol + j] - 0.25 * step1Lon[(i - 1) * 2 * nCol + j];
+		}
+		if(newLon[(2 * i + 1) * 2 * nCol + j] > 180) {
+			newLon[(2 * i + 1) * 2 * nCol + j] -= 360;
+		}
+		else if(newLon[(2 * i + 1) * 2 * nCol + j] < -180) {
+			newLon[(2 * i + 1) * 2 * nCol + j] += 360;
 		}
 	}
-*/
-	free(step1Lat);
-	free(step1Lon);	
-
-	
-	return;
 }
 
 /**
- * NAME:	upscaleLatLonSpherical
- * DESCRIPTION:	calculate the latitude and longitude of MODIS cell centers at finner resolution based on coarser resolution cell locations, using a planer cooridnate system
- * PARAMETERS:
- * 	double * oriLat:	the latitudes of input cells at coarser resolution
- * 	double * oriLon:	the longitudes of input cells at coarser resolution
- * 	int nRow:		the number of rows of input raster
- * 	int nRol:		the number of columns of input raster
- * 	int scanSize:		the number of cells in a scan
- * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- * Output:
- * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
- * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * NAME:	sphericalScan
+ * DESCRIPTION:	the spherical interpolation of one scan. The parameters are the same as the ones of planarScan,
+ * 		except that the output is in radians.
  */
-
-void upscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon) {
-
-	if(0 != nRow % scanSize) {
-		printf("nRows:%d is not a multiple of scanSize: %d\n", nRow, scanSize);
-		exit(1);
-	}
-
-	double * step1Lat;
-	double * step1Lon;
-
-	if(NULL == (step1Lat = (double *)malloc(sizeof(double) * 2 * nRow * nCol))) {
-		printf("Out of memeory for step1Lat\n");
-		exit(1);
-	}
-
-	if(NULL == (step1Lon = (double *)malloc(sizeof(double) * 2 * nRow * nCol))) {
-		printf("Out of memeory for step1Lon\n");
-		exit(1);
-	}
+static void sphericalScan(const double * oriLat, const double * oriLon, int nCol, int scanSize, double * step1Lat, double * step1Lon, double * newLat, double * newLon) {
 
 	int i, j;
 
-	double * oLat;
-	double * oLon;
-	if(NULL == (oLat = (double *)malloc(sizeof(double) * nRow * nCol))) {
-		printf("Out of memeory for oLat\n");
-		exit(1);
-	}
-
-	if(NULL == (oLon = (double *)malloc(sizeof(double) * nRow * nCol))) {
-		printf("Out of memeory for oLon\n");
-		exit(1);
-	}
-
-
-	// Convert oriLat and oriLon to radians
-	for(i = 0; i < nRow; i++) {
-		for(j = 0; j < nCol; j++) {
-			oLat[i * nCol + j] = oriLat[i * nCol + j] * M_PI / 180; 
-			oLon[i * nCol + j] = oriLon[i * nCol + j] * M_PI / 180; 
-		}
-	}
-
 	double phi1, phi2, phi3, lambda1, lambda2, lambda3, bX, bY;
 	double dPhi, dLambda;
 	double a, b, x, y, z, f, delta;
 	double f1, f2;
 
+	// Convert oriLat and oriLon to radians. The converted values go to the even columns of step1, which
+	// are only written, never read, by the first step.
+	for(i = 0; i < scanSize; i++) {
+		for(j = 0; j < nCol; j++) {
+			step1Lat[i * 2 * nCol + 2 * j] = oriLat[i * nCol + j] * M_PI / 180;
+			step1Lon[i * 2 * nCol + 2 * j] = oriLon[i * nCol + j] * M_PI / 180;
+		}
+	}
 
 	// First step for bilinear interpolation
 	f = 1.5;
-	for(i = 0; i < nRow; i++) {
+	for(i = 0; i < scanSize; i++) {
+		const double * oLat = step1Lat + i * 2 * nCol;
+		const double * oLon = step1Lon + i * 2 * nCol;
 		for(j = 0; j < nCol; j++) {
 
-			step1Lat[i * 2 * nCol + 2 * j] = oLat[i * nCol + j];
-			step1Lon[i * 2 * nCol + 2 * j] = oLon[i * nCol + j];
-
 			if(j == nCol - 1) {
-	
-				phi1 = oLat[i * nCol + j - 1];
-				phi2 = oLat[i * nCol + j];
-				lambda1 = oLon[i * nCol + j - 1];
-				lambda2 = oLon[i * nCol + j];
+
+				phi1 = oLat[2 * (j - 1)];
+				phi2 = oLat[2 * j];
+				lambda1 = oLon[2 * (j - 1)];
+				lambda2 = oLon[2 * j];
 
 				dPhi = (phi2 - phi1);
 				dLambda = (lambda2 - lambda1);
@@ -296,10 +231,10 @@ void upscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol
 
 			else {
 
-				phi1 = oLat[i * nCol + j];
-				phi2 = oLat[i * nCol + j + 1];
-				lambda1 = oLon[i * nCol + j];
-				lambda2 = oLon[i * nCol + j + 1];
+				phi1 = oLat[2 * j];
+				phi2 = oLat[2 * (j + 1)];
+				lambda1 = oLon[2 * j];
+				lambda2 = oLon[2 * (j + 1)];
 
 				bX = cos(phi2) * cos(lambda2 - lambda1);
 				bY = cos(phi2) * sin(lambda2 - lambda1);
@@ -310,35 +245,62 @@ void upscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol
 				lambda3 = lambda1 + atan2(bY, cos(phi1) + bX) + 3 * M_PI;
 				lambda3 = lambda3 - (int)(lambda3 / (2 * M_PI)) * 2 * M_PI - M_PI;
 
-				step1Lon[i * 2 * nCol + 2 * j + 1] = lambda3;	
+				step1Lon[i * 2 * nCol + 2 * j + 1] = lambda3;
 			}
 		}
-	}	
+	}
 
 	// Second step for bilinear interpolation
 	f = 1.25;
 	f1 = 0.25;
 	f2 = 0.75;
 
-	int k = 0;
-	for(k = 0; k < nRow; k += scanSize) {
+	//  Processing the first row in a scan
+	i = 0;
+	for(j = 0; j < 2 * nCol; j++) {
+		phi1 = step1Lat[(i + 1) * 2 * nCol + j];
+		phi2 = step1Lat[i * 2 * nCol + j];
+		lambda1 = step1Lon[(i + 1) * 2 * nCol + j];
+		lambda2 = step1Lon[i * 2 * nCol + j];
+
+		dPhi = (phi2 - phi1);
+		dLambda = (lambda2 - lambda1);
+
+		a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+		delta = 2 * atan2(sqrt(a), sqrt(1-a));
+
+		a = sin((1-f) * delta) / sin(delta);
+		b = sin(f * delta) / sin(delta);
+
+		x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+		y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+		z = a * sin(phi1) + b * sin(phi2);
+
+		phi3 = atan2(z, sqrt(x * x + y * y));
+		lambda3 = atan2(y, x);
+
+		newLat[(i * 2) * 2 * nCol + j] = phi3;
+		newLon[(i * 2) * 2 * nCol + j] = lambda3;
+	}
 
-		//  Processing the first row in a scan
-		i = k;
+	//  Processing intermediate rows in a scan
+	for(i = 0; i < scanSize - 1; i ++) {
 		for(j = 0; j < 2 * nCol; j++) {
-			phi1 = step1Lat[(i + 1) * 2 * nCol + j];
-			phi2 = step1Lat[i * 2 * nCol + j];
-			lambda1 = step1Lon[(i + 1) * 2 * nCol + j];
-			lambda2 = step1Lon[i * 2 * nCol + j];
-	
+
+			phi1 = step1Lat[i * 2 * nCol + j];
+			phi2 = step1Lat[(i + 1) * 2 * nCol + j];
+			lambda1 = step1Lon[i * 2 * nCol + j];
+			lambda2 = step1Lon[(i + 1) * 2 * nCol + j];
+
 			dPhi = (phi2 - phi1);
 			dLambda = (lambda2 - lambda1);
 
 			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
 			delta = 2 * atan2(sqrt(a), sqrt(1-a));
-	
-			a = sin((1-f) * delta) / sin(delta);
-			b = sin(f * delta) / sin(delta);
+
+			//Interpolate the first intermediate point
+			a = sin((1-f1) * delta) / sin(delta);
+			b = sin(f1 * delta) / sin(delta);
 
 			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
 			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
@@ -347,109 +309,301 @@ void upscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol
 			phi3 = atan2(z, sqrt(x * x + y * y));
 			lambda3 = atan2(y, x);
 
-			newLat[(i * 2) * 2 * nCol + j] = phi3;
-			newLon[(i * 2) * 2 * nCol + j] = lambda3;
+			newLat[(i * 2 + 1) * 2 * nCol + j] = phi3;
+			newLon[(i * 2 + 1) * 2 * nCol + j] = lambda3;
+
+			//Interpolate the second intermediate point
+			a = sin((1-f2) * delta) / sin(delta);
+			b = sin(f2 * delta) / sin(delta);
+
+			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+			z = a * sin(phi1) + b * sin(phi2);
+
+			phi3 = atan2(z, sqrt(x * x + y * y));
+			lambda3 = atan2(y, x);
+
+			newLat[(i * 2 + 2) * 2 * nCol + j] = phi3;
+			newLon[(i * 2 + 2) * 2 * nCol + j] = lambda3;
 		}
+	}
 
-		//  Processing intermediate rows in a scan
-		for(i = k; i < k + scanSize - 1; i ++) {
-			for(j = 0; j < 2 * nCol; j++) {
-				
-				phi1 = step1Lat[i * 2 * nCol + j];
-				phi2 = step1Lat[(i + 1) * 2 * nCol + j];
-				lambda1 = step1Lon[i * 2 * nCol + j];
-				lambda2 = step1Lon[(i + 1) * 2 * nCol + j];
-			
-				dPhi = (phi2 - phi1);
-				dLambda = (lambda2 - lambda1);
+	//  Processing the last row in a scan
+	i = scanSize - 1;
+	for(j = 0; j < 2 * nCol; j++) {
+		phi1 = step1Lat[(i - 1) * 2 * nCol + j];
+		phi2 = step1Lat[i * 2 * nCol + j];
+		lambda1 = step1Lon[(i - 1) * 2 * nCol + j];
+		lambda2 = step1Lon[i * 2 * nCol + j];
 
-				a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-				delta = 2 * atan2(sqrt(a), sqrt(1-a));
+		dPhi = (phi2 - phi1);
+		dLambda = (lambda2 - lambda1);
 
-				//Interpolate the first intermediate point
-				a = sin((1-f1) * delta) / sin(delta);
-				b = sin(f1 * delta) / sin(delta);
-			
-				x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-				y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-				z = a * sin(phi1) + b * sin(phi2);
+		a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+		delta = 2 * atan2(sqrt(a), sqrt(1-a));
 
-				phi3 = atan2(z, sqrt(x * x + y * y));
-				lambda3 = atan2(y, x);
+		a = sin((1-f) * delta) / sin(delta);
+		b = sin(f * delta) / sin(delta);
 
-				newLat[(i * 2 + 1) * 2 * nCol + j] = phi3;
-				newLon[(i * 2 + 1) * 2 * nCol + j] = lambda3;
+		x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+		y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+		z = a * sin(phi1) + b * sin(phi2);
 
-				//Interpolate the second intermediate point
-				a = sin((1-f2) * delta) / sin(delta);
-				b = sin(f2 * delta) / sin(delta);
+		phi3 = atan2(z, sqrt(x * x + y * y));
+		lambda3 = atan2(y, x);
 
-				x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-				y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-				z = a * sin(phi1) + b * sin(phi2);
-	
-				phi3 = atan2(z, sqrt(x * x + y * y));
-				lambda3 = atan2(y, x);
+		newLat[(2 * i + 1) * 2 * nCol + j] = phi3;
+		newLon[(2 * i + 1) * 2 * nCol + j] = lambda3;
+	}
+}
 
-				newLat[(i * 2 + 2) * 2 * nCol + j] = phi3;
-				newLon[(i * 2 + 2) * 2 * nCol + j] = lambda3;
-			}
+/* The work shared by the threads of one upscaling */
+typedef struct {
+	const double * oriLat;
+	const double * oriLon;
+	const float * oriLatF;
+	const float * oriLonF;
+	int nRow;
+	int nCol;
+	int scanSize;
+	int spherical;
+	double * newLat;
+	double * newLon;
+	float * newLatF;
+	float * newLonF;
+	float * new2LatF;
+	float * new2LonF;
+	int nThreads;
+	int thread;
+} upscaleTask;
+
+/* Upscale one scan of nCol columns, in degrees */
+static void upscaleScan(const double * oriLat, const double * oriLon, int nCol, int scanSize, int spherical,
+                        double * step1Lat, double * step1Lon, double * scanLat, double * scanLon) {
+	size_t scanOut = (size_t)4 * scanSize * nCol;
+
+	if(spherical) {
+		sphericalScan(oriLat, oriLon, nCol, scanSize, step1Lat, step1Lon, scanLat, scanLon);
+		// Convert newLat and newLon to degrees
+		for(size_t n = 0; n < scanOut; n++) {
+			scanLat[n] = scanLat[n] * 180 / M_PI;
+			scanLon[n] = scanLon[n] * 180 / M_PI;
 		}
+	}
+	else
+		planarScan(oriLat, oriLon, nCol, scanSize, step1Lat, step1Lon, scanLat, scanLon);
+}
 
-		//  Processing the last row in a scan
-		i = k + scanSize - 1;
-		for(j = 0; j < 2 * nCol; j++) {
-			phi1 = step1Lat[(i - 1) * 2 * nCol + j];
-			phi2 = step1Lat[i * 2 * nCol + j];
-			lambda1 = step1Lon[(i - 1) * 2 * nCol + j];
-			lambda2 = step1Lon[i * 2 * nCol + j];
+/* Interpolate the scans thread, thread + nThreads, ... of the task */
+static void * upscaleScans(void * arg) {
 
-			dPhi = (phi2 - phi1);
-			dLambda = (lambda2 - lambda1);
+	upscaleTask * task = (upscaleTask *)arg;
+	int nCol = task->nCol;
+	int scanSize = task->scanSize;
+	size_t scanIn = (size_t)scanSize * nCol;
+	size_t scanOut = (size_t)4 * scanSize * nCol;
+	int twice = (task->new2LatF != NULL);
 
-			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
-			delta = 2 * atan2(sqrt(a), sqrt(1-a));
+	/* The second upscaling has twice the columns, the step buffers are sized for it */
+	double * step1Lat;
+	double * step1Lon;
+	double * scanLat;
+	double * scanLon;
+	double * inLat = NULL;
+	double * inLon = NULL;
+	double * scan2Lat = NULL;
+	double * scan2Lon = NULL;
+
+	if(NULL == (step1Lat = (double *)malloc(sizeof(double) * 2 * scanSize * nCol * (twice ? 2 : 1))) ||
+	   NULL == (step1Lon = (double *)malloc(sizeof(double) * 2 * scanSize * nCol * (twice ? 2 : 1))) ||
+	   NULL == (scanLat = (double *)malloc(sizeof(double) * scanOut)) ||
+	   NULL == (scanLon = (double *)malloc(sizeof(double) * scanOut)) ||
+	   (task->oriLatF != NULL && (NULL == (inLat = (double *)malloc(sizeof(double) * scanIn)) ||
+	                              NULL == (inLon = (double *)malloc(sizeof(double) * scanIn)))) ||
+	   (twice && (NULL == (scan2Lat = (double *)malloc(sizeof(double) * 2 * scanOut)) ||
+	              NULL == (scan2Lon = (double *)malloc(sizeof(double) * 2 * scanOut))))) {
+		printf("Out of memeory for the scan buffers\n");
+		exit(1);
+	}
 
-			a = sin((1-f) * delta) / sin(delta);
-			b = sin(f * delta) / sin(delta);
+	for(int k = task->thread * scanSize; k < task->nRow; k += task->nThreads * scanSize) {
 
-			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
-			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
-			z = a * sin(phi1) + b * sin(phi2);
+		const double * oriLat;
+		const double * oriLon;
+		size_t offset = (size_t)k * 4 * nCol;
 
-			phi3 = atan2(z, sqrt(x * x + y * y));
-			lambda3 = atan2(y, x);
+		if(task->oriLatF != NULL) {
+			for(size_t n = 0; n < scanIn; n++) {
+				inLat[n] = (double)task->oriLatF[(size_t)k * nCol + n];
+				inLon[n] = (double)task->oriLonF[(size_t)k * nCol + n];
+			}
+			oriLat = inLat;
+			oriLon = inLon;
+		}
+		else {
+			oriLat = task->oriLat + (size_t)k * nCol;
+			oriLon = task->oriLon + (size_t)k * nCol;
+		}
 
-			newLat[(2 * i + 1) * 2 * nCol + j] = phi3;
-			newLon[(2 * i + 1) * 2 * nCol + j] = lambda3;
+		upscaleScan(oriLat, oriLon, nCol, scanSize, task->spherical, step1Lat, step1Lon, scanLat, scanLon);
+
+		for(size_t n = 0; n < scanOut; n++) {
+			if(task->newLat != NULL) {
+				task->newLat[offset + n] = scanLat[n];
+				task->newLon[offset + n] = scanLon[n];
+			}
+			if(task->newLatF != NULL) {
+				task->newLatF[offset + n] = (float)scanLat[n];
+				task->newLonF[offset + n] = (float)scanLon[n];
+			}
 		}
-	}
 
-/*
-	for(i = 0; i < nRow; i++) {
-		for(j = 0; j < 2 * nCol; j++) {
-			printf("%lf,%lf\n", step1Lat[i * 2 * nCol + j], step1Lon[i * 2 * nCol + j]);
+		/* The 2 * scanSize finer rows are 2 scans of the second upscaling */
+		for(int h = 0; twice && h < 2; h++) {
+			size_t offset2 = (size_t)(2 * k + h * scanSize) * 2 * 4 * nCol;
+			upscaleScan(scanLat + (size_t)h * scanSize * 2 * nCol, scanLon + (size_t)h * scanSize * 2 * nCol, 2 * nCol,
+			            scanSize, task->spherical, step1Lat, step1Lon, scan2Lat, scan2Lon);
+			for(size_t n = 0; n < 2 * scanOut; n++) {
+				task->new2LatF[offset2 + n] = (float)scan2Lat[n];
+				task->new2LonF[offset2 + n] = (float)scan2Lon[n];
+			}
 		}
 	}
-*/
 
-	// Convert newLat and newLon to degrees
-	for(i = 0; i < 2 * nRow; i++) {
-		for(j = 0; j < 2 * nCol; j++) {
-			newLat[i * 2 * nCol + j] = newLat[i * 2 * nCol + j] * 180 / M_PI;			
-			newLon[i * 2 * nCol + j] = newLon[i * 2 * nCol + j] * 180 / M_PI;
+	free(step1Lat);
+	free(step1Lon);
+	free(scanLat);
+	free(scanLon);
+	free(inLat);
+	free(inLon);
+	free(scan2Lat);
+	free(scan2Lon);
+
+	return NULL;
+}
+
+static void upscaleLatLon(const double * oriLat, const double * oriLon, const float * oriLatF, const float * oriLonF,
+                          int nRow, int nCol, int scanSize, int spherical, double * newLat, double * newLon,
+                          float * newLatF, float * newLonF, float * new2LatF, float * new2LonF, int nThreads) {
+
+	if(0 != nRow % scanSize) {
+		printf("nRows:%d is not a multiple of scanSize: %d\n", nRow, scanSize);
+		exit(1);
+	}
+
+	int nScans = nRow / scanSize;
+	if(nThreads > nScans)
+		nThreads = nScans;
+	if(nThreads < 1)
+		nThreads = 1;
+
+	upscaleTask * tasks;
+	pthread_t * threads;
+	if(NULL == (tasks = (upscaleTask *)malloc(sizeof(upscaleTask) * nThreads)) ||
+	   NULL == (threads = (pthread_t *)malloc(sizeof(pthread_t) * nThreads))) {
+		printf("Out of memeory for the interpolation threads\n");
+		exit(1);
+	}
+
+	for(int t = 0; t < nThreads; t++) {
+		upscaleTask task = {oriLat, oriLon, oriLatF, oriLonF, nRow, nCol, scanSize, spherical, newLat, newLon,
+		                    newLatF, newLonF, new2LatF, new2LonF, nThreads, t};
+		tasks[t] = task;
+	}
+
+	// The calling thread takes the first share. If a thread cannot be started, its share is done here as well.
+	for(int t = 1; t < nThreads; t++) {
+		if(0 != pthread_create(&threads[t], NULL, upscaleScans, &tasks[t])) {
+			upscaleScans(&tasks[t]);
+			tasks[t].nThreads = 0;
 		}
 	}
+	upscaleScans(&tasks[0]);
+	for(int t = 1; t < nThreads; t++) {
+		if(tasks[t].nThreads != 0)
+			pthread_join(threads[t], NULL);
+	}
 
-	free(oLat);
-	free(oLon);
-	free(step1Lat);
-	free(step1Lon);	
+	free(tasks);
+	free(threads);
+}
 
-	
-	return;
+/**
+ * NAME:	upscaleLatLonPlanar
+ * DESCRIPTION:	calculate the latitude and longitude of MODIS cell centers at finner resolution based on coarser resolution cell locations, using a planer cooridnate system
+ * PARAMETERS:
+ * 	double * oriLat:	the latitudes of input cells at coarser resolution
+ * 	double * oriLon:	the longitudes of input cells at coarser resolution
+ * 	int nRow:		the number of rows of input raster
+ * 	int nRol:		the number of columns of input raster
+ * 	int scanSize:		the number of cells in a scan
+ * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * Output:
+ * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ */
 
+void upscaleLatLonPlanar(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon) {
+	upscaleLatLon(oriLat, oriLon, NULL, NULL, nRow, nCol, scanSize, 0, newLat, newLon, NULL, NULL, NULL, NULL, 1);
+}
 
+/**
+ * NAME:	upscaleLatLonSpherical
+ * DESCRIPTION:	calculate the latitude and longitude of MODIS cell centers at finner resolution based on coarser resolution cell locations, using a planer cooridnate system
+ * PARAMETERS:
+ * 	double * oriLat:	the latitudes of input cells at coarser resolution
+ * 	double * oriLon:	the longitudes of input cells at coarser resolution
+ * 	int nRow:		the number of rows of input raster
+ * 	int nRol:		the number of columns of input raster
+ * 	int scanSize:		the number of cells in a scan
+ * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * Output:
+ * 	double * newLat:	the latitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ * 	double * newLon:	the longitudes of output cells at finer resolution (the number of rows and columns will be doubled)
+ */
 
+void upscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon) {
+	upscaleLatLon(oriLat, oriLon, NULL, NULL, nRow, nCol, scanSize, 1, newLat, newLon, NULL, NULL, NULL, NULL, 1);
+}
+
+/**
+ * NAME:	upscaleLatLonPlanarTiled, upscaleLatLonSphericalTiled
+ * DESCRIPTION:	the same as upscaleLatLonPlanar and upscaleLatLonSpherical, with the scans spread over
+ * 		nThreads threads and an optional float output
+ * PARAMETERS:
+ * 	double * newLat, newLon:	the double output, or NULL
+ * 	float * newLatF, newLonF:	the float output, or NULL
+ * 	int nThreads:			the number of threads (including the calling one)
+ * 	others:				see upscaleLatLonPlanar
+ */
+
+void upscaleLatLonPlanarTiled(const double * oriLat, const double * oriLon, int nRow, int nCol, int scanSize,
+                              double * newLat, double * newLon, float * newLatF, float * newLonF, int nThreads) {
+	upscaleLatLon(oriLat, oriLon, NULL, NULL, nRow, nCol, scanSize, 0, newLat, newLon, newLatF, newLonF, NULL, NULL, nThreads);
 }
 
+void upscaleLatLonSphericalTiled(const double * oriLat, const double * oriLon, int nRow, int nCol, int scanSize,
+                                 double * newLat, double * newLon, float * newLatF, float * newLonF, int nThreads) {
+	upscaleLatLon(oriLat, oriLon, NULL, NULL, nRow, nCol, scanSize, 1, newLat, newLon, newLatF, newLonF, NULL, NULL, nThreads);
+}
+
+/**
+ * NAME:	upscaleLatLonSphericalFloat
+ * DESCRIPTION:	the same as upscaleLatLonSphericalTiled for float input and output, with an optional
+ * 		second upscaling of the result (e.g. 1km to 500m and 250m). The values are the ones of
+ * 		upscaleLatLonSpherical on the input converted to double, upscaled twice in double and
+ * 		rounded to float.
+ * PARAMETERS:
+ * 	float * oriLat, oriLon:		the latitudes and longitudes of input cells at coarser resolution
+ * 	int nRow, nCol, scanSize:	see upscaleLatLonSpherical
+ * 	float * newLat, newLon:		the output at 2 times the resolution (2 * nRow by 2 * nCol)
+ * 	float * new2Lat, new2Lon:	the output at 4 times the resolution (4 * nRow by 4 * nCol), or NULL
+ * 	int nThreads:			the number of threads (including the calling one)
+ */
+
+void upscaleLatLonSphericalFloat(const float * oriLat, const float * oriLon, int nRow, int nCol, int scanSize,
+                                 float * newLat, float * newLon, float * new2Lat, float * new2Lon, int nThreads) {
+	upscaleLatLon(NULL, NULL, oriLat, oriLon, nRow, nCol, scanSize, 1, NULL, NULL, newLat, newLon, new2Lat, new2Lon, nThreads);
+}
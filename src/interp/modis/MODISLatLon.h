@@ -2,4 +2,7 @@
 #define MLLH
 void upscaleLatLonPlanar(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon);
 void upscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon);
+void upscaleLatLonPlanarTiled(const double * oriLat, const double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon, float * newLatF, float * newLonF, int nThreads);
+void upscaleLatLonSphericalTiled(const double * oriLat, const double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon, float * newLatF, float * newLonF, int nThreads);
+void upscaleLatLonSphericalFloat(const float * oriLat, const float * oriLon, int nRow, int nCol, int scanSize, float * newLat, float * newLon, float * new2Lat, float * new2Lon, int nThreads);
 #endif
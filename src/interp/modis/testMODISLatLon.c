@@ -1,7 +1,261 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "MODISLatLon.h"
 
+#ifndef M_PI
+#    define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * NAME:	referenceUpscaleLatLonSpherical
+ * DESCRIPTION:	copy of the original full granule upscaleLatLonSpherical (double step1 and radian buffers), kept as the reference for the per-scan version
+ */
+static void referenceUpscaleLatLonSpherical(double * oriLat, double * oriLon, int nRow, int nCol, int scanSize, double * newLat, double * newLon) {
+
+	if(0 != nRow % scanSize) {
+		printf("nRows:%d is not a multiple of scanSize: %d\n", nRow, scanSize);
+		exit(1);
+	}
+
+	double * step1Lat;
+	double * step1Lon;
+
+	if(NULL == (step1Lat = (double *)malloc(sizeof(double) * 2 * nRow * nCol))) {
+		printf("Out of memeory for step1Lat\n");
+		exit(1);
+	}
+
+	if(NULL == (step1Lon = (double *)malloc(sizeof(double) * 2 * nRow * nCol))) {
+		printf("Out of memeory for step1Lon\n");
+		exit(1);
+	}
+
+	int i, j;
+
+	double * oLat;
+	double * oLon;
+	if(NULL == (oLat = (double *)malloc(sizeof(double) * nRow * nCol))) {
+		printf("Out of memeory for oLat\n");
+		exit(1);
+	}
+
+	if(NULL == (oLon = (double *)malloc(sizeof(double) * nRow * nCol))) {
+		printf("Out of memeory for oLon\n");
+		exit(1);
+	}
+
+
+	// Convert oriLat and oriLon to radians
+	for(i = 0; i < nRow; i++) {
+		for(j = 0; j < nCol; j++) {
+			oLat[i * nCol + j] = oriLat[i * nCol + j] * M_PI / 180; 
+			oLon[i * nCol + j] = oriLon[i * nCol + j] * M_PI / 180; 
+		}
+	}
+
+	double phi1, phi2, phi3, lambda1, lambda2, lambda3, bX, bY;
+	double dPhi, dLambda;
+	double a, b, x, y, z, f, delta;
+	double f1, f2;
+
+
+	// First step for bilinear interpolation
+	f = 1.5;
+	for(i = 0; i < nRow; i++) {
+		for(j = 0; j < nCol; j++) {
+
+			step1Lat[i * 2 * nCol + 2 * j] = oLat[i * nCol + j];
+			step1Lon[i * 2 * nCol + 2 * j] = oLon[i * nCol + j];
+
+			if(j == nCol - 1) {
+	
+				phi1 = oLat[i * nCol + j - 1];
+				phi2 = oLat[i * nCol + j];
+				lambda1 = oLon[i * nCol + j - 1];
+				lambda2 = oLon[i * nCol + j];
+
+				dPhi = (phi2 - phi1);
+				dLambda = (lambda2 - lambda1);
+
+				a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+				delta = 2 * atan2(sqrt(a), sqrt(1-a));
+
+				a = sin((1-f) * delta) / sin(delta);
+				b = sin(f * delta) / sin(delta);
+
+				x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+				y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+				z = a * sin(phi1) + b * sin(phi2);
+
+				phi3 = atan2(z, sqrt(x * x + y * y));
+				lambda3 = atan2(y, x);
+
+				step1Lat[i * 2 * nCol + 2 * j + 1] = phi3;
+				step1Lon[i * 2 * nCol + 2 * j + 1] = lambda3;
+			}
+
+			else {
+
+				phi1 = oLat[i * nCol + j];
+				phi2 = oLat[i * nCol + j + 1];
+				lambda1 = oLon[i * nCol + j];
+				lambda2 = oLon[i * nCol + j + 1];
+
+				bX = cos(phi2) * cos(lambda2 - lambda1);
+				bY = cos(phi2) * sin(lambda2 - lambda1);
+
+				phi3 = atan2(sin(phi1) + sin(phi2), sqrt((cos(phi1) + bX) * (cos(phi1) + bX) + bY * bY));
+				step1Lat[i * 2 * nCol + 2 * j + 1] = phi3;
+
+				lambda3 = lambda1 + atan2(bY, cos(phi1) + bX) + 3 * M_PI;
+				lambda3 = lambda3 - (int)(lambda3 / (2 * M_PI)) * 2 * M_PI - M_PI;
+
+				step1Lon[i * 2 * nCol + 2 * j + 1] = lambda3;	
+			}
+		}
+	}	
+
+	// Second step for bilinear interpolation
+	f = 1.25;
+	f1 = 0.25;
+	f2 = 0.75;
+
+	int k = 0;
+	for(k = 0; k < nRow; k += scanSize) {
+
+		//  Processing the first row in a scan
+		i = k;
+		for(j = 0; j < 2 * nCol; j++) {
+			phi1 = step1Lat[(i + 1) * 2 * nCol + j];
+			phi2 = step1Lat[i * 2 * nCol + j];
+			lambda1 = step1Lon[(i + 1) * 2 * nCol + j];
+			lambda2 = step1Lon[i * 2 * nCol + j];
+	
+			dPhi = (phi2 - phi1);
+			dLambda = (lambda2 - lambda1);
+
+			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+			delta = 2 * atan2(sqrt(a), sqrt(1-a));
+	
+			a = sin((1-f) * delta) / sin(delta);
+			b = sin(f * delta) / sin(delta);
+
+			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+			z = a * sin(phi1) + b * sin(phi2);
+
+			phi3 = atan2(z, sqrt(x * x + y * y));
+			lambda3 = atan2(y, x);
+
+			newLat[(i * 2) * 2 * nCol + j] = phi3;
+			newLon[(i * 2) * 2 * nCol + j] = lambda3;
+		}
+
+		//  Processing intermediate rows in a scan
+		for(i = k; i < k + scanSize - 1; i ++) {
+			for(j = 0; j < 2 * nCol; j++) {
+				
+				phi1 = step1Lat[i * 2 * nCol + j];
+				phi2 = step1Lat[(i + 1) * 2 * nCol + j];
+				lambda1 = step1Lon[i * 2 * nCol + j];
+				lambda2 = step1Lon[(i + 1) * 2 * nCol + j];
+			
+				dPhi = (phi2 - phi1);
+				dLambda = (lambda2 - lambda1);
+
+				a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+				delta = 2 * atan2(sqrt(a), sqrt(1-a));
+
+				//Interpolate the first intermediate point
+				a = sin((1-f1) * delta) / sin(delta);
+				b = sin(f1 * delta) / sin(delta);
+			
+				x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+				y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+				z = a * sin(phi1) + b * sin(phi2);
+
+				phi3 = atan2(z, sqrt(x * x + y * y));
+				lambda3 = atan2(y, x);
+
+				newLat[(i * 2 + 1) * 2 * nCol + j] = phi3;
+				newLon[(i * 2 + 1) * 2 * nCol + j] = lambda3;
+
+				//Interpolate the second intermediate point
+				a = sin((1-f2) * delta) / sin(delta);
+				b = sin(f2 * delta) / sin(delta);
+
+				x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+				y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+				z = a * sin(phi1) + b * sin(phi2);
+	
+				phi3 = atan2(z, sqrt(x * x + y * y));
+				lambda3 = atan2(y, x);
+
+				newLat[(i * 2 + 2) * 2 * nCol + j] = phi3;
+				newLon[(i * 2 + 2) * 2 * nCol + j] = lambda3;
+			}
+		}
+
+		//  Processing the last row in a scan
+		i = k + scanSize - 1;
+		for(j = 0; j < 2 * nCol; j++) {
+			phi1 = step1Lat[(i - 1) * 2 * nCol + j];
+			phi2 = step1Lat[i * 2 * nCol + j];
+			lambda1 = step1Lon[(i - 1) * 2 * nCol + j];
+			lambda2 = step1Lon[i * 2 * nCol + j];
+
+			dPhi = (phi2 - phi1);
+			dLambda = (lambda2 - lambda1);
+
+			a = sin(dPhi/2) * sin(dPhi/2) + cos(phi1) * cos(phi2) * sin(dLambda/2) * sin(dLambda/2);
+			delta = 2 * atan2(sqrt(a), sqrt(1-a));
+
+			a = sin((1-f) * delta) / sin(delta);
+			b = sin(f * delta) / sin(delta);
+
+			x = a * cos(phi1) * cos(lambda1) + b * cos(phi2) * cos(lambda2);
+			y = a * cos(phi1) * sin(lambda1) + b * cos(phi2) * sin(lambda2);
+			z = a * sin(phi1) + b * sin(phi2);
+
+			phi3 = atan2(z, sqrt(x * x + y * y));
+			lambda3 = atan2(y, x);
+
+			newLat[(2 * i + 1) * 2 * nCol + j] = phi3;
+			newLon[(2 * i + 1) * 2 * nCol + j] = lambda3;
+		}
+	}
+
+/*
+	for(i = 0; i < nRow; i++) {
+		for(j = 0; j < 2 * nCol; j++) {
+			printf("%lf,%lf\n", step1Lat[i * 2 * nCol + j], step1Lon[i * 2 * nCol + j]);
+		}
+	}
+*/
+
+	// Convert newLat and newLon to degrees
+	for(i = 0; i < 2 * nRow; i++) {
+		for(j = 0; j < 2 * nCol; j++) {
+			newLat[i * 2 * nCol + j] = newLat[i * 2 * nCol + j] * 180 / M_PI;			
+			newLon[i * 2 * nCol + j] = newLon[i * 2 * nCol + j] * 180 / M_PI;
+		}
+	}
+
+	free(oLat);
+	free(oLon);
+	free(step1Lat);
+	free(step1Lon);	
+
+	
+	return;
+
+
+
+}
+
+
+
 int main(int argc, char ** argv) {
 
 	int nRow = 2030;
@@ -34,33 +288,127 @@ int main(int argc, char ** argv) {
 		exit(1);
 	}
 
-	char * fileName = "MODIS1630.csv";
-	FILE * input;
+	// Synthetic 1km swath: a descending pass from 85N to 85S whose scans overlap (bow-tie)
+	// and whose longitudes cross the antimeridian
+	for(int i = 0; i < nRow; i++) {
+		for(int j = 0; j < nCol; j++) {
+			double along = (i / scanSize) * (double)scanSize * 0.9 + (i % scanSize);
+			double across = (j - nCol / 2) / (double)nCol;
+			oriLat[i * nCol + j] = 85.0 - along * 170.0 / nRow + 2.0 * across * across;
+			oriLon[i * nCol + j] = fmod(170.0 + 40.0 * across + 0.01 * i + 540.0, 360.0) - 180.0;
+		}
+	}
 
-	if(NULL == (input = fopen(fileName, "r"))) {
-		printf("Cannot read input file\n");
+	int i = 0;
+
+	// The per-scan version must give the values of the original full granule version
+	{
+		double * refLat;
+		double * refLon;
+
+		if(NULL == (refLat = (double *)malloc(sizeof(double) * 4 * nRow * nCol)) ||
+		   NULL == (refLon = (double *)malloc(sizeof(double) * 4 * nRow * nCol))) {
+			printf("Out of memeory for the reference output\n");
+			exit(1);
+		}
+
+		referenceUpscaleLatLonSpherical(oriLat, oriLon, nRow, nCol, scanSize, refLat, refLon);
+		upscaleLatLonSpherical(oriLat, oriLon, nRow, nCol, scanSize, newLat, newLon);
+		for(i = 0; i < 4 * nRow * nCol; i++) {
+			if(refLat[i] != newLat[i] || refLon[i] != newLon[i]) {
+				printf("Output differs from the original algorithm at %d\n", i);
+				exit(1);
+			}
+		}
+
+		free(refLat);
+		free(refLon);
+	}
+
+	// The tiled version must give the same values with any number of threads, and the float output must be the rounded double output
+	float * newLatF;
+	float * newLonF;
+	double * tiledLat;
+	double * tiledLon;
+
+	if(NULL == (newLatF = (float *)malloc(sizeof(float) * 4 * nRow * nCol)) ||
+	   NULL == (newLonF = (float *)malloc(sizeof(float) * 4 * nRow * nCol)) ||
+	   NULL == (tiledLat = (double *)malloc(sizeof(double) * 4 * nRow * nCol)) ||
+	   NULL == (tiledLon = (double *)malloc(sizeof(double) * 4 * nRow * nCol))) {
+		printf("Out of memeory for the tiled output\n");
 		exit(1);
 	}
 
-	for(int i = 0; i < nRow; i++) {
-		for(int j = 0; j < nCol; j++) {
-			fscanf(input, "%lf,%lf\n", oriLat + i * nCol + j, oriLon + i * nCol + j);
+	upscaleLatLonSphericalTiled(oriLat, oriLon, nRow, nCol, scanSize, tiledLat, tiledLon, newLatF, newLonF, 4);
+	for(i = 0; i < 4 * nRow * nCol; i++) {
+		if(tiledLat[i] != newLat[i] || tiledLon[i] != newLon[i] || newLatF[i] != (float)newLat[i] || newLonF[i] != (float)newLon[i]) {
+			printf("Tiled output differs at %d\n", i);
+			exit(1);
 		}
 	}
 
-//	upscaleLatLonPlanar(oriLat, oriLon, nRow, nCol, scanSize, newLat, newLon);
-	upscaleLatLonSpherical(oriLat, oriLon, nRow, nCol, scanSize, newLat, newLon);
+	free(newLatF);
+	free(newLonF);
+	free(tiledLat);
+	free(tiledLon);
 
-	int i = 0;
-	int j = 0;
-	for(i = 0; i < 2 * nRow; i++) {
-		for(j = 0; j < 2 * nCol; j++) {
-			printf("%lf,%lf\n", newLat[i * 2 * nCol + j], newLon[i * 2 * nCol + j]);
+	// The float version must give the float rounded values of upscaling the float input twice in double
+	{
+		float * oriLatF;
+		float * oriLonF;
+		float * lat2F;
+		float * lon2F;
+		double * refLat2;
+		double * refLon2;
+
+		if(NULL == (oriLatF = (float *)malloc(sizeof(float) * nRow * nCol)) ||
+		   NULL == (oriLonF = (float *)malloc(sizeof(float) * nRow * nCol)) ||
+		   NULL == (newLatF = (float *)malloc(sizeof(float) * 4 * nRow * nCol)) ||
+		   NULL == (newLonF = (float *)malloc(sizeof(float) * 4 * nRow * nCol)) ||
+		   NULL == (lat2F = (float *)malloc(sizeof(float) * 16 * nRow * nCol)) ||
+		   NULL == (lon2F = (float *)malloc(sizeof(float) * 16 * nRow * nCol)) ||
+		   NULL == (tiledLat = (double *)malloc(sizeof(double) * 4 * nRow * nCol)) ||
+		   NULL == (tiledLon = (double *)malloc(sizeof(double) * 4 * nRow * nCol)) ||
+		   NULL == (refLat2 = (double *)malloc(sizeof(double) * 16 * nRow * nCol)) ||
+		   NULL == (refLon2 = (double *)malloc(sizeof(double) * 16 * nRow * nCol))) {
+			printf("Out of memeory for the float output\n");
+			exit(1);
 		}
-	}
 
+		for(i = 0; i < nRow * nCol; i++) {
+			oriLatF[i] = (float)oriLat[i];
+			oriLonF[i] = (float)oriLon[i];
+			oriLat[i] = (double)oriLatF[i];
+			oriLon[i] = (double)oriLonF[i];
+		}
+		upscaleLatLonSpherical(oriLat, oriLon, nRow, nCol, scanSize, tiledLat, tiledLon);
+		upscaleLatLonSpherical(tiledLat, tiledLon, 2 * nRow, 2 * nCol, scanSize, refLat2, refLon2);
 
-	fclose(input);
+		upscaleLatLonSphericalFloat(oriLatF, oriLonF, nRow, nCol, scanSize, newLatF, newLonF, lat2F, lon2F, 4);
+		for(i = 0; i < 4 * nRow * nCol; i++) {
+			if(newLatF[i] != (float)tiledLat[i] || newLonF[i] != (float)tiledLon[i]) {
+				printf("Float output differs at %d\n", i);
+				exit(1);
+			}
+		}
+		for(i = 0; i < 16 * nRow * nCol; i++) {
+			if(lat2F[i] != (float)refLat2[i] || lon2F[i] != (float)refLon2[i]) {
+				printf("Float second upscaling differs at %d\n", i);
+				exit(1);
+			}
+		}
+
+		free(oriLatF);
+		free(oriLonF);
+		free(newLatF);
+		free(newLonF);
+		free(lat2F);
+		free(lon2F);
+		free(tiledLat);
+		free(tiledLon);
+		free(refLat2);
+		free(refLon2);
+	}
 
 	free(oriLat);
 	free(oriLon);
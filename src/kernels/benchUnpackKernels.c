@@ -0,0 +1,108 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "unpackKernels.h"
+
+/*
+ * Micro-benchmark of the unpack kernels against the scalar loops.
+ * The default size is one ASTER VNIR band (4200 x 4980).
+ * Usage: benchUnpackKernels [nElems] [repeats]
+ */
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void report(const char * what, double scalar, double kernel, size_t n) {
+	printf("%-14s scalar %8.2f ms  %-6s %8.2f ms  speedup %5.2fx  (%.0f Melem/s)\n", what, scalar * 1e3,
+	       unpackKernelName(), kernel * 1e3, scalar / kernel, n / kernel * 1e-6);
+}
+
+int main(int argc, char ** argv) {
+
+	size_t n = 4200 * 4980;
+	int repeats = 10;
+	double t0, scalar, kernel;
+	float checksum = 0;
+
+	if(argc > 1)
+		n = (size_t)strtoul(argv[1], NULL, 10);
+	if(argc > 2)
+		repeats = atoi(argv[2]);
+
+	unsigned char * dn8 = (unsigned char *)malloc(n);
+	unsigned short * dn16 = (unsigned short *)malloc(sizeof(unsigned short) * n);
+	unsigned int * laPos = (unsigned int *)malloc(sizeof(unsigned int) * n);
+	float * out = (float *)malloc(sizeof(float) * n);
+	if(dn8 == NULL || dn16 == NULL || laPos == NULL || out == NULL) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	srand(1);
+	for(size_t i = 0; i < n; i++) {
+		dn8[i] = (unsigned char)(rand() & 0xff);
+		dn16[i] = (unsigned short)(rand() & 0xffff);
+	}
+
+	/* ASTER VNIR/SWIR */
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		unpackASTERUint8Scalar(dn8, out, n, 1.688f);
+	scalar = (now() - t0) / repeats;
+	checksum += out[n / 2];
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		unpackASTERUint8(dn8, out, n, 1.688f);
+	kernel = (now() - t0) / repeats;
+	checksum += out[n / 2];
+	report("ASTER uint8", scalar, kernel, n);
+
+	/* ASTER TIR */
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		unpackASTERUint16Scalar(dn16, out, n, 0.006822f);
+	scalar = (now() - t0) / repeats;
+	checksum += out[n / 2];
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		unpackASTERUint16(dn16, out, n, 0.006822f);
+	kernel = (now() - t0) / repeats;
+	checksum += out[n / 2];
+	report("ASTER uint16", scalar, kernel, n);
+
+	/* MODIS */
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		unpackUint16RadianceScalar(dn16, out, n, 0.0264617f, 8.3877f);
+	scalar = (now() - t0) / repeats;
+	checksum += out[n / 2];
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		unpackUint16Radiance(dn16, out, n, 0.0264617f, 8.3877f);
+	kernel = (now() - t0) / repeats;
+	checksum += out[n / 2];
+	report("MODIS", scalar, kernel, n);
+
+	/* MISR */
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		checksum += unpackMISRRadianceScalar(dn16, out, n, 0.047203f, 0, laPos);
+	scalar = (now() - t0) / repeats;
+	t0 = now();
+	for(int r = 0; r < repeats; r++)
+		checksum += unpackMISRRadiance(dn16, out, n, 0.047203f, 0, laPos);
+	kernel = (now() - t0) / repeats;
+	report("MISR", scalar, kernel, n);
+
+	printf("checksum %g\n", checksum);
+
+	free(dn8);
+	free(dn16);
+	free(laPos);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unpackKernels.h"
+
+/* The MODIS radiance loop of readThenWrite_MODIS_Unpack before the kernels */
+static void referenceLoop(const unsigned short * in, float * out, size_t n, float scale, float offset) {
+	unsigned short special_values_start = 65535;
+	unsigned short special_values_stop = 65500;
+	float special_values_packed_start = -999.0;
+	float temp_scale_offset = scale * offset;
+
+	for(size_t j = 0; j < n; j++) {
+		if((in[j] <= special_values_start) && (in[j] >= special_values_stop))
+			out[j] = special_values_packed_start + (special_values_start - in[j]);
+		else
+			out[j] = scale * in[j] - temp_scale_offset;
+	}
+}
+
+/* The ASTER loops of readThenWrite_ASTER_Unpack before the kernels */
+static void referenceASTER8(const unsigned char * in, float * out, size_t n, float unc) {
+	for(size_t i = 0; i < n; i++) {
+		if(in[i] == 0)
+			out[i] = -999;
+		else if(in[i] == 1)
+			out[i] = 0;
+		else if(in[i] == 255)
+			out[i] = -998;
+		else
+			out[i] = (float)((in[i] - 1)) * unc;
+	}
+}
+
+static void referenceASTER16(const unsigned short * in, float * out, size_t n, float unc) {
+	for(size_t i = 0; i < n; i++) {
+		if(in[i] == 0)
+			out[i] = -999;
+		else if(in[i] == 1)
+			out[i] = 0;
+		else if(in[i] == 4095)
+			out[i] = -998;
+		else
+			out[i] = (float)((in[i] - 1)) * unc;
+	}
+}
+
+/* The CERES geolocation conversion of readThenWriteSubset before the kernels */
+static void referenceLatitude(const float * in, float * out, size_t n) {
+	for(size_t i = 0; i < n; i++)
+		out[i] = (float)(90.0f - in[i]);
+}
+
+static void referenceLongitude(const float * in, float * out, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		out[i] = in[i];
+		if(out[i] > 180.0f)
+			out[i] = out[i] - 360.0f;
+	}
+}
+
+static int compare(const char * what, const float * expected, const float * result, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		if(memcmp(expected + i, result + i, sizeof(float)) != 0) {
+			printf("%s: element %zu differs, %.9g instead of %.9g\n", what, i, result[i], expected[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* The MISR loop of readThenWrite_MISR_Unpack before the kernels */
+static size_t referenceMISR(const unsigned short * in, float * out, size_t n, float scale_factor, unsigned int firstPos, unsigned int * la_data_pos) {
+	unsigned short rdqi = 0;
+	unsigned short rdqi_mask = 3;
+	unsigned short temp_input_val;
+	size_t num_la_data = 0;
+
+	for(size_t i = 0; i < n; i++) {
+		rdqi = in[i] & rdqi_mask;
+		if(rdqi == 2 || rdqi == 3)
+			out[i] = -999.0;
+		else {
+			if(rdqi == 1)
+				la_data_pos[num_la_data++] = firstPos + (unsigned int)i;
+			temp_input_val = in[i] >> 2;
+			if(temp_input_val == 16378 || temp_input_val == 16380)
+				out[i] = -999.0;
+			else
+				out[i] = scale_factor * ((float)temp_input_val);
+		}
+	}
+	return num_la_data;
+}
+
+static int comparePositions(const char * what, const unsigned int * expected, size_t nExpected, const unsigned int * result, size_t nResult) {
+	if(nExpected != nResult) {
+		printf("%s: %zu low accuracy positions instead of %zu\n", what, nResult, nExpected);
+		return 1;
+	}
+	if(nExpected > 0 && memcmp(expected, result, sizeof(unsigned int) * nExpected) != 0) {
+		printf("%s: low accuracy positions differ\n", what);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+
+	/* Scales and offsets of MODIS 1km reflective and emissive bands, and some odd ones */
+	float scales[] = {0.0264617f, 0.0006335f, 1.0f, 3.3e-7f, 123.456f};
+	float offsets[] = {316.9722f, 2730.5835f, 0.0f, -17.5f, 65535.0f};
+	int nScales = sizeof(scales) / sizeof(scales[0]);
+	size_t n = 65536 + 13;
+	int failed = 0;
+
+	unsigned short * in;
+	float * expected;
+	float * result;
+
+	if(NULL == (in = (unsigned short *)malloc(sizeof(unsigned short) * n)) ||
+	   NULL == (expected = (float *)malloc(sizeof(float) * n)) ||
+	   NULL == (result = (float *)malloc(sizeof(float) * n))) {
+		printf("Out of memory\n");
+		exit(1);
+	}
+
+	/* every possible value, then a few special values for the scalar tail */
+	for(size_t i = 0; i < n; i++)
+		in[i] = (unsigned short)(i < 65536 ? i : 65535 - (i - 65536));
+
+	printf("Kernel: %s\n", unpackKernelName());
+
+	for(int s = 0; s < nScales; s++) {
+		referenceLoop(in, expected, n, scales[s], offsets[s]);
+
+		unpackUint16RadianceScalar(in, result, n, scales[s], scales[s] * offsets[s]);
+		failed |= compare("scalar", expected, result, n);
+
+		/* all lengths and alignments up to two vectors */
+		for(size_t start = 0; start < 17; start++) {
+			for(size_t len = 0; len < 40; len++) {
+				memset(result, 0, sizeof(float) * n);
+				unpackUint16Radiance(in + 65490 + start, result, len, scales[s], scales[s] * offsets[s]);
+				failed |= compare("tail", expected + 65490 + start, result, len);
+			}
+		}
+
+		unpackUint16Radiance(in, result, n, scales[s], scales[s] * offsets[s]);
+		failed |= compare(unpackKernelName(), expected, result, n);
+	}
+
+	{
+		float misrScales[] = {0.047203f, 0.0354856f, 1.0f};
+		unsigned int * expectedPos;
+		unsigned int * resultPos;
+		if(NULL == (expectedPos = (unsigned int *)malloc(sizeof(unsigned int) * n)) ||
+		   NULL == (resultPos = (unsigned int *)malloc(sizeof(unsigned int) * n))) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+		for(int s = 0; s < 3; s++) {
+			size_t nExpected = referenceMISR(in, expected, n, misrScales[s], 1000, expectedPos);
+			size_t nResult = unpackMISRRadianceScalar(in, result, n, misrScales[s], 1000, resultPos);
+			failed |= compare("MISR scalar", expected, result, n);
+			failed |= comparePositions("MISR scalar", expectedPos, nExpected, resultPos, nResult);
+
+			for(size_t start = 0; start < 17; start++) {
+				for(size_t len = 0; len < 40; len++) {
+					nExpected = referenceMISR(in + 65490 + start, expected, len, misrScales[s], 7, expectedPos);
+					nResult = unpackMISRRadiance(in + 65490 + start, result, len, misrScales[s], 7, resultPos);
+					failed |= compare("MISR tail", expected, result, len);
+					failed |= comparePositions("MISR tail", expectedPos, nExpected, resultPos, nResult);
+				}
+			}
+
+			nExpected = referenceMISR(in, expected, n, misrScales[s], 1000, expectedPos);
+			nResult = unpackMISRRadiance(in, result, n, misrScales[s], 1000, resultPos);
+			failed |= compare("MISR", expected, result, n);
+			failed |= comparePositions("MISR", expectedPos, nExpected, resultPos, nResult);
+		}
+		free(expectedPos);
+		free(resultPos);
+	}
+
+	{
+		/* unit conversion coefficients of VNIR, SWIR and TIR bands, and a negative one */
+		float uncs[] = {1.688f, 0.2174f, 0.006822f, -0.5f};
+		unsigned char * bytes;
+		if(NULL == (bytes = (unsigned char *)malloc(n))) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+		for(size_t i = 0; i < n; i++)
+			bytes[i] = (unsigned char)(i < 65536 ? i : 255 - (i - 65536));
+		for(int s = 0; s < 4; s++) {
+			referenceASTER8(bytes, expected, n, uncs[s]);
+			unpackASTERUint8Scalar(bytes, result, n, uncs[s]);
+			failed |= compare("ASTER uint8 scalar", expected, result, n);
+			unpackASTERUint8(bytes, result, n, uncs[s]);
+			failed |= compare("ASTER uint8", expected, result, n);
+
+			referenceASTER16(in, expected, n, uncs[s]);
+			unpackASTERUint16Scalar(in, result, n, uncs[s]);
+			failed |= compare("ASTER uint16 scalar", expected, result, n);
+			unpackASTERUint16(in, result, n, uncs[s]);
+			failed |= compare("ASTER uint16", expected, result, n);
+
+			for(size_t start = 0; start < 17; start++) {
+				for(size_t len = 0; len < 40; len++) {
+					referenceASTER8(bytes + 65490 + start, expected, len, uncs[s]);
+					unpackASTERUint8(bytes + 65490 + start, result, len, uncs[s]);
+					failed |= compare("ASTER uint8 tail", expected, result, len);
+					referenceASTER16(in + 4080 + start, expected, len, uncs[s]);
+					unpackASTERUint16(in + 4080 + start, result, len, uncs[s]);
+					failed |= compare("ASTER uint16 tail", expected, result, len);
+				}
+			}
+		}
+		free(bytes);
+	}
+
+	{
+		unsigned char bytes[512];
+		float table[256];
+		for(int i = 0; i < 256; i++)
+			table[i] = i * 0.5f - 3.0f;
+		for(int i = 0; i < 512; i++)
+			bytes[i] = (unsigned char)(i * 7);
+		unpackUint8Table(bytes, result, 512, table);
+		for(int i = 0; i < 512; i++)
+			expected[i] = table[(unsigned char)(i * 7)];
+		failed |= compare("table", expected, result, 512);
+	}
+
+	{
+		/* colatitudes and longitudes over [-10, 370], with the boundaries and special values */
+		float * geo;
+		float special[] = {0.0f, -0.0f, 90.0f, 180.0f, 180.00002f, 359.99997f, 360.0f, -999.0f, 1e30f, -1e30f};
+		size_t nSpecial = sizeof(special) / sizeof(special[0]);
+		if(NULL == (geo = (float *)malloc(sizeof(float) * n))) {
+			printf("Out of memory\n");
+			exit(1);
+		}
+		for(size_t i = 0; i < n; i++)
+			geo[i] = (i % 7 == 0) ? special[(i / 7) % nSpecial] : -10.0f + 380.0f * (float)i / (float)n;
+
+		referenceLatitude(geo, expected, n);
+		colatitudeToLatitudeScalar(geo, result, n);
+		failed |= compare("latitude scalar", expected, result, n);
+		colatitudeToLatitude(geo, result, n);
+		failed |= compare("latitude", expected, result, n);
+
+		referenceLongitude(geo, expected, n);
+		wrapLongitudeScalar(geo, result, n);
+		failed |= compare("longitude scalar", expected, result, n);
+		wrapLongitude(geo, result, n);
+		failed |= compare("longitude", expected, result, n);
+
+		for(size_t start = 0; start < 17; start++) {
+			for(size_t len = 0; len < 40; len++) {
+				referenceLatitude(geo + start, expected, len);
+				colatitudeToLatitude(geo + start, result, len);
+				failed |= compare("latitude tail", expected, result, len);
+				referenceLongitude(geo + start, expected, len);
+				wrapLongitude(geo + start, result, len);
+				failed |= compare("longitude tail", expected, result, len);
+			}
+		}
+
+		/* in place, as CERES converts its read buffer */
+		referenceLongitude(geo, expected, n);
+		memcpy(result, geo, sizeof(float) * n);
+		wrapLongitude(result, result, n);
+		failed |= compare("longitude in place", expected, result, n);
+		free(geo);
+	}
+
+	free(in);
+	free(expected);
+	free(result);
+
+	if(failed) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,565 @@
+/**
+ * unpackKernels.c
+ * Vectorized kernels for unpacking the scaled integers of the instrument files and for
+ * normalizing their geolocation.
+ *
+ * Each kernel has a scalar version, which is the reference, and on x86 an SSE2 and an
+ * AVX2 version. The version is selected at run time from the CPU features. The vector
+ * versions do the same float operations in the same order as the scalar one (no FMA),
+ * so the results are bit-identical.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unpackKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define UNPACK_X86 1
+#    include <immintrin.h>
+#endif
+
+/* MODIS special values: 65500 to 65535 are unpacked to -964 to -999 */
+#define SPECIAL_START 65535
+#define SPECIAL_STOP 65500
+#define SPECIAL_PACKED_START -999.0f
+
+enum { KERNEL_UNSET = 0, KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+
+static int kernelLevel = KERNEL_UNSET;
+
+static int selectKernel(void) {
+	/* Every thread selects the same level, so a race on kernelLevel is harmless */
+	if(kernelLevel == KERNEL_UNSET) {
+		int level = KERNEL_SCALAR;
+#ifdef UNPACK_X86
+		/* TERRA_SIMD=scalar|sse2 limits the instruction set, e.g. to test the other kernels */
+		const char * s = getenv("TERRA_SIMD");
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2") && (s == NULL || strcmp(s, "avx2") == 0))
+			level = KERNEL_AVX2;
+		else if(__builtin_cpu_supports("sse2") && (s == NULL || strcmp(s, "scalar") != 0))
+			level = KERNEL_SSE2;
+#endif
+		kernelLevel = level;
+	}
+	return kernelLevel;
+}
+
+/**
+ * NAME:	unpackKernelName
+ * DESCRIPTION:	name of the instruction set used by the kernels ("scalar", "sse2" or "avx2")
+ */
+const char * unpackKernelName(void) {
+	switch(selectKernel()) {
+	case KERNEL_AVX2:
+		return "avx2";
+	case KERNEL_SSE2:
+		return "sse2";
+	default:
+		return "scalar";
+	}
+}
+
+/**
+ * NAME:	unpackUint16RadianceScalar
+ * DESCRIPTION:	unpack MODIS scaled integers to radiances, the reference version of unpackUint16Radiance
+ * PARAMETERS:
+ * 	unsigned short * in:	the scaled integers
+ * 	float * out:		the radiances
+ * 	size_t n:		the number of values
+ * 	float scale:		the radiance scale of the band
+ * 	float scaledOffset:	the radiance scale times the radiance offset of the band
+ * Output:
+ * 	float * out:		scale*in - scaledOffset, or -999 + (65535-in) for the special values 65500 to 65535
+ */
+void unpackUint16RadianceScalar(const unsigned short * in, float * out, size_t n, float scale, float scaledOffset) {
+	for(size_t i = 0; i < n; i++) {
+		if(in[i] >= SPECIAL_STOP)
+			out[i] = SPECIAL_PACKED_START + (SPECIAL_START - in[i]);
+		else
+			out[i] = scale * in[i] - scaledOffset;
+	}
+}
+
+#ifdef UNPACK_X86
+__attribute__((target("sse2")))
+static size_t unpackUint16RadianceSSE2(const unsigned short * in, float * out, size_t n, float scale, float scaledOffset) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i stop = _mm_set1_epi32(SPECIAL_STOP - 1);
+	const __m128i start = _mm_set1_epi32(SPECIAL_START);
+	const __m128 vScale = _mm_set1_ps(scale);
+	const __m128 vOffset = _mm_set1_ps(scaledOffset);
+	const __m128 vPacked = _mm_set1_ps(SPECIAL_PACKED_START);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8) {
+		__m128i packed = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i half[2];
+		half[0] = _mm_unpacklo_epi16(packed, zero);
+		half[1] = _mm_unpackhi_epi16(packed, zero);
+		for(int h = 0; h < 2; h++) {
+			__m128 value = _mm_sub_ps(_mm_mul_ps(vScale, _mm_cvtepi32_ps(half[h])), vOffset);
+			__m128 special = _mm_add_ps(vPacked, _mm_cvtepi32_ps(_mm_sub_epi32(start, half[h])));
+			__m128 mask = _mm_castsi128_ps(_mm_cmpgt_epi32(half[h], stop));
+			_mm_storeu_ps(out + i + 4 * h, _mm_or_ps(_mm_and_ps(mask, special), _mm_andnot_ps(mask, value)));
+		}
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t unpackUint16RadianceAVX2(const unsigned short * in, float * out, size_t n, float scale, float scaledOffset) {
+	const __m256i stop = _mm256_set1_epi32(SPECIAL_STOP - 1);
+	const __m256i start = _mm256_set1_epi32(SPECIAL_START);
+	const __m256 vScale = _mm256_set1_ps(scale);
+	const __m256 vOffset = _mm256_set1_ps(scaledOffset);
+	const __m256 vPacked = _mm256_set1_ps(SPECIAL_PACKED_START);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8) {
+		__m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+		__m256 value = _mm256_sub_ps(_mm256_mul_ps(vScale, _mm256_cvtepi32_ps(wide)), vOffset);
+		__m256 special = _mm256_add_ps(vPacked, _mm256_cvtepi32_ps(_mm256_sub_epi32(start, wide)));
+		__m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(wide, stop));
+		_mm256_storeu_ps(out + i, _mm256_blendv_ps(value, special, mask));
+	}
+	return i;
+}
+#endif
+
+/**
+ * NAME:	unpackUint16Radiance
+ * DESCRIPTION:	unpack MODIS scaled integers to radiances with the fastest kernel of the CPU
+ * PARAMETERS:	see unpackUint16RadianceScalar
+ */
+void unpackUint16Radiance(const unsigned short * in, float * out, size_t n, float scale, float scaledOffset) {
+	size_t done = 0;
+#ifdef UNPACK_X86
+	switch(selectKernel()) {
+	case KERNEL_AVX2:
+		done = unpackUint16RadianceAVX2(in, out, n, scale, scaledOffset);
+		break;
+	case KERNEL_SSE2:
+		done = unpackUint16RadianceSSE2(in, out, n, scale, scaledOffset);
+		break;
+	}
+#endif
+	unpackUint16RadianceScalar(in + done, out + done, n - done, scale, scaledOffset);
+}
+
+/* MISR: the 2 low bits are the RDQI, the 14 high bits the scaled radiance */
+#define MISR_RDQI_MASK 3
+#define MISR_FILL1 16378
+#define MISR_FILL2 16380
+#define MISR_FILL_PACKED -999.0f
+
+/**
+ * NAME:	unpackMISRRadianceScalar
+ * DESCRIPTION:	unpack MISR radiance/RDQI values, the reference version of unpackMISRRadiance
+ * PARAMETERS:
+ * 	unsigned short * in:	the packed values
+ * 	float * out:		the radiances
+ * 	size_t n:		the number of values
+ * 	float scale:		the scale factor of the band
+ * 	unsigned int firstPos:	the position of in[0] in the dataset
+ * 	unsigned int * laPos:	room for n positions
+ * Output:
+ * 	float * out:		-999 if the RDQI is 2 or 3 or the radiance is a fill value (16378, 16380), else scale*radiance
+ * 	unsigned int * laPos:	the positions of the low accuracy (RDQI == 1) values, in increasing order
+ * Return:			the number of low accuracy values
+ */
+size_t unpackMISRRadianceScalar(const unsigned short * in, float * out, size_t n, float scale, unsigned int firstPos, unsigned int * laPos) {
+	size_t numLa = 0;
+	for(size_t i = 0; i < n; i++) {
+		unsigned short rdqi = in[i] & MISR_RDQI_MASK;
+		unsigned short value = in[i] >> 2;
+		if(rdqi == 1)
+			laPos[numLa++] = firstPos + (unsigned int)i;
+		if(rdqi > 1 || value == MISR_FILL1 || value == MISR_FILL2)
+			out[i] = MISR_FILL_PACKED;
+		else
+			out[i] = scale * (float)value;
+	}
+	return numLa;
+}
+
+#ifdef UNPACK_X86
+/* Append the positions of the set bits of a movemask, lowest first */
+static size_t compactPositions(unsigned int bits, unsigned int base, unsigned int * laPos) {
+	size_t numLa = 0;
+	while(bits) {
+		laPos[numLa++] = base + (unsigned int)__builtin_ctz(bits);
+		bits &= bits - 1;
+	}
+	return numLa;
+}
+
+__attribute__((target("sse2")))
+static size_t unpackMISRRadianceSSE2(const unsigned short * in, float * out, size_t n, float scale, unsigned int firstPos, unsigned int * laPos, size_t * numLa) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rdqiMask = _mm_set1_epi32(MISR_RDQI_MASK);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i fill1 = _mm_set1_epi32(MISR_FILL1);
+	const __m128i fill2 = _mm_set1_epi32(MISR_FILL2);
+	const __m128 vScale = _mm_set1_ps(scale);
+	const __m128 vFill = _mm_set1_ps(MISR_FILL_PACKED);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8) {
+		__m128i packed = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i half[2];
+		unsigned int laBits = 0;
+		half[0] = _mm_unpacklo_epi16(packed, zero);
+		half[1] = _mm_unpackhi_epi16(packed, zero);
+		for(int h = 0; h < 2; h++) {
+			__m128i rdqi = _mm_and_si128(half[h], rdqiMask);
+			__m128i value = _mm_srli_epi32(half[h], 2);
+			__m128i bad = _mm_or_si128(_mm_cmpgt_epi32(rdqi, one),
+			                           _mm_or_si128(_mm_cmpeq_epi32(value, fill1), _mm_cmpeq_epi32(value, fill2)));
+			__m128 radiance = _mm_mul_ps(vScale, _mm_cvtepi32_ps(value));
+			__m128 mask = _mm_castsi128_ps(bad);
+			_mm_storeu_ps(out + i + 4 * h, _mm_or_ps(_mm_and_ps(mask, vFill), _mm_andnot_ps(mask, radiance)));
+			laBits |= (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(rdqi, one))) << (4 * h);
+		}
+		*numLa += compactPositions(laBits, firstPos + (unsigned int)i, laPos + *numLa);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t unpackMISRRadianceAVX2(const unsigned short * in, float * out, size_t n, float scale, unsigned int firstPos, unsigned int * laPos, size_t * numLa) {
+	const __m256i rdqiMask = _mm256_set1_epi32(MISR_RDQI_MASK);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i fill1 = _mm256_set1_epi32(MISR_FILL1);
+	const __m256i fill2 = _mm256_set1_epi32(MISR_FILL2);
+	const __m256 vScale = _mm256_set1_ps(scale);
+	const __m256 vFill = _mm256_set1_ps(MISR_FILL_PACKED);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8) {
+		__m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+		__m256i rdqi = _mm256_and_si256(wide, rdqiMask);
+		__m256i value = _mm256_srli_epi32(wide, 2);
+		__m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(rdqi, one),
+		                              _mm256_or_si256(_mm256_cmpeq_epi32(value, fill1), _mm256_cmpeq_epi32(value, fill2)));
+		__m256 radiance = _mm256_mul_ps(vScale, _mm256_cvtepi32_ps(value));
+		_mm256_storeu_ps(out + i, _mm256_blendv_ps(radiance, vFill, _mm256_castsi256_ps(bad)));
+		unsigned int laBits = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(rdqi, one)));
+		*numLa += compactPositions(laBits, firstPos + (unsigned int)i, laPos + *numLa);
+	}
+	return i;
+}
+#endif
+
+/**
+ * NAME:	unpackMISRRadiance
+ * DESCRIPTION:	unpack MISR radiance/RDQI values with the fastest kernel of the CPU
+ * PARAMETERS:	see unpackMISRRadianceScalar
+ */
+size_t unpackMISRRadiance(const unsigned short * in, float * out, size_t n, float scale, unsigned int firstPos, unsigned int * laPos) {
+	size_t done = 0;
+	size_t numLa = 0;
+#ifdef UNPACK_X86
+	switch(selectKernel()) {
+	case KERNEL_AVX2:
+		done = unpackMISRRadianceAVX2(in, out, n, scale, firstPos, laPos, &numLa);
+		break;
+	case KERNEL_SSE2:
+		done = unpackMISRRadianceSSE2(in, out, n, scale, firstPos, laPos, &numLa);
+		break;
+	}
+#endif
+	return numLa + unpackMISRRadianceScalar(in + done, out + done, n - done, scale, firstPos + (unsigned int)done, laPos + numLa);
+}
+
+/* ASTER: DN 0 is no data, 1 is zero radiance and the maximum DN is saturated */
+#define ASTER_NODATA_PACKED -999.0f
+#define ASTER_SATURATED_PACKED -998.0f
+#define ASTER_UINT8_SATURATED 255
+#define ASTER_UINT16_SATURATED 4095
+
+/**
+ * NAME:	unpackASTERUint8Scalar, unpackASTERUint16Scalar
+ * DESCRIPTION:	convert ASTER DNs to radiances, the reference versions of unpackASTERUint8 and unpackASTERUint16
+ * PARAMETERS:
+ * 	unsigned char/short * in:	the DNs (VNIR and SWIR are 8-bit, TIR is 16-bit)
+ * 	float * out:			the radiances
+ * 	size_t n:			the number of values
+ * 	float unc:			the unit conversion coefficient of the band
+ * Output:
+ * 	float * out:			-999 for DN 0, 0 for DN 1, -998 for the saturated DN (255 or 4095), else (DN-1)*unc
+ */
+void unpackASTERUint8Scalar(const unsigned char * in, float * out, size_t n, float unc) {
+	for(size_t i = 0; i < n; i++) {
+		if(in[i] == 0)
+			out[i] = ASTER_NODATA_PACKED;
+		else if(in[i] == 1)
+			out[i] = 0;
+		else if(in[i] == ASTER_UINT8_SATURATED)
+			out[i] = ASTER_SATURATED_PACKED;
+		else
+			out[i] = (float)(in[i] - 1) * unc;
+	}
+}
+
+void unpackASTERUint16Scalar(const unsigned short * in, float * out, size_t n, float unc) {
+	for(size_t i = 0; i < n; i++) {
+		if(in[i] == 0)
+			out[i] = ASTER_NODATA_PACKED;
+		else if(in[i] == 1)
+			out[i] = 0;
+		else if(in[i] == ASTER_UINT16_SATURATED)
+			out[i] = ASTER_SATURATED_PACKED;
+		else
+			out[i] = (float)(in[i] - 1) * unc;
+	}
+}
+
+#ifdef UNPACK_X86
+/* Convert 8 DNs, widened to 16 bits */
+__attribute__((target("sse2")))
+static void unpackASTER8SSE2(__m128i dn, float * out, __m128 vUnc, __m128i saturated) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(1);
+	__m128i half[2];
+	half[0] = _mm_unpacklo_epi16(dn, zero);
+	half[1] = _mm_unpackhi_epi16(dn, zero);
+	for(int h = 0; h < 2; h++) {
+		__m128 radiance = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(half[h], one)), vUnc);
+		__m128 isZero = _mm_castsi128_ps(_mm_cmpeq_epi32(half[h], zero));
+		__m128 isOne = _mm_castsi128_ps(_mm_cmpeq_epi32(half[h], one));
+		__m128 isSaturated = _mm_castsi128_ps(_mm_cmpeq_epi32(half[h], saturated));
+		__m128 special = _mm_or_ps(_mm_and_ps(isZero, _mm_set1_ps(ASTER_NODATA_PACKED)),
+		                           _mm_and_ps(isSaturated, _mm_set1_ps(ASTER_SATURATED_PACKED)));
+		__m128 mask = _mm_or_ps(_mm_or_ps(isZero, isOne), isSaturated);
+		/* DN 1 gives 0, which is all zero bits and needs no term of its own */
+		_mm_storeu_ps(out + 4 * h, _mm_or_ps(special, _mm_andnot_ps(mask, radiance)));
+	}
+}
+
+__attribute__((target("sse2")))
+static size_t unpackASTERUint8SSE2(const unsigned char * in, float * out, size_t n, float unc) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i saturated = _mm_set1_epi32(ASTER_UINT8_SATURATED);
+	const __m128 vUnc = _mm_set1_ps(unc);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8)
+		unpackASTER8SSE2(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(in + i)), zero), out + i, vUnc, saturated);
+	return i;
+}
+
+__attribute__((target("sse2")))
+static size_t unpackASTERUint16SSE2(const unsigned short * in, float * out, size_t n, float unc) {
+	const __m128i saturated = _mm_set1_epi32(ASTER_UINT16_SATURATED);
+	const __m128 vUnc = _mm_set1_ps(unc);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8)
+		unpackASTER8SSE2(_mm_loadu_si128((const __m128i *)(in + i)), out + i, vUnc, saturated);
+	return i;
+}
+
+/* Convert 8 DNs, widened to 32 bits */
+__attribute__((target("avx2")))
+static void unpackASTER8AVX2(__m256i dn, float * out, __m256 vUnc, __m256i saturated) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi32(1);
+	__m256 radiance = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(dn, one)), vUnc);
+	radiance = _mm256_blendv_ps(radiance, _mm256_setzero_ps(), _mm256_castsi256_ps(_mm256_cmpeq_epi32(dn, one)));
+	radiance = _mm256_blendv_ps(radiance, _mm256_set1_ps(ASTER_NODATA_PACKED), _mm256_castsi256_ps(_mm256_cmpeq_epi32(dn, zero)));
+	radiance = _mm256_blendv_ps(radiance, _mm256_set1_ps(ASTER_SATURATED_PACKED), _mm256_castsi256_ps(_mm256_cmpeq_epi32(dn, saturated)));
+	_mm256_storeu_ps(out, radiance);
+}
+
+__attribute__((target("avx2")))
+static size_t unpackASTERUint8AVX2(const unsigned char * in, float * out, size_t n, float unc) {
+	const __m256i saturated = _mm256_set1_epi32(ASTER_UINT8_SATURATED);
+	const __m256 vUnc = _mm256_set1_ps(unc);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8)
+		unpackASTER8AVX2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + i))), out + i, vUnc, saturated);
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t unpackASTERUint16AVX2(const unsigned short * in, float * out, size_t n, float unc) {
+	const __m256i saturated = _mm256_set1_epi32(ASTER_UINT16_SATURATED);
+	const __m256 vUnc = _mm256_set1_ps(unc);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8)
+		unpackASTER8AVX2(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(in + i))), out + i, vUnc, saturated);
+	return i;
+}
+#endif
+
+/**
+ * NAME:	unpackASTERUint8, unpackASTERUint16
+ * DESCRIPTION:	convert ASTER DNs to radiances with the fastest kernel of the CPU
+ * PARAMETERS:	see unpackASTERUint8Scalar
+ */
+void unpackASTERUint8(const unsigned char * in, float * out, size_t n, float unc) {
+	size_t done = 0;
+#ifdef UNPACK_X86
+	switch(selectKernel()) {
+	case KERNEL_AVX2:
+		done = unpackASTERUint8AVX2(in, out, n, unc);
+		break;
+	case KERNEL_SSE2:
+		done = unpackASTERUint8SSE2(in, out, n, unc);
+		break;
+	}
+#endif
+	unpackASTERUint8Scalar(in + done, out + done, n - done, unc);
+}
+
+void unpackASTERUint16(const unsigned short * in, float * out, size_t n, float unc) {
+	size_t done = 0;
+#ifdef UNPACK_X86
+	switch(selectKernel()) {
+	case KERNEL_AVX2:
+		done = unpackASTERUint16AVX2(in, out, n, unc);
+		break;
+	case KERNEL_SSE2:
+		done = unpackASTERUint16SSE2(in, out, n, unc);
+		break;
+	}
+#endif
+	unpackASTERUint16Scalar(in + done, out + done, n - done, unc);
+}
+
+/**
+ * NAME:	unpackUint8Table
+ * DESCRIPTION:	unpack 8-bit integers through a table of the 256 unpacked values. Used when the
+ * 		unpacking is too expensive to do per element (e.g. the MODIS uncertainty, which needs exp()).
+ * PARAMETERS:
+ * 	unsigned char * in:	the packed values
+ * 	float * out:		the unpacked values
+ * 	size_t n:		the number of values
+ * 	float * table:		the 256 unpacked values
+ * Output:
+ * 	float * out:		table[in]
+ */
+void unpackUint8Table(const unsigned char * in, float * out, size_t n, const float * table) {
+	for(size_t i = 0; i < n; i++)
+		out[i] = table[in[i]];
+}
+
+/* Geolocation: latitudes in [-90, 90] and longitudes in [-180, 180] */
+#define LATITUDE_MAX 90.0f
+#define LONGITUDE_MAX 180.0f
+#define LONGITUDE_TURN 360.0f
+
+/**
+ * NAME:	colatitudeToLatitudeScalar, wrapLongitudeScalar
+ * DESCRIPTION:	normalize the geolocation of an instrument (e.g. CERES), the reference versions
+ * 		of colatitudeToLatitude and wrapLongitude. in and out can be the same buffer.
+ * PARAMETERS:
+ * 	float * in:	the colatitudes or longitudes, of any rank (n is the product of the dimensions)
+ * 	float * out:	the latitudes or longitudes
+ * 	size_t n:	the number of values
+ * Output:
+ * 	float * out:	90 - colatitude, or longitude - 360 for the longitudes > 180 (others unchanged)
+ */
+void colatitudeToLatitudeScalar(const float * in, float * out, size_t n) {
+	for(size_t i = 0; i < n; i++)
+		out[i] = LATITUDE_MAX - in[i];
+}
+
+void wrapLongitudeScalar(const float * in, float * out, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		if(in[i] > LONGITUDE_MAX)
+			out[i] = in[i] - LONGITUDE_TURN;
+		else
+			out[i] = in[i];
+	}
+}
+
+#ifdef UNPACK_X86
+__attribute__((target("sse2")))
+static size_t colatitudeToLatitudeSSE2(const float * in, float * out, size_t n) {
+	const __m128 vMax = _mm_set1_ps(LATITUDE_MAX);
+	size_t i = 0;
+
+	for(; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_sub_ps(vMax, _mm_loadu_ps(in + i)));
+	return i;
+}
+
+__attribute__((target("sse2")))
+static size_t wrapLongitudeSSE2(const float * in, float * out, size_t n) {
+	const __m128 vMax = _mm_set1_ps(LONGITUDE_MAX);
+	const __m128 vTurn = _mm_set1_ps(LONGITUDE_TURN);
+	size_t i = 0;
+
+	for(; i + 4 <= n; i += 4) {
+		__m128 lon = _mm_loadu_ps(in + i);
+		/* NaN compares false and stays unchanged, as in the scalar version */
+		__m128 mask = _mm_cmpgt_ps(lon, vMax);
+		_mm_storeu_ps(out + i, _mm_sub_ps(lon, _mm_and_ps(mask, vTurn)));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t colatitudeToLatitudeAVX2(const float * in, float * out, size_t n) {
+	const __m256 vMax = _mm256_set1_ps(LATITUDE_MAX);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_sub_ps(vMax, _mm256_loadu_ps(in + i)));
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t wrapLongitudeAVX2(const float * in, float * out, size_t n) {
+	const __m256 vMax = _mm256_set1_ps(LONGITUDE_MAX);
+	const __m256 vTurn = _mm256_set1_ps(LONGITUDE_TURN);
+	size_t i = 0;
+
+	for(; i + 8 <= n; i += 8) {
+		__m256 lon = _mm256_loadu_ps(in + i);
+		__m256 mask = _mm256_cmp_ps(lon, vMax, _CMP_GT_OQ);
+		_mm256_storeu_ps(out + i, _mm256_blendv_ps(lon, _mm256_sub_ps(lon, vTurn), mask));
+	}
+	return i;
+}
+#endif
+
+/**
+ * NAME:	colatitudeToLatitude, wrapLongitude
+ * DESCRIPTION:	normalize the geolocation with the fastest kernel of the CPU
+ * PARAMETERS:	see colatitudeToLatitudeScalar
+ */
+void colatitudeToLatitude(const float * in, float * out, size_t n) {
+	size_t done = 0;
+#ifdef UNPACK_X86
+	switch(selectKernel()) {
+	case KERNEL_AVX2:
+		done = colatitudeToLatitudeAVX2(in, out, n);
+		break;
+	case KERNEL_SSE2:
+		done = colatitudeToLatitudeSSE2(in, out, n);
+		break;
+	}
+#endif
+	colatitudeToLatitudeScalar(in + done, out + done, n - done);
+}
+
+void wrapLongitude(const float * in, float * out, size_t n) {
+	size_t done = 0;
+#ifdef UNPACK_X86
+	switch(selectKernel()) {
+	case KERNEL_AVX2:
+		done = wrapLongitudeAVX2(in, out, n);
+		break;
+	case KERNEL_SSE2:
+		done = wrapLongitudeSSE2(in, out, n);
+		break;
+	}
+#endif
+	wrapLongitudeScalar(in + done, out + done, n - done);
+}
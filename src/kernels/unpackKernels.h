@@ -0,0 +1,19 @@
+#ifndef UNPACKKERNELS_H
+#define UNPACKKERNELS_H
+#include <stddef.h>
+
+void unpackUint16Radiance(const unsigned short * in, float * out, size_t n, float scale, float scaledOffset);
+void unpackUint16RadianceScalar(const unsigned short * in, float * out, size_t n, float scale, float scaledOffset);
+size_t unpackMISRRadiance(const unsigned short * in, float * out, size_t n, float scale, unsigned int firstPos, unsigned int * laPos);
+size_t unpackMISRRadianceScalar(const unsigned short * in, float * out, size_t n, float scale, unsigned int firstPos, unsigned int * laPos);
+void unpackASTERUint8(const unsigned char * in, float * out, size_t n, float unc);
+void unpackASTERUint8Scalar(const unsigned char * in, float * out, size_t n, float unc);
+void unpackASTERUint16(const unsigned short * in, float * out, size_t n, float unc);
+void unpackASTERUint16Scalar(const unsigned short * in, float * out, size_t n, float unc);
+void unpackUint8Table(const unsigned char * in, float * out, size_t n, const float * table);
+void colatitudeToLatitude(const float * in, float * out, size_t n);
+void colatitudeToLatitudeScalar(const float * in, float * out, size_t n);
+void wrapLongitude(const float * in, float * out, size_t n);
+void wrapLongitudeScalar(const float * in, float * out, size_t n);
+const char * unpackKernelName(void);
+#endif
@@ -12,6 +12,7 @@
 */
 
 #include "libTERRA.h"
+#include "kernels/unpackKernels.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -82,6 +83,14 @@ hid_t insertDataset(  hid_t const *outputFileID, hid_t *datasetGroup_ID, int ret
     herr_t status;
     char *correct_dsetname;
 
+    /* Chunked and compressed with USE_CHUNK=1 (see chunkPolicy.c) */
+    hid_t plist_id = chunkPolicyPlist( rank, datasetDims, dataType, 0 );
+    if ( plist_id == FATAL_ERR )
+    {
+        FATAL_MSG("Cannot create the HDF5 dataset creation property list.\n");
+        return (FATAL_ERR);
+    }
+
     memspace = H5Screate_simple( rank, datasetDims, NULL );
 
 
@@ -89,7 +98,8 @@ hid_t insertDataset(  hid_t const *outputFileID, hid_t *datasetGroup_ID, int ret
     correct_dsetname = correct_name(datasetName);
 
     dataset = H5Dcreate( *datasetGroup_ID, correct_dsetname, dataType, memspace,
-                         H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+                         H5P_DEFAULT, plist_id, H5P_DEFAULT );
+    if ( plist_id != H5P_DEFAULT ) H5Pclose(plist_id);
     if(dataset<0)
     {
         FATAL_MSG("Unable to create dataset \"%s\".\n", datasetName );
@@ -108,6 +118,8 @@ hid_t insertDataset(  hid_t const *outputFileID, hid_t *datasetGroup_ID, int ret
         return (FATAL_ERR);
     }
 
+    timingAddWritten( (size_t) H5Sget_simple_extent_npoints(memspace) * H5Tget_size(dataType) );
+
     /* Free all remaining memory */
     free(correct_dsetname);
     H5Sclose(memspace);
@@ -136,49 +148,20 @@ hid_t insertDataset_comp( hid_t const *outputFileID, hid_t *datasetGroup_ID, int
     herr_t status;
     char *correct_dsetname;
 
-    //hsize_t chunk_dims[DIM_MAX];
-    hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+    /* Always chunked, with the shape of the dataset class (see chunkPolicy.c) */
+    hid_t plist_id = chunkPolicyPlist( rank, datasetDims, dataType, 1 );
 
     if(plist_id <0)
     {
         FATAL_MSG("Cannot create the HDF5 dataset creation property list.\n");
         return(FATAL_ERR);
     }
-    // The chunk size is the same as the array size
-    if(H5Pset_chunk(plist_id,rank,datasetDims)<0)
-    {
-        FATAL_MSG("Cannot set chunk for the HDF5 dataset creation property list.\n");
-        H5Pclose(plist_id);
-        return(FATAL_ERR);
-    }
-
-    short gzip_comp_level = 0;
-
-    //Set compression level,USE_GZIP must be a number
-    {
-        const char *s;
-        s = getenv("USE_GZIP");
-        if(s && isdigit((int)*s))
-            if((unsigned int)strtol(s,NULL,0) >0)
-                gzip_comp_level= (unsigned int)strtol(s,NULL,0);
-    }
-
-    // GZIP is only valid when the level is between 1 and 9
-    if(gzip_comp_level >0 && gzip_comp_level <10)
-    {
-        if(H5Pset_deflate(plist_id,gzip_comp_level)<0)
-        {
-            FATAL_MSG("Cannot set deflate for the HDF5 dataset creation property list.\n");
-            H5Pclose(plist_id);
-            return(FATAL_ERR);
-        }
-    }
 
     memspace = H5Screate_simple( rank, datasetDims, NULL );
     if(memspace <0)
     {
         FATAL_MSG("Cannot create the memory space.\n");
-        H5Pclose(plist_id);
+        if ( plist_id != H5P_DEFAULT ) H5Pclose(plist_id);
         return(FATAL_ERR);
     }
 
@@ -194,7 +177,7 @@ hid_t insertDataset_comp( hid_t const *outputFileID, hid_t *datasetGroup_ID, int
     if(dataset<0)
     {
          FATAL_MSG("H5Dcreate -- Unable to create dataset \"%s\".\n", datasetName );
-        H5Pclose(plist_id);
+        if ( plist_id != H5P_DEFAULT ) H5Pclose(plist_id);
         H5Sclose(memspace);
         free(correct_dsetname);
         return (FATAL_ERR);
@@ -204,16 +187,18 @@ hid_t insertDataset_comp( hid_t const *outputFileID, hid_t *datasetGroup_ID, int
     if ( status < 0 )
     {
          FATAL_MSG("H5DWrite -- Unable to write to dataset \"%s\".\n", datasetName );
-        H5Pclose(plist_id);
+        if ( plist_id != H5P_DEFAULT ) H5Pclose(plist_id);
         H5Dclose(dataset);
         H5Sclose(memspace);
         free(correct_dsetname);
         return (FATAL_ERR);
     }
 
+    timingAddWritten( (size_t) H5Sget_simple_extent_npoints(memspace) * H5Tget_size(dataType) );
+
     /* Free all remaining memory */
     free(correct_dsetname);
-    H5Pclose(plist_id);
+    if ( plist_id != H5P_DEFAULT ) H5Pclose(plist_id);
     H5Sclose(memspace);
 
     /*
@@ -492,6 +477,7 @@ hid_t MOPITTinsertDataset( hid_t const *inputFileID, hid_t *datasetGroup_ID,
             goto cleanupFail;
         }
     }
+    timingAddWritten( (size_t) H5Sget_simple_extent_npoints(newmemspace) * H5Tget_size(dataType) );
 
     if ( H5Sclose(dataspace) < 0 )
         WARN_MSG("Failed to close dataspace\n");
@@ -571,15 +557,63 @@ herr_t openFile( hid_t *file, char* inputFileName, unsigned flags  )
 
 }
 
+#define CORE_VFD_INCREMENT ((size_t) 256 << 20)   // growth of the in-memory output file
+
+/* Returns non-zero if the output file is assembled in memory (TERRA_CORE_VFD=1) */
+int coreVfdEnabled()
+{
+    const char *s;
+    s = getenv("TERRA_CORE_VFD");
+
+    if(s && isdigit((int)*s))
+        if((unsigned int)strtol(s,NULL,10) == 1)
+            return 1;
+
+    return 0;
+}
+
+/*
+    The file access property list of the output file: the core driver with TERRA_CORE_VFD=1.
+    The backing store is written when the file is really closed; with the strong close
+    degree that is in H5Fclose() even if an object of the file is still open, so H5Fclose()
+    reports a failed write.
+*/
+static hid_t outputFileAccess()
+{
+    hid_t fapl = H5P_DEFAULT;
+
+    if ( coreVfdEnabled() )
+    {
+        fapl = H5Pcreate(H5P_FILE_ACCESS);
+        if ( fapl < 0 || H5Pset_fapl_core(fapl, CORE_VFD_INCREMENT, 1) < 0 ||
+             H5Pset_fclose_degree(fapl, H5F_CLOSE_STRONG) < 0 )
+        {
+            FATAL_MSG("Cannot set the core driver for the HDF5 file access property list.\n");
+            if ( fapl >= 0 ) H5Pclose(fapl);
+            return FATAL_ERR;
+        }
+    }
+
+    return fapl;
+}
+
 /*
                 createOutputFile
     DESCRIPTION:
         This function creates an ouptut HDF5 file. If the file with outputFileName already exists, errors will be thrown.
+
+        When the environment variable TERRA_CORE_VFD is set to 1, the file is created with the
+        core (in-memory) driver and a backing store: the whole file is assembled in memory and
+        written to disk in one sequential pass by H5Fclose(), instead of one small write per
+        group, attribute and dimension scale. The memory grows by CORE_VFD_INCREMENT at a time
+        and ends up the size of the output file.
     ARGUMENTS:
         1. A pointer to the output file identifier
         2. output file name string
     EFFECTS:
         Creates a new HDF5 file if it doesn't exist. Updates argument 1.
+        With TERRA_CORE_VFD=1, nothing is written to the file until it is closed; the caller must
+        check the return value of H5Fclose().
     RETURN:
         FATAL_ERR on failure (equivalent to non-zero number in most environments)
         RET_SUCCESS on success (equivalent to 0 in most systems)
@@ -587,7 +621,12 @@ herr_t openFile( hid_t *file, char* inputFileName, unsigned flags  )
 
 herr_t createOutputFile( hid_t *outputFile, char* outputFileName)
 {
-    *outputFile = H5Fcreate( outputFileName, H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT );
+    hid_t fapl = outputFileAccess();
+    if ( fapl == FATAL_ERR )
+        return FATAL_ERR;
+
+    *outputFile = H5Fcreate( outputFileName, H5F_ACC_EXCL, H5P_DEFAULT, fapl );
+    if ( fapl != H5P_DEFAULT ) H5Pclose(fapl);
     if ( *outputFile < 0 )
     {
          FATAL_MSG("H5Fcreate -- Could not create HDF5 file. Does it already exist? If so, delete or don't\n\t    call this function.\n" );
@@ -597,6 +636,38 @@ herr_t createOutputFile( hid_t *outputFile, char* outputFileName)
     return RET_SUCCESS;
 }
 
+/*
+                reopenOutputFile
+    DESCRIPTION:
+        Opens an existing output file for writing, with the same file access properties as
+        createOutputFile(). Used to resume an orbit (see checkpoint.c).
+    ARGUMENTS:
+        1. A pointer to the output file identifier
+        2. output file name string
+    EFFECTS:
+        Updates argument 1.
+    RETURN:
+        FATAL_ERR on failure
+        RET_SUCCESS on success
+*/
+
+herr_t reopenOutputFile( hid_t *outputFile, char* outputFileName)
+{
+    hid_t fapl = outputFileAccess();
+    if ( fapl == FATAL_ERR )
+        return FATAL_ERR;
+
+    *outputFile = H5Fopen( outputFileName, H5F_ACC_RDWR, fapl );
+    if ( fapl != H5P_DEFAULT ) H5Pclose(fapl);
+    if ( *outputFile < 0 )
+    {
+        FATAL_MSG("H5Fopen -- Could not open HDF5 file \"%s\" for writing.\n", outputFileName );
+        return FATAL_ERR;
+    }
+
+    return RET_SUCCESS;
+}
+
 
 /*
                         createGroup
@@ -867,6 +938,10 @@ int32 H4readData( int32 fileID, const char* datasetName, void** data, int32 *ret
         return FATAL_ERR;
     }
 
+    /* Orbit window (see orbitWindow.c): the dataset looks as if it only had the window,
+       h4_start is relative to the window start. */
+    int32 windowStart[DIM_MAX] = {0};
+    orbitWindowSDS( sds_id, rank, dimsizes, windowStart );
 
     // Adding subsetting information.
 
@@ -875,6 +950,8 @@ int32 H4readData( int32 fileID, const char* datasetName, void** data, int32 *ret
         for(int i = 0; i<rank; i++)
             start[i] = h4_start[i];
     }
+    for(int i = 0; i<rank; i++)
+        start[i] += windowStart[i];
 
     if(h4_stride != NULL)
     {
@@ -955,6 +1032,7 @@ int32 H4readData( int32 fileID, const char* datasetName, void** data, int32 *ret
         if ( data != NULL ) free(data);
         return FATAL_ERR;
     }
+    timingAddRead( (size_t) total_elems * DFKNTsize(dataType) );
 
 
     SDendaccess(sds_id);
@@ -1073,8 +1151,8 @@ hid_t attrCreateString( hid_t objectID, char* name, char* value )
         any errors.
 */
 
-hid_t readThenWrite( const char* outDatasetName, hid_t outputGroupID, const char* inDatasetName, int32 inputDataType,
-                     hid_t outputDataType, int32 inputFileID )
+static hid_t doReadThenWrite( const char* outDatasetName, hid_t outputGroupID, const char* inDatasetName, int32 inputDataType,
+                            hid_t outputDataType, int32 inputFileID )
 {
     int32 dataRank;
     int32 dataDimSizes[DIM_MAX];
@@ -1083,6 +1161,24 @@ hid_t readThenWrite( const char* outDatasetName, hid_t outputGroupID, const char
 
     herr_t status;
 
+    /* Overlap the read of one slab with the write of the previous one */
+    if ( pipelineEnabled() )
+    {
+        TERRApipeline_t pipe;
+        memset(&pipe, 0, sizeof(pipe));
+        pipe.inputFileID = inputFileID;
+        pipe.inDatasetName = inDatasetName;
+        pipe.inputDataType = inputDataType;
+        pipe.outputGroupID = outputGroupID;
+        pipe.outDatasetName = outDatasetName;
+        pipe.outputDataType = outputDataType;
+
+        datasetID = pipelineTransfer(&pipe);
+        if ( datasetID == FATAL_ERR )
+            FATAL_MSG("Error writing \"%s\" dataset.\n", outDatasetName ? outDatasetName : inDatasetName );
+        return datasetID;
+    }
+
     status = H4readData( inputFileID, inDatasetName,
                          (void**)&dataBuffer, &dataRank, dataDimSizes, inputDataType,NULL,NULL,NULL );
 
@@ -1128,6 +1224,16 @@ hid_t readThenWrite( const char* outDatasetName, hid_t outputGroupID, const char
     return datasetID;
 }
 
+/* Runs doReadThenWrite() inside a timing record (see timing.c) */
+hid_t readThenWrite( const char* outDatasetName, hid_t outputGroupID, const char* inDatasetName, int32 inputDataType,
+                     hid_t outputDataType, int32 inputFileID )
+{
+    int timer = timingBegin("readThenWrite", outDatasetName, NULL);
+    hid_t ret = doReadThenWrite( outDatasetName, outputGroupID, inDatasetName, inputDataType, outputDataType, inputFileID );
+    timingEnd(timer);
+    return ret;
+}
+
 float ReverseFloat( const float inFloat )
 {
    float retVal;
@@ -1196,8 +1302,8 @@ float ReverseFloat( const float inFloat )
         any errors.
 */
 
-hid_t readThenWriteSubset( int CER_LATLON, const char* outDatasetName, hid_t outputGroupID, const char* inDatasetName, int32 inputDataType,
-                           hid_t outputDataType, int32 inputFileID,int32 *start,int32*stride,int32*count )
+static hid_t doReadThenWriteSubset( int CER_LATLON, const char* outDatasetName, hid_t outputGroupID, const char* inDatasetName, int32 inputDataType,
+                                  hid_t outputDataType, int32 inputFileID,int32 *start,int32*stride,int32*count )
 {
     int32 dataRank;
     int32 dataDimSizes[DIM_MAX];
@@ -1225,42 +1331,16 @@ hid_t readThenWriteSubset( int CER_LATLON, const char* outDatasetName, hid_t out
      */
     if ( CER_LATLON )
     {
-        /* Perform the conversion */
-        // Check if this dataset is Latitude or Longitude
-        int index = 0;
-        if ( strstr(outDatasetName, "Latitude" ) )
-        {
-            // Iterate through every dimension
-            for ( int dim = 0; dim < dataRank; dim++ )
-            {
-                // Iterate through every element in each dimension
-                for ( int elem = 0; elem < dataDimSizes[dim]; elem++ )
-                {
+        /* The conversion covers all dimensions. See kernels/unpackKernels.c */
+        size_t numElems = 1;
+        for ( int dim = 0; dim < dataRank; dim++ )
+            numElems *= dataDimSizes[dim];
 
-                    /* Databuffer has to be cast to a float* for proper pointer arithmetic.
-                       This is specific just to the geolocation datasets. We know in advance that
-                       it is a floating point number.
-                     */
-                    ( (float*) dataBuffer)[index] = (float)(90.0f - ( (float*) dataBuffer)[index]);
-                    index++;
-                }
-            }
-        }
+        if ( strstr(outDatasetName, "Latitude" ) )
+            colatitudeToLatitude( (float*) dataBuffer, (float*) dataBuffer, numElems );
 
         else if ( strstr(outDatasetName, "Longitude" ) )
-        {
-            // Iterate through every dimension
-            for ( int dim = 0; dim < dataRank; dim++ )
-            {
-                // Iterate through every element in each dimension
-                for ( int elem = 0; elem < dataDimSizes[dim]; elem++ )
-                {   
-                    if ( ((float*) dataBuffer)[index] > 180.0f )
-                        ( (float *) dataBuffer)[index] = ( (float *) dataBuffer)[index] - 360.0f;
-                    index++;
-                }
-            }
-        }
+            wrapLongitude( (float*) dataBuffer, (float*) dataBuffer, numElems );
 
         else
         {
@@ -1310,6 +1390,17 @@ cleanupFail:
     return retVal;
 }
 
+/* Runs doReadThenWriteSubset() inside a timing record (see timing.c) */
+hid_t readThenWriteSubset( int CER_LATLON, const char* outDatasetName, hid_t outputGroupID, const char* inDatasetName, int32 inputDataType,
+                           hid_t outputDataType, int32 inputFileID,int32 *start,int32*stride,int32*count )
+{
+    int timer = timingBegin("readThenWriteSubset", outDatasetName, NULL);
+    hid_t ret = doReadThenWriteSubset( CER_LATLON, outDatasetName, outputGroupID, inDatasetName, inputDataType,
+                                      outputDataType, inputFileID, start, stride, count );
+    timingEnd(timer);
+    return ret;
+}
+
 
 /*
         correct_name
@@ -1378,6 +1469,23 @@ char *correct_name(const char* oldname)
     return newname;
 }
 
+/*
+    Conversion callbacks of readThenWrite_ASTER_Unpack. See pipelineTransfer() for the arguments.
+    DN 0 is no data (-999), 1 is zero radiance and the maximum DN is saturated (-998, to
+    differentiate it from no data). The conversion is in kernels/unpackKernels.c.
+*/
+static herr_t unpackASTER_UINT8( const void* in, void* out, size_t nElems, size_t firstElem, void* arg )
+{
+    unpackASTERUint8( in, out, nElems, *(float*) arg );
+    return RET_SUCCESS;
+}
+
+static herr_t unpackASTER_UINT16( const void* in, void* out, size_t nElems, size_t firstElem, void* arg )
+{
+    unpackASTERUint16( in, out, nElems, *(float*) arg );
+    return RET_SUCCESS;
+}
+
 /*
                     readThenWrite_ASTER_Unpack
     DESCRIPTION:
@@ -1416,8 +1524,8 @@ char *correct_name(const char* oldname)
         any errors.
 */
 /* MY 2016-12-20, routine to unpack ASTER data */
-hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
-                                  int32 inputFileID,float unc )
+static hid_t doReadThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+                                         int32 inputFileID,float unc )
 {
     int32 dataRank = 0;
     int32 dataDimSizes[DIM_MAX] = {0};
@@ -1427,6 +1535,7 @@ hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32
     size_t buffer_size = 1;
     hid_t datasetID = 0;
     hid_t outputDataType = 0;
+    TERRAconvert_t unpack = NULL;
 
     intn status = -1;
 
@@ -1437,22 +1546,62 @@ hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32
 
     }
 
+    if(DFNT_UINT8 == inputDataType)
+        unpack = unpackASTER_UINT8;
+    else if(DFNT_UINT16 == inputDataType)
+        unpack = unpackASTER_UINT16;
+    else
+    {
+         FATAL_MSG("Unsupported datatype. Datatype must be either DFNT_UINT16 or DFNT_UINT8.\n" );
+        return (FATAL_ERR);
+    }
+
+    outputDataType = H5T_NATIVE_FLOAT;
+
+    short use_chunk = 0;
+
+    /* If using chunk */
+    {
+        const char *s;
+        s = getenv("USE_CHUNK");
+
+        if(s && isdigit((int)*s))
+            if((unsigned int)strtol(s,NULL,0) == 1)
+                use_chunk = 1;
+    }
+
+    /* Overlap the read, the unpacking and the write of consecutive slabs */
+    if ( pipelineEnabled() )
+    {
+        TERRApipeline_t pipe;
+        memset(&pipe, 0, sizeof(pipe));
+        pipe.inputFileID = inputFileID;
+        pipe.inDatasetName = datasetName;
+        pipe.inputDataType = inputDataType;
+        pipe.outputGroupID = outputGroupID;
+        pipe.outputDataType = outputDataType;
+        pipe.outElemSize = sizeof(float);
+        pipe.convert = unpack;
+        pipe.convertArg = &unc;
+        pipe.useChunk = use_chunk;
+
+        datasetID = pipelineTransfer(&pipe);
+        if ( datasetID == FATAL_ERR )
+             FATAL_MSG("Error writing %s dataset.\n", datasetName );
+        return datasetID;
+    }
+
     if(DFNT_UINT8 == inputDataType)
     {
         status = H4readData( inputFileID, datasetName,
                              (void**)&vsir_dataBuffer, &dataRank, dataDimSizes, inputDataType,NULL,NULL,NULL );
     }
-    else if(DFNT_UINT16 == inputDataType)
+    else
     {
         status = H4readData( inputFileID, datasetName,
                              (void**)&tir_dataBuffer, &dataRank, dataDimSizes, inputDataType,NULL,NULL,NULL );
 
     }
-    else
-    {
-         FATAL_MSG("Unsupported datatype. Datatype must be either DFNT_UINT16 or DFNT_UINT8.\n" );
-        return (FATAL_ERR);
-    }
 
 
     if ( status == FATAL_ERR )
@@ -1464,50 +1613,17 @@ hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32
     }
 
     {
-        float* temp_float_pointer = NULL;
-        uint8_t* temp_uint8_pointer = vsir_dataBuffer;
-        unsigned short* temp_uint16_pointer = tir_dataBuffer;
         /* Now we need to unpack the data */
         for(int i = 0; i <dataRank; i++)
             buffer_size *=dataDimSizes[i];
 
         output_dataBuffer = malloc(sizeof output_dataBuffer *buffer_size);
-
-        temp_float_pointer = output_dataBuffer;
+        timingBuffer( sizeof(float) * buffer_size );
 
         if(DFNT_UINT8 == inputDataType)
-        {
-            for(int i = 0; i<buffer_size; i++)
-            {
-                if(*temp_uint8_pointer == 0)
-                    *temp_float_pointer = -999;
-                else if(*temp_uint8_pointer == 1)
-                    *temp_float_pointer = 0;
-                else if(*temp_uint8_pointer == 255)// Now make no data differentiate from saturated data
-                    *temp_float_pointer = -998;
-                else
-                    *temp_float_pointer = (float)((*temp_uint8_pointer -1))*unc;
-                temp_float_pointer++;
-                temp_uint8_pointer++;
-            }
-        }
-        else if(DFNT_UINT16 == inputDataType)
-        {
-            for(int i = 0; i<buffer_size; i++)
-            {
-                if(*temp_uint16_pointer == 0)
-                    *temp_float_pointer = -999;
-                else if(*temp_uint16_pointer == 1)
-                    *temp_float_pointer = 0;
-                else if(*temp_uint16_pointer == 4095)// Now make no data differentiate from saturated data
-                    *temp_float_pointer = -998;
-                else
-                    *temp_float_pointer = (float)((*temp_uint16_pointer-1))*unc;
-                temp_float_pointer++;
-                temp_uint16_pointer++;
-
-            }
-        }
+            unpack( vsir_dataBuffer, output_dataBuffer, buffer_size, 0, &unc );
+        else
+            unpack( tir_dataBuffer, output_dataBuffer, buffer_size, 0, &unc );
 
     }
     /* END READ DATA. BEGIN INSERTION OF DATA */
@@ -1522,20 +1638,6 @@ hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32
     for ( int i = 0; i < DIM_MAX; i++ )
         temp[i] = (hsize_t) dataDimSizes[i];
 
-    outputDataType = H5T_NATIVE_FLOAT;
-
-    short use_chunk = 0;
-
-    /* If using chunk */
-    {
-        const char *s;
-        s = getenv("USE_CHUNK");
-
-        if(s && isdigit((int)*s))
-            if((unsigned int)strtol(s,NULL,0) == 1)
-                use_chunk = 1;
-    }
-
     if(use_chunk == 1)
     {
         datasetID = insertDataset_comp( &outputFile, &outputGroupID, 1, dataRank,
@@ -1563,6 +1665,261 @@ hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32
     return datasetID;
 }
 
+/* Runs doReadThenWrite_ASTER_Unpack() inside a timing record (see timing.c) */
+hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+                                  int32 inputFileID,float unc )
+{
+    int timer = timingBegin("readThenWrite_ASTER_Unpack", datasetName, NULL);
+    hid_t ret = doReadThenWrite_ASTER_Unpack( outputGroupID, datasetName, inputDataType, inputFileID, unc );
+    timingEnd(timer);
+    return ret;
+}
+
+/* Number of elements unpackMISR passes to the kernel at a time. Bounds the growth of the position list. */
+#define MISR_UNPACK_BLOCK 65536
+
+/*
+    Conversion callback of readThenWrite_MISR_Unpack. See pipelineTransfer() for the arguments.
+    arg is the MISRradiance_t of the dataset. Besides unpacking, it appends the position of
+    every low accuracy element to arg->la_data_pos. Every element is checked, so the list is
+    complete and exact. The decoding is done by unpackMISRRadiance() (kernels/unpackKernels.c).
+*/
+static herr_t unpackMISR( const void* in, void* out, size_t nElems, size_t firstElem, void* arg )
+{
+    MISRradiance_t* misrArg = arg;
+    const unsigned short* temp_uint16_pointer = in;
+    float* temp_float_pointer = out;
+
+    for(size_t i = 0; i<nElems; i += MISR_UNPACK_BLOCK)
+    {
+        size_t blockSize = min( (size_t)MISR_UNPACK_BLOCK, nElems - i );
+
+        /* The kernel needs room for a position per element in the worst case */
+        if ( misrArg->la_data_cap - misrArg->num_la_data < blockSize )
+        {
+            size_t newCap = max( 2*misrArg->la_data_cap, misrArg->num_la_data + blockSize );
+            unsigned int* tmp = realloc( misrArg->la_data_pos, newCap * sizeof(unsigned int) );
+            if ( tmp == NULL )
+            {
+                FATAL_MSG("Failed to allocate memory.\n");
+                return FATAL_ERR;
+            }
+            misrArg->la_data_pos = tmp;
+            misrArg->la_data_cap = newCap;
+        }
+
+        misrArg->num_la_data += unpackMISRRadiance( temp_uint16_pointer + i, temp_float_pointer + i, blockSize,
+                                                    misrArg->scale_factor, (unsigned int)(firstElem + i),
+                                                    misrArg->la_data_pos + misrArg->num_la_data );
+    }
+
+    return RET_SUCCESS;
+}
+
+/* The output name of a MISR radiance dataset is the input name without "/RDQI". Caller must free it. */
+static char* MISRoutputName( const char* datasetName )
+{
+    char* RDQIName = "/RDQI";
+    char* newdatasetName = NULL;
+    const char* temp_sub_dsetname = strstr(datasetName,RDQIName);
+
+    if(temp_sub_dsetname!=NULL && strncmp(RDQIName,temp_sub_dsetname,strlen(temp_sub_dsetname)) == 0)
+    {
+        newdatasetName = malloc( strlen(datasetName) - strlen(RDQIName) + 1 );
+        memset(newdatasetName,'\0',strlen(datasetName)-strlen(RDQIName)+1);
+
+        strncpy(newdatasetName,datasetName,strlen(datasetName)-strlen(RDQIName));
+    }
+    else  // We will fail here.
+    {
+         FATAL_MSG("Error: The dataset name doesn't end with /RDQI\n");
+    }
+
+    return newdatasetName;
+}
+
+static short MISRuseChunk()
+{
+    const char *s;
+    s = getenv("USE_CHUNK");
+
+    if(s && isdigit((int)*s))
+        if((unsigned int)strtol(s,NULL,0) == 1)
+            return 1;
+
+    return 0;
+}
+
+/*
+    Records the positions of the low accuracy data of a MISR radiance dataset in the dataset
+    <newdatasetName>_low_accuracy_pos. Does nothing if there is no low accuracy data.
+    Returns FATAL_ERR on failure, RET_SUCCESS otherwise.
+*/
+static herr_t MISRwriteLowAccuracy( hid_t outputGroupID, const char* newdatasetName, const MISRradiance_t* rad )
+{
+    if(rad->num_la_data > 0)
+    {
+
+        hid_t la_pos_dsetid =0 ;
+        int la_pos_dset_rank = 1;
+        hsize_t la_pos_dset_dims[1];
+        la_pos_dset_dims[0]= rad->num_la_data;
+        char* la_pos_dset_name_suffix="_low_accuracy_pos";
+        size_t la_pos_dset_name_len = strlen(la_pos_dset_name_suffix)+strlen(newdatasetName)+1;
+        char* la_pos_dset_name=malloc(la_pos_dset_name_len);
+        la_pos_dset_name[la_pos_dset_name_len-1]='\0';
+        strcpy(la_pos_dset_name,newdatasetName);
+        strcat(la_pos_dset_name,la_pos_dset_name_suffix);
+
+        /* Create a dataset to remember the postion of low accuracy data */
+        la_pos_dsetid = insertDataset( &outputFile, &outputGroupID, 1, la_pos_dset_rank,
+                                       la_pos_dset_dims, H5T_NATIVE_INT, la_pos_dset_name, rad->la_data_pos );
+
+        free(la_pos_dset_name);
+
+        if ( la_pos_dsetid == FATAL_ERR )
+        {
+             FATAL_MSG("Error writing %s dataset.\n", newdatasetName );
+            return (FATAL_ERR);
+        }
+
+        H5Dclose(la_pos_dsetid);
+    }
+    //else { } may add an attribute to the group later.
+
+    return RET_SUCCESS;
+}
+
+/*
+                    MISRreadRadiance
+    DESCRIPTION:
+        First stage of the MISR radiance unpacking: reads the packed uint16 radiance SDS
+        rad->datasetName into rad->in. Together with MISRunpackRadiance() and
+        MISRwriteRadiance() it does the same as readThenWrite_MISR_Unpack(), split so that
+        the unpacking can run on another thread (see MISR.c).
+
+    ARGUMENTS:
+        1. inputFileID -- The HDF4 input file identifier
+        2. rad         -- datasetName and scale_factor must be set, the rest zeroed
+
+    EFFECTS:
+        Sets rad->in, rad->rank and rad->dims.
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise.
+*/
+herr_t MISRreadRadiance( int32 inputFileID, MISRradiance_t* rad )
+{
+    if ( H4readData( inputFileID, rad->datasetName, (void**)&rad->in, &rad->rank, rad->dims, DFNT_UINT16,
+                     NULL,NULL,NULL ) < 0 )
+    {
+         FATAL_MSG("Unable to read %s data.\n",  rad->datasetName );
+        if ( rad->in != NULL ) free(rad->in);
+        rad->in = NULL;
+        return (FATAL_ERR);
+    }
+
+    return RET_SUCCESS;
+}
+
+/*
+                    MISRunpackRadiance
+    DESCRIPTION:
+        Second stage of the MISR radiance unpacking: converts rad->in into rad->out and
+        collects the low accuracy positions. Does not call the HDF libraries, so it can run
+        on any thread. Frees rad->in.
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise.
+*/
+herr_t MISRunpackRadiance( MISRradiance_t* rad )
+{
+    herr_t status = RET_SUCCESS;
+    size_t buffer_size = 1;
+
+    for(int i = 0; i <rad->rank; i++)
+        buffer_size *=rad->dims[i];
+
+    rad->out = malloc(sizeof(float) * buffer_size);
+    timingBuffer( sizeof(float) * buffer_size );
+    if ( rad->out == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        status = FATAL_ERR;
+    }
+    else
+        status = unpackMISR( rad->in, rad->out, buffer_size, 0, rad );
+
+    free(rad->in);
+    rad->in = NULL;
+    return status;
+}
+
+/*
+                    MISRwriteRadiance
+    DESCRIPTION:
+        Last stage of the MISR radiance unpacking: writes rad->out and the low accuracy
+        positions to the output file. See readThenWrite_MISR_Unpack() for the output
+        dataset and retDatasetNamePtr.
+
+    RETURN:
+        The dataset identifier, FATAL_ERR on failure.
+*/
+hid_t MISRwriteRadiance( hid_t outputGroupID, MISRradiance_t* rad, char** retDatasetNamePtr )
+{
+    hid_t datasetID = 0;
+    char* newdatasetName = MISRoutputName(rad->datasetName);
+    hsize_t temp[DIM_MAX];
+
+    if ( newdatasetName == NULL )
+        return FATAL_ERR;
+
+    for ( int i = 0; i < DIM_MAX; i++ )
+        temp[i] = (hsize_t) rad->dims[i];
+
+    if(MISRuseChunk() == 1)
+    {
+        datasetID = insertDataset_comp( &outputFile, &outputGroupID, 1, rad->rank,
+                                        temp, H5T_NATIVE_FLOAT, newdatasetName, rad->out );
+    }
+    else
+    {
+        datasetID = insertDataset( &outputFile, &outputGroupID, 1, rad->rank,
+                                   temp, H5T_NATIVE_FLOAT, newdatasetName, rad->out );
+    }
+
+    if ( datasetID == FATAL_ERR )
+    {
+         FATAL_MSG("Error writing %s dataset.\n", rad->datasetName );
+        free(newdatasetName);
+        return (FATAL_ERR);
+    }
+
+    if ( MISRwriteLowAccuracy( outputGroupID, newdatasetName, rad ) == FATAL_ERR )
+    {
+        free(newdatasetName);
+        H5Dclose(datasetID);
+        return (FATAL_ERR);
+    }
+
+    if ( retDatasetNamePtr )
+        *retDatasetNamePtr= correct_name(newdatasetName);
+
+    free(newdatasetName);
+    return datasetID;
+}
+
+/* Frees the buffers of a MISRradiance_t */
+void MISRfreeRadiance( MISRradiance_t* rad )
+{
+    if ( rad->in ) free(rad->in);
+    if ( rad->out ) free(rad->out);
+    if ( rad->la_data_pos ) free(rad->la_data_pos);
+    rad->in = NULL;
+    rad->out = NULL;
+    rad->la_data_pos = NULL;
+}
+
 /*
                     readThenWrite_MISR_Unpack
     DESCRIPTION:
@@ -1608,17 +1965,17 @@ hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32
         any errors.
 */
 /* MY-2016-12-20 Routine to unpack MISR data */
-hid_t readThenWrite_MISR_Unpack( hid_t outputGroupID, char* datasetName, char** retDatasetNamePtr,int32 inputDataType,
-                                 int32 inputFileID,float scale_factor )
+static hid_t doReadThenWrite_MISR_Unpack( hid_t outputGroupID, char* datasetName, char** retDatasetNamePtr,int32 inputDataType,
+                                        int32 inputFileID,float scale_factor )
 {
-    int32 dataRank = 0;
-    int32 dataDimSizes[DIM_MAX] = {0};
-    unsigned short* input_dataBuffer = NULL;
-    float * output_dataBuffer = NULL;
     hid_t datasetID = 0;
-    hid_t outputDataType = 0;
-    intn status = 0;
+    herr_t status = 0;
     char* newdatasetName = NULL;
+    MISRradiance_t rad;
+
+    memset(&rad, 0, sizeof(rad));
+    rad.datasetName = datasetName;
+    rad.scale_factor = scale_factor;
 
     if(scale_factor < 0)
     {
@@ -1626,231 +1983,320 @@ hid_t readThenWrite_MISR_Unpack( hid_t outputGroupID, char* datasetName, char**
         return (FATAL_ERR);
 
     }
-    status = H4readData( inputFileID, datasetName,
-                         (void**)&input_dataBuffer, &dataRank, dataDimSizes, inputDataType,NULL,NULL,NULL);
-    if ( status < 0 )
-    {
-         FATAL_MSG("Unable to read %s data.\n",  datasetName );
-        if ( input_dataBuffer != NULL ) free(input_dataBuffer);
-        return (FATAL_ERR);
-    }
 
-    /* Before unpacking the data, we want to re-arrange the name */
-    char* RDQIName = "/RDQI";
-    char* temp_sub_dsetname = strstr(datasetName,RDQIName);
+    /* Read, unpack and write the whole dataset */
+    if ( !pipelineEnabled() )
+    {
+        if ( MISRreadRadiance( inputFileID, &rad ) == FATAL_ERR )
+            return (FATAL_ERR);
 
+        status = MISRunpackRadiance( &rad );
 
-    if(temp_sub_dsetname!=NULL && strncmp(RDQIName,temp_sub_dsetname,strlen(temp_sub_dsetname)) == 0)
-    {
-        newdatasetName = malloc( strlen(datasetName) - strlen(RDQIName) + 1 );
-        memset(newdatasetName,'\0',strlen(datasetName)-strlen(RDQIName)+1);
+        if ( status == FATAL_ERR )
+            datasetID = FATAL_ERR;
+        else
+            datasetID = MISRwriteRadiance( outputGroupID, &rad, retDatasetNamePtr );
 
-        strncpy(newdatasetName,datasetName,strlen(datasetName)-strlen(RDQIName));
+        MISRfreeRadiance( &rad );
+        if ( datasetID == FATAL_ERR )
+             FATAL_MSG("Error writing %s dataset.\n", datasetName );
+        return datasetID;
     }
-    else  // We will fail here.
-    {
-         FATAL_MSG("Error: The dataset name doesn't end with /RDQI\n");
+
+    /* Before unpacking the data, we want to re-arrange the name */
+    newdatasetName = MISRoutputName(datasetName);
+    if ( newdatasetName == NULL )
         return FATAL_ERR;
-    }
 
+    /* Overlap the read, the unpacking and the write of consecutive slabs */
+    TERRApipeline_t pipe;
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.inputFileID = inputFileID;
+    pipe.inDatasetName = datasetName;
+    pipe.inputDataType = inputDataType;
+    pipe.outputGroupID = outputGroupID;
+    pipe.outDatasetName = newdatasetName;
+    pipe.outputDataType = H5T_NATIVE_FLOAT;
+    pipe.outElemSize = sizeof(float);
+    pipe.convert = unpackMISR;
+    pipe.convertArg = &rad;
+    pipe.useChunk = MISRuseChunk();
+
+    datasetID = pipelineTransfer(&pipe);
 
+    if ( datasetID == FATAL_ERR )
+    {
+         FATAL_MSG("Error writing %s dataset.\n", datasetName );
+        free(newdatasetName);
+        MISRfreeRadiance( &rad );
+        return (FATAL_ERR);
+    }
 
-    /* Data Unpack */
+    /* Here we want to record the low accuracy data information for this dataset.*/
+    if ( MISRwriteLowAccuracy( outputGroupID, newdatasetName, &rad ) == FATAL_ERR )
     {
+        free(newdatasetName);
+        MISRfreeRadiance( &rad );
+        H5Dclose(datasetID);
+        return (FATAL_ERR);
+    }
+    MISRfreeRadiance( &rad );
 
-        float* temp_float_pointer = NULL;
-        unsigned short* temp_uint16_pointer = input_dataBuffer;
-        size_t buffer_size = 1;
-        unsigned short  rdqi = 0;
-        unsigned short  rdqi_mask = 3;
-        size_t num_la_data = 0;
-        uint8_t has_la_data = 0;
+    if ( retDatasetNamePtr )
+        *retDatasetNamePtr= correct_name(newdatasetName);
 
-        unsigned int* la_data_pos = NULL;
-        unsigned int* temp_la_data_pos_pointer = NULL;
+    free(newdatasetName);
 
-        for(int i = 0; i <dataRank; i++)
-            buffer_size *=dataDimSizes[i];
+    return datasetID;
+}
 
+/* Runs doReadThenWrite_MISR_Unpack() inside a timing record (see timing.c) */
+hid_t readThenWrite_MISR_Unpack( hid_t outputGroupID, char* datasetName, char** retDatasetNamePtr,int32 inputDataType,
+                                 int32 inputFileID,float scale_factor )
+{
+    int timer = timingBegin("readThenWrite_MISR_Unpack", datasetName, NULL);
+    hid_t ret = doReadThenWrite_MISR_Unpack( outputGroupID, datasetName, retDatasetNamePtr, inputDataType, inputFileID,
+                                            scale_factor );
+    timingEnd(timer);
+    return ret;
+}
 
-        for(int i = 0; i<buffer_size; i++)
-        {
-            rdqi = (*temp_uint16_pointer)&rdqi_mask;
-            if(rdqi == 1)
-                num_la_data++;
-        }
+/* Argument of the MODIS radiance conversion callback */
+typedef struct
+{
+    const float* radi_sc_values;    // radiance_scales, one per band
+    const float* radi_off_values;   // radiance_offsets, one per band
+    size_t band_buffer_size;        // number of elements in one band
+} MODISunpackArg_t;
 
-        if(num_la_data>0)
-        {
-            has_la_data = 1;
-            la_data_pos = malloc(sizeof la_data_pos*num_la_data);
-            temp_la_data_pos_pointer = la_data_pos;
-        }
+/*
+    Conversion callback of readThenWrite_MODIS_Unpack. See pipelineTransfer() for the arguments.
+    The band of an element is given by its position in the whole dataset, so the input may
+    start and end in the middle of a band.
+*/
+static herr_t unpackMODIS( const void* in, void* out, size_t nElems, size_t firstElem, void* arg )
+{
+    const MODISunpackArg_t* modisArg = arg;
+    const unsigned short* temp_uint16_pointer = in;
+    float* temp_float_pointer = out;
+    size_t pos = firstElem;
+    size_t end = firstElem + nElems;
 
-        /* We need to check if there are any the low accuracy data */
+    while ( pos < end )
+    {
+        size_t i = pos / modisArg->band_buffer_size;
+        size_t bandEnd = min( (i+1)*modisArg->band_buffer_size, end );
+        float temp_scale_offset = modisArg->radi_sc_values[i]*modisArg->radi_off_values[i];
 
+        /* The special values 65500-65535 are unpacked to -999 + (65535 - value). See kernels/unpackKernels.c */
+        unpackUint16Radiance( temp_uint16_pointer, temp_float_pointer, bandEnd - pos,
+                              modisArg->radi_sc_values[i], temp_scale_offset );
+        temp_uint16_pointer += bandEnd - pos;
+        temp_float_pointer += bandEnd - pos;
+        pos = bandEnd;
+    }
 
-        output_dataBuffer = malloc(sizeof output_dataBuffer *buffer_size);
-        temp_float_pointer = output_dataBuffer;
+    return RET_SUCCESS;
+}
 
-        unsigned short temp_input_val;
+/* Number of 1km frames (columns) of a MODIS swath. Used to tell 1km, 500m and 250m data apart. */
+#define MODIS_1KM_FRAMES 1354
+/* Number of 1km rows in one MODIS scan */
+#define MODIS_1KM_SCAN_ROWS 10
 
-        if(has_la_data == 1)
-        {
-            for(int i = 0; i<buffer_size; i++)
-            {
+/*
+                    streamMODIS_Unpack
+    DESCRIPTION:
+        Streaming version of the readThenWrite_MODIS_Unpack data transfer. Instead of
+        reading the whole [band][row][column] radiance SDS and allocating a float copy of
+        it, it selects the SDS once, reads numScans MODIS scans of all bands at a time with
+        SDreaddata(), unpacks them and writes them with a hyperslab selection into an
+        output dataset that is created beforehand. With USE_CHUNK=1 the output is chunked
+        with one chunk per scan and band, and compressed according to TERRA_FILTERS or
+        USE_GZIP (see chunkPolicy.c); otherwise it is contiguous like the other transfers.
 
-                rdqi = (*temp_uint16_pointer)&rdqi_mask;
-                if(rdqi == 2 || rdqi == 3)
-                    *temp_float_pointer = -999.0;
-                else
-                {
-                    if(rdqi == 1)
-                    {
-                        *temp_la_data_pos_pointer = i;
-                        temp_la_data_pos_pointer++;
-                    }
-                    temp_input_val = (*temp_uint16_pointer)>>2;
-                    if(temp_input_val == 16378 || temp_input_val == 16380)
-                        *temp_float_pointer = -999.0;
-                    else
-                        *temp_float_pointer = scale_factor*((float)temp_input_val);
-                }
-                temp_uint16_pointer++;
-                temp_float_pointer++;
-            }
-        }
-        else
-        {
-            for(int i = 0; i<buffer_size; i++)
-            {
-                rdqi = (*temp_uint16_pointer)&rdqi_mask;
-                if(rdqi == 2 || rdqi == 3)
-                    *temp_float_pointer = -999.0;
-                else
-                {
-                    temp_input_val = (*temp_uint16_pointer)>>2;
-                    if(temp_input_val == 16378 || temp_input_val == 16380)
-                        *temp_float_pointer = -999.0;
-                    else
-                        *temp_float_pointer = scale_factor*((float)temp_input_val);
-                }
-                temp_uint16_pointer++;
-                temp_float_pointer++;
-            }
-        }
+        One scan is 10 rows at 1km, 20 rows at 500m and 40 rows at 250m. The resolution
+        is derived from the number of columns (1354 at 1km).
 
-        /* Here we want to record the low accuracy data information for this dataset.*/
-        if(has_la_data ==1)
-        {
+    ARGUMENTS:
+        1. outputGroupID  -- The output HDF5 group
+        2. datasetName    -- The name of the input SDS and of the output dataset
+        3. inputDataType  -- The HDF4 type of the SDS (DFNT_UINT16)
+        4. inputFileID    -- The HDF4 input file identifier
+        5. dataDimSizes   -- The dimension sizes of the SDS (rank 3) within the orbit window
+        6. unpackArg      -- The radiance scales and offsets
+        7. numScans       -- Number of scans to read at a time
 
-            hid_t la_pos_dsetid =0 ;
-            int la_pos_dset_rank = 1;
-            hsize_t la_pos_dset_dims[1];
-            la_pos_dset_dims[0]= num_la_data;
-            char* la_pos_dset_name_suffix="_low_accuracy_pos";
-            size_t la_pos_dset_name_len = strlen(la_pos_dset_name_suffix)+strlen(newdatasetName)+1;
-            char* la_pos_dset_name=malloc(la_pos_dset_name_len);
-            la_pos_dset_name[la_pos_dset_name_len-1]='\0';
-            strcpy(la_pos_dset_name,newdatasetName);
-            strcat(la_pos_dset_name,la_pos_dset_name_suffix);
-
-            /* Create a dataset to remember the postion of low accuracy data */
-            la_pos_dsetid = insertDataset( &outputFile, &outputGroupID, 1, la_pos_dset_rank,
-                                           la_pos_dset_dims, H5T_NATIVE_INT, la_pos_dset_name, la_data_pos );
-
-            if ( la_pos_dsetid == FATAL_ERR )
-            {
-                 FATAL_MSG("Error writing %s dataset.\n", newdatasetName );
-                if(la_pos_dset_name)
-                    free(la_pos_dset_name);
-                if(la_data_pos)
-                    free(la_data_pos);
-                H5Dclose(la_pos_dsetid);
-                return (FATAL_ERR);
-            }
-            if(la_pos_dset_name)
-                free(la_pos_dset_name);
-            if(la_data_pos)
-                free(la_data_pos);
+    EFFECTS:
+        Peak memory is numScans scans of all bands, once as uint16 and once as float. The
+        buffers are allocated once and reused for every slab.
+        It is the responsibility of the caller to close the returned dataset ID.
 
-            H5Dclose(la_pos_dsetid);
-        }
-        //else { } may add an attribute to the group later.
+    RETURN:
+        Returns the dataset identifier if successful. Else returns FATAL_ERR.
+*/
+static hid_t streamMODIS_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType, int32 inputFileID,
+                                 const int32* dataDimSizes, MODISunpackArg_t* unpackArg, int numScans )
+{
+    int32 start[DIM_MAX] = {0};
+    int32 count[DIM_MAX] = {0};
+    int32 windowStart[DIM_MAX] = {0};
+    int32 sdsDimSizes[DIM_MAX] = {0};
+    int32 sds_id = FAIL;
+    int32 sds_index, rank, ntype, num_attrs;
+    hsize_t dims[3];
+    hsize_t h5start[3] = {0};
+    hsize_t h5count[3];
+    unsigned short* input_dataBuffer = NULL;
+    float* output_dataBuffer = NULL;
+    char* correct_dsetname = NULL;
+    hid_t plist = 0;
+    hid_t fileSpace = 0;
+    hid_t memSpace = 0;
+    hid_t datasetID = FATAL_ERR;
+    int32 nBands = dataDimSizes[0];
+    int32 nRows = dataDimSizes[1];
+    int32 nCols = dataDimSizes[2];
+    int32 scanRows = MODIS_1KM_SCAN_ROWS;
+    int32 slabRows = 0;
+
+    if ( nCols % MODIS_1KM_FRAMES == 0 && nCols > 0 )
+        scanRows = MODIS_1KM_SCAN_ROWS * (nCols / MODIS_1KM_FRAMES);
+    if ( scanRows > nRows ) scanRows = nRows;
+    slabRows = min( numScans * scanRows, nRows );
+
+    for ( int i = 0; i < 3; i++ )
+        dims[i] = (hsize_t) dataDimSizes[i];
+
+    /* The SDS is selected once for all slabs. Rows are read relative to the orbit window (see orbitWindow.c). */
+    sds_index = SDnametoindex( inputFileID, datasetName );
+    if ( sds_index < 0 )
+    {
+        FATAL_MSG("SDnametoindex: Failed to get index of dataset \"%s\".\n", datasetName );
+        return FATAL_ERR;
+    }
+    sds_id = SDselect( inputFileID, sds_index );
+    if ( sds_id < 0 )
+    {
+        FATAL_MSG("SDselect: Failed to select dataset \"%s\".\n", datasetName );
+        return FATAL_ERR;
+    }
+    if ( SDgetinfo( sds_id, NULL, &rank, sdsDimSizes, &ntype, &num_attrs ) < 0 || rank != 3 ||
+         ntype != inputDataType )
+    {
+        FATAL_MSG("SDgetinfo: \"%s\" is not the expected radiance dataset.\n", datasetName );
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
+    orbitWindowSDS( sds_id, rank, sdsDimSizes, windowStart );
+    if ( sdsDimSizes[0] != nBands || sdsDimSizes[1] != nRows || sdsDimSizes[2] != nCols )
+    {
+        FATAL_MSG("The dimensions of \"%s\" changed.\n", datasetName );
+        SDendaccess(sds_id);
+        return FATAL_ERR;
     }
 
-
-    /* END READ DATA. BEGIN INSERTION OF DATA */
-
-    /* Because we are converting from HDF4 to HDF5, there are a few type mismatches
-     * that need to be resolved. Thus, we need to take the DimSizes array, which is
-     * of type int32 (an HDF4 type) and put it into an array of type hsize_t.
-     * A simple casting might work, but that is dangerous considering hsize_t and int32
-     * are not simply two different names for the same type. They are two different types.
-     */
-    hsize_t temp[DIM_MAX];
-    for ( int i = 0; i < DIM_MAX; i++ )
-        temp[i] = (hsize_t) dataDimSizes[i];
-
-
-    outputDataType = H5T_NATIVE_FLOAT;
-
-    short use_chunk = 0;
-
-    /* If using chunk */
+    /* Create the output dataset, with USE_CHUNK=1 one chunk per scan and band (see chunkPolicy.c) */
+    plist = chunkPolicyPlist( 3, dims, H5T_NATIVE_FLOAT, 0 );
+    if ( plist == FATAL_ERR )
     {
-        const char *s;
-        s = getenv("USE_CHUNK");
+        FATAL_MSG("Cannot create the HDF5 dataset creation property list.\n");
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
-        if(s && isdigit((int)*s))
-            if((unsigned int)strtol(s,NULL,0) == 1)
-                use_chunk = 1;
+    fileSpace = H5Screate_simple( 3, dims, NULL );
+    if ( fileSpace < 0 )
+    {
+        FATAL_MSG("Cannot create the data space.\n");
+        goto cleanupFail;
     }
 
-    if(use_chunk == 1)
+    correct_dsetname = correct_name(datasetName);
+    datasetID = H5Dcreate( outputGroupID, correct_dsetname, H5T_NATIVE_FLOAT, fileSpace,
+                           H5P_DEFAULT, plist, H5P_DEFAULT );
+    if ( datasetID < 0 )
     {
-        datasetID = insertDataset_comp( &outputFile, &outputGroupID, 1, dataRank,
-                                        temp, outputDataType, newdatasetName, output_dataBuffer );
+        FATAL_MSG("H5Dcreate -- Unable to create dataset \"%s\".\n", datasetName );
+        datasetID = FATAL_ERR;
+        goto cleanupFail;
     }
-    else
+
+    input_dataBuffer = malloc( sizeof(unsigned short) * (size_t) nBands * slabRows * nCols );
+    output_dataBuffer = malloc( sizeof(float) * (size_t) nBands * slabRows * nCols );
+    if ( input_dataBuffer == NULL || output_dataBuffer == NULL )
     {
-        datasetID = insertDataset( &outputFile, &outputGroupID, 1, dataRank,
-                                   temp, outputDataType, newdatasetName, output_dataBuffer );
+        FATAL_MSG("Failed to allocate memory.\n");
+        goto cleanupFail;
     }
+    timingBuffer( sizeof(float) * (size_t) nBands * slabRows * nCols );
 
-    //datasetID = insertDataset( &outputFile, &outputGroupID, 1, dataRank ,
-    //    temp, outputDataType, newdatasetName, output_dataBuffer );
+    start[0] = windowStart[0];
+    start[2] = windowStart[2];
+    count[0] = nBands;
+    count[2] = nCols;
+    h5count[0] = (hsize_t) nBands;
+    h5count[2] = (hsize_t) nCols;
 
-    if ( datasetID == FATAL_ERR )
+    for ( int32 row = 0; row < nRows; row += slabRows )
     {
-         FATAL_MSG("Error writing %s dataset.\n", datasetName );
-        if(newdatasetName) free(newdatasetName);
-        if( input_dataBuffer) free(input_dataBuffer);
-        if( output_dataBuffer) free(output_dataBuffer);
-        return (FATAL_ERR);
-    }
+        int32 rows = min( slabRows, nRows - row );
+        size_t slabBandElems = (size_t) rows * nCols;
 
-    if ( retDatasetNamePtr )
-        *retDatasetNamePtr= correct_name(newdatasetName);
+        start[1] = windowStart[1] + row;
+        count[1] = rows;
+
+        intn readStatus = SDreaddata( sds_id, start, NULL, count, input_dataBuffer );
+        if ( readStatus < 0 )
+        {
+            FATAL_MSG("SDreaddata: Failed to read %s data.\n", datasetName );
+            goto cleanupFail;
+        }
+        timingAddRead( sizeof(unsigned short) * (size_t) nBands * slabBandElems );
 
+        /* unpackMODIS finds the band from the position, so pass the offset of each band's part */
+        for ( int32 b = 0; b < nBands; b++ )
+            unpackMODIS( input_dataBuffer + b*slabBandElems, output_dataBuffer + b*slabBandElems,
+                         slabBandElems, (size_t) b * unpackArg->band_buffer_size, unpackArg );
 
-    /*
-       tempFloat = -999.0;
-       if(H5LTset_attribute_float( datasetID, correctedName,"_FillValue",&tempFloat,1)<0) {
-            FATAL_MSG("Error writing %s dataset's fillvalue attributes.\n", datasetName );
-           if(newdatasetName) free(newdatasetName);
-           if( input_dataBuffer) free(input_dataBuffer);
-           if( output_dataBuffer) free(output_dataBuffer);
-           return (FATAL_ERR);
-
-       }
-    */
+        h5start[1] = (hsize_t) row;
+        h5count[1] = (hsize_t) rows;
+        memSpace = H5Screate_simple( 3, h5count, NULL );
+        if ( memSpace < 0 || H5Sselect_hyperslab( fileSpace, H5S_SELECT_SET, h5start, NULL, h5count, NULL ) < 0 )
+        {
+            FATAL_MSG("Cannot select the hyperslab of \"%s\".\n", datasetName );
+            goto cleanupFail;
+        }
+
+        herr_t status = H5Dwrite( datasetID, H5T_NATIVE_FLOAT, memSpace, fileSpace, H5P_DEFAULT, output_dataBuffer );
+        if ( status < 0 )
+        {
+            FATAL_MSG("H5Dwrite -- Unable to write to dataset \"%s\".\n", datasetName );
+            goto cleanupFail;
+        }
+        timingAddWritten( sizeof(float) * (size_t) nBands * slabBandElems );
+        H5Sclose(memSpace);
+        memSpace = 0;
+    }
 
+    SDendaccess(sds_id);
     free(input_dataBuffer);
     free(output_dataBuffer);
-    if(newdatasetName) free(newdatasetName);
-
+    free(correct_dsetname);
+    H5Sclose(fileSpace);
+    if ( plist != H5P_DEFAULT ) H5Pclose(plist);
     return datasetID;
+
+cleanupFail:
+    SDendaccess(sds_id);
+    if ( input_dataBuffer ) free(input_dataBuffer);
+    if ( output_dataBuffer ) free(output_dataBuffer);
+    if ( correct_dsetname ) free(correct_dsetname);
+    if ( memSpace > 0 ) H5Sclose(memSpace);
+    if ( fileSpace > 0 ) H5Sclose(fileSpace);
+    if ( datasetID > 0 ) H5Dclose(datasetID);
+    if ( plist != H5P_DEFAULT ) H5Pclose(plist);
+    return FATAL_ERR;
 }
 
 /*
@@ -1891,8 +2337,8 @@ hid_t readThenWrite_MISR_Unpack( hid_t outputGroupID, char* datasetName, char**
 */
 
 /* MY 2016-12-20 Unpack MODIS data */
-hid_t readThenWrite_MODIS_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
-                                  int32 inputFileID)
+static hid_t doReadThenWrite_MODIS_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+                                         int32 inputFileID)
 {
 
     //unsigned short special_values_unpacked[] = {65535,65534,65533,65532,65531,65530,65529,65528,65527,65526,65525,65500};
@@ -1905,175 +2351,199 @@ hid_t readThenWrite_MODIS_Unpack( hid_t outputGroupID, char* datasetName, int32
     float* output_dataBuffer = NULL;
     hid_t datasetID = 0;
     hid_t outputDataType = 0;
+    MODISunpackArg_t unpackArg;
 
+    intn status = -1;
 
-    unsigned short special_values_start = 65535;
-    unsigned short special_values_stop = 65500;
+    /* 1. Obtain radiance_scales and radiance_offsets. */
+    int32 sds_id = -1;
+    int32 sds_index = -1;
+    int32 radi_sc_index = -1;
+    int32 radi_off_index = -1;
+    int32 radi_sc_type = -1;
+    int32 radi_off_type = -1;
+    int32 num_radi_sc_values = -1;
+    int32 num_radi_off_values = -1;
+    int32 ntype = 0;
+    int32 num_attrs = 0;
+    char temp_attr_name[H4_MAX_NC_NAME];
 
-    float special_values_packed_start = -999.0;
+    float* radi_sc_values = NULL;
+    float* radi_off_values = NULL;;
 
-    intn status = -1;
 
-    status = H4readData( inputFileID, datasetName,
-                         (void**)&input_dataBuffer, &dataRank, dataDimSizes, inputDataType,NULL,NULL,NULL );
-    if ( status < 0 )
+    /* get the index of the dataset from the dataset's name */
+    sds_index = SDnametoindex( inputFileID, datasetName );
+    if( sds_index < 0 )
     {
-         FATAL_MSG("Unable to read %s data.\n",  datasetName );
-        if ( input_dataBuffer ) free(input_dataBuffer);
-        return (FATAL_ERR);
+         FATAL_MSG("-- SDnametoindex -- Failed to get index of dataset.\n");
+        return FATAL_ERR;
     }
 
-
-    /* Data Unpack */
+    sds_id = SDselect( inputFileID, sds_index );
+    if ( sds_id < 0 )
     {
+         FATAL_MSG("SDselect -- Failed to get the ID of the dataset.\n");
+        return FATAL_ERR;
+    }
 
-        /* 1. Obtain radiance_scales and radiance_offsets. */
-        int32 sds_id = -1;
-        int32 sds_index = -1;
-        int32 radi_sc_index = -1;
-        int32 radi_off_index = -1;
-        int32 radi_sc_type = -1;
-        int32 radi_off_type = -1;
-        int32 num_radi_sc_values = -1;
-        int32 num_radi_off_values = -1;
-        char temp_attr_name[H4_MAX_NC_NAME];
+    /* The number of bands is needed before the data is read */
+    if ( SDgetinfo( sds_id, NULL, &dataRank, dataDimSizes, &ntype, &num_attrs ) < 0 )
+    {
+         FATAL_MSG("SDgetinfo -- Failed to get info from dataset.\n");
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
+    orbitWindowSDS( sds_id, dataRank, dataDimSizes, NULL );
 
-        float* radi_sc_values = NULL;
-        float* radi_off_values = NULL;;
+    radi_sc_index = SDfindattr(sds_id,radi_scales);
+    if(radi_sc_index < 0)
+    {
+         FATAL_MSG("Cannot find attribute %s of variable %s\n",radi_scales,datasetName);
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
+    if(SDattrinfo (sds_id, radi_sc_index, temp_attr_name, &radi_sc_type, &num_radi_sc_values)<0)
+    {
+         FATAL_MSG("Cannot obtain SDS attribute %s of variable %s\n",radi_scales,datasetName);
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
-        /* get the index of the dataset from the dataset's name */
-        sds_index = SDnametoindex( inputFileID, datasetName );
-        if( sds_index < 0 )
-        {
-             FATAL_MSG("-- SDnametoindex -- Failed to get index of dataset.\n");
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
+    radi_off_index = SDfindattr(sds_id,radi_offset);
+    if(radi_off_index < 0)
+    {
+         FATAL_MSG("Cannot find attribute %s of variable %s\n",radi_offset,datasetName);
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
-        sds_id = SDselect( inputFileID, sds_index );
-        if ( sds_id < 0 )
-        {
-             FATAL_MSG("SDselect -- Failed to get the ID of the dataset.\n");
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
 
-        radi_sc_index = SDfindattr(sds_id,radi_scales);
-        if(radi_sc_index < 0)
-        {
-             FATAL_MSG("Cannot find attribute %s of variable %s\n",radi_scales,datasetName);
-            SDendaccess(sds_id);
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
+    if(SDattrinfo (sds_id, radi_off_index, temp_attr_name, &radi_off_type, &num_radi_off_values)<0)
+    {
+         FATAL_MSG("Cannot obtain SDS attribute %s of variable %s\n",radi_offset,datasetName);
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
-        if(SDattrinfo (sds_id, radi_sc_index, temp_attr_name, &radi_sc_type, &num_radi_sc_values)<0)
-        {
-             FATAL_MSG("Cannot obtain SDS attribute %s of variable %s\n",radi_scales,datasetName);
-            SDendaccess(sds_id);
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
+    if(radi_sc_type != DFNT_FLOAT32 || radi_sc_type != radi_off_type || num_radi_sc_values != num_radi_off_values)
+    {
+         FATAL_MSG("Error: ");
+        fprintf(stderr, "Either the scale/offset datatype is not 32-bit floating-point type\n\tor there is inconsistency between scale and offset datatype or number of values\n");
+        fprintf(stderr, "\tThis is for the variable %s\n",datasetName);
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
-        radi_off_index = SDfindattr(sds_id,radi_offset);
-        if(radi_off_index < 0)
-        {
-             FATAL_MSG("Cannot find attribute %s of variable %s\n",radi_offset,datasetName);
-            SDendaccess(sds_id);
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
 
+    radi_sc_values = calloc((size_t)num_radi_sc_values,sizeof radi_sc_values);
+    radi_off_values= calloc((size_t)num_radi_off_values,sizeof radi_off_values);
 
-        if(SDattrinfo (sds_id, radi_off_index, temp_attr_name, &radi_off_type, &num_radi_off_values)<0)
-        {
-             FATAL_MSG("Cannot obtain SDS attribute %s of variable %s\n",radi_offset,datasetName);
-            SDendaccess(sds_id);
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
+    if(SDreadattr(sds_id,radi_sc_index,radi_sc_values) <0)
+    {
+         FATAL_MSG("Cannot obtain SDS attribute value %s of variable %s\n",radi_scales,datasetName);
+        free(radi_sc_values);
+        free(radi_off_values);
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
-        if(radi_sc_type != DFNT_FLOAT32 || radi_sc_type != radi_off_type || num_radi_sc_values != num_radi_off_values)
-        {
-             FATAL_MSG("Error: ");
-            fprintf(stderr, "Either the scale/offset datatype is not 32-bit floating-point type\n\tor there is inconsistency between scale and offset datatype or number of values\n");
-            fprintf(stderr, "\tThis is for the variable %s\n",datasetName);
-            SDendaccess(sds_id);
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
 
+    if(SDreadattr(sds_id,radi_off_index,radi_off_values) <0)
+    {
+         FATAL_MSG("Cannot obtain SDS attribute value %s of variable %s\n",radi_scales,datasetName);
+        free(radi_sc_values);
+        free(radi_off_values);
+        SDendaccess(sds_id);
+        return FATAL_ERR;
+    }
 
-        radi_sc_values = calloc((size_t)num_radi_sc_values,sizeof radi_sc_values);
-        radi_off_values= calloc((size_t)num_radi_off_values,sizeof radi_off_values);
+    SDendaccess(sds_id);
 
-        if(SDreadattr(sds_id,radi_sc_index,radi_sc_values) <0)
-        {
-             FATAL_MSG("Cannot obtain SDS attribute value %s of variable %s\n",radi_scales,datasetName);
-            free(radi_sc_values);
-            free(radi_off_values);
-            SDendaccess(sds_id);
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
+    int num_bands = dataDimSizes[0];
 
+    if(num_bands != num_radi_off_values)
+    {
+         FATAL_MSG("Error: Number of band (the first dimension size) of the variable %s\n\tis not the same as the number of scale/offset values\n",datasetName);
+        free(radi_sc_values);
+        free(radi_off_values);
+        return FATAL_ERR;
+    }
 
-        if(SDreadattr(sds_id,radi_off_index,radi_off_values) <0)
-        {
-             FATAL_MSG("Cannot obtain SDS attribute value %s of variable %s\n",radi_scales,datasetName);
-            free(radi_sc_values);
-            free(radi_off_values);
-            SDendaccess(sds_id);
-            free(input_dataBuffer);
-            return FATAL_ERR;
-        }
+    assert(dataRank>1);
+    unpackArg.radi_sc_values = radi_sc_values;
+    unpackArg.radi_off_values = radi_off_values;
+    unpackArg.band_buffer_size = 1;
+    for(int i = 1; i <dataRank; i++)
+        unpackArg.band_buffer_size *=dataDimSizes[i];
 
-        SDendaccess(sds_id);
+    outputDataType = H5T_NATIVE_FLOAT;
 
+    /* Scan-line streaming, TERRA_MODIS_STREAM gives the number of scans per read */
+    {
+        const char *s;
+        int num_scans = 0;
+        s = getenv("TERRA_MODIS_STREAM");
 
-        float* temp_float_pointer = NULL;
-        unsigned short* temp_uint16_pointer = input_dataBuffer;
-        size_t buffer_size = 1;
-        size_t band_buffer_size = 1;
-        int num_bands = dataDimSizes[0];
+        if(s && isdigit((int)*s))
+            num_scans = (int)strtol(s,NULL,10);
 
-        if(num_bands != num_radi_off_values)
+        if ( num_scans > 0 && dataRank == 3 )
         {
-             FATAL_MSG("Error: Number of band (the first dimension size) of the variable %s\n\tis not the same as the number of scale/offset values\n",datasetName);
+            datasetID = streamMODIS_Unpack( outputGroupID, datasetName, inputDataType, inputFileID,
+                                            dataDimSizes, &unpackArg, num_scans );
             free(radi_sc_values);
             free(radi_off_values);
-            free(input_dataBuffer);
-            return FATAL_ERR;
+            if ( datasetID == FATAL_ERR )
+                 FATAL_MSG("Error writing %s dataset.\n", datasetName );
+            return datasetID;
         }
+    }
 
-        assert(dataRank>1);
-        for(int i = 1; i <dataRank; i++)
-            band_buffer_size *=dataDimSizes[i];
+    /* Overlap the read, the unpacking and the write of consecutive slabs */
+    if ( pipelineEnabled() )
+    {
+        TERRApipeline_t pipe;
+        memset(&pipe, 0, sizeof(pipe));
+        pipe.inputFileID = inputFileID;
+        pipe.inDatasetName = datasetName;
+        pipe.inputDataType = inputDataType;
+        pipe.outputGroupID = outputGroupID;
+        pipe.outputDataType = outputDataType;
+        pipe.outElemSize = sizeof(float);
+        pipe.convert = unpackMODIS;
+        pipe.convertArg = &unpackArg;
 
-        buffer_size = band_buffer_size*num_bands;
+        datasetID = pipelineTransfer(&pipe);
+        free(radi_sc_values);
+        free(radi_off_values);
+        if ( datasetID == FATAL_ERR )
+             FATAL_MSG("Error writing %s dataset.\n", datasetName );
+        return datasetID;
+    }
 
-        output_dataBuffer = malloc(sizeof output_dataBuffer *buffer_size);
+    status = H4readData( inputFileID, datasetName,
+                         (void**)&input_dataBuffer, &dataRank, dataDimSizes, inputDataType,NULL,NULL,NULL );
+    if ( status < 0 )
+    {
+         FATAL_MSG("Unable to read %s data.\n",  datasetName );
+        if ( input_dataBuffer ) free(input_dataBuffer);
+        free(radi_sc_values);
+        free(radi_off_values);
+        return (FATAL_ERR);
+    }
 
-        temp_float_pointer = output_dataBuffer;
 
+    /* Data Unpack */
+    {
+        size_t buffer_size = unpackArg.band_buffer_size*num_bands;
+
+        output_dataBuffer = malloc(sizeof output_dataBuffer *buffer_size);
+        timingBuffer( sizeof(float) * buffer_size );
+
+        unpackMODIS( input_dataBuffer, output_dataBuffer, buffer_size, 0, &unpackArg );
 
-        for(int i = 0; i<num_bands; i++)
-        {
-            float temp_scale_offset = radi_sc_values[i]*radi_off_values[i];
-            for(int j = 0; j<band_buffer_size; j++)
-            {
-                /* Check special values  , here I may need to make it a little clear.*/
-                if(((*temp_uint16_pointer)<=special_values_start) && ((*temp_uint16_pointer)>=special_values_stop))
-                    *temp_float_pointer = special_values_packed_start +(special_values_start-(*temp_uint16_pointer));
-                else
-                {
-                    *temp_float_pointer = radi_sc_values[i]*(*temp_uint16_pointer) - temp_scale_offset;
-                }
-                temp_uint16_pointer++;
-                temp_float_pointer++;
-            }
-        }
         free(radi_sc_values);
         free(radi_off_values);
 
@@ -2094,33 +2564,7 @@ hid_t readThenWrite_MODIS_Unpack( hid_t outputGroupID, char* datasetName, int32
     for ( int i = 0; i < DIM_MAX; i++ )
         temp[i] = (hsize_t) dataDimSizes[i];
 
-    outputDataType = H5T_NATIVE_FLOAT;
-#if 0
-    short use_chunk = 0;
-
-    /* If using chunk */
-    {
-        const char *s;
-        s = getenv("USE_CHUNK");
-
-        if(s && isdigit((int)*s))
-            if((unsigned int)strtol(s,NULL,0) == 1)
-                use_chunk = 1;
-    }
-
-    if(use_chunk == 1)
-    {
-        datasetID = insertDataset_comp( &outputFile, &outputGroupID, 1, dataRank,
-                                        temp, outputDataType, datasetName, output_dataBuffer );
-    }
-    else
-    {
-        datasetID = insertDataset( &outputFile, &outputGroupID, 1, dataRank,
-                                   temp, outputDataType, datasetName, output_dataBuffer );
-    }
-#endif
-
-
+    /* Chunked with the MODIS chunk policy when USE_CHUNK=1 (see chunkPolicy.c) */
     datasetID = insertDataset( &outputFile, &outputGroupID, 1, dataRank,
                                temp, outputDataType, datasetName, output_dataBuffer );
 
@@ -2140,8 +2584,18 @@ hid_t readThenWrite_MODIS_Unpack( hid_t outputGroupID, char* datasetName, int32
     return datasetID;
 }
 
+/* Runs doReadThenWrite_MODIS_Unpack() inside a timing record (see timing.c) */
+hid_t readThenWrite_MODIS_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+                                  int32 inputFileID)
+{
+    int timer = timingBegin("readThenWrite_MODIS_Unpack", datasetName, NULL);
+    hid_t ret = doReadThenWrite_MODIS_Unpack( outputGroupID, datasetName, inputDataType, inputFileID );
+    timingEnd(timer);
+    return ret;
+}
+
 /* Unpack MODIS uncertainty */
-hid_t readThenWrite_MODIS_Uncert_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+static hid_t doReadThenWrite_MODIS_Uncert_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
         int32 inputFileID)
 {
 
@@ -2300,29 +2754,33 @@ hid_t readThenWrite_MODIS_Uncert_Unpack( hid_t outputGroupID, char* datasetName,
         buffer_size = band_buffer_size*num_bands;
 
         output_dataBuffer = malloc(sizeof output_dataBuffer *buffer_size);
+        timingBuffer( sizeof(float) * buffer_size );
 
         temp_float_pointer = output_dataBuffer;
 
-
         for(int i = 0; i<num_bands; i++)
         {
-            for(int j = 0; j<band_buffer_size; j++)
+            /* A uint8 has only 256 values. Unpack them once per band instead of calling exp() for every pixel. */
+            float unpacked_values[256];
+            for(int v = 0; v<256; v++)
             {
+                uint8_t packed_value = (uint8_t)v;
                 /* Check special values  , here I may need to make it a little clear.*/
-                if((*temp_uint8_pointer)== fvalue)
-                    *temp_float_pointer = fvalue_packed;
-                else if(((*temp_uint8_pointer)<valid_min) && ((*temp_uint8_pointer)>valid_max))
+                if(packed_value== fvalue)
+                    unpacked_values[v] = fvalue_packed;
+                else if((packed_value<valid_min) && (packed_value>valid_max))
                 {
                     /* currently set any invalid value to fill values */
-                    *temp_float_pointer = fvalue_packed;
+                    unpacked_values[v] = fvalue_packed;
                 }
                 else
                 {
-                    *temp_float_pointer = uncert_values[i]*exp((*temp_uint8_pointer)/sc_values[i]);
+                    unpacked_values[v] = uncert_values[i]*exp(packed_value/sc_values[i]);
                 }
-                temp_uint8_pointer++;
-                temp_float_pointer++;
             }
+            unpackUint8Table( temp_uint8_pointer, temp_float_pointer, band_buffer_size, unpacked_values );
+            temp_uint8_pointer += band_buffer_size;
+            temp_float_pointer += band_buffer_size;
         }
         free(sc_values);
         free(uncert_values);
@@ -2385,6 +2843,17 @@ hid_t readThenWrite_MODIS_Uncert_Unpack( hid_t outputGroupID, char* datasetName,
 
     return datasetID;
 }
+
+/* Runs doReadThenWrite_MODIS_Uncert_Unpack() inside a timing record (see timing.c) */
+hid_t readThenWrite_MODIS_Uncert_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+        int32 inputFileID)
+{
+    int timer = timingBegin("readThenWrite_MODIS_Uncert_Unpack", datasetName, NULL);
+    hid_t ret = doReadThenWrite_MODIS_Uncert_Unpack( outputGroupID, datasetName, inputDataType, inputFileID );
+    timingEnd(timer);
+    return ret;
+}
+
 /*
                     readThenWrite_MODIS_GeoMetry_Unpack
     DESCRIPTION:
@@ -2423,7 +2892,7 @@ hid_t readThenWrite_MODIS_Uncert_Unpack( hid_t outputGroupID, char* datasetName,
 */
 
 /* MY 2017-03-03 Unpack MODIS Geometry data */
-hid_t readThenWrite_MODIS_GeoMetry_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+static hid_t doReadThenWrite_MODIS_GeoMetry_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
         int32 inputFileID)
 {
 
@@ -2507,6 +2976,7 @@ hid_t readThenWrite_MODIS_GeoMetry_Unpack( hid_t outputGroupID, char* datasetNam
             buffer_size *=dataDimSizes[i];
 
         output_dataBuffer = malloc(sizeof output_dataBuffer *buffer_size);
+        timingBuffer( sizeof(float) * buffer_size );
 
         temp_float_pointer = output_dataBuffer;
         short scaled_fillvalue = -32767;
@@ -2541,32 +3011,7 @@ hid_t readThenWrite_MODIS_GeoMetry_Unpack( hid_t outputGroupID, char* datasetNam
         temp[i] = (hsize_t) dataDimSizes[i];
 
     outputDataType = H5T_NATIVE_FLOAT;
-#if 0
-    short use_chunk = 0;
-
-    /* If using chunk */
-    {
-        const char *s;
-        s = getenv("USE_CHUNK");
-
-        if(s && isdigit((int)*s))
-            if((unsigned int)strtol(s,NULL,0) == 1)
-                use_chunk = 1;
-    }
-
-    if(use_chunk == 1)
-    {
-        datasetID = insertDataset_comp( &outputFile, &outputGroupID, 1, dataRank,
-                                        temp, outputDataType, datasetName, output_dataBuffer );
-    }
-    else
-    {
-        datasetID = insertDataset( &outputFile, &outputGroupID, 1, dataRank,
-                                   temp, outputDataType, datasetName, output_dataBuffer );
-    }
-#endif
-
-
+    /* Chunked with the MODIS chunk policy when USE_CHUNK=1 (see chunkPolicy.c) */
     datasetID = insertDataset( &outputFile, &outputGroupID, 1, dataRank,
                                temp, outputDataType, datasetName, output_dataBuffer );
 
@@ -2586,6 +3031,16 @@ hid_t readThenWrite_MODIS_GeoMetry_Unpack( hid_t outputGroupID, char* datasetNam
     return datasetID;
 }
 
+/* Runs doReadThenWrite_MODIS_GeoMetry_Unpack() inside a timing record (see timing.c) */
+hid_t readThenWrite_MODIS_GeoMetry_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
+        int32 inputFileID)
+{
+    int timer = timingBegin("readThenWrite_MODIS_GeoMetry_Unpack", datasetName, NULL);
+    hid_t ret = doReadThenWrite_MODIS_GeoMetry_Unpack( outputGroupID, datasetName, inputDataType, inputFileID );
+    timingEnd(timer);
+    return ret;
+}
+
 herr_t convert_SD_Attrs(int32 sd_id,hid_t h5parobj_id,char*h5obj_name,char*sds_name)
 {
 
@@ -3793,6 +4248,11 @@ herr_t copyDimension( char* dimSuffix, int32 h4fileID, char* h4datasetName, hid_
             goto cleanupFail;
         }
 
+        /* Orbit window (see orbitWindow.c): the dimension only has the window */
+        int32 fullSize = size;
+        int32 dimStart = 0;
+        orbitWindowDim( dimName, fullSize, &dimStart, &size );
+
 
         /* If dimSuffix is provided, we need to append this string to the dimName variable.*/
        
@@ -3907,7 +4367,7 @@ herr_t copyDimension( char* dimSuffix, int32 h4fileID, char* h4datasetName, hid_
                     }
 
                     /* read the dimension scale into a buffer */
-                    dimBuffer = malloc(size);
+                    dimBuffer = malloc( (size_t) fullSize * DFKNTsize(ntype) );
                     //int32 start[1] = {0};
                     //int32 stride[1] = {1};
                     //statusn = SDreaddata( h4dimID, start, stride, &dimSizes, dimBuffer );
@@ -3921,7 +4381,8 @@ herr_t copyDimension( char* dimSuffix, int32 h4fileID, char* h4datasetName, hid_
                     /* make a new dataset for our dimension scale */
 
                     tempInt = size;
-                    h5dimID = insertDataset(&outputFile, &h5dimGroupID, 1, 1, &tempInt, h5type, catString, dimBuffer);
+                    h5dimID = insertDataset(&outputFile, &h5dimGroupID, 1, 1, &tempInt, h5type, catString,
+                                            (char*) dimBuffer + (size_t) dimStart * DFKNTsize(ntype));
                     if ( h5dimID == FATAL_ERR )
                     {
                         h5dimID = 0;
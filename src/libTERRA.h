@@ -62,6 +62,53 @@ typedef struct GDateInfo
 
 } GDateInfo_t;
 
+/* CERES granule opened once for the orbit subsetting and the data transfer (see CERES.c) */
+typedef struct CERESgranule
+{
+    int32 fileID;                       // SD interface ID, 0 if closed
+    double* julianDate;                 // "Time of observation" of the whole granule
+    int32 numTimes;
+    int startIndex;                     // subset within the orbit, negative if outside
+    int endIndex;
+
+} CERESgranule_t;
+
+/* Instrument job (see parallel.c) */
+#define TERRA_JOB_MAX_ARGS 13
+
+enum { INSTR_MOPITT = 0, INSTR_CERES, INSTR_MODIS, INSTR_ASTER, INSTR_MISR };
+
+typedef struct TERRAjob
+{
+    int instrument;                     // one of the INSTR_* values
+    char* args[TERRA_JOB_MAX_ARGS];     // argv style arguments of the instrument function
+    int index;                          // CERES: 1 for FM1, 2 for FM2
+    int count;                          // granule count (CERES, MODIS, ASTER)
+    int unpack;
+    CERESgranule_t ceres;               // CERES: open granule, owned by the job
+    OInfo_t orbitInfo;                  // MOPITT, MODIS and MISR
+    int checkpoint;                     // record the instrument as complete in args[0] (see checkpoint.c)
+
+} TERRAjob_t;
+
+/* Staged read -> convert -> write transfer (see pipeline.c) */
+typedef herr_t (*TERRAconvert_t)( const void* in, void* out, size_t nElems, size_t firstElem, void* arg );
+
+typedef struct TERRApipeline
+{
+    int32 inputFileID;
+    const char* inDatasetName;
+    int32 inputDataType;
+    hid_t outputGroupID;
+    const char* outDatasetName;         // NULL: same as inDatasetName
+    hid_t outputDataType;
+    size_t outElemSize;                 // size of one converted element
+    TERRAconvert_t convert;             // NULL: write the input as is
+    void* convertArg;
+    int useChunk;
+
+} TERRApipeline_t;
+
 /*********************
  *FUNCTION PROTOTYPES*
  *********************/
@@ -70,11 +117,73 @@ extern double* TAI93toUTCoffset; // The array containing the TAI93 to UTC offset
 int numDigits(int digit);
 
 int MOPITT( char* argv[], OInfo_t cur_orbit_info);
-int CERES( char* argv[],int index,int ceres_fm_count,int32*,int32*,int32*);
-int CERES_OrbitInfo(char*argv[],int* start_index_ptr,int* end_index_ptr,OInfo_t orbit_info);
-int MODIS( char* argv[],int modis_count,int unpack );
+int CERES( char* argv[],int index,int ceres_fm_count,CERESgranule_t* granule );
+herr_t CERESopenGranule( char* fileName, OInfo_t orbit_info, CERESgranule_t* granule );
+void CERESfreeGranule( CERESgranule_t* granule );
+int MODIS( char* argv[],int modis_count,int unpack, OInfo_t orbit_info );
 int ASTER( char* argv[],int aster_count,int unpack );
-int MISR( char* argv[],int unpack );
+int MISR( char* argv[],int unpack, OInfo_t orbit_info );
+
+/* instrument dispatch (see parallel.c) */
+herr_t dispatchInstrument( const TERRAjob_t* job, int nargs );
+herr_t dispatchCheckpoint( int instrument, char* checkpointFile );
+void instrumentSkipSet( int mask );
+const char* instrumentNameOf( int instrument );
+int interpThreadCount();
+int misrThreadCount();
+
+/* timing report (see timing.c) */
+int timingInit();
+int timingBegin( const char* kind, const char* name, const char* file );
+void timingEnd( int handle );
+void timingAddRead( size_t bytes );
+void timingAddWritten( size_t bytes );
+void timingBuffer( size_t bytes );
+herr_t timingWrite( const char* outputFileName, int failed );
+
+/* resumable conversion (see checkpoint.c) */
+int checkpointEnabled();
+char* checkpointName( const char* outputFileName );
+int checkpointDone( const char* checkpointFile, const char* key );
+herr_t checkpointRecord( const char* checkpointFile, const char* key );
+herr_t checkpointRecordSkipped( const char* checkpointFile );
+herr_t checkpointLoadSkipped( const char* checkpointFile );
+herr_t checkpointSync( hid_t file );
+herr_t checkpointDropGroup( hid_t file, const char* name );
+herr_t checkpointValidate( hid_t file, const char* checkpointFile );
+herr_t checkpointResume( hid_t file, const char* checkpointFile, int* skipMask );
+
+/* input file prefetching (see prefetch.c) */
+herr_t prefetchStart( const char* inputListName );
+void prefetchConsumed( char* const* args, int nargs );
+void prefetchStop();
+
+/* per-instrument part files of a batch orbit (see merge.c) */
+herr_t mergeOrbitParts( char* outputFileName, char** partNames, int numParts );
+void granuleListIntersect( char* granList, const char* other );
+
+/* orbit window trimming of MODIS and MISR (see orbitWindow.c) */
+int orbitTrimEnabled();
+void orbitWindowSet( const char* dimKey, int32 units, int32 first, int32 count );
+void orbitWindowClear();
+int orbitWindowDim( const char* dimName, int32 size, int32* start, int32* count );
+int orbitWindowSDS( int32 sdsID, int32 rank, int32* dims, int32* start );
+herr_t orbitGranuleSkip( char* const* files, int nfiles );
+void orbitGranuleSkipReset();
+char* orbitGranuleSkipped();
+void orbitGranuleListTrim( char* granList );
+herr_t MODISorbitWindow( int32 MOD03FileID, OInfo_t orbit, int32* numScans, int32* first, int32* count );
+herr_t MISRorbitWindow( int32 hFileID, OInfo_t orbit, int32* numBlocks, int32* first, int32* count );
+
+/* chunk shapes and filters of the output datasets (see chunkPolicy.c) */
+void chunkPolicySet( int instrument );
+int chunkPolicyEnabled();
+int chunkPolicyShape( int rank, const hsize_t* dims, size_t elemSize, hsize_t* chunkDims );
+hid_t chunkPolicyPlist( int rank, const hsize_t* dims, hid_t dataType, int force );
+
+/* pipelined transfers */
+int pipelineEnabled();
+hid_t pipelineTransfer( const TERRApipeline_t* pipe );
 
 hid_t insertDataset( hid_t const *outputFileID, hid_t *datasetGroup_ID,
                      int returnDatasetID, int rank, hsize_t* datasetDims,
@@ -86,7 +195,9 @@ hid_t insertDataset_comp( hid_t const *outputFileID, hid_t *datasetGroup_ID,
                           hid_t dataType, char* datasetName, void* data_out);
 
 herr_t openFile(hid_t *file, char* inputFileName, unsigned flags );
+int coreVfdEnabled();
 herr_t createOutputFile( hid_t *outputFile, char* outputFileName);
+herr_t reopenOutputFile( hid_t *outputFile, char* outputFileName);
 herr_t createGroup( hid_t const *referenceGroup, hid_t *newGroup, char* newGroupName);
 /* general type attribute creation */
 hid_t attributeCreate( hid_t objectID, const char* attrName, hid_t datatypeID );
@@ -117,6 +228,26 @@ hid_t readThenWrite_ASTER_Unpack( hid_t outputGroupID, char* datasetName, int32
 /* MISR funcions */
 hid_t readThenWrite_MISR_Unpack( hid_t outputGroupID, char* datasetName, char** correctedNameptr,int32 inputDataType,
                                  int32 inputFile, float scale_factor);
+
+/* One MISR radiance dataset in the read -> unpack -> write stages of readThenWrite_MISR_Unpack */
+typedef struct MISRradiance
+{
+    char* datasetName;                  // input SDS name, e.g. "Red Radiance/RDQI"
+    float scale_factor;
+    int32 rank;
+    int32 dims[DIM_MAX];
+    unsigned short* in;                 // packed data
+    float* out;                         // unpacked data
+    unsigned int* la_data_pos;          // positions of the low accuracy (RDQI == 1) data
+    size_t num_la_data;
+    size_t la_data_cap;
+
+} MISRradiance_t;
+
+herr_t MISRreadRadiance( int32 inputFileID, MISRradiance_t* rad );
+herr_t MISRunpackRadiance( MISRradiance_t* rad );
+hid_t MISRwriteRadiance( hid_t outputGroupID, MISRradiance_t* rad, char** retDatasetNamePtr );
+void MISRfreeRadiance( MISRradiance_t* rad );
 hid_t readThenWrite_MODIS_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
                                   int32 inputFileID);
 hid_t readThenWrite_MODIS_Uncert_Unpack( hid_t outputGroupID, char* datasetName, int32 inputDataType,
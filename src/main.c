@@ -1,3 +1,4 @@
+#define _GNU_SOURCE     // fork, wait4 and strdup with -std=c99
 #include "libTERRA.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,15 +7,47 @@
 #include <assert.h>
 #include <curses.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #define STR_LEN 500
 #define LOGIN_NODE "login"
 #define MOM_NODE
+#define BATCH_MAX_PROCS 256
 
 
 
 int getNextLine ( char* string, FILE* const inputFile );
-
-int main( int argc, char* argv[] )
+static const OInfo_t* findOrbit( const OInfo_t* orbits, size_t numOrbits, unsigned int orbitNumber );
+
+/*
+                    convertOrbit
+    DESCRIPTION:
+        Converts one orbit: creates the output file and transfers the granules of every
+        instrument listed in the input file list into it. This is what a basicFusion
+        process does with its arguments; the batch modes (see main) call it once per orbit
+        with the orbit_info.bin table and the TAI93 offsets loaded only once.
+
+        When instrument is one of the INSTR_* values, only that instrument is converted,
+        into a part file of the orbit (see runBatch). The InputGranules attribute still
+        lists the granules of all instruments; only those that this instrument skipped
+        are left out.
+
+    ARGUMENTS:
+        char* argv[]           -- The program name, the output file name and the input file
+                                  list name, as in "basicFusion out.h5 inputFiles.txt"
+        const OInfo_t* orbits  -- The content of orbit_info.bin
+        size_t numOrbits       -- Number of entries of orbits
+        int instrument         -- The only instrument to convert, -1 for all of them
+
+    RETURN:
+        FATAL_ERR on failure
+        RET_SUCCESS on success
+*/
+static int convertOrbit( char* argv[], const OInfo_t* orbits, size_t numOrbits, int instrument )
 {
 
     char* MOPITTargs[3] = {NULL};
@@ -74,17 +107,10 @@ int main( int argc, char* argv[] )
     int ceres_count = 1;
     int ceres_fm1_count = 1;
     int ceres_fm2_count = 1;
-    int ceres_start_index = 0;
-    int* ceres_start_index_ptr=&ceres_start_index;
-    int ceres_end_index = 0;
-    int* ceres_end_index_ptr=&ceres_end_index;
-    int ceres_subset_num_elems = 0;
-    int32* ceres_subset_num_elems_ptr=NULL;
+    CERESgranule_t ceresGranule;
     int modis_count = 1;
     int aster_count = 1;
-    FILE* new_orbit_info_b = NULL;
     OInfo_t current_orbit_info;
-    OInfo_t* test_orbit_ptr = NULL;
 
     FILE* inputFile = NULL;
     char inputLine[STR_LEN];
@@ -98,15 +124,20 @@ int main( int argc, char* argv[] )
     int useGZIP = 0;
     int useChunk = 0;
 
-    if ( argc != 4 )
-    {
-        fprintf( stderr, "Usage: %s [outputFile] [inputFiles.txt] [orbit_info.bin]\n", argv[0] );
-        fprintf( stderr, "Set environment variable TERRA_DATA_UNPACK to non-zero for unpacking.\n");
-        goto cleanupFail;
-    }
+    /* The instrument calls (see parallel.c) */
+    TERRAjob_t job;
+
+    /* TERRA_RESUME=1: the checkpoint file of the output file (see checkpoint.c) */
+    char* checkpointFile = NULL;
+    int resumed = 0;
+    int skipMask = 0;
+
+    memset(&ceresGranule, 0, sizeof(ceresGranule));
+    outputFile = 0;
 
     /* Get the starting execution Unix time */
     sTime = time(NULL);    
+    timingInit();
 
     /* open the input file list */
     inputFile = fopen( argv[2], "r" );
@@ -117,27 +148,9 @@ int main( int argc, char* argv[] )
         goto cleanupFail;
     }
 
-    // open the orbit_info.bin file
-    new_orbit_info_b = fopen(argv[3],"r");
-    long fSize;
-
-    // get the size of the file
-    fseek(new_orbit_info_b,0,SEEK_END);
-    fSize = ftell(new_orbit_info_b);
-    // rewind file pointer to beginning of file
-    rewind(new_orbit_info_b);
-
-
-    test_orbit_ptr = calloc(fSize/sizeof(OInfo_t),sizeof(OInfo_t));
-
-    // read the file into the test_orbit_ptr struct array
-    size_t result = fread(test_orbit_ptr,sizeof(OInfo_t),fSize/sizeof(OInfo_t),new_orbit_info_b);
-    if(result != fSize/sizeof(OInfo_t))
-    {
-        FATAL_MSG("fread is not successful.\n");
-        goto cleanupFail;
-    }
-
+    /* No-op unless TERRA_PREFETCH is set */
+    if ( prefetchStart( argv[2] ) == FATAL_ERR )
+        WARN_MSG("Unable to start prefetching the input files, continuing without.\n");
 
     /* Get the orbit number from inputFiles.txt */
     status = getNextLine( inputLine, inputFile );
@@ -153,19 +166,13 @@ int main( int argc, char* argv[] )
     }
 
     int current_orbit_number = atoi(inputLine);
-    for ( int i = 0; i<fSize/sizeof(OInfo_t); i++)
+    const OInfo_t* orbitRecord = findOrbit( orbits, numOrbits, (unsigned int) current_orbit_number );
+    if ( orbitRecord == NULL )
     {
-        if( test_orbit_ptr[i].orbit_number == current_orbit_number )
-        {
-            current_orbit_info = test_orbit_ptr[i];
-            break;
-        }
+        FATAL_MSG("Orbit %d of %s is not in the orbit info file or its record is corrupt.\n", current_orbit_number, argv[2]);
+        goto cleanupFail;
     }
-
-    fclose(new_orbit_info_b);
-    new_orbit_info_b = NULL;
-    free(test_orbit_ptr);
-    test_orbit_ptr = NULL;
+    current_orbit_info = *orbitRecord;
 
 
 
@@ -205,16 +212,64 @@ int main( int argc, char* argv[] )
                       Correction: leave it for the time being since the createOutputFile uses the EXCL flag.
                       TODO: Will turn this off in the operation.
     */
-    remove( argv[1] );
+    if ( checkpointEnabled() )
+    {
+        /* The core driver leaves nothing on disk to resume before the file is closed */
+        if ( coreVfdEnabled() )
+            WARN_MSG("TERRA_RESUME=1 with TERRA_CORE_VFD=1 only records complete orbits: a failed orbit is converted again from scratch.\n");
+
+        checkpointFile = checkpointName( argv[1] );
+        if ( checkpointFile == NULL )
+            goto cleanupFail;
+
+        if ( checkpointDone( checkpointFile, "COMPLETE" ) && access( argv[1], F_OK ) == 0 )
+        {
+            printf("%s is already complete.\n", argv[1]);
+            goto cleanup;
+        }
+
+        /* Continue the output file of an earlier run */
+        if ( access( checkpointFile, F_OK ) == 0 && access( argv[1], F_OK ) == 0 )
+        {
+            /* Skip the completed instruments and drop what the others left behind */
+            if ( reopenOutputFile( &outputFile, argv[1] ) == RET_SUCCESS )
+            {
+                if ( checkpointResume( outputFile, checkpointFile, &skipMask ) == RET_SUCCESS )
+                    resumed = 1;
+                else
+                {
+                    H5Fclose(outputFile);
+                    skipMask = 0;
+                }
+            }
 
-    /* create the output file or open it if it exists */
-    if ( createOutputFile( &outputFile, argv[1] ))
+            if ( !resumed )
+            {
+                WARN_MSG("Unable to resume %s, it is converted again.\n", argv[1]);
+                outputFile = 0;
+            }
+        }
+    }
+
+    if ( !resumed )
     {
-        FATAL_MSG("Unable to create output file.\n");
-        outputFile = 0;
-        goto cleanupFail;
+        remove( argv[1] );
+        if ( checkpointFile ) remove( checkpointFile );
+
+        /* create the output file or open it if it exists */
+        if ( createOutputFile( &outputFile, argv[1] ))
+        {
+            FATAL_MSG("Unable to create output file.\n");
+            outputFile = 0;
+            goto cleanupFail;
+        }
     }
 
+    /* A part file holds a single instrument */
+    if ( instrument >= 0 )
+        skipMask |= ((1 << (INSTR_MISR + 1)) - 1) & ~(1 << instrument);
+    instrumentSkipSet( skipMask );
+
 
     /**********
      * MOPITT *
@@ -270,7 +325,12 @@ int main( int argc, char* argv[] )
                 goto cleanupFail;
             }
 
-            if ( MOPITT( MOPITTargs, current_orbit_info ) == FATAL_ERR )
+            memset(&job, 0, sizeof(job));
+            job.instrument = INSTR_MOPITT;
+            for ( int j = 0; j < 3; j++ ) job.args[j] = MOPITTargs[j];
+            job.orbitInfo = current_orbit_info;
+
+            if ( dispatchInstrument( &job, 3 ) == FATAL_ERR )
             {
                 FATAL_MSG("MOPITT failed data transfer on file:\n\t%s\nExiting program.\n", inputLine);
                 goto cleanupFail;
@@ -307,6 +367,12 @@ int main( int argc, char* argv[] )
         
     }
 
+    if ( checkpointFile && dispatchCheckpoint( INSTR_MOPITT, checkpointFile ) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to record the MOPITT checkpoint.\n");
+        goto cleanupFail;
+    }
+
     /*********
      * CERES *
      *********/
@@ -349,20 +415,16 @@ int main( int argc, char* argv[] )
                 CERESargs[2] = calloc(strlen(inputLine)+1, 1);
                 
                 strncpy( CERESargs[2], inputLine, strlen(inputLine) );
-                status = CERES_OrbitInfo(CERESargs,ceres_start_index_ptr,ceres_end_index_ptr,current_orbit_info);
+                status = CERESopenGranule(CERESargs[2],current_orbit_info,&ceresGranule);
                 if ( status == FATAL_ERR )
                 {
                     FATAL_MSG("CERES failed to obtain orbit info.\nExiting program.\n");
                     goto cleanupFail;
                 }
 
-                if(*ceres_start_index_ptr >=0 && *ceres_end_index_ptr >=0)
+                if(ceresGranule.startIndex >=0 && ceresGranule.endIndex >=0)
                 {
 
-                    ceres_subset_num_elems = (*ceres_end_index_ptr) -(*ceres_start_index_ptr)+1;
-                    ceres_subset_num_elems_ptr =&ceres_subset_num_elems;
-                    
-
                     granTempPtr = strrchr( inputLine, '/' );
                     if ( granTempPtr == NULL )
                     {
@@ -375,7 +437,15 @@ int main( int argc, char* argv[] )
                         FATAL_MSG("Failed to update the granule list.\n");
                         goto cleanupFail;
                     }
-                    status = CERES(CERESargs,1,ceres_fm1_count,(int32*)ceres_start_index_ptr,NULL,ceres_subset_num_elems_ptr);
+                    memset(&job, 0, sizeof(job));
+                    job.instrument = INSTR_CERES;
+                    for ( int j = 0; j < 4; j++ ) job.args[j] = CERESargs[j];
+                    job.index = 1;
+                    job.count = ceres_fm1_count;
+                    /* The job takes over the open granule */
+                    job.ceres = ceresGranule;
+                    memset(&ceresGranule, 0, sizeof(ceresGranule));
+                    status = dispatchInstrument( &job, 4 );
                     if ( status == FATAL_ERR )
                     {
                         FATAL_MSG("CERES failed data transfer on file:\n\t%s\nExiting program.\n", inputLine);
@@ -392,18 +462,15 @@ int main( int argc, char* argv[] )
                 CERESargs[2] = calloc(strlen(inputLine)+1, 1);
                 strncpy( CERESargs[2], inputLine, strlen(inputLine) );
                 
-                status = CERES_OrbitInfo(CERESargs,ceres_start_index_ptr,ceres_end_index_ptr,current_orbit_info);
+                status = CERESopenGranule(CERESargs[2],current_orbit_info,&ceresGranule);
                 if ( status == FATAL_ERR )
                 {
                     FATAL_MSG("CERES failed to obtain orbit info.\nExiting program.\n");
                     goto cleanupFail;
                 }
 
-                if(*ceres_start_index_ptr >=0 && *ceres_end_index_ptr >=0)
+                if(ceresGranule.startIndex >=0 && ceresGranule.endIndex >=0)
                 {
-                    ceres_subset_num_elems = (*ceres_end_index_ptr) - (*ceres_start_index_ptr)+1;
-                    ceres_subset_num_elems_ptr =&ceres_subset_num_elems;
-                    
                     granTempPtr = strrchr( inputLine, '/' );
                     if ( granTempPtr == NULL )
                     {
@@ -416,7 +483,15 @@ int main( int argc, char* argv[] )
                         FATAL_MSG("Failed to update the granule list.\n");
                         goto cleanupFail;
                     }
-                    status = CERES(CERESargs,2,ceres_fm2_count,(int32*)ceres_start_index_ptr,NULL,ceres_subset_num_elems_ptr);
+                    memset(&job, 0, sizeof(job));
+                    job.instrument = INSTR_CERES;
+                    for ( int j = 0; j < 4; j++ ) job.args[j] = CERESargs[j];
+                    job.index = 2;
+                    job.count = ceres_fm2_count;
+                    /* The job takes over the open granule */
+                    job.ceres = ceresGranule;
+                    memset(&ceresGranule, 0, sizeof(ceresGranule));
+                    status = dispatchInstrument( &job, 4 );
                     if ( status == FATAL_ERR )
                     {
                         FATAL_MSG("CERES failed data transfer on file:\n\t%s\nExiting program.\n", inputLine);
@@ -431,6 +506,13 @@ int main( int argc, char* argv[] )
                 goto cleanupFail;
             }
 
+            /* The granule is outside of the orbit, no job reads it */
+            if ( ceresGranule.fileID )
+            {
+                prefetchConsumed( CERESargs, 4 );
+                CERESfreeGranule(&ceresGranule);
+            }
+
             status = getNextLine( inputLine, inputFile);
             if ( status == FATAL_ERR )
             {
@@ -469,6 +551,12 @@ int main( int argc, char* argv[] )
         }    
     }
 
+    if ( checkpointFile && dispatchCheckpoint( INSTR_CERES, checkpointFile ) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to record the CERES checkpoint.\n");
+        goto cleanupFail;
+    }
+
     /*********
      * MODIS *
      *********/
@@ -613,7 +701,13 @@ int main( int argc, char* argv[] )
                 strncpy( MODISargs[4], inputLine, strlen(inputLine) );
                 sprintf(modis_granule_suffix,"%d",modis_count);
 
-                status = MODIS( MODISargs,modis_count,unpack);
+                memset(&job, 0, sizeof(job));
+                job.instrument = INSTR_MODIS;
+                for ( int j = 0; j < 7; j++ ) job.args[j] = MODISargs[j];
+                job.count = modis_count;
+                job.unpack = unpack;
+                job.orbitInfo = current_orbit_info;
+                status = dispatchInstrument( &job, 7 );
                 if ( status == FATAL_ERR )
                 {    
                     FATAL_MSG("MODIS failed data transfer on this granule:\n)");
@@ -645,7 +739,13 @@ int main( int argc, char* argv[] )
                 strncpy(MODISargs[5],granule,strlen(granule));
                 strncat(MODISargs[5],modis_granule_suffix,strlen(modis_granule_suffix));
 
-                status = MODIS( MODISargs,modis_count,unpack );
+                memset(&job, 0, sizeof(job));
+                job.instrument = INSTR_MODIS;
+                for ( int j = 0; j < 7; j++ ) job.args[j] = MODISargs[j];
+                job.count = modis_count;
+                job.unpack = unpack;
+                job.orbitInfo = current_orbit_info;
+                status = dispatchInstrument( &job, 7 );
                 if ( status == FATAL_ERR )
                 {
                     FATAL_MSG("MODIS failed data transfer on this granule:\n)");
@@ -703,6 +803,12 @@ int main( int argc, char* argv[] )
         }
 
     }
+    if ( checkpointFile && dispatchCheckpoint( INSTR_MODIS, checkpointFile ) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to record the MODIS checkpoint.\n");
+        goto cleanupFail;
+    }
+
     /*********
      * ASTER *
      *********/
@@ -737,7 +843,12 @@ int main( int argc, char* argv[] )
                 strncpy( ASTERargs[1], inputLine, strlen(inputLine) );
 
                 /* EXECUTE ASTER DATA TRANSFER */
-                status = ASTER( ASTERargs,aster_count,unpack);
+                memset(&job, 0, sizeof(job));
+                job.instrument = INSTR_ASTER;
+                for ( int j = 0; j < 4; j++ ) job.args[j] = ASTERargs[j];
+                job.count = aster_count;
+                job.unpack = unpack;
+                status = dispatchInstrument( &job, 4 );
 
                 if ( status == FATAL_ERR )
                 {
@@ -780,6 +891,12 @@ int main( int argc, char* argv[] )
 
     }
 
+    if ( checkpointFile && dispatchCheckpoint( INSTR_ASTER, checkpointFile ) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to record the ASTER checkpoint.\n");
+        goto cleanupFail;
+    }
+
     /********
      * MISR *
      ********/
@@ -908,7 +1025,12 @@ int main( int argc, char* argv[] )
         strncpy( MISRargs[12], inputLine, strlen(inputLine) );
 
         // EXECUTE MISR DATA TRANSFER
-        status = MISR( MISRargs,unpack);
+        memset(&job, 0, sizeof(job));
+        job.instrument = INSTR_MISR;
+        for ( int j = 0; j < 13; j++ ) job.args[j] = MISRargs[j];
+        job.unpack = unpack;
+        job.orbitInfo = current_orbit_info;
+        status = dispatchInstrument( &job, 13 );
         if ( status == FATAL_ERR )
         {
             FATAL_MSG("MISR failed data transfer on file:\n\t%s\nExiting program.\n", inputLine);
@@ -919,13 +1041,38 @@ int main( int argc, char* argv[] )
     else
         printf("No MISR files found.\n");
 
-    /* Attach the granuleList as an attribute to the root HDF5 object */
+    if ( checkpointFile && dispatchCheckpoint( INSTR_MISR, checkpointFile ) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to record the MISR checkpoint.\n");
+        goto cleanupFail;
+    }
+
+    /* Attach the granuleList as an attribute to the root HDF5 object, without the
+     * granules that TERRA_ORBIT_TRIM skipped
+     */
+    orbitGranuleListTrim( granuleList );
     errStatus = H5LTset_attribute_string( outputFile, "/", "InputGranules", granuleList);
     if ( errStatus < 0 )
     {
         FATAL_MSG("Failed to set Input Granules attribute in root group.\n");
         goto cleanupFail;
     }
+
+    /* With TERRA_CORE_VFD=1 (see createOutputFile), the whole file is written here */
+    {
+        int timer = timingBegin("closeOutputFile", argv[1], NULL);
+        errStatus = H5Fclose(outputFile);
+        timingEnd(timer);
+        outputFile = 0;
+        if ( errStatus < 0 )
+        {
+            FATAL_MSG("Failed to write and close the output file.\n");
+            goto cleanupFail;
+        }
+    }
+
+    if ( checkpointFile && checkpointRecord( checkpointFile, "COMPLETE" ) == FATAL_ERR )
+        goto cleanupFail;
     
 
     printf("Data transfer successful.\n");
@@ -938,6 +1085,16 @@ cleanupFail:
         fail = 1;
     }
 
+cleanup:
+    instrumentSkipSet( 0 );
+    orbitGranuleSkipReset();
+    prefetchStop();
+
+    /* No-op unless TERRA_TIMING=1 */
+    if ( timingWrite( argv[1], fail ) == FATAL_ERR )
+        WARN_MSG("Unable to write the timing report.\n");
+
+    CERESfreeGranule(&ceresGranule);
     if ( outputFile ) H5Fclose(outputFile);
     if ( inputFile ) fclose(inputFile);
     if ( MOPITTargs[1] ) free(MOPITTargs[1]);
@@ -948,20 +1105,931 @@ cleanupFail:
     if ( MODISargs[5] ) free( MODISargs[5] );
     if ( ASTERargs[1] ) free ( ASTERargs[1] );
     if ( ASTERargs[2] ) free ( ASTERargs[2] );
-    if ( TAI93toUTCoffset ) free(TAI93toUTCoffset);
-    if ( test_orbit_ptr) free(test_orbit_ptr);
-    if ( new_orbit_info_b) fclose(new_orbit_info_b);
     if ( CER_curTime ) free( CER_curTime );
     if ( CER_prevTime ) free(CER_prevTime);
     for ( int j = 1; j <= 12; j++ )
         if ( MISRargs[j] ) free (MISRargs[j]);
     if ( granuleList ) free(granuleList);
+    if ( checkpointFile ) free(checkpointFile);
 
     eTime = time(NULL);
     /* Print the program execution time */
     time_t runTime = eTime - sTime;
     printf("Running time: %ld seconds\n", runTime);
 
+    if ( fail ) return FATAL_ERR;
+
+    return RET_SUCCESS;
+}
+
+/* Returns non-zero if the record looks like an orbit of the Terra record */
+static int validOrbitRecord( const OInfo_t* orbit )
+{
+    return orbit->start_year >= 1999 && orbit->start_month >= 1 && orbit->start_month <= 12 &&
+           orbit->start_day >= 1 && orbit->start_day <= 31 &&
+           orbit->end_year >= orbit->start_year && orbit->end_month >= 1 && orbit->end_month <= 12 &&
+           orbit->end_day >= 1 && orbit->end_day <= 31;
+}
+
+/* Returns non-zero if the record is a valid record of the orbit */
+static int isOrbitRecord( const OInfo_t* orbit, unsigned int orbitNumber )
+{
+    return orbit->orbit_number == orbitNumber && validOrbitRecord( orbit );
+}
+
+/*
+                    mapOrbitInfo
+    DESCRIPTION:
+        Maps orbit_info.bin read-only into memory. Only the pages of the orbits that are looked
+        up with findOrbit() are read from the file. The file must be a whole number of OInfo_t
+        records; its first and last records are checked to catch a file written with another
+        record layout.
+
+    ARGUMENTS:
+        const char* fileName -- Path of orbit_info.bin
+        size_t* numOrbits    -- Receives the number of records
+
+    EFFECTS:
+        The caller must unmap the records with unmapOrbitInfo().
+
+    RETURN:
+        The records, NULL on failure.
+*/
+static const OInfo_t* mapOrbitInfo( const char* fileName, size_t* numOrbits )
+{
+    struct stat sb;
+    void* map = NULL;
+    int fd;
+
+    *numOrbits = 0;
+    fd = open(fileName, O_RDONLY);
+    if ( fd < 0 )
+    {
+        FATAL_MSG("file \"%s\" does not exist.\n", fileName);
+        return NULL;
+    }
+
+    if ( fstat(fd, &sb) < 0 || sb.st_size <= 0 || (size_t) sb.st_size % sizeof(OInfo_t) != 0 )
+    {
+        FATAL_MSG("\"%s\" is not an orbit info file: its size is not a multiple of the %zu byte records.\n",
+                  fileName, sizeof(OInfo_t));
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( map == MAP_FAILED )
+    {
+        FATAL_MSG("Failed to map \"%s\".\n", fileName);
+        return NULL;
+    }
+
+    *numOrbits = (size_t) sb.st_size / sizeof(OInfo_t);
+    if ( !validOrbitRecord( (const OInfo_t*) map ) || !validOrbitRecord( (const OInfo_t*) map + *numOrbits - 1 ) )
+    {
+        FATAL_MSG("\"%s\" is not an orbit info file: unexpected record content.\n", fileName);
+        munmap(map, (size_t) sb.st_size);
+        *numOrbits = 0;
+        return NULL;
+    }
+
+    return (const OInfo_t*) map;
+}
+
+static void unmapOrbitInfo( const OInfo_t* orbits, size_t numOrbits )
+{
+    if ( orbits ) munmap((void*) orbits, numOrbits * sizeof(OInfo_t));
+}
+
+/*
+                    findOrbit
+    DESCRIPTION:
+        Looks up an orbit in the records of orbit_info.bin. The records are dense and sorted
+        by orbit number, so the record is first looked for at its offset from the first
+        orbit, then by binary search. A linear scan covers files that are not sorted. Every
+        path checks the orbit number and the content of the record it returns, so a gap or a
+        corrupt record in the middle of the file cannot return the wrong orbit.
+
+    RETURN:
+        The record of the orbit, NULL if the orbit is not in the file or its record is not
+        valid.
+*/
+static const OInfo_t* findOrbit( const OInfo_t* orbits, size_t numOrbits, unsigned int orbitNumber )
+{
+    size_t low = 0;
+    size_t high = numOrbits;
+
+    if ( numOrbits == 0 )
+        return NULL;
+
+    if ( orbitNumber >= orbits[0].orbit_number )
+    {
+        size_t i = orbitNumber - orbits[0].orbit_number;
+        if ( i < numOrbits && isOrbitRecord( &orbits[i], orbitNumber ) )
+            return &orbits[i];
+    }
+
+    while ( low < high )
+    {
+        size_t mid = low + (high - low) / 2;
+        if ( isOrbitRecord( &orbits[mid], orbitNumber ) )
+            return &orbits[mid];
+        if ( orbits[mid].orbit_number < orbitNumber )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    for ( size_t i = 0; i < numOrbits; i++ )
+        if ( isOrbitRecord( &orbits[i], orbitNumber ) )
+            return &orbits[i];
+
+    return NULL;
+}
+
+/* Task kinds of a batch besides the INSTR_* parts (see runBatch) */
+#define BATCH_MERGE (INSTR_MISR + 1)
+#define BATCH_ORBIT (INSTR_MISR + 2)
+#define BATCH_KINDS (INSTR_MISR + 3)
+
+/* Peak memory per input byte assumed for a task kind until a task of the kind finished */
+#define BATCH_MEMORY_RATIO 2.0
+
+enum { TASK_NONE = 0, TASK_WAITING, TASK_RUNNING, TASK_DONE, TASK_FAILED };
+
+typedef struct
+{
+    int state;
+    size_t input;               // input bytes, for the merge the bytes of the part files
+    size_t reserved;            // memory reserved for the task while it runs
+    pid_t pid;
+} batchTask_t;
+
+typedef struct
+{
+    size_t input;                   // input bytes of all instruments
+    size_t inputs[INSTR_MISR + 1];  // input bytes of each instrument
+    int present[INSTR_MISR + 1];    // the input file list has granules of the instrument
+    int started;                    // its tasks are created
+    int partsLeft;                  // parts not converted yet
+    int running;                    // tasks running
+    int failed;
+    int done;
+    batchTask_t task[BATCH_KINDS];
+} batchOrbit_t;
+
+typedef struct
+{
+    size_t cost;
+    size_t job;
+} batchOrder_t;
+
+typedef struct
+{
+    batchOrbit_t* orbit;
+    batchOrder_t* order;            // orbits, largest first
+    size_t numJobs;
+    size_t unstarted;               // orbits without tasks
+    long numProcs;
+    long running;                   // tasks running
+    size_t budget;                  // TERRA_BATCH_MEMORY_MB in bytes, 0 if not set
+    size_t baseMemory;              // resident memory of a task before it converts anything
+    double ratio[BATCH_KINDS];      // peak memory per input byte of each task kind
+    int learned[BATCH_KINDS];
+} batch_t;
+
+/* Larger orbits first */
+static int compareCost( const void* a, const void* b )
+{
+    const batchOrder_t* x = a;
+    const batchOrder_t* y = b;
+    if ( x->cost != y->cost )
+        return x->cost < y->cost ? 1 : -1;
+    return x->job < y->job ? -1 : ( x->job > y->job );
+}
+
+/* The number of batch processes, from TERRA_BATCH_PROCS */
+static long batchProcs()
+{
+    const char* s = getenv("TERRA_BATCH_PROCS");
+    long numProcs = 1;
+
+    if ( s && isdigit((int)*s) )
+        numProcs = strtol(s,NULL,10);
+    if ( numProcs < 1 ) numProcs = 1;
+    if ( numProcs > BATCH_MAX_PROCS ) numProcs = BATCH_MAX_PROCS;
+
+    return numProcs;
+}
+
+/* Adds the size of every granule of an input file list to the instrument it belongs to */
+static void orbitInputs( const char* inputListName, batchOrbit_t* orbit )
+{
+    static const char* keys[INSTR_MISR + 1][2] = { {"MOP01", NULL}, {"CER_SSF", NULL},
+                                                   {"MOD02", "MOD03"}, {"AST_L1T", NULL}, {"MISR", NULL} };
+    FILE* fp = fopen(inputListName, "r");
+    char line[STR_LEN];
+    struct stat sb;
+
+    if ( fp == NULL )
+        return;
+
+    while ( getNextLine( line, fp ) == RET_SUCCESS )
+    {
+        for ( int i = 0; i <= INSTR_MISR; i++ )
+        {
+            if ( strstr(line, "N/A") || ( strstr(line, keys[i][0]) == NULL &&
+                 ( keys[i][1] == NULL || strstr(line, keys[i][1]) == NULL ) ) )
+                continue;
+            orbit->present[i] = 1;
+            if ( stat(line, &sb) == 0 )
+            {
+                orbit->inputs[i] += (size_t) sb.st_size;
+                orbit->input += (size_t) sb.st_size;
+            }
+            break;
+        }
+    }
+
+    fclose(fp);
+}
+
+/* The part file of one instrument of an orbit: <output file>.<instrument>.part */
+static void partName( char* name, size_t size, const char* outputFileName, int instrument )
+{
+    snprintf(name, size, "%s.%s.part", outputFileName, instrumentNameOf(instrument));
+}
+
+/* Removes the part files of an orbit and their checkpoint files */
+static void removeParts( const char* outputFileName, const batchOrbit_t* orbit )
+{
+    char name[2*STR_LEN];
+
+    for ( int i = 0; i <= INSTR_MISR; i++ )
+    {
+        if ( orbit->task[i].state == TASK_NONE )
+            continue;
+        partName(name, sizeof(name), outputFileName, i);
+        remove(name);
+        char* checkpointFile = checkpointName(name);
+        if ( checkpointFile )
+        {
+            remove(checkpointFile);
+            free(checkpointFile);
+        }
+    }
+}
+
+/* Resident memory of a running task in bytes, 0 if it is not known */
+static size_t taskResident( pid_t pid )
+{
+    char name[64];
+    long pages = 0;
+    long resident = 0;
+    FILE* fp;
+
+    snprintf(name, sizeof(name), "/proc/%ld/statm", (long) pid);
+    fp = fopen(name, "r");
+    if ( fp == NULL )
+        return 0;
+    if ( fscanf(fp, "%ld %ld", &pages, &resident) != 2 )
+        resident = 0;
+    fclose(fp);
+
+    return resident > 0 ? (size_t) resident * (size_t) sysconf(_SC_PAGESIZE) : 0;
+}
+
+/* The peak memory expected of a task */
+static size_t taskEstimate( const batch_t* batch, int kind, size_t input )
+{
+    return batch->baseMemory + (size_t) (batch->ratio[kind] * (double) input);
+}
+
+/*
+    Whether a task with the given estimate may start: the memory reserved for the running
+    tasks, or their resident memory where a task has outgrown its reservation, plus the
+    estimate must fit into the budget. A task always starts if no other one is running.
+*/
+static int taskFits( const batch_t* batch, size_t inUse, size_t estimate )
+{
+    return batch->budget == 0 || batch->running == 0 || inUse + estimate <= batch->budget;
+}
+
+/* Creates the tasks of an orbit: one per instrument and the merge, or a single one */
+static void startOrbit( batch_t* batch, size_t job, int split )
+{
+    batchOrbit_t* orbit = &batch->orbit[job];
+    int numPresent = 0;
+
+    for ( int i = 0; i <= INSTR_MISR; i++ )
+        numPresent += orbit->present[i];
+
+    if ( split && numPresent > 1 )
+    {
+        for ( int i = 0; i <= INSTR_MISR; i++ )
+        {
+            if ( !orbit->present[i] )
+                continue;
+            orbit->task[i].state = TASK_WAITING;
+            orbit->task[i].input = orbit->inputs[i];
+            orbit->partsLeft++;
+        }
+        orbit->task[BATCH_MERGE].state = TASK_WAITING;
+    }
+    else
+    {
+        orbit->task[BATCH_ORBIT].state = TASK_WAITING;
+        orbit->task[BATCH_ORBIT].input = orbit->input;
+    }
+
+    orbit->started = 1;
+    batch->unstarted--;
+}
+
+/*
+    Picks the next task that fits into the memory budget:
+        1. the merge of an orbit whose parts are all converted
+        2. the largest waiting task of the orbits that have been started
+        3. the largest orbit not started yet, as a whole
+    Once no more orbits are waiting to start than there are processes, the remaining orbits
+    are split into their instruments, so the processes that run out of orbits convert the
+    instruments of the last ones instead of idling.
+    Returns 0 if no task fits.
+*/
+static int pickTask( batch_t* batch, size_t* job, int* kind )
+{
+    size_t inUse = 0;
+    int found = 0;
+    size_t bestInput = 0;
+
+    for ( size_t j = 0; j < batch->numJobs; j++ )
+    {
+        for ( int k = 0; k < BATCH_KINDS; k++ )
+        {
+            const batchTask_t* task = &batch->orbit[j].task[k];
+            if ( task->state == TASK_RUNNING )
+                inUse += max(task->reserved, taskResident(task->pid));
+        }
+    }
+
+    if ( batch->unstarted > 0 && batch->unstarted <= (size_t) batch->numProcs )
+        for ( size_t i = 0; i < batch->numJobs; i++ )
+            if ( !batch->orbit[batch->order[i].job].started )
+                startOrbit( batch, batch->order[i].job, 1 );
+
+    for ( size_t j = 0; j < batch->numJobs; j++ )
+    {
+        batchOrbit_t* orbit = &batch->orbit[j];
+        batchTask_t* task = &orbit->task[BATCH_MERGE];
+        if ( !orbit->failed && task->state == TASK_WAITING && orbit->partsLeft == 0 &&
+             taskFits( batch, inUse, taskEstimate(batch, BATCH_MERGE, task->input) ) )
+        {
+            *job = j;
+            *kind = BATCH_MERGE;
+            return 1;
+        }
+    }
+
+    for ( size_t j = 0; j < batch->numJobs; j++ )
+    {
+        batchOrbit_t* orbit = &batch->orbit[j];
+        for ( int k = 0; k < BATCH_KINDS; k++ )
+        {
+            batchTask_t* task = &orbit->task[k];
+            if ( k == BATCH_MERGE || task->state != TASK_WAITING )
+                continue;
+            /* Nothing more is converted for a failed orbit */
+            if ( orbit->failed )
+            {
+                task->state = TASK_FAILED;
+                continue;
+            }
+            if ( ( !found || task->input > bestInput ) &&
+                 taskFits( batch, inUse, taskEstimate(batch, k, task->input) ) )
+            {
+                *job = j;
+                *kind = k;
+                bestInput = task->input;
+                found = 1;
+            }
+        }
+    }
+    if ( found )
+        return 1;
+
+    for ( size_t i = 0; i < batch->numJobs; i++ )
+    {
+        size_t j = batch->order[i].job;
+        if ( batch->orbit[j].started ||
+             !taskFits( batch, inUse, taskEstimate(batch, BATCH_ORBIT, batch->orbit[j].input) ) )
+            continue;
+        startOrbit( batch, j, 0 );
+        *job = j;
+        *kind = BATCH_ORBIT;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Merges the parts of an orbit into its output file, in the forked process of the task */
+static int mergeTask( char* outputFileName, const batchOrbit_t* orbit )
+{
+    char names[INSTR_MISR + 1][2*STR_LEN];
+    char* partNames[INSTR_MISR + 1];
+    char* checkpointFile = NULL;
+    int numParts = 0;
+    int status;
+
+    for ( int i = 0; i <= INSTR_MISR; i++ )
+    {
+        if ( orbit->task[i].state == TASK_NONE )
+            continue;
+        partName(names[numParts], sizeof(names[numParts]), outputFileName, i);
+        partNames[numParts] = names[numParts];
+        numParts++;
+    }
+
+    if ( checkpointEnabled() )
+    {
+        checkpointFile = checkpointName( outputFileName );
+        if ( checkpointFile == NULL )
+            return FATAL_ERR;
+        remove( checkpointFile );
+    }
+
+    status = mergeOrbitParts( outputFileName, partNames, numParts );
+
+    if ( status == RET_SUCCESS && checkpointFile )
+        status = checkpointRecord( checkpointFile, "COMPLETE" );
+    if ( checkpointFile ) free(checkpointFile);
+
+    return status;
+}
+
+/* Accounts for a task that ended */
+static void finishTask( batch_t* batch, char** outputs, char** inputs, size_t job, int kind, int ok,
+                        size_t peakMemory )
+{
+    batchOrbit_t* orbit = &batch->orbit[job];
+    batchTask_t* task = &orbit->task[kind];
+
+    batch->running--;
+    orbit->running--;
+
+    if ( ok )
+    {
+        task->state = TASK_DONE;
+
+        /* The largest peak memory per input byte seen for the kind */
+        if ( task->input > 0 && peakMemory > batch->baseMemory )
+        {
+            double ratio = (double) (peakMemory - batch->baseMemory) / (double) task->input;
+            if ( !batch->learned[kind] || ratio > batch->ratio[kind] )
+                batch->ratio[kind] = ratio;
+            batch->learned[kind] = 1;
+        }
+
+        if ( kind <= INSTR_MISR && --orbit->partsLeft == 0 )
+        {
+            char name[2*STR_LEN];
+            struct stat sb;
+            for ( int i = 0; i <= INSTR_MISR; i++ )
+            {
+                partName(name, sizeof(name), outputs[job], i);
+                if ( orbit->task[i].state != TASK_NONE && stat(name, &sb) == 0 )
+                    orbit->task[BATCH_MERGE].input += (size_t) sb.st_size;
+            }
+        }
+        else if ( kind == BATCH_MERGE || kind == BATCH_ORBIT )
+            orbit->done = 1;
+    }
+    else
+    {
+        task->state = TASK_FAILED;
+        orbit->failed = 1;
+        if ( kind == BATCH_MERGE )
+            FATAL_MSG("Failed to merge the parts of %s.\n", outputs[job]);
+        else if ( kind == BATCH_ORBIT )
+            FATAL_MSG("Failed to convert %s into %s.\n", inputs[job], outputs[job]);
+        else
+            FATAL_MSG("Failed to convert %s of %s into %s.\n", instrumentNameOf(kind), inputs[job], outputs[job]);
+    }
+
+    /* With TERRA_RESUME=1 the parts of a failed orbit are kept for the rerun */
+    if ( orbit->running == 0 && orbit->task[BATCH_MERGE].state != TASK_NONE &&
+         ( orbit->done || ( orbit->failed && !checkpointEnabled() ) ) )
+        removeParts( outputs[job], orbit );
+}
+
+/*
+                    runBatch
+    DESCRIPTION:
+        Converts a list of orbits. With TERRA_BATCH_PROCS unset or 1, the orbits are
+        converted one after the other with convertOrbit() in this process.
+
+        When TERRA_BATCH_PROCS is set to N > 1, the orbits are cut into tasks that run in up
+        to N forked processes, after the orbit table and the TAI93 offsets are loaded:
+
+            - a whole orbit, converted with convertOrbit() into its output file
+            - one instrument of an orbit, converted into the part file
+              <output file>.<instrument>.part
+            - the merge of the parts of an orbit into its output file (see merge.c), once
+              all of them are converted
+
+        The orbits start whole, largest first by the total size of their input granules.
+        When no more orbits wait to start than there are processes, the remaining orbits
+        are split into one task per instrument, and these tasks are taken largest first
+        across all orbits. The processes that are done with their orbits then convert the
+        instruments of the last orbits, e.g. the ASTER scenes of an ASTER-heavy orbit next
+        to its MODIS and MISR granules, instead of leaving it as the long tail of the node.
+        A split orbit costs one more copy of its data for the merge. The instruments of an
+        orbit cannot share one output file between processes, since the HDF libraries do
+        not allow concurrent writers; the part files are how they run concurrently.
+
+        When TERRA_BATCH_MEMORY_MB is set to M, a task only starts while the memory of the
+        running tasks plus the expected peak memory of the task fit into M MB; smaller tasks
+        are taken ahead of a larger one that does not fit. The memory of a running task is
+        its reservation or, if it has grown beyond, its resident memory. The expected peak is
+        the memory of a process before it converts plus the input size times the largest
+        peak memory per input byte measured for the task kind so far (the peak resident
+        memory of a finished task, from wait4()), or BATCH_MEMORY_RATIO before the first task
+        of the kind finished. A task always starts if no other one is running.
+
+        A failed task fails its orbit: the other tasks of the orbit are not started and its
+        part files are removed (kept with TERRA_RESUME=1, which resumes them on a rerun).
+        A crashed process fails its task. A failed orbit does not stop the batch.
+
+    ARGUMENTS:
+        char* progName        -- argv[0]
+        char** outputs        -- Output file name of each orbit
+        char** inputs         -- Input file list name of each orbit
+        size_t numJobs        -- Number of orbits
+        const OInfo_t* orbits -- The content of orbit_info.bin
+        size_t numOrbits      -- Number of entries of orbits
+
+    RETURN:
+        The number of orbits that failed, FATAL_ERR if the batch could not be started.
+*/
+static int runBatch( char* progName, char** outputs, char** inputs, size_t numJobs,
+                     const OInfo_t* orbits, size_t numOrbits )
+{
+    batch_t batch;
+    int failed = 0;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.numJobs = numJobs;
+    batch.numProcs = batchProcs();
+
+    if ( batch.numProcs == 1 )
+    {
+        for ( size_t j = 0; j < numJobs; j++ )
+        {
+            char* args[3] = { progName, outputs[j], inputs[j] };
+            printf("\n_____ORBIT %zu OF %zu: %s_____\n", j + 1, numJobs, inputs[j]);
+            if ( convertOrbit( args, orbits, numOrbits, -1 ) == FATAL_ERR )
+            {
+                FATAL_MSG("Failed to convert %s into %s.\n", inputs[j], outputs[j]);
+                failed++;
+            }
+            fflush(stdout);
+        }
+        return failed;
+    }
+
+    {
+        const char *s = getenv("TERRA_BATCH_MEMORY_MB");
+        if ( s && isdigit((int)*s) )
+            batch.budget = (size_t) strtoul(s,NULL,10) << 20;
+    }
+
+    batch.orbit = calloc(max(numJobs, (size_t) 1), sizeof(batchOrbit_t));
+    batch.order = calloc(max(numJobs, (size_t) 1), sizeof(batchOrder_t));
+    if ( batch.orbit == NULL || batch.order == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        failed = FATAL_ERR;
+        goto cleanup;
+    }
+
+    for ( int k = 0; k < BATCH_KINDS; k++ )
+        batch.ratio[k] = BATCH_MEMORY_RATIO;
+
+    for ( size_t j = 0; j < numJobs; j++ )
+    {
+        batchOrbit_t* orbit = &batch.orbit[j];
+
+        /* A rerun with TERRA_RESUME=1 skips the complete orbits */
+        if ( checkpointEnabled() && access( outputs[j], F_OK ) == 0 )
+        {
+            char* checkpointFile = checkpointName( outputs[j] );
+            if ( checkpointFile && checkpointDone( checkpointFile, "COMPLETE" ) )
+            {
+                printf("%s is already complete.\n", outputs[j]);
+                orbit->started = orbit->done = 1;
+            }
+            if ( checkpointFile ) free(checkpointFile);
+        }
+
+        orbitInputs( inputs[j], orbit );
+        batch.order[j].cost = orbit->input;
+        batch.order[j].job = j;
+        if ( !orbit->started )
+            batch.unstarted++;
+    }
+    qsort(batch.order, numJobs, sizeof(batchOrder_t), compareCost);
+
+    /* Warm the lookup tables once for all orbits and processes */
+    if ( TAI93toUTCoffset == NULL && initializeTimeOffset() == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to initialize the TAI93 offsets.\n");
+        failed = FATAL_ERR;
+        goto cleanup;
+    }
+    batch.baseMemory = taskResident( getpid() );
+
+    for ( ;; )
+    {
+        size_t job;
+        int kind;
+
+        while ( batch.running < batch.numProcs && pickTask( &batch, &job, &kind ) )
+        {
+            batchTask_t* task = &batch.orbit[job].task[kind];
+            pid_t pid;
+
+            if ( kind == BATCH_MERGE )
+                printf("\n_____ORBIT %zu OF %zu: merging %s_____\n", job + 1, numJobs, outputs[job]);
+            else
+                printf("\n_____ORBIT %zu OF %zu: %s (%s)_____\n", job + 1, numJobs, inputs[job],
+                       kind == BATCH_ORBIT ? "all instruments" : instrumentNameOf(kind));
+            fflush(stdout);
+            fflush(stderr);
+
+            pid = fork();
+            if ( pid < 0 )
+            {
+                /* The task waits for a running one to end, unless there is none */
+                WARN_MSG("Failed to fork a batch process while %ld are running.\n", batch.running);
+                break;
+            }
+
+            if ( pid == 0 )
+            {
+                int status;
+                if ( kind == BATCH_MERGE )
+                    status = mergeTask( outputs[job], &batch.orbit[job] );
+                else
+                {
+                    char name[2*STR_LEN];
+                    char* args[3] = { progName, outputs[job], inputs[job] };
+                    if ( kind != BATCH_ORBIT )
+                    {
+                        partName(name, sizeof(name), outputs[job], kind);
+                        args[1] = name;
+                    }
+                    status = convertOrbit( args, orbits, numOrbits, kind == BATCH_ORBIT ? -1 : kind );
+                }
+                fflush(stdout);
+                _exit( status == FATAL_ERR ? EXIT_FAILURE : EXIT_SUCCESS );
+            }
+
+            task->state = TASK_RUNNING;
+            task->pid = pid;
+            task->reserved = taskEstimate( &batch, kind, task->input );
+            batch.orbit[job].running++;
+            batch.running++;
+        }
+
+        if ( batch.running == 0 )
+            break;
+
+        /* Wait for a task to end */
+        {
+            struct rusage usage;
+            int childStatus;
+            pid_t pid = wait4( -1, &childStatus, 0, &usage );
+            int found = 0;
+
+            if ( pid < 0 )
+            {
+                FATAL_MSG("Lost track of the batch processes.\n");
+                break;
+            }
+
+            for ( size_t j = 0; j < numJobs && !found; j++ )
+            {
+                for ( int k = 0; k < BATCH_KINDS && !found; k++ )
+                {
+                    batchTask_t* task = &batch.orbit[j].task[k];
+                    if ( task->state != TASK_RUNNING || task->pid != pid )
+                        continue;
+                    found = 1;
+                    /* ru_maxrss is in kilobytes */
+                    finishTask( &batch, outputs, inputs, j, k,
+                                WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == EXIT_SUCCESS,
+                                (size_t) usage.ru_maxrss << 10 );
+                }
+            }
+        }
+    }
+
+    for ( size_t j = 0; j < numJobs; j++ )
+    {
+        if ( batch.orbit[j].done )
+            continue;
+        if ( !batch.orbit[j].failed )
+            FATAL_MSG("%s was not converted: no batch process could be forked.\n", outputs[j]);
+        failed++;
+    }
+
+cleanup:
+    if ( batch.orbit ) free(batch.orbit);
+    if ( batch.order ) free(batch.order);
+    return failed;
+}
+
+/* Fills outputs and inputs from a batch file of "outputFile inputFiles.txt" lines */
+static int readBatchFile( const char* fileName, char*** outputs, char*** inputs, size_t* numJobs )
+{
+    FILE* fp = NULL;
+    char line[STR_LEN];
+    char outName[STR_LEN];
+    char inName[STR_LEN];
+    size_t capacity = 0;
+
+    *numJobs = 0;
+    fp = fopen(fileName, "r");
+    if ( fp == NULL )
+    {
+        FATAL_MSG("file \"%s\" does not exist.\n", fileName);
+        return FATAL_ERR;
+    }
+
+    while ( getNextLine( line, fp ) == RET_SUCCESS )
+    {
+        if ( sscanf( line, "%499s %499s", outName, inName ) != 2 )
+        {
+            FATAL_MSG("Expected \"outputFile inputFiles.txt\" in %s, received:\n\t%s\n", fileName, line);
+            fclose(fp);
+            return FATAL_ERR;
+        }
+
+        if ( *numJobs == capacity )
+        {
+            capacity = capacity ? 2 * capacity : 64;
+            char** newOutputs = realloc(*outputs, capacity * sizeof(char*));
+            if ( newOutputs ) *outputs = newOutputs;
+            char** newInputs = realloc(*inputs, capacity * sizeof(char*));
+            if ( newInputs ) *inputs = newInputs;
+            if ( newOutputs == NULL || newInputs == NULL )
+            {
+                FATAL_MSG("Failed to allocate memory.\n");
+                fclose(fp);
+                return FATAL_ERR;
+            }
+        }
+
+        (*outputs)[*numJobs] = strdup(outName);
+        (*inputs)[*numJobs] = strdup(inName);
+        (*numJobs)++;
+        if ( (*outputs)[*numJobs-1] == NULL || (*inputs)[*numJobs-1] == NULL )
+        {
+            FATAL_MSG("Failed to allocate memory.\n");
+            fclose(fp);
+            return FATAL_ERR;
+        }
+    }
+
+    fclose(fp);
+    return RET_SUCCESS;
+}
+
+/*
+    Fills outputs and inputs for the orbits first..last with the naming of
+    TerraGen/util/genBFcommands.sh: <inputDir>/input<orbit>.txt and
+    <outputDir>/TERRA_BF_L1B_O<orbit>_F000_V000.h5
+*/
+static int orbitRangeJobs( long first, long last, const char* inputDir, const char* outputDir,
+                           char*** outputs, char*** inputs, size_t* numJobs )
+{
+    *numJobs = 0;
+    if ( first < 0 || last < first )
+    {
+        FATAL_MSG("Invalid orbit range %ld to %ld.\n", first, last);
+        return FATAL_ERR;
+    }
+
+    *outputs = calloc((size_t)(last - first + 1), sizeof(char*));
+    *inputs = calloc((size_t)(last - first + 1), sizeof(char*));
+    if ( *outputs == NULL || *inputs == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        return FATAL_ERR;
+    }
+
+    for ( long orbit = first; orbit <= last; orbit++ )
+    {
+        char name[STR_LEN];
+
+        snprintf(name, STR_LEN, "%s/TERRA_BF_L1B_O%ld_F000_V000.h5", outputDir, orbit);
+        (*outputs)[*numJobs] = strdup(name);
+        snprintf(name, STR_LEN, "%s/input%ld.txt", inputDir, orbit);
+        (*inputs)[*numJobs] = strdup(name);
+        (*numJobs)++;
+        if ( (*outputs)[*numJobs-1] == NULL || (*inputs)[*numJobs-1] == NULL )
+        {
+            FATAL_MSG("Failed to allocate memory.\n");
+            return FATAL_ERR;
+        }
+    }
+
+    return RET_SUCCESS;
+}
+
+static void usage( const char* progName )
+{
+    fprintf( stderr, "Usage: %s [outputFile] [inputFiles.txt] [orbit_info.bin]\n", progName );
+    fprintf( stderr, "       %s -batch [batchFile] [orbit_info.bin]\n", progName );
+    fprintf( stderr, "       %s -orbits [orbit start] [orbit end] [input file list path] [output path] [orbit_info.bin]\n", progName );
+    fprintf( stderr, "A batch file has one \"outputFile inputFiles.txt\" pair per line. With -orbits, the input\n"
+                     "files are named input[orbit].txt and the outputs TERRA_BF_L1B_O[orbit]_F000_V000.h5.\n"
+                     "Set TERRA_BATCH_PROCS=N to convert the orbits of a batch, or the instruments of\n"
+                     "an orbit, in N processes.\n");
+    fprintf( stderr, "Set environment variable TERRA_DATA_UNPACK to non-zero for unpacking.\n");
+}
+
+int main( int argc, char* argv[] )
+{
+    const OInfo_t* orbits = NULL;
+    size_t numOrbits = 0;
+    char** outputs = NULL;
+    char** inputs = NULL;
+    size_t numJobs = 0;
+    int fail = 0;
+
+    if ( argc == 4 && argv[1][0] != '-' )
+    {
+        orbits = mapOrbitInfo( argv[3], &numOrbits );
+        if ( orbits == NULL )
+            goto cleanupFail;
+
+        /* With TERRA_BATCH_PROCS > 1, the instruments of the orbit run in their own processes */
+        if ( batchProcs() > 1 )
+        {
+            if ( runBatch( argv[0], &argv[1], &argv[2], 1, orbits, numOrbits ) != 0 )
+                goto cleanupFail;
+        }
+        else if ( convertOrbit( argv, orbits, numOrbits, -1 ) == FATAL_ERR )
+            goto cleanupFail;
+    }
+    else if ( argc == 4 && strcmp(argv[1], "-batch") == 0 )
+    {
+        if ( readBatchFile( argv[2], &outputs, &inputs, &numJobs ) == FATAL_ERR )
+            goto cleanupFail;
+        orbits = mapOrbitInfo( argv[3], &numOrbits );
+        if ( orbits == NULL )
+            goto cleanupFail;
+
+        fail = runBatch( argv[0], outputs, inputs, numJobs, orbits, numOrbits );
+    }
+    else if ( argc == 7 && strcmp(argv[1], "-orbits") == 0 )
+    {
+        if ( orbitRangeJobs( strtol(argv[2],NULL,10), strtol(argv[3],NULL,10), argv[4], argv[5],
+                             &outputs, &inputs, &numJobs ) == FATAL_ERR )
+            goto cleanupFail;
+        orbits = mapOrbitInfo( argv[6], &numOrbits );
+        if ( orbits == NULL )
+            goto cleanupFail;
+
+        fail = runBatch( argv[0], outputs, inputs, numJobs, orbits, numOrbits );
+    }
+    else
+    {
+        usage( argv[0] );
+        goto cleanupFail;
+    }
+
+    if ( fail > 0 )
+        printf("%d orbit conversion(s) failed.\n", fail);
+
+    if ( 0 )
+    {
+cleanupFail:
+        fail = 1;
+    }
+
+    for ( size_t j = 0; j < numJobs; j++ )
+    {
+        if ( outputs && outputs[j] ) free(outputs[j]);
+        if ( inputs && inputs[j] ) free(inputs[j]);
+    }
+    if ( outputs ) free(outputs);
+    if ( inputs ) free(inputs);
+    unmapOrbitInfo( orbits, numOrbits );
+    if ( TAI93toUTCoffset ) free(TAI93toUTCoffset);
+
     if ( fail ) return -1;
 
     return 0;
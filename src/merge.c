@@ -0,0 +1,427 @@
+/*
+
+    DESCRIPTION:
+        Merging of the per-instrument part files of an orbit into its output file.
+
+        In a batch with TERRA_BATCH_PROCS > 1 (see runBatch() in main.c), the instruments
+        of an orbit are converted by separate processes, each into its own part file
+        <output file>.<instrument>.part. mergeOrbitParts() then assembles the output file:
+
+            - every object in the root group of a part is copied with H5Ocopy(), in the
+              order of the parts, so the instrument groups come out in the same order as
+              in a sequential conversion
+            - a dimension scale in the root group that an earlier part already created is
+              not copied again. The sequential conversion shares such a scale between the
+              instruments by its name (see copyDimension()), and so does the merge.
+            - H5Ocopy() does not carry the dimension scale attachments over between files,
+              so the DIMENSION_LIST and REFERENCE_LIST attributes of the copies are deleted
+              and every dataset is attached again to the scales of the output file with the
+              same names as the scales it had in its part
+            - each part recorded the InputGranules of the whole orbit without the granules
+              that its own instrument skipped (see orbitWindow.c), so the InputGranules of
+              the output file are the granules that all parts kept
+
+        The merge copies the data of the parts once more, but it only does I/O and needs
+        little memory.
+
+*/
+
+#define _POSIX_C_SOURCE 200809L     // strdup with -std=c99
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A dimension of a dataset and the scale attached to it, by path */
+typedef struct
+{
+    char* dataset;
+    unsigned dim;
+    char* scale;
+} mergeLink_t;
+
+typedef struct
+{
+    hid_t output;
+    mergeLink_t* links;
+    size_t numLinks;
+    size_t capacity;
+    char** newScales;           // scales the part adds to the output file
+    size_t numNewScales;
+    size_t scaleCapacity;
+    const char* dataset;        // dataset being visited
+} mergeState_t;
+
+/* Returns an allocated copy of the path of an object */
+static char* objectPath( hid_t obj )
+{
+    ssize_t len = H5Iget_name(obj, NULL, 0);
+    char* path = NULL;
+
+    if ( len <= 0 )
+        return NULL;
+    path = malloc((size_t) len + 1);
+    if ( path && H5Iget_name(obj, path, (size_t) len + 1) < 0 )
+    {
+        free(path);
+        path = NULL;
+    }
+    return path;
+}
+
+/* H5DSiterate_scales() callback: records the scale attached to dimension dim */
+static herr_t collectScale( hid_t dset, unsigned dim, hid_t scale, void* data )
+{
+    mergeState_t* state = data;
+    (void) dset;
+
+    if ( state->numLinks == state->capacity )
+    {
+        size_t capacity = state->capacity ? 2 * state->capacity : 256;
+        mergeLink_t* links = realloc(state->links, capacity * sizeof(mergeLink_t));
+        if ( links == NULL )
+            return -1;
+        state->links = links;
+        state->capacity = capacity;
+    }
+
+    state->links[state->numLinks].dataset = strdup(state->dataset);
+    state->links[state->numLinks].dim = dim;
+    state->links[state->numLinks].scale = objectPath(scale);
+    state->numLinks++;
+    if ( state->links[state->numLinks-1].dataset == NULL || state->links[state->numLinks-1].scale == NULL )
+        return -1;
+
+    return 0;
+}
+
+/* Whether the first component of path is in the root group of file */
+static int rootLinkExists( hid_t file, const char* path )
+{
+    char name[STR_LEN];
+    size_t len;
+
+    while ( *path == '/' ) path++;
+    len = strcspn(path, "/");
+    if ( len == 0 || len >= STR_LEN )
+        return 0;
+    memcpy(name, path, len);
+    name[len] = '\0';
+
+    return H5Lexists(file, name, H5P_DEFAULT) > 0;
+}
+
+/*
+    H5Ovisit() callback: records the scale attachments of every dataset of a part and the
+    scales that are not in the output file yet
+*/
+static herr_t collectObject( hid_t part, const char* name, const H5O_info_t* info, void* data )
+{
+    mergeState_t* state = data;
+    hid_t dset;
+    int rank;
+    herr_t retVal = 0;
+
+    if ( info->type != H5O_TYPE_DATASET )
+        return 0;
+
+    dset = H5Dopen2(part, name, H5P_DEFAULT);
+    if ( dset < 0 )
+        return -1;
+
+    if ( H5DSis_scale(dset) > 0 )
+    {
+        /* A scale that is already in the output file keeps its attachments */
+        if ( !rootLinkExists(state->output, name) )
+        {
+            if ( state->numNewScales == state->scaleCapacity )
+            {
+                size_t capacity = state->scaleCapacity ? 2 * state->scaleCapacity : 64;
+                char** scales = realloc(state->newScales, capacity * sizeof(char*));
+                if ( scales == NULL )
+                {
+                    H5Dclose(dset);
+                    return -1;
+                }
+                state->newScales = scales;
+                state->scaleCapacity = capacity;
+            }
+            state->newScales[state->numNewScales] = objectPath(dset);
+            if ( state->newScales[state->numNewScales++] == NULL )
+                retVal = -1;
+        }
+    }
+    else if ( H5Aexists(dset, "DIMENSION_LIST") > 0 )
+    {
+        hid_t space = H5Dget_space(dset);
+        rank = space < 0 ? -1 : H5Sget_simple_extent_ndims(space);
+        if ( space >= 0 ) H5Sclose(space);
+
+        state->dataset = name;
+        for ( int d = 0; d < rank && retVal == 0; d++ )
+            if ( H5DSget_num_scales(dset, (unsigned) d) > 0 &&
+                 H5DSiterate_scales(dset, (unsigned) d, NULL, collectScale, state) < 0 )
+                retVal = -1;
+        if ( rank < 0 )
+            retVal = -1;
+    }
+
+    H5Dclose(dset);
+    return retVal;
+}
+
+/* Deletes the attribute attrName of the object at path, if it has one */
+static herr_t deleteAttribute( hid_t file, const char* path, const char* attrName )
+{
+    htri_t exists = H5Aexists_by_name(file, path, attrName, H5P_DEFAULT);
+
+    if ( exists < 0 )
+        return FATAL_ERR;
+    if ( exists > 0 && H5Adelete_by_name(file, path, attrName, H5P_DEFAULT) < 0 )
+        return FATAL_ERR;
+    return RET_SUCCESS;
+}
+
+/* H5Literate() callback: copies one object of the root group of a part */
+static herr_t copyRootObject( hid_t part, const char* name, const H5L_info_t* info, void* data )
+{
+    mergeState_t* state = data;
+    hid_t obj;
+    int isScale = 0;
+    (void) info;
+
+    if ( H5Lexists(state->output, name, H5P_DEFAULT) > 0 )
+    {
+        /* A scale shared with an earlier instrument */
+        obj = H5Oopen(state->output, name, H5P_DEFAULT);
+        if ( obj >= 0 && H5Iget_type(obj) == H5I_DATASET )
+            isScale = H5DSis_scale(obj) > 0;
+        if ( obj >= 0 ) H5Oclose(obj);
+        if ( isScale )
+            return 0;
+
+        FATAL_MSG("\"%s\" is in more than one part of the orbit.\n", name);
+        return -1;
+    }
+
+    if ( H5Ocopy(part, name, state->output, name, H5P_DEFAULT, H5P_DEFAULT) < 0 )
+    {
+        FATAL_MSG("Failed to copy \"%s\" into the output file.\n", name);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Attaches the copied datasets of a part to the scales of the output file */
+static herr_t reattachScales( mergeState_t* state )
+{
+    for ( size_t i = 0; i < state->numNewScales; i++ )
+        if ( deleteAttribute(state->output, state->newScales[i], "REFERENCE_LIST") == FATAL_ERR )
+        {
+            FATAL_MSG("Failed to reset the dimension scale \"%s\".\n", state->newScales[i]);
+            return FATAL_ERR;
+        }
+
+    for ( size_t i = 0; i < state->numLinks; i++ )
+        if ( deleteAttribute(state->output, state->links[i].dataset, "DIMENSION_LIST") == FATAL_ERR )
+        {
+            FATAL_MSG("Failed to reset the dimensions of \"%s\".\n", state->links[i].dataset);
+            return FATAL_ERR;
+        }
+
+    for ( size_t i = 0; i < state->numLinks; i++ )
+    {
+        hid_t dset = H5Dopen2(state->output, state->links[i].dataset, H5P_DEFAULT);
+        hid_t scale = H5Dopen2(state->output, state->links[i].scale, H5P_DEFAULT);
+        herr_t status = -1;
+
+        if ( dset >= 0 && scale >= 0 )
+            status = H5DSattach_scale(dset, scale, state->links[i].dim);
+        if ( scale >= 0 ) H5Dclose(scale);
+        if ( dset >= 0 ) H5Dclose(dset);
+        if ( status < 0 )
+        {
+            FATAL_MSG("Failed to attach \"%s\" to dimension %u of \"%s\".\n", state->links[i].scale,
+                      state->links[i].dim, state->links[i].dataset);
+            return FATAL_ERR;
+        }
+    }
+
+    return RET_SUCCESS;
+}
+
+static void resetState( mergeState_t* state )
+{
+    for ( size_t i = 0; i < state->numLinks; i++ )
+    {
+        free(state->links[i].dataset);
+        free(state->links[i].scale);
+    }
+    for ( size_t i = 0; i < state->numNewScales; i++ )
+        free(state->newScales[i]);
+    state->numLinks = 0;
+    state->numNewScales = 0;
+}
+
+/*
+                    granuleListIntersect
+    DESCRIPTION:
+        Removes the entries of the comma separated list granList that are not in the comma
+        separated list other. The order of granList is kept and no trailing comma is left.
+
+    ARGUMENTS:
+        char* granList     -- The list, modified in place
+        const char* other  -- The list to intersect with
+*/
+void granuleListIntersect( char* granList, const char* other )
+{
+    char* in = granList;
+    char* out = granList;
+
+    while ( *in )
+    {
+        size_t len = strcspn(in, ",");
+        int found = 0;
+
+        for ( const char* p = other; len > 0 && *p && !found; )
+        {
+            size_t otherLen = strcspn(p, ",");
+            found = otherLen == len && strncmp(p, in, len) == 0;
+            p += otherLen;
+            if ( *p == ',' ) p++;
+        }
+
+        if ( found )
+        {
+            if ( out > granList ) *out++ = ',';
+            memmove(out, in, len);
+            out += len;
+        }
+
+        in += len;
+        if ( *in == ',' ) in++;
+    }
+    *out = '\0';
+}
+
+/* Reads the InputGranules attribute of a part, NULL on failure */
+static char* readGranuleList( hid_t part )
+{
+    hsize_t dims = 0;
+    H5T_class_t typeClass;
+    size_t size = 0;
+    char* granList = NULL;
+
+    if ( H5LTget_attribute_info(part, "/", "InputGranules", &dims, &typeClass, &size) < 0 )
+        return NULL;
+
+    granList = calloc(size + 1, 1);
+    if ( granList && H5LTget_attribute_string(part, "/", "InputGranules", granList) < 0 )
+    {
+        free(granList);
+        granList = NULL;
+    }
+    return granList;
+}
+
+/*
+                    mergeOrbitParts
+    DESCRIPTION:
+        Creates the output file of an orbit from its part files (see the top of this file).
+        The output file is created with createOutputFile(), so TERRA_CORE_VFD applies to
+        it. An existing output file is replaced. The part files are left in place.
+
+    ARGUMENTS:
+        char* outputFileName -- Name of the output file
+        char** partNames     -- Names of the part files, in instrument order
+        int numParts         -- Number of entries of partNames
+
+    RETURN:
+        FATAL_ERR on failure
+        RET_SUCCESS on success
+*/
+herr_t mergeOrbitParts( char* outputFileName, char** partNames, int numParts )
+{
+    mergeState_t state;
+    hid_t output = 0;
+    hid_t part = -1;
+    char* granList = NULL;
+    herr_t retVal = FATAL_ERR;
+
+    memset(&state, 0, sizeof(state));
+
+    remove( outputFileName );
+    if ( createOutputFile( &output, outputFileName ) == FATAL_ERR )
+        return FATAL_ERR;
+    state.output = output;
+
+    for ( int i = 0; i < numParts; i++ )
+    {
+        char* partList = NULL;
+
+        part = H5Fopen(partNames[i], H5F_ACC_RDONLY, H5P_DEFAULT);
+        if ( part < 0 )
+        {
+            FATAL_MSG("Failed to open the part file %s.\n", partNames[i]);
+            goto cleanup;
+        }
+
+        if ( H5Ovisit(part, H5_INDEX_NAME, H5_ITER_NATIVE, collectObject, &state) < 0 )
+        {
+            FATAL_MSG("Failed to read the dimension scales of %s.\n", partNames[i]);
+            goto cleanup;
+        }
+
+        if ( H5Literate(part, H5_INDEX_NAME, H5_ITER_INC, NULL, copyRootObject, &state) < 0 )
+        {
+            FATAL_MSG("Failed to copy %s into %s.\n", partNames[i], outputFileName);
+            goto cleanup;
+        }
+
+        if ( reattachScales(&state) == FATAL_ERR )
+            goto cleanup;
+        resetState(&state);
+
+        partList = readGranuleList(part);
+        if ( partList == NULL )
+        {
+            FATAL_MSG("Failed to read the InputGranules of %s.\n", partNames[i]);
+            goto cleanup;
+        }
+        if ( granList == NULL )
+            granList = partList;
+        else
+        {
+            granuleListIntersect(granList, partList);
+            free(partList);
+        }
+
+        H5Fclose(part);
+        part = -1;
+    }
+
+    if ( H5LTset_attribute_string(output, "/", "InputGranules", granList ? granList : "") < 0 )
+    {
+        FATAL_MSG("Failed to set Input Granules attribute in root group.\n");
+        goto cleanup;
+    }
+
+    retVal = RET_SUCCESS;
+
+cleanup:
+    resetState(&state);
+    free(state.links);
+    free(state.newScales);
+    if ( granList ) free(granList);
+    if ( part >= 0 ) H5Fclose(part);
+    if ( H5Fclose(output) < 0 )
+    {
+        FATAL_MSG("Failed to write and close the output file.\n");
+        retVal = FATAL_ERR;
+    }
+    if ( retVal == FATAL_ERR )
+        remove( outputFileName );
+
+    return retVal;
+}
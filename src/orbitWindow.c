@@ -0,0 +1,480 @@
+/*
+
+    DESCRIPTION:
+        Trimming of MODIS granules and MISR files to the time window of the orbit.
+
+        MOPITT (MOPITT_OrbitInfo) and CERES (CERESopenGranule) are subset to the orbit start
+        and end time. When the environment variable TERRA_ORBIT_TRIM is set to 1, MODIS
+        and MISR are subset too, along their along-track dimension:
+
+            MODIS -- whole scans. The scans are selected with the "EV start time" (TAI93) of
+                     the MOD03 file. Dimensions whose name contains "nscans" are trimmed.
+            MISR  -- whole SOM blocks. The blocks are selected with the "BlockCenterTime" of
+                     the "PerBlockMetadataTime" Vdata of the AN camera file. Dimensions whose
+                     name contains "SOMBlockDim" are trimmed.
+
+        A scan or block is kept if its time is within [orbit start, orbit end). A granule
+        without any scan or block within the orbit belongs to the neighbouring orbit: it is
+        skipped and orbitGranuleSkip() records its files, which main() then removes from
+        the InputGranules list with orbitGranuleListTrim(). main() forgets the files with
+        orbitGranuleSkipReset() when the orbit fails, as a granule at the edge of the orbit
+        also belongs to the next orbit of a batch. With TERRA_RESUME=1 the skipped files
+        of a completed instrument are kept in the checkpoint file too and recorded again
+        when the orbit is resumed (see checkpoint.c). If the times cannot be read, the
+        granule is copied in full. Otherwise (TERRA_ORBIT_TRIM unset or 0), the granules
+        are copied in full, so the first and last granules of an orbit overlap with those
+        of the neighbouring orbits.
+
+        The instrument function sets the window of the granule it converts with
+        orbitWindowSet() and clears it with orbitWindowClear(). While a window is set, H4readData()
+        reads only the window of every trimmed dimension and returns the trimmed dimension
+        sizes, the pipeline (pipeline.c) does the same and copyDimension() creates the
+        trimmed dimensions. Functions that read an SDS with SDreaddata() themselves must
+        call orbitWindowSDS() after SDgetinfo().
+
+*/
+
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#define WINDOW_KEY_LEN 32
+
+static __thread int windowActive = 0;
+static __thread char windowKey[WINDOW_KEY_LEN];
+static __thread int32 windowUnits = 0;       // scans or blocks of the whole granule
+static __thread int32 windowFirst = 0;
+static __thread int32 windowCount = 0;
+
+/* Files of the skipped granules, in the format of updateGranList() */
+static char* skippedList = NULL;
+static size_t skippedSize = 0;
+static pthread_mutex_t skippedLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+                    orbitTrimEnabled
+    DESCRIPTION:
+        Returns non-zero if the environment variable TERRA_ORBIT_TRIM is set to 1.
+*/
+int orbitTrimEnabled()
+{
+    const char *s;
+    s = getenv("TERRA_ORBIT_TRIM");
+
+    if(s && isdigit((int)*s))
+        if((unsigned int)strtol(s,NULL,10) == 1)
+            return 1;
+
+    return 0;
+}
+
+/*
+                    orbitWindowSet
+    DESCRIPTION:
+        Sets the window of the calling thread: every dimension whose name contains dimKey
+        and whose size is a multiple of units is trimmed to the units first .. first+count-1.
+        A dimension of size k*units is trimmed to k*first .. k*(first+count)-1.
+
+    ARGUMENTS:
+        const char* dimKey -- Part of the along-track dimension names, e.g. "nscans"
+        int32 units        -- Number of scans or blocks of the whole granule
+        int32 first        -- First scan or block to keep
+        int32 count        -- Number of scans or blocks to keep
+*/
+void orbitWindowSet( const char* dimKey, int32 units, int32 first, int32 count )
+{
+    strncpy(windowKey, dimKey, WINDOW_KEY_LEN-1);
+    windowKey[WINDOW_KEY_LEN-1] = '\0';
+    windowUnits = units;
+    windowFirst = first;
+    windowCount = count;
+    windowActive = ( units > 0 && count > 0 && first >= 0 && first + count <= units );
+}
+
+/* Clears the window of the calling thread */
+void orbitWindowClear()
+{
+    windowActive = 0;
+}
+
+/*
+                    orbitGranuleSkip
+    DESCRIPTION:
+        Records the input files of a granule that has no scan or block within the orbit,
+        so that orbitGranuleListTrim() leaves them out of the InputGranules list.
+
+    ARGUMENTS:
+        char* const* files -- Paths of the input files of the granule, NULL entries allowed
+        int nfiles         -- Number of entries of files
+
+    RETURN:
+        FATAL_ERR on failure, RET_SUCCESS otherwise.
+*/
+herr_t orbitGranuleSkip( char* const* files, int nfiles )
+{
+    herr_t status = RET_SUCCESS;
+
+    pthread_mutex_lock(&skippedLock);
+    for ( int i = 0; i < nfiles && status == RET_SUCCESS; i++ )
+    {
+        const char* name;
+
+        if ( files[i] == NULL )
+            continue;
+        name = strrchr(files[i], '/');
+        name = name ? name + 1 : files[i];
+        status = updateGranList( &skippedList, name, &skippedSize );
+    }
+    pthread_mutex_unlock(&skippedLock);
+
+    return status;
+}
+
+/* Returns non-zero if the comma separated list contains the name of length len */
+static int granListHas( const char* list, const char* name, size_t len )
+{
+    while ( list && *list )
+    {
+        size_t entryLen = strcspn(list, ",");
+        if ( entryLen == len && strncmp(list, name, len) == 0 )
+            return 1;
+        list += entryLen;
+        if ( *list == ',' )
+            list++;
+    }
+    return 0;
+}
+
+/*
+                    orbitGranuleSkipReset
+    DESCRIPTION:
+        Forgets the files recorded by orbitGranuleSkip().
+*/
+void orbitGranuleSkipReset()
+{
+    pthread_mutex_lock(&skippedLock);
+    free(skippedList);
+    skippedList = NULL;
+    skippedSize = 0;
+    pthread_mutex_unlock(&skippedLock);
+}
+
+/*
+                    orbitGranuleSkipped
+    DESCRIPTION:
+        Returns a copy of the files recorded by orbitGranuleSkip(), comma separated with a
+        trailing comma, or an empty string if there are none. The caller must free it.
+        Returns NULL if the memory cannot be allocated.
+*/
+char* orbitGranuleSkipped()
+{
+    char* copy;
+
+    pthread_mutex_lock(&skippedLock);
+    copy = malloc(skippedList ? strlen(skippedList) + 1 : 1);
+    if ( copy )
+        strcpy(copy, skippedList ? skippedList : "");
+    pthread_mutex_unlock(&skippedLock);
+
+    if ( copy == NULL )
+        FATAL_MSG("Failed to allocate memory.\n");
+    return copy;
+}
+
+/*
+                    orbitGranuleListTrim
+    DESCRIPTION:
+        Removes the files recorded by orbitGranuleSkip() from a granule list built by
+        updateGranList(), in place, and forgets them. The trailing comma that
+        updateGranList() leaves after the last file is removed too, so the list is the
+        same whichever of its files are skipped.
+
+    ARGUMENTS:
+        char* granList -- The comma separated granule list. Can be NULL.
+*/
+void orbitGranuleListTrim( char* granList )
+{
+    pthread_mutex_lock(&skippedLock);
+    if ( granList )
+    {
+        char* out = granList;
+        const char* in = granList;
+
+        while ( *in )
+        {
+            size_t len = strcspn(in, ",");
+            int comma = ( in[len] == ',' );
+
+            if ( len > 0 && !granListHas(skippedList, in, len) )
+            {
+                memmove(out, in, len + comma);
+                out += len + comma;
+            }
+            in += len + comma;
+        }
+        if ( out > granList && out[-1] == ',' )
+            out--;
+        *out = '\0';
+    }
+    pthread_mutex_unlock(&skippedLock);
+
+    orbitGranuleSkipReset();
+}
+
+/*
+                    orbitWindowDim
+    DESCRIPTION:
+        Applies the window of the calling thread to one dimension.
+
+    ARGUMENTS:
+        const char* dimName -- Name of the HDF4 dimension
+        int32 size          -- Size of the dimension in the file
+        int32* start        -- Receives the first index to read
+        int32* count        -- Receives the number of indices to read
+
+    RETURN:
+        1 if the dimension is trimmed, 0 if it is read in full (start 0, count size).
+*/
+int orbitWindowDim( const char* dimName, int32 size, int32* start, int32* count )
+{
+    *start = 0;
+    *count = size;
+
+    if ( !windowActive || dimName == NULL || strstr(dimName, windowKey) == NULL ||
+         size <= 0 || size % windowUnits != 0 )
+        return 0;
+
+    *start = (size / windowUnits) * windowFirst;
+    *count = (size / windowUnits) * windowCount;
+    return 1;
+}
+
+/*
+                    orbitWindowSDS
+    DESCRIPTION:
+        Applies the window of the calling thread to all dimensions of an SDS.
+
+    ARGUMENTS:
+        int32 sdsID  -- The SDS
+        int32 rank   -- Its rank
+        int32* dims  -- Its dimension sizes as given by SDgetinfo(). The trimmed dimensions
+                        are replaced by their window size.
+        int32* start -- Receives the first index to read of each dimension. Can be NULL.
+
+    RETURN:
+        The number of trimmed dimensions.
+*/
+int orbitWindowSDS( int32 sdsID, int32 rank, int32* dims, int32* start )
+{
+    char dimName[H4_MAX_NC_NAME];
+    int32 size, ntype, num_attrs;
+    int32 dimStart, dimCount;
+    int trimmed = 0;
+
+    for ( int32 i = 0; i < rank; i++ )
+    {
+        if ( start ) start[i] = 0;
+        if ( !windowActive )
+            continue;
+
+        int32 dimID = SDgetdimid(sdsID, i);
+        if ( dimID == FAIL || SDdiminfo(dimID, dimName, &size, &ntype, &num_attrs) == FAIL )
+            continue;
+
+        if ( orbitWindowDim(dimName, dims[i], &dimStart, &dimCount) )
+        {
+            dims[i] = dimCount;
+            if ( start ) start[i] = dimStart;
+            trimmed++;
+        }
+    }
+
+    return trimmed;
+}
+
+/*
+    Finds the units of times[] (TAI93, negative for fill values) within the orbit. Sets
+    *count to 0 if there is none.
+*/
+static herr_t findWindow( const double* times, int32 n, OInfo_t orbit, int32* first, int32* count )
+{
+    GDateInfo_t date;
+    double startTAI93, endTAI93;
+    int32 last = -1;
+
+    date.year = orbit.start_year;
+    date.month = orbit.start_month;
+    date.day = orbit.start_day;
+    date.hour = orbit.start_hour;
+    date.minute = orbit.start_minute;
+    date.second = (double) orbit.start_second;
+    if ( getTAI93(date, &startTAI93) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to get TAI93 timestamp.\n");
+        return FATAL_ERR;
+    }
+
+    date.year = orbit.end_year;
+    date.month = orbit.end_month;
+    date.day = orbit.end_day;
+    date.hour = orbit.end_hour;
+    date.minute = orbit.end_minute;
+    date.second = (double) orbit.end_second;
+    if ( getTAI93(date, &endTAI93) == FATAL_ERR )
+    {
+        FATAL_MSG("Failed to get TAI93 timestamp.\n");
+        return FATAL_ERR;
+    }
+
+    *first = -1;
+    for ( int32 i = 0; i < n; i++ )
+    {
+        if ( times[i] < 0.0 || times[i] < startTAI93 || times[i] >= endTAI93 )
+            continue;
+        if ( *first < 0 ) *first = i;
+        last = i;
+    }
+
+    *count = ( *first < 0 ) ? 0 : last - *first + 1;
+    if ( *first < 0 ) *first = 0;
+
+    return RET_SUCCESS;
+}
+
+/*
+                    MODISorbitWindow
+    DESCRIPTION:
+        Finds the scans of a MODIS granule within the orbit from the "EV start time" of its
+        MOD03 file.
+
+    ARGUMENTS:
+        int32 MOD03FileID  -- SD interface ID of the MOD03 file
+        OInfo_t orbit      -- The current orbit
+        int32* numScans    -- Receives the number of scans of the granule
+        int32* first       -- Receives the first scan within the orbit
+        int32* count       -- Receives the number of scans within the orbit (0 if none)
+
+    RETURN:
+        FATAL_ERR if the scan times cannot be read, RET_SUCCESS otherwise.
+*/
+herr_t MODISorbitWindow( int32 MOD03FileID, OInfo_t orbit, int32* numScans, int32* first, int32* count )
+{
+    double* scanTimes = NULL;
+    int32 rank = 0;
+    int32 dims[DIM_MAX] = {0};
+    herr_t status;
+
+    /* The window must not apply to the scan times themselves */
+    int wasActive = windowActive;
+    windowActive = 0;
+    status = H4readData( MOD03FileID, "EV start time", (void**)&scanTimes, &rank, dims, DFNT_FLOAT64,
+                         NULL, NULL, NULL );
+    windowActive = wasActive;
+    if ( status == FATAL_ERR || rank != 1 )
+    {
+        FATAL_MSG("Failed to read the MODIS scan start times.\n");
+        if ( scanTimes ) free(scanTimes);
+        return FATAL_ERR;
+    }
+
+    *numScans = dims[0];
+    status = findWindow(scanTimes, dims[0], orbit, first, count);
+    free(scanTimes);
+
+    return status;
+}
+
+/*
+                    MISRorbitWindow
+    DESCRIPTION:
+        Finds the SOM blocks of a MISR file within the orbit from the "BlockCenterTime"
+        field ("YYYY-MM-DDThh:mm:ss.ssssssZ") of its "PerBlockMetadataTime" Vdata. Blocks
+        without a valid time are not in the orbit. The V interface must be started.
+
+    ARGUMENTS:
+        int32 hFileID      -- H interface ID of a MISR GRP file
+        OInfo_t orbit      -- The current orbit
+        int32* numBlocks   -- Receives the number of blocks of the file
+        int32* first       -- Receives the first block within the orbit
+        int32* count       -- Receives the number of blocks within the orbit (0 if none)
+
+    RETURN:
+        FATAL_ERR if the block times cannot be read, RET_SUCCESS otherwise.
+*/
+herr_t MISRorbitWindow( int32 hFileID, OInfo_t orbit, int32* numBlocks, int32* first, int32* count )
+{
+    int32 vdataRef, vdataID;
+    int32 nRecords, recordSize;
+    char* records = NULL;
+    double* blockTimes = NULL;
+    herr_t status = FATAL_ERR;
+
+    vdataRef = VSfind(hFileID, "PerBlockMetadataTime");
+    if ( vdataRef <= 0 )
+    {
+        FATAL_MSG("Failed to find the MISR PerBlockMetadataTime Vdata.\n");
+        return FATAL_ERR;
+    }
+
+    vdataID = VSattach(hFileID, vdataRef, "r");
+    if ( vdataID == FAIL )
+    {
+        FATAL_MSG("VSattach failed.\n");
+        return FATAL_ERR;
+    }
+
+    nRecords = VSelts(vdataID);
+    recordSize = VSsizeof(vdataID, "BlockCenterTime");
+    if ( nRecords <= 0 || recordSize <= 0 || VSsetfields(vdataID, "BlockCenterTime") == FAIL )
+    {
+        FATAL_MSG("Failed to find the BlockCenterTime field.\n");
+        goto cleanup;
+    }
+
+    records = calloc((size_t) nRecords * recordSize + 1, 1);
+    blockTimes = malloc(sizeof(double) * nRecords);
+    if ( records == NULL || blockTimes == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        goto cleanup;
+    }
+
+    if ( VSread(vdataID, (uint8*) records, nRecords, FULL_INTERLACE) != nRecords )
+    {
+        FATAL_MSG("VSread failed.\n");
+        goto cleanup;
+    }
+
+    for ( int32 i = 0; i < nRecords; i++ )
+    {
+        char timeString[64] = {'\0'};
+        unsigned int year, month, day, hour, minute;
+        GDateInfo_t date;
+
+        blockTimes[i] = -1.0;
+        strncpy(timeString, records + (size_t) i * recordSize, min(recordSize, (int32) sizeof(timeString) - 1));
+        if ( sscanf(timeString, "%4u-%2u-%2uT%2u:%2u:%lf", &year, &month, &day, &hour, &minute, &date.second) != 6 ||
+             year < 1993 )
+            continue;
+
+        date.year = (unsigned short) year;
+        date.month = (unsigned char) month;
+        date.day = (unsigned char) day;
+        date.hour = (unsigned char) hour;
+        date.minute = (unsigned char) minute;
+        if ( getTAI93(date, &blockTimes[i]) == FATAL_ERR )
+            blockTimes[i] = -1.0;
+    }
+
+    *numBlocks = nRecords;
+    status = findWindow(blockTimes, nRecords, orbit, first, count);
+
+cleanup:
+    VSdetach(vdataID);
+    if ( records ) free(records);
+    if ( blockTimes ) free(blockTimes);
+    return status;
+}
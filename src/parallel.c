@@ -0,0 +1,236 @@
+/*
+
+    DESCRIPTION:
+        Dispatch of the instrument converters.
+
+        main() does not call MOPITT(), CERES(), MODIS(), ASTER() and MISR() directly. Every
+        call is packaged into a TERRAjob_t and handed to dispatchInstrument(), which runs it
+        in the calling thread inside a timing record, after the input prefetch and the chunk
+        policy of the instrument have been updated. The same path drops the jobs of the
+        instruments a resumed orbit already completed and records completed instruments in
+        the checkpoint file (see checkpoint.c).
+
+        Neither the HDF4 nor the HDF5 library is thread-safe, so the instruments of one
+        orbit run one after the other. The threads of the program only ever run code that
+        does not call into the libraries (the lat/lon interpolation, the MISR unpacking) or
+        are the only user of one of them (see pipeline.c). Orbits are converted next to
+        each other by processes instead (see runBatch() in main.c).
+
+        This file also holds the thread counts of those helper threads.
+
+*/
+
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define NUM_INSTRUMENTS 5
+
+static int skipMask = 0;            // instruments whose jobs are dropped (1 << INSTR_*)
+
+static const char* instrumentName[NUM_INSTRUMENTS] = { "MOPITT", "CERES", "MODIS", "ASTER", "MISR" };
+
+/*
+                    runJob
+    DESCRIPTION:
+        Calls the instrument function described by job inside a timing record.
+
+    RETURN:
+        The return value of the instrument function.
+*/
+static int runJob( TERRAjob_t* job )
+{
+    int status = FATAL_ERR;
+    int timer;
+
+    /* All earlier jobs of the instrument succeeded: make them durable, then record them */
+    if ( job->checkpoint )
+    {
+        /* With the core driver a flush writes the whole in-memory file, so only the
+         * COMPLETE record after the close is kept (see checkpoint.c)
+         */
+        if ( coreVfdEnabled() )
+            return RET_SUCCESS;
+        if ( checkpointSync( outputFile ) == FATAL_ERR || checkpointRecordSkipped( job->args[0] ) == FATAL_ERR )
+            return FATAL_ERR;
+        return checkpointRecord( job->args[0], instrumentName[job->instrument] );
+    }
+
+    timer = timingBegin("instrument", instrumentName[job->instrument],
+                            job->instrument == INSTR_CERES ? job->args[2] : job->args[1]);
+
+    /* The input files of this job are read now, prefetch the next ones */
+    prefetchConsumed( job->args, TERRA_JOB_MAX_ARGS );
+
+    /* The output datasets get the chunk shapes of this instrument */
+    chunkPolicySet( job->instrument );
+
+    switch ( job->instrument )
+    {
+    case INSTR_MOPITT:
+        status = MOPITT( job->args, job->orbitInfo );
+        break;
+    case INSTR_CERES:
+        status = CERES( job->args, job->index, job->count, &job->ceres );
+        CERESfreeGranule( &job->ceres );
+        break;
+    case INSTR_MODIS:
+        status = MODIS( job->args, job->count, job->unpack, job->orbitInfo );
+        break;
+    case INSTR_ASTER:
+        status = ASTER( job->args, job->count, job->unpack );
+        break;
+    case INSTR_MISR:
+        status = MISR( job->args, job->unpack, job->orbitInfo );
+        break;
+    default:
+        FATAL_MSG("Unknown instrument %d.\n", job->instrument);
+        break;
+    }
+
+    chunkPolicySet( -1 );
+    timingEnd(timer);
+    return status;
+}
+
+/* Closes the CERES granule of a job that will not run */
+static void dropJobGranule( const TERRAjob_t* job )
+{
+    CERESgranule_t granule = job->ceres;
+
+    if ( job->instrument != INSTR_CERES || granule.fileID == 0 )
+        return;
+
+    CERESfreeGranule(&granule);
+}
+
+/*
+                    dispatchInstrument
+    DESCRIPTION:
+        Runs the instrument job in the calling thread, unless its instrument is skipped
+        (see instrumentSkipSet()). The job owns job->ceres: the granule is closed once the
+        job has run or when it is dropped.
+
+    ARGUMENTS:
+        TERRAjob_t* job -- The job. Only the first nargs entries of job->args are used.
+        int nargs       -- Number of entries in job->args
+
+    RETURN:
+        FATAL_ERR if the job is invalid or failed
+        RET_SUCCESS otherwise.
+*/
+herr_t dispatchInstrument( const TERRAjob_t* job, int nargs )
+{
+    TERRAjob_t local;
+
+    if ( nargs > TERRA_JOB_MAX_ARGS || job->instrument < 0 || job->instrument >= NUM_INSTRUMENTS )
+    {
+        FATAL_MSG("Invalid instrument job.\n");
+        dropJobGranule(job);
+        return FATAL_ERR;
+    }
+
+    /* Completed by an earlier run (see checkpoint.c) */
+    if ( skipMask & (1 << job->instrument) )
+    {
+        prefetchConsumed( job->args, TERRA_JOB_MAX_ARGS );
+        dropJobGranule(job);
+        return RET_SUCCESS;
+    }
+
+    local = *job;
+    for ( int i = nargs; i < TERRA_JOB_MAX_ARGS; i++ )
+        local.args[i] = NULL;
+    return runJob(&local) == FATAL_ERR ? FATAL_ERR : RET_SUCCESS;
+}
+
+/*
+                    dispatchCheckpoint
+    DESCRIPTION:
+        Runs a checkpoint job after the jobs of an instrument: once they all succeeded, the
+        output file is flushed and the instrument is recorded as complete in the
+        checkpoint file (see checkpoint.c). Nothing is recorded if one of them failed.
+
+    ARGUMENTS:
+        int instrument        -- One of the INSTR_* values
+        char* checkpointFile  -- Name of the checkpoint file
+
+    RETURN:
+        The return value of dispatchInstrument().
+*/
+herr_t dispatchCheckpoint( int instrument, char* checkpointFile )
+{
+    TERRAjob_t job;
+
+    memset(&job, 0, sizeof(job));
+    job.instrument = instrument;
+    job.checkpoint = 1;
+    job.args[0] = checkpointFile;
+
+    return dispatchInstrument( &job, 1 );
+}
+
+/*
+                    instrumentSkipSet
+    DESCRIPTION:
+        Sets the instruments whose jobs dispatchInstrument() drops instead of running, as a
+        mask of (1 << INSTR_*) bits. Used to skip the instruments that an earlier run of a
+        resumed orbit completed.
+*/
+void instrumentSkipSet( int mask )
+{
+    skipMask = mask;
+}
+
+/* Returns the name of an instrument, which is also the name of its root group */
+const char* instrumentNameOf( int instrument )
+{
+    if ( instrument < 0 || instrument >= NUM_INSTRUMENTS )
+        return NULL;
+    return instrumentName[instrument];
+}
+
+/*
+                    interpThreadCount
+    DESCRIPTION:
+        Number of threads to use for one lat/lon interpolation. It is the value of the
+        environment variable TERRA_INTERP_THREADS. If the variable is not set, the
+        interpolation runs on the calling thread, since several processes usually share
+        a node (processBF_SX.sh, TERRA_BATCH_PROCS).
+
+    RETURN:
+        The number of threads, at least 1
+*/
+int interpThreadCount()
+{
+    const char* s = getenv("TERRA_INTERP_THREADS");
+    long numThreads = 0;
+
+    if ( s && isdigit((int)*s) )
+        numThreads = strtol(s, NULL, 10);
+
+    return numThreads > 1 ? (int) numThreads : 1;
+}
+
+/*
+                    misrThreadCount
+    DESCRIPTION:
+        Number of threads that unpack the MISR camera radiances (see MISR.c). It is the
+        value of the environment variable TERRA_MISR_THREADS. If the variable is not set,
+        the radiances are unpacked on the MISR thread itself.
+
+    RETURN:
+        The number of threads, 1 for the serial conversion
+*/
+int misrThreadCount()
+{
+    const char* s = getenv("TERRA_MISR_THREADS");
+    long numThreads = 0;
+
+    if ( s && isdigit((int)*s) )
+        numThreads = strtol(s, NULL, 10);
+
+    return numThreads > 1 ? (int) numThreads : 1;
+}
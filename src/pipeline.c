@@ -0,0 +1,497 @@
+/*
+
+    DESCRIPTION:
+        Staged read -> convert -> write pipeline for the readThenWrite family.
+
+        Without the pipeline, a transfer reads the whole HDF4 SDS into memory, converts it
+        and only then writes it with H5Dwrite, so the three steps never overlap. With
+        the pipeline (environment variable TERRA_PIPELINE=1), the SDS is split into slabs
+        along its first dimension and moved through three stages:
+
+            reader thread     -- SDreaddata() of slab k+1
+            converter thread  -- unpacking of slab k
+            calling thread    -- H5Dwrite() hyperslab of slab k-1
+
+        The stages are connected by a ring of PIPE_SLOTS slab buffers, which is the bounded
+        queue between them. A slot goes FREE -> READ -> CONVERTED -> FREE, and slab k always
+        uses slot k % PIPE_SLOTS, so slabs are written in order. Peak memory is PIPE_SLOTS
+        slabs instead of the whole dataset plus its converted copy.
+
+        The calling thread stays the only HDF5 user and the reader thread the only HDF4
+        user while the pipeline runs, so neither library is ever entered by two threads.
+
+        The output dataset is created before the first slab is read, so the caller gets the
+        same dataset identifier back as from insertDataset().
+
+*/
+
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Number of slab buffers in the ring and the targeted size of one slab */
+#define PIPE_SLOTS 3
+#define PIPE_SLAB_BYTES (8*1024*1024)
+
+enum { SLOT_FREE = 0, SLOT_READ, SLOT_CONVERTED };
+
+typedef struct
+{
+    int state;
+    void* inBuffer;
+    void* outBuffer;    // same as inBuffer if there is no conversion
+} pipeSlot_t;
+
+typedef struct
+{
+    const TERRApipeline_t* pipe;
+    int32 sdsID;
+    int32 rank;
+    int32 dimSizes[DIM_MAX];
+    int32 windowStart[DIM_MAX];     // start of the orbit window (see orbitWindow.c)
+    size_t rowElems;        // number of elements in one row of the first dimension
+    int32 slabRows;         // rows per slab
+    int32 numSlabs;
+    pipeSlot_t slots[PIPE_SLOTS];
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int failed;
+} pipeState_t;
+
+/*
+                    pipelineEnabled
+    DESCRIPTION:
+        Returns non-zero if the environment variable TERRA_PIPELINE is set to 1.
+*/
+int pipelineEnabled()
+{
+    const char *s;
+    s = getenv("TERRA_PIPELINE");
+
+    if(s && isdigit((int)*s))
+        if((unsigned int)strtol(s,NULL,10) == 1)
+            return 1;
+
+    return 0;
+}
+
+static int32 slabRowCount( const pipeState_t* st, int32 slab )
+{
+    int32 first = slab * st->slabRows;
+    return min( st->slabRows, st->dimSizes[0] - first );
+}
+
+/* Wait until the slot of the given slab reaches the state. Returns 0 if the pipeline failed. */
+static int waitForSlot( pipeState_t* st, int32 slab, int state )
+{
+    pipeSlot_t* slot = &st->slots[slab % PIPE_SLOTS];
+
+    pthread_mutex_lock(&st->lock);
+    while ( slot->state != state && !st->failed )
+        pthread_cond_wait(&st->cond, &st->lock);
+    int ok = !st->failed;
+    pthread_mutex_unlock(&st->lock);
+
+    return ok;
+}
+
+static void setSlot( pipeState_t* st, int32 slab, int state, int failed )
+{
+    pthread_mutex_lock(&st->lock);
+    if ( failed ) st->failed = 1;
+    else st->slots[slab % PIPE_SLOTS].state = state;
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void* readerStage( void* arg )
+{
+    pipeState_t* st = (pipeState_t*) arg;
+    int32 start[DIM_MAX] = {0};
+    int32 edges[DIM_MAX];
+    intn status;
+
+    for ( int i = 0; i < st->rank; i++ )
+        edges[i] = st->dimSizes[i];
+
+    for ( int32 slab = 0; slab < st->numSlabs; slab++ )
+    {
+        if ( !waitForSlot(st, slab, SLOT_FREE) )
+            break;
+
+        for ( int i = 0; i < st->rank; i++ )
+            start[i] = st->windowStart[i];
+        start[0] += slab * st->slabRows;
+        edges[0] = slabRowCount(st, slab);
+
+        status = SDreaddata( st->sdsID, start, NULL, edges, st->slots[slab % PIPE_SLOTS].inBuffer );
+
+        if ( status < 0 )
+        {
+            FATAL_MSG("SDreaddata: Failed to read slab %d of \"%s\".\n", (int) slab, st->pipe->inDatasetName);
+            setSlot(st, slab, 0, 1);
+            break;
+        }
+        setSlot(st, slab, SLOT_READ, 0);
+    }
+
+    return NULL;
+}
+
+static void* converterStage( void* arg )
+{
+    pipeState_t* st = (pipeState_t*) arg;
+    const TERRApipeline_t* pipe = st->pipe;
+
+    for ( int32 slab = 0; slab < st->numSlabs; slab++ )
+    {
+        if ( !waitForSlot(st, slab, SLOT_READ) )
+            break;
+
+        pipeSlot_t* slot = &st->slots[slab % PIPE_SLOTS];
+        size_t nElems = (size_t) slabRowCount(st, slab) * st->rowElems;
+        size_t firstElem = (size_t) slab * st->slabRows * st->rowElems;
+
+        if ( pipe->convert( slot->inBuffer, slot->outBuffer, nElems, firstElem, pipe->convertArg ) < 0 )
+        {
+            FATAL_MSG("Failed to convert slab %d of \"%s\".\n", (int) slab, pipe->inDatasetName);
+            setSlot(st, slab, 0, 1);
+            break;
+        }
+        setSlot(st, slab, SLOT_CONVERTED, 0);
+    }
+
+    return NULL;
+}
+
+/* Creates the output dataset */
+static hid_t createPipeDataset( const pipeState_t* st )
+{
+    const TERRApipeline_t* pipe = st->pipe;
+    hsize_t dims[DIM_MAX];
+    hid_t space = 0;
+    hid_t plist = H5P_DEFAULT;
+    hid_t dset = FATAL_ERR;
+    char* correct_dsetname = NULL;
+
+    for ( int i = 0; i < st->rank; i++ )
+        dims[i] = (hsize_t) st->dimSizes[i];
+
+    /* Chunked and filtered like the datasets of insertDataset(), useChunk only forces it */
+    plist = chunkPolicyPlist( st->rank, dims, pipe->outputDataType, pipe->useChunk );
+    if ( plist == FATAL_ERR )
+        return FATAL_ERR;
+
+    space = H5Screate_simple( st->rank, dims, NULL );
+    if ( space < 0 )
+    {
+        FATAL_MSG("Cannot create the data space.\n");
+        if ( plist != H5P_DEFAULT ) H5Pclose(plist);
+        return FATAL_ERR;
+    }
+
+    /* This is necessary since "/" is a reserved character in HDF5,we have to change it "_". */
+    correct_dsetname = correct_name( pipe->outDatasetName ? pipe->outDatasetName : pipe->inDatasetName );
+
+    dset = H5Dcreate( pipe->outputGroupID, correct_dsetname, pipe->outputDataType, space,
+                      H5P_DEFAULT, plist, H5P_DEFAULT );
+    if ( dset < 0 )
+    {
+        FATAL_MSG("H5Dcreate -- Unable to create dataset \"%s\".\n", correct_dsetname );
+        dset = FATAL_ERR;
+    }
+
+    free(correct_dsetname);
+    H5Sclose(space);
+    if ( plist != H5P_DEFAULT ) H5Pclose(plist);
+
+    return dset;
+}
+
+/* Returns the number of rows of the first dimension in one chunk of dset, 0 if it is not chunked */
+static hsize_t pipeChunkRows( hid_t dset )
+{
+    hsize_t chunkDims[DIM_MAX];
+    hsize_t rows = 0;
+    hid_t plist = H5Dget_create_plist(dset);
+
+    if ( plist < 0 )
+        return 0;
+    if ( H5Pget_layout(plist) == H5D_CHUNKED && H5Pget_chunk(plist, DIM_MAX, chunkDims) > 0 )
+        rows = chunkDims[0];
+    H5Pclose(plist);
+
+    return rows;
+}
+
+static herr_t writeSlab( const pipeState_t* st, hid_t dset, int32 slab, const void* buffer )
+{
+    hsize_t start[DIM_MAX] = {0};
+    hsize_t count[DIM_MAX];
+    hid_t fileSpace = 0;
+    hid_t memSpace = 0;
+    herr_t status = FATAL_ERR;
+
+    for ( int i = 0; i < st->rank; i++ )
+        count[i] = (hsize_t) st->dimSizes[i];
+    start[0] = (hsize_t) slab * st->slabRows;
+    count[0] = (hsize_t) slabRowCount(st, slab);
+
+    fileSpace = H5Dget_space(dset);
+    memSpace = H5Screate_simple( st->rank, count, NULL );
+    if ( fileSpace < 0 || memSpace < 0 )
+    {
+        FATAL_MSG("Cannot obtain the data spaces.\n");
+        goto done;
+    }
+
+    if ( H5Sselect_hyperslab( fileSpace, H5S_SELECT_SET, start, NULL, count, NULL ) < 0 )
+    {
+        FATAL_MSG("Cannot select the hyperslab.\n");
+        goto done;
+    }
+
+    if ( H5Dwrite( dset, st->pipe->outputDataType, memSpace, fileSpace, H5P_DEFAULT, buffer ) < 0 )
+    {
+        FATAL_MSG("H5Dwrite -- Unable to write slab %d of \"%s\".\n", (int) slab, st->pipe->inDatasetName );
+        goto done;
+    }
+
+    /* The reader thread has no timing record, so both sides of the slab are counted here */
+    timingAddRead( (size_t) count[0] * st->rowElems * DFKNTsize(st->pipe->inputDataType) );
+    timingAddWritten( (size_t) count[0] * st->rowElems * H5Tget_size(st->pipe->outputDataType) );
+
+    status = RET_SUCCESS;
+
+done:
+    if ( memSpace > 0 ) H5Sclose(memSpace);
+    if ( fileSpace > 0 ) H5Sclose(fileSpace);
+    return status;
+}
+
+/*
+                    pipelineTransfer
+    DESCRIPTION:
+        Copies the HDF4 SDS pipe->inDatasetName into a new HDF5 dataset, running the
+        read, the conversion and the write of consecutive slabs concurrently. If the
+        dataset fits into a single slab, everything is done in the calling thread.
+
+    ARGUMENTS:
+        const TERRApipeline_t* pipe -- Description of the transfer:
+            inputFileID     -- HDF4 SD interface identifier
+            inDatasetName   -- name of the input SDS
+            inputDataType   -- HDF4 number type of the input SDS
+            outputGroupID   -- HDF5 group for the output dataset
+            outDatasetName  -- name of the output dataset (passed through correct_name()).
+                               NULL means the same as inDatasetName.
+            outputDataType  -- HDF5 type of the output dataset and of the converted buffer
+            outElemSize     -- size in bytes of one converted element
+            convert         -- conversion callback. NULL means that the input buffer is
+                               written as is.
+            convertArg      -- passed to convert
+            useChunk        -- non-zero to chunk the dataset even if USE_CHUNK is not 1.
+                               The chunk shape and the filters are those of
+                               chunkPolicyPlist(), as for insertDataset().
+
+        The callback is called once per slab, in slab order, from one thread:
+            convert( in, out, nElems, firstElem, convertArg )
+        where firstElem is the position of in[0] within the whole dataset.
+
+    EFFECTS:
+        Creates and fills a new dataset. It is the responsibility of the caller to close
+        the returned identifier with H5Dclose().
+
+    RETURN:
+        Returns the dataset identifier if successful. Else returns FATAL_ERR.
+*/
+hid_t pipelineTransfer( const TERRApipeline_t* pipe )
+{
+    pipeState_t st;
+    int32 sds_index = 0;
+    int32 ntype = 0;
+    int32 num_attrs = 0;
+    size_t inElemSize = 0;
+    size_t outElemSize = 0;
+    size_t slabBytes = 0;
+    hid_t datasetID = FATAL_ERR;
+    pthread_t readerThread;
+    pthread_t converterThread;
+    int readerStarted = 0;
+    int converterStarted = 0;
+
+    memset(&st, 0, sizeof(st));
+    st.pipe = pipe;
+    st.sdsID = FAIL;
+
+    sds_index = SDnametoindex( pipe->inputFileID, pipe->inDatasetName );
+    if ( sds_index < 0 )
+    {
+        FATAL_MSG("SDnametoindex: Failed to get index of dataset \"%s\".\n", pipe->inDatasetName);
+        return FATAL_ERR;
+    }
+
+    st.sdsID = SDselect( pipe->inputFileID, sds_index );
+    if ( st.sdsID < 0 )
+    {
+        FATAL_MSG("SDselect: Failed to select dataset.\n");
+        return FATAL_ERR;
+    }
+
+    if ( SDgetinfo( st.sdsID, NULL, &st.rank, st.dimSizes, &ntype, &num_attrs ) < 0 )
+    {
+        FATAL_MSG("SDgetinfo: Failed to get info from dataset.\n");
+        SDendaccess(st.sdsID);
+        return FATAL_ERR;
+    }
+
+    if ( ntype != pipe->inputDataType )
+    {
+        FATAL_MSG("The number type of \"%s\" is not the expected one.\n", pipe->inDatasetName);
+        SDendaccess(st.sdsID);
+        return FATAL_ERR;
+    }
+
+    /* The reader thread does not see the orbit window of this thread, keep it in st */
+    orbitWindowSDS( st.sdsID, st.rank, st.dimSizes, st.windowStart );
+
+    inElemSize = (size_t) DFKNTsize( pipe->inputDataType );
+    outElemSize = pipe->convert ? pipe->outElemSize : inElemSize;
+
+    /* Created first, the slabs follow its chunk layout */
+    datasetID = createPipeDataset(&st);
+    if ( datasetID == FATAL_ERR )
+    {
+        SDendaccess(st.sdsID);
+        return FATAL_ERR;
+    }
+
+    st.rowElems = 1;
+    for ( int i = 1; i < st.rank; i++ )
+        st.rowElems *= (size_t) st.dimSizes[i];
+
+    /* Slab size: as many rows of the first dimension as fit in PIPE_SLAB_BYTES */
+    {
+        size_t rowBytes = st.rowElems * max(inElemSize, outElemSize);
+        size_t rows = rowBytes > 0 ? PIPE_SLAB_BYTES / rowBytes : 1;
+        if ( rows < 1 ) rows = 1;
+        if ( rows > (size_t) st.dimSizes[0] ) rows = (size_t) st.dimSizes[0];
+
+        /* Whole chunks per slab, so that no chunk is written (and compressed) twice */
+        hsize_t chunkRows = pipeChunkRows(datasetID);
+        if ( chunkRows > 0 && rows >= chunkRows )
+            rows -= rows % chunkRows;
+
+        st.slabRows = (int32) max(rows, 1);
+        st.numSlabs = st.dimSizes[0] > 0 ? (st.dimSizes[0] + st.slabRows - 1) / st.slabRows : 0;
+        slabBytes = (size_t) st.slabRows * st.rowElems;
+    }
+
+    for ( int i = 0; i < PIPE_SLOTS && i < st.numSlabs; i++ )
+    {
+        st.slots[i].inBuffer = malloc( slabBytes * inElemSize );
+        st.slots[i].outBuffer = pipe->convert ? malloc( slabBytes * outElemSize ) : st.slots[i].inBuffer;
+        if ( st.slots[i].inBuffer == NULL || st.slots[i].outBuffer == NULL )
+        {
+            FATAL_MSG("Failed to allocate memory.\n");
+            goto cleanupFail;
+        }
+    }
+    timingBuffer( slabBytes * max(inElemSize, outElemSize) );
+
+    /* A single slab does not need any threads */
+    if ( st.numSlabs <= 1 )
+    {
+        for ( int32 slab = 0; slab < st.numSlabs; slab++ )
+        {
+            int32 start[DIM_MAX] = {0};
+            int32 edges[DIM_MAX];
+            for ( int i = 0; i < st.rank; i++ )
+            {
+                start[i] = st.windowStart[i];
+                edges[i] = st.dimSizes[i];
+            }
+
+            intn status = SDreaddata( st.sdsID, start, NULL, edges, st.slots[0].inBuffer );
+            if ( status < 0 )
+            {
+                FATAL_MSG("SDreaddata: Failed to read \"%s\".\n", pipe->inDatasetName);
+                goto cleanupFail;
+            }
+
+            status = pipe->convert ? pipe->convert( st.slots[0].inBuffer, st.slots[0].outBuffer,
+                                                    (size_t) st.dimSizes[0] * st.rowElems, 0, pipe->convertArg ) : 0;
+            if ( status < 0 )
+            {
+                FATAL_MSG("Failed to convert \"%s\".\n", pipe->inDatasetName);
+                goto cleanupFail;
+            }
+
+            if ( writeSlab(&st, datasetID, slab, st.slots[0].outBuffer) == FATAL_ERR )
+                goto cleanupFail;
+        }
+        goto done;
+    }
+
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+
+    if ( pthread_create(&readerThread, NULL, readerStage, &st) == 0 )
+        readerStarted = 1;
+    if ( readerStarted && pipe->convert && pthread_create(&converterThread, NULL, converterStage, &st) == 0 )
+        converterStarted = 1;
+
+    if ( !readerStarted || (pipe->convert && !converterStarted) )
+    {
+        FATAL_MSG("Failed to create the pipeline threads.\n");
+        setSlot(&st, 0, 0, 1);
+    }
+    else
+    {
+        /* The calling thread is the writer */
+        int ready = pipe->convert ? SLOT_CONVERTED : SLOT_READ;
+        for ( int32 slab = 0; slab < st.numSlabs; slab++ )
+        {
+            if ( !waitForSlot(&st, slab, ready) )
+                break;
+
+            herr_t status = writeSlab(&st, datasetID, slab, st.slots[slab % PIPE_SLOTS].outBuffer);
+
+            if ( status == FATAL_ERR )
+            {
+                setSlot(&st, slab, 0, 1);
+                break;
+            }
+            setSlot(&st, slab, SLOT_FREE, 0);
+        }
+    }
+
+    if ( readerStarted ) pthread_join(readerThread, NULL);
+    if ( converterStarted ) pthread_join(converterThread, NULL);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.cond);
+
+    if ( st.failed )
+        goto cleanupFail;
+
+done:
+    for ( int i = 0; i < PIPE_SLOTS; i++ )
+    {
+        if ( st.slots[i].outBuffer != st.slots[i].inBuffer ) free(st.slots[i].outBuffer);
+        free(st.slots[i].inBuffer);
+    }
+    SDendaccess(st.sdsID);
+    return datasetID;
+
+cleanupFail:
+    for ( int i = 0; i < PIPE_SLOTS; i++ )
+    {
+        if ( st.slots[i].outBuffer != st.slots[i].inBuffer ) free(st.slots[i].outBuffer);
+        free(st.slots[i].inBuffer);
+    }
+    SDendaccess(st.sdsID);
+    H5Dclose(datasetID);
+    return FATAL_ERR;
+}
@@ -0,0 +1,262 @@
+/*
+
+    DESCRIPTION:
+        Prefetching of the input granules of an orbit into the page cache.
+
+        When the environment variable TERRA_PREFETCH is set to N > 0, prefetchStart() reads
+        the whole input file list of the orbit up front and starts a thread that asks the
+        kernel (posix_fadvise POSIX_FADV_WILLNEED) to read the next N input files ahead while
+        the current ones are converted. On storage where the first read of a file stalls
+        (HSM recall, cold disks), the instrument functions then find their granules in
+        memory when they open them.
+
+        A file is consumed when the job that reads it starts (runJob() in parallel.c calls
+        prefetchConsumed() with the job arguments), or when it is opened but not converted
+        (a skipped instrument, a CERES granule outside of the orbit). The window is the first N files of the
+        list that are not consumed yet, so it follows the conversion from one instrument to
+        the next. TERRA_PREFETCH_MB (default PREFETCH_DEFAULT_MB) bounds the size of the
+        prefetched files that are not consumed yet; a file larger than the budget is only
+        prefetched when nothing else is waiting.
+
+*/
+
+#define _POSIX_C_SOURCE 200809L     // posix_fadvise and strdup with -std=c99
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PREFETCH_LINE_LEN 500
+#define PREFETCH_DEFAULT_MB 1024
+
+typedef struct
+{
+    char* name;
+    size_t size;
+    int advised;
+    int consumed;
+} prefetchFile_t;
+
+static prefetchFile_t* files = NULL;
+static size_t numFiles = 0;
+static size_t window = 0;               // files to keep ahead
+static size_t budget = 0;               // bytes
+static size_t pending = 0;              // bytes advised and not consumed
+static int stopThread = 0;
+static int threadStarted = 0;
+static pthread_t thread;
+static pthread_mutex_t prefetchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetchCond = PTHREAD_COND_INITIALIZER;
+
+/* Asks the kernel to read the whole file ahead */
+static void adviseFile( const char* name )
+{
+    int fd = open(name, O_RDONLY);
+    if ( fd < 0 )
+        return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+/* Returns the next file of the window to prefetch, -1 if none fits. Called with prefetchLock held. */
+static long nextFile()
+{
+    size_t ahead = 0;
+
+    for ( size_t i = 0; i < numFiles && ahead < window; i++ )
+    {
+        if ( files[i].consumed )
+            continue;
+        ahead++;
+        if ( files[i].advised )
+            continue;
+        if ( pending == 0 || pending + files[i].size <= budget )
+            return (long) i;
+        return -1;
+    }
+
+    return -1;
+}
+
+static void* prefetchMain( void* arg )
+{
+    (void) arg;
+
+    pthread_mutex_lock(&prefetchLock);
+    while ( !stopThread )
+    {
+        long i = nextFile();
+        if ( i < 0 )
+        {
+            pthread_cond_wait(&prefetchCond, &prefetchLock);
+            continue;
+        }
+
+        files[i].advised = 1;
+        pending += files[i].size;
+
+        /* open() may block for a long time on HSM storage */
+        pthread_mutex_unlock(&prefetchLock);
+        adviseFile(files[i].name);
+        pthread_mutex_lock(&prefetchLock);
+    }
+    pthread_mutex_unlock(&prefetchLock);
+
+    return NULL;
+}
+
+/*
+                    prefetchStart
+    DESCRIPTION:
+        Reads the input file list and starts the prefetch thread. Does nothing unless
+        TERRA_PREFETCH is set to a positive number. Lines that are not an existing regular
+        file (orbit number, "MOP N/A" ...) are ignored.
+
+    ARGUMENTS:
+        const char* inputListName -- The input file list of the orbit
+
+    RETURN:
+        FATAL_ERR if the prefetcher could not be started, RET_SUCCESS otherwise (also when it
+        is disabled). The conversion does not depend on the prefetcher, so the caller can go
+        on after a failure.
+*/
+herr_t prefetchStart( const char* inputListName )
+{
+    const char* s;
+    FILE* fp = NULL;
+    char line[PREFETCH_LINE_LEN];
+    size_t capacity = 0;
+
+    s = getenv("TERRA_PREFETCH");
+    if ( !s || !isdigit((int)*s) || strtol(s, NULL, 10) <= 0 )
+        return RET_SUCCESS;
+    window = (size_t) strtol(s, NULL, 10);
+
+    budget = (size_t) PREFETCH_DEFAULT_MB << 20;
+    s = getenv("TERRA_PREFETCH_MB");
+    if ( s && isdigit((int)*s) && strtol(s, NULL, 10) > 0 )
+        budget = (size_t) strtol(s, NULL, 10) << 20;
+
+    fp = fopen(inputListName, "r");
+    if ( fp == NULL )
+    {
+        FATAL_MSG("Unable to open the input file list \"%s\".\n", inputListName);
+        return FATAL_ERR;
+    }
+
+    while ( fgets(line, PREFETCH_LINE_LEN, fp) )
+    {
+        struct stat sb;
+
+        line[strcspn(line, "\n")] = '\0';
+        if ( line[0] == '#' || line[0] == '\0' || line[0] == ' ' )
+            continue;
+        if ( stat(line, &sb) != 0 || !S_ISREG(sb.st_mode) )
+            continue;
+
+        if ( numFiles == capacity )
+        {
+            prefetchFile_t* newFiles;
+            capacity = capacity ? 2 * capacity : 64;
+            newFiles = realloc(files, capacity * sizeof(prefetchFile_t));
+            if ( newFiles == NULL )
+            {
+                FATAL_MSG("Failed to allocate memory.\n");
+                fclose(fp);
+                prefetchStop();
+                return FATAL_ERR;
+            }
+            files = newFiles;
+        }
+
+        files[numFiles].name = strdup(line);
+        files[numFiles].size = (size_t) sb.st_size;
+        files[numFiles].advised = 0;
+        files[numFiles].consumed = 0;
+        if ( files[numFiles].name == NULL )
+        {
+            FATAL_MSG("Failed to allocate memory.\n");
+            fclose(fp);
+            prefetchStop();
+            return FATAL_ERR;
+        }
+        numFiles++;
+    }
+    fclose(fp);
+
+    stopThread = 0;
+    pending = 0;
+    if ( pthread_create(&thread, NULL, prefetchMain, NULL) != 0 )
+    {
+        FATAL_MSG("Failed to create the prefetch thread.\n");
+        prefetchStop();
+        return FATAL_ERR;
+    }
+    threadStarted = 1;
+
+    return RET_SUCCESS;
+}
+
+/*
+                    prefetchConsumed
+    DESCRIPTION:
+        Marks the input files among the arguments of a job as consumed, which moves the
+        prefetch window past them. Arguments that are not in the input file list are ignored.
+
+    ARGUMENTS:
+        char* const* args -- Job arguments, NULL entries allowed
+        int nargs         -- Number of entries of args
+*/
+void prefetchConsumed( char* const* args, int nargs )
+{
+    int changed = 0;
+
+    if ( !threadStarted )
+        return;
+
+    pthread_mutex_lock(&prefetchLock);
+    for ( int a = 0; a < nargs; a++ )
+    {
+        if ( args[a] == NULL )
+            continue;
+        for ( size_t i = 0; i < numFiles; i++ )
+        {
+            if ( files[i].consumed || strcmp(files[i].name, args[a]) != 0 )
+                continue;
+            files[i].consumed = 1;
+            if ( files[i].advised )
+                pending -= files[i].size;
+            changed = 1;
+            break;
+        }
+    }
+    if ( changed )
+        pthread_cond_signal(&prefetchCond);
+    pthread_mutex_unlock(&prefetchLock);
+}
+
+/* Stops the prefetch thread and forgets the input file list */
+void prefetchStop()
+{
+    if ( threadStarted )
+    {
+        pthread_mutex_lock(&prefetchLock);
+        stopThread = 1;
+        pthread_cond_signal(&prefetchCond);
+        pthread_mutex_unlock(&prefetchLock);
+        pthread_join(thread, NULL);
+        threadStarted = 0;
+    }
+
+    for ( size_t i = 0; i < numFiles; i++ )
+        free(files[i].name);
+    free(files);
+    files = NULL;
+    numFiles = 0;
+    pending = 0;
+}
@@ -0,0 +1,181 @@
+/*
+
+    DESCRIPTION:
+        Tests the merge of the part files of an orbit (merge.c): two parts with their own
+        instrument group share a dimension scale in the root group. The merged file must
+        have both groups with their data, a single copy of the shared scale attached to the
+        datasets of both parts, and the InputGranules that both parts kept.
+
+*/
+
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NX 4
+
+static const char* partNames[2] = { "testMergeParts.MODIS.part", "testMergeParts.MISR.part" };
+static const char* mergedName = "testMergeParts.h5";
+
+/* Creates a root scale named scaleName (if not NULL) and an attached dataset group/data */
+static int writePart( const char* fileName, const char* group, const char* scaleName, int offset,
+                      const char* granules )
+{
+	hsize_t dims[2] = { NX, 2 };
+	hsize_t scaleDims[1] = { NX };
+	int data[NX*2];
+	float scaleData[NX];
+	int failed = 1;
+	hid_t file, groupID = -1, dset = -1, shared = -1, own = -1, space = -1, scaleSpace = -1;
+	char ownName[64];
+
+	for(int i = 0; i < NX*2; i++) data[i] = offset + i;
+	for(int i = 0; i < NX; i++) scaleData[i] = (float) i;
+
+	file = H5Fcreate(fileName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	if(file < 0) return 1;
+
+	space = H5Screate_simple(2, dims, NULL);
+	scaleSpace = H5Screate_simple(1, scaleDims, NULL);
+	groupID = H5Gcreate2(file, group, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	dset = H5Dcreate2(groupID, "Data", H5T_NATIVE_INT, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	shared = H5Dcreate2(file, scaleName, H5T_NATIVE_FLOAT, scaleSpace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	if(groupID < 0 || dset < 0 || shared < 0) goto done;
+
+	/* The second dimension has a scale of its own, inside the group */
+	snprintf(ownName, sizeof(ownName), "%s_pair", group);
+	scaleDims[0] = 2;
+	H5Sclose(scaleSpace);
+	scaleSpace = H5Screate_simple(1, scaleDims, NULL);
+	own = H5Dcreate2(groupID, ownName, H5T_NATIVE_FLOAT, scaleSpace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+	if(own < 0) goto done;
+
+	if(H5Dwrite(dset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) < 0 ||
+	   H5Dwrite(shared, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, scaleData) < 0 ||
+	   H5DSset_scale(shared, scaleName) < 0 || H5DSset_scale(own, ownName) < 0 ||
+	   H5DSattach_scale(dset, shared, 0) < 0 || H5DSattach_scale(dset, own, 1) < 0 ||
+	   H5LTset_attribute_string(file, "/", "InputGranules", granules) < 0)
+		goto done;
+
+	failed = 0;
+done:
+	if(own >= 0) H5Dclose(own);
+	if(shared >= 0) H5Dclose(shared);
+	if(dset >= 0) H5Dclose(dset);
+	if(groupID >= 0) H5Gclose(groupID);
+	if(scaleSpace >= 0) H5Sclose(scaleSpace);
+	if(space >= 0) H5Sclose(space);
+	H5Fclose(file);
+	return failed;
+}
+
+/* Checks the data and the scales of group/Data in the merged file */
+static int checkGroup( hid_t file, const char* group, int offset )
+{
+	char path[64];
+	char ownPath[64];
+	int data[NX*2];
+	int failed = 0;
+	hid_t dset, shared, own;
+
+	snprintf(path, sizeof(path), "%s/Data", group);
+	snprintf(ownPath, sizeof(ownPath), "%s/%s_pair", group, group);
+	dset = H5Dopen2(file, path, H5P_DEFAULT);
+	shared = H5Dopen2(file, "Shared", H5P_DEFAULT);
+	own = H5Dopen2(file, ownPath, H5P_DEFAULT);
+	if(dset < 0 || shared < 0 || own < 0) {
+		printf("%s: objects missing\n", group);
+		failed = 1;
+		goto done;
+	}
+
+	if(H5Dread(dset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) < 0) {
+		printf("%s: data unreadable\n", group);
+		failed = 1;
+	}
+	for(int i = 0; i < NX*2 && !failed; i++) {
+		if(data[i] != offset + i) {
+			printf("%s: data[%d] is %d instead of %d\n", group, i, data[i], offset + i);
+			failed = 1;
+		}
+	}
+
+	if(H5DSis_attached(dset, shared, 0) <= 0 || H5DSis_attached(dset, own, 1) <= 0 ||
+	   H5DSget_num_scales(dset, 0) != 1 || H5DSget_num_scales(dset, 1) != 1) {
+		printf("%s: dimension scales not attached\n", group);
+		failed = 1;
+	}
+
+done:
+	if(own >= 0) H5Dclose(own);
+	if(shared >= 0) H5Dclose(shared);
+	if(dset >= 0) H5Dclose(dset);
+	return failed;
+}
+
+static int checkIntersect( const char* list, const char* other, const char* expected )
+{
+	char buffer[256];
+
+	strcpy(buffer, list);
+	granuleListIntersect(buffer, other);
+	if(strcmp(buffer, expected) != 0) {
+		printf("intersection of \"%s\" and \"%s\": \"%s\" instead of \"%s\"\n", list, other, buffer, expected);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+
+	int failed = 0;
+	char granules[256] = {0};
+	hid_t file;
+
+	failed |= checkIntersect("a.hdf,b.hdf,c.hdf", "a.hdf,b.hdf,c.hdf", "a.hdf,b.hdf,c.hdf");
+	failed |= checkIntersect("a.hdf,b.hdf,c.hdf", "b.hdf,c.hdf", "b.hdf,c.hdf");
+	failed |= checkIntersect("a.hdf,b.hdf,c.hdf", "a.hdf,c.hdf", "a.hdf,c.hdf");
+	failed |= checkIntersect("a.hdf,b.hdf,c.hdf", "a.hdf,b.hdf", "a.hdf,b.hdf");
+	failed |= checkIntersect("a.hdf,b.hdf", "", "");
+	failed |= checkIntersect("a.hdf,b.hdf", "a.hd,b.hdf.1", "");
+
+	/* MODIS skipped c.hdf and MISR skipped a.hdf */
+	if(writePart(partNames[0], "MODIS", "Shared", 0, "a.hdf,b.hdf,d.hdf") ||
+	   writePart(partNames[1], "MISR", "Shared", 100, "b.hdf,c.hdf,d.hdf")) {
+		printf("Failed to write the part files\n");
+		failed = 1;
+	}
+	else if(mergeOrbitParts((char*) mergedName, (char**) partNames, 2) == FATAL_ERR) {
+		printf("mergeOrbitParts failed\n");
+		failed = 1;
+	}
+	else {
+		file = H5Fopen(mergedName, H5F_ACC_RDONLY, H5P_DEFAULT);
+		if(file < 0) {
+			printf("Failed to open the merged file\n");
+			failed = 1;
+		}
+		else {
+			failed |= checkGroup(file, "MODIS", 0);
+			failed |= checkGroup(file, "MISR", 100);
+			if(H5LTget_attribute_string(file, "/", "InputGranules", granules) < 0 ||
+			   strcmp(granules, "b.hdf,d.hdf") != 0) {
+				printf("InputGranules is \"%s\" instead of \"b.hdf,d.hdf\"\n", granules);
+				failed = 1;
+			}
+			H5Fclose(file);
+		}
+	}
+
+	remove(partNames[0]);
+	remove(partNames[1]);
+	remove(mergedName);
+
+	if(failed) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+
+    DESCRIPTION:
+        Tests the InputGranules list trimming of orbitWindow.c: the files recorded by
+        orbitGranuleSkip() are removed from a list built by updateGranList(), whichever of
+        its entries they are, and are forgotten after the trim or orbitGranuleSkipReset().
+        The skipped files recorded in a checkpoint file (checkpoint.c) are recorded once and
+        are skipped again when they are loaded back, as for a resumed orbit.
+
+*/
+
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Builds the list of files with updateGranList(), skips the files of skip and trims it */
+static int checkTrim( const char* what, char** files, int nfiles, char** skip, int nskip, const char* expected )
+{
+	char* granList = NULL;
+	size_t granListSize = 0;
+	int failed = 0;
+
+	for(int i = 0; i < nfiles; i++) {
+		if(updateGranList(&granList, files[i], &granListSize) == FATAL_ERR) {
+			printf("%s: updateGranList failed\n", what);
+			free(granList);
+			return 1;
+		}
+	}
+
+	if(nskip > 0 && orbitGranuleSkip(skip, nskip) == FATAL_ERR) {
+		printf("%s: orbitGranuleSkip failed\n", what);
+		free(granList);
+		return 1;
+	}
+
+	orbitGranuleListTrim(granList);
+	if(strcmp(granList, expected) != 0) {
+		printf("%s: \"%s\" instead of \"%s\"\n", what, granList, expected);
+		failed = 1;
+	}
+
+	free(granList);
+	return failed;
+}
+
+/* Counts the lines of the checkpoint file, -1 if it cannot be read */
+static int countLines( const char* fileName )
+{
+	char line[1024];
+	int count = 0;
+	FILE* fp = fopen(fileName, "r");
+
+	if(fp == NULL)
+		return -1;
+	while(fgets(line, sizeof(line), fp))
+		count++;
+	fclose(fp);
+	return count;
+}
+
+int main(void) {
+
+	char* files[] = {"MOD021KM.A2007.0000.hdf", "MOD021KM.A2007.0005.hdf", "MOD021KM.A2007.0010.hdf",
+	                 "MOD021KM.A2007.0015.hdf"};
+	char* first[] = {"/input/MODIS/MOD021KM.A2007.0000.hdf"};
+	char* middle[] = {"MOD021KM.A2007.0005.hdf", NULL, "/input/MODIS/MOD021KM.A2007.0010.hdf"};
+	char* last[] = {"/input/MODIS/MOD021KM.A2007.0015.hdf"};
+	char* prefix[] = {"MOD021KM.A2007.001"};
+	const char* checkpointFile = "testOrbitWindow.checkpoint";
+	int failed = 0;
+
+	failed |= checkTrim("nothing skipped", files, 4, NULL, 0,
+	                    "MOD021KM.A2007.0000.hdf,MOD021KM.A2007.0005.hdf,MOD021KM.A2007.0010.hdf,MOD021KM.A2007.0015.hdf");
+	failed |= checkTrim("first skipped", files, 4, first, 1,
+	                    "MOD021KM.A2007.0005.hdf,MOD021KM.A2007.0010.hdf,MOD021KM.A2007.0015.hdf");
+	failed |= checkTrim("middle skipped", files, 4, middle, 3,
+	                    "MOD021KM.A2007.0000.hdf,MOD021KM.A2007.0015.hdf");
+	failed |= checkTrim("last skipped", files, 4, last, 1,
+	                    "MOD021KM.A2007.0000.hdf,MOD021KM.A2007.0005.hdf,MOD021KM.A2007.0010.hdf");
+	failed |= checkTrim("all skipped", files, 1, first, 1, "");
+	failed |= checkTrim("prefix of a file skipped", files, 4, prefix, 1,
+	                    "MOD021KM.A2007.0000.hdf,MOD021KM.A2007.0005.hdf,MOD021KM.A2007.0010.hdf,MOD021KM.A2007.0015.hdf");
+
+	/* A failed orbit forgets its skipped files instead of passing them to the next orbit */
+	if(orbitGranuleSkip(last, 1) == FATAL_ERR) {
+		printf("orbitGranuleSkip failed\n");
+		failed = 1;
+	}
+	orbitGranuleSkipReset();
+	failed |= checkTrim("after reset", files, 4, NULL, 0,
+	                    "MOD021KM.A2007.0000.hdf,MOD021KM.A2007.0005.hdf,MOD021KM.A2007.0010.hdf,MOD021KM.A2007.0015.hdf");
+
+	/* A resumed orbit skips again the files recorded before its completed instruments */
+	remove(checkpointFile);
+	if(orbitGranuleSkip(first, 1) == FATAL_ERR || checkpointRecordSkipped(checkpointFile) == FATAL_ERR ||
+	   orbitGranuleSkip(last, 1) == FATAL_ERR || checkpointRecordSkipped(checkpointFile) == FATAL_ERR) {
+		printf("checkpointRecordSkipped failed\n");
+		failed = 1;
+	}
+	else if(countLines(checkpointFile) != 2) {
+		printf("checkpoint file has %d lines instead of 2\n", countLines(checkpointFile));
+		failed = 1;
+	}
+	orbitGranuleSkipReset();
+	if(checkpointLoadSkipped(checkpointFile) == FATAL_ERR) {
+		printf("checkpointLoadSkipped failed\n");
+		failed = 1;
+	}
+	failed |= checkTrim("after resume", files, 4, NULL, 0,
+	                    "MOD021KM.A2007.0005.hdf,MOD021KM.A2007.0010.hdf");
+	remove(checkpointFile);
+
+	if(failed) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,332 @@
+/*
+
+    DESCRIPTION:
+        Per-instrument and per-dataset timing report.
+
+        When the environment variable TERRA_TIMING is set to 1, every instrument function
+        (see runJob() in parallel.c) and every readThenWrite* call opens a timing record.
+        A record collects:
+
+            wall_seconds        -- elapsed wall clock time (CLOCK_MONOTONIC)
+            cpu_seconds         -- CPU time of the calling thread (CLOCK_THREAD_CPUTIME_ID)
+            process_cpu_seconds -- CPU time of the whole process (CLOCK_PROCESS_CPUTIME_ID)
+            bytes_read          -- bytes read from the HDF4 input files
+            bytes_written       -- bytes written to the HDF5 output file
+            peak_buffer_bytes   -- the largest single data buffer used by the record
+
+        Records nest: the byte counters are added to every record the calling thread has
+        open, so an instrument record contains the sum of its readThenWrite* records. Each
+        thread keeps its own stack of open records, so the counters of a record only include
+        the I/O done on the thread that opened it. The pipeline (pipeline.c) counts its slabs
+        on the calling thread for that reason.
+
+        cpu_seconds leaves out the helper threads of a record: the pipeline reader, the
+        lat/lon interpolation threads and the MISR unpack threads. process_cpu_seconds
+        includes them.
+
+        At the end of the run, timingWrite() writes all records as JSON to the file
+        <output file>.timing.json next to the output file. When TERRA_TIMING is not set,
+        all functions return immediately and no file is written.
+
+*/
+
+#define _POSIX_C_SOURCE 199309L
+#include "libTERRA.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TIMING_NAME_LEN 256
+#define TIMING_STACK_MAX 16
+
+typedef struct
+{
+    char kind[32];
+    char name[TIMING_NAME_LEN];
+    char file[TIMING_NAME_LEN];
+    int depth;
+    double start;
+    double wall;
+    double cpuStart;
+    double cpu;
+    double processCpuStart;
+    double processCpu;
+    unsigned long long bytesRead;
+    unsigned long long bytesWritten;
+    unsigned long long peakBuffer;
+    int open;
+} timingRecord_t;
+
+static int timingEnabled = 0;
+static double timingStart = 0.0;
+static timingRecord_t* records = NULL;
+static int numRecords = 0;
+static int maxRecords = 0;
+static pthread_mutex_t recordLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread int openStack[TIMING_STACK_MAX];
+static __thread int openDepth = 0;
+
+static double clockSeconds( clockid_t clk )
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+static void copyName( char* dest, const char* src )
+{
+    dest[0] = '\0';
+    if ( src )
+    {
+        strncpy(dest, src, TIMING_NAME_LEN-1);
+        dest[TIMING_NAME_LEN-1] = '\0';
+    }
+}
+
+/*
+                    timingInit
+    DESCRIPTION:
+        Reads the environment variable TERRA_TIMING, drops the records of the previous run
+        (batch mode converts several orbits in one process) and starts the run clock. Must
+        be called before any other timing function of a run and before any thread is started.
+
+    RETURN:
+        1 if timing is enabled, 0 otherwise.
+*/
+int timingInit()
+{
+    const char* s = getenv("TERRA_TIMING");
+
+    timingEnabled = ( s && isdigit((int)*s) && strtol(s, NULL, 10) == 1 );
+    timingStart = clockSeconds(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&recordLock);
+    numRecords = 0;
+    pthread_mutex_unlock(&recordLock);
+    openDepth = 0;
+
+    return timingEnabled;
+}
+
+/*
+                    timingBegin
+    DESCRIPTION:
+        Opens a timing record on the calling thread.
+
+    ARGUMENTS:
+        const char* kind -- Kind of the record, e.g. "instrument" or the readThenWrite*
+                            function name
+        const char* name -- Instrument or dataset name
+        const char* file -- Input file of the record, may be NULL
+
+    RETURN:
+        The record handle to pass to timingEnd(), or -1 if timing is disabled or the record
+        could not be created.
+*/
+int timingBegin( const char* kind, const char* name, const char* file )
+{
+    timingRecord_t* rec = NULL;
+    int handle = -1;
+
+    if ( !timingEnabled || openDepth >= TIMING_STACK_MAX )
+        return -1;
+
+    pthread_mutex_lock(&recordLock);
+    if ( numRecords == maxRecords )
+    {
+        int newMax = maxRecords ? 2 * maxRecords : 256;
+        timingRecord_t* tmp = realloc(records, sizeof(timingRecord_t) * newMax);
+        if ( tmp == NULL )
+        {
+            pthread_mutex_unlock(&recordLock);
+            WARN_MSG("Failed to allocate memory for a timing record.\n");
+            return -1;
+        }
+        records = tmp;
+        maxRecords = newMax;
+    }
+    handle = numRecords++;
+    rec = &records[handle];
+    memset(rec, 0, sizeof(timingRecord_t));
+    strncpy(rec->kind, kind, sizeof(rec->kind)-1);
+    copyName(rec->name, name);
+    copyName(rec->file, file);
+    rec->depth = openDepth;
+    rec->open = 1;
+    rec->start = clockSeconds(CLOCK_MONOTONIC);
+    rec->cpuStart = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+    rec->processCpuStart = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+    pthread_mutex_unlock(&recordLock);
+
+    openStack[openDepth++] = handle;
+
+    return handle;
+}
+
+/*
+                    timingEnd
+    DESCRIPTION:
+        Closes the timing record returned by timingBegin(). Records must be closed in the
+        reverse order they were opened. A handle of -1 is ignored.
+*/
+void timingEnd( int handle )
+{
+    double wall, cpu, processCpu;
+
+    if ( handle < 0 )
+        return;
+
+    wall = clockSeconds(CLOCK_MONOTONIC);
+    cpu = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+    processCpu = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+
+    pthread_mutex_lock(&recordLock);
+    records[handle].wall = wall - records[handle].start;
+    records[handle].cpu = cpu - records[handle].cpuStart;
+    records[handle].processCpu = processCpu - records[handle].processCpuStart;
+    records[handle].open = 0;
+    pthread_mutex_unlock(&recordLock);
+
+    if ( openDepth > 0 && openStack[openDepth-1] == handle )
+        openDepth--;
+}
+
+/* Adds to the counters of all records the calling thread has open */
+static void timingAdd( size_t bytesRead, size_t bytesWritten, size_t buffer )
+{
+    if ( !timingEnabled || openDepth == 0 )
+        return;
+
+    pthread_mutex_lock(&recordLock);
+    for ( int i = 0; i < openDepth; i++ )
+    {
+        timingRecord_t* rec = &records[openStack[i]];
+        rec->bytesRead += bytesRead;
+        rec->bytesWritten += bytesWritten;
+        if ( buffer > rec->peakBuffer )
+            rec->peakBuffer = buffer;
+    }
+    pthread_mutex_unlock(&recordLock);
+}
+
+/*
+                    timingAddRead / timingAddWritten / timingBuffer
+    DESCRIPTION:
+        Account bytes read from HDF4, bytes written to HDF5 and the size of a data buffer
+        to the open records of the calling thread. Callers count the bytes only after the
+        read or write succeeded.
+*/
+void timingAddRead( size_t bytes )
+{
+    timingAdd(bytes, 0, bytes);
+}
+
+void timingAddWritten( size_t bytes )
+{
+    timingAdd(0, bytes, 0);
+}
+
+void timingBuffer( size_t bytes )
+{
+    timingAdd(0, 0, bytes);
+}
+
+static void writeJSONString( FILE* fp, const char* s )
+{
+    fputc('"', fp);
+    for ( ; *s; s++ )
+    {
+        if ( *s == '"' || *s == '\\' )
+            fprintf(fp, "\\%c", *s);
+        else if ( (unsigned char) *s < 0x20 )
+            fprintf(fp, "\\u%04x", (unsigned) (unsigned char) *s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+                    timingWrite
+    DESCRIPTION:
+        Writes all timing records to <outputFileName>.timing.json. Does nothing if timing
+        is disabled. Must be called after the last instrument of the orbit has run.
+
+    ARGUMENTS:
+        const char* outputFileName -- Name of the HDF5 output file
+        int failed                 -- Non-zero if the run failed
+
+    RETURN:
+        FATAL_ERR if the file could not be written, RET_SUCCESS otherwise.
+*/
+herr_t timingWrite( const char* outputFileName, int failed )
+{
+    FILE* fp = NULL;
+    char* jsonName = NULL;
+    double total;
+
+    if ( !timingEnabled )
+        return RET_SUCCESS;
+
+    total = clockSeconds(CLOCK_MONOTONIC) - timingStart;
+
+    jsonName = calloc(strlen(outputFileName) + strlen(".timing.json") + 1, 1);
+    if ( jsonName == NULL )
+    {
+        FATAL_MSG("Failed to allocate memory.\n");
+        return FATAL_ERR;
+    }
+    strcpy(jsonName, outputFileName);
+    strcat(jsonName, ".timing.json");
+
+    fp = fopen(jsonName, "w");
+    if ( fp == NULL )
+    {
+        FATAL_MSG("Unable to open the timing report \"%s\".\n", jsonName);
+        free(jsonName);
+        return FATAL_ERR;
+    }
+
+    fprintf(fp, "{\n  \"output\": ");
+    writeJSONString(fp, outputFileName);
+    fprintf(fp, ",\n  \"status\": \"%s\",\n  \"wall_seconds\": %.6f,\n  \"records\": [",
+            failed ? "failed" : "success", total);
+
+    pthread_mutex_lock(&recordLock);
+    for ( int i = 0; i < numRecords; i++ )
+    {
+        const timingRecord_t* rec = &records[i];
+        fprintf(fp, "%s\n    { \"kind\": ", i ? "," : "");
+        writeJSONString(fp, rec->kind);
+        fprintf(fp, ", \"name\": ");
+        writeJSONString(fp, rec->name);
+        if ( rec->file[0] )
+        {
+            fprintf(fp, ", \"file\": ");
+            writeJSONString(fp, rec->file);
+        }
+        fprintf(fp, ", \"depth\": %d, \"start_seconds\": %.6f, \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f,"
+                " \"process_cpu_seconds\": %.6f, \"bytes_read\": %llu, \"bytes_written\": %llu,"
+                " \"peak_buffer_bytes\": %llu%s }",
+                rec->depth, rec->start - timingStart, rec->wall, rec->cpu, rec->processCpu, rec->bytesRead,
+                rec->bytesWritten, rec->peakBuffer, rec->open ? ", \"unfinished\": true" : "");
+    }
+    pthread_mutex_unlock(&recordLock);
+
+    fprintf(fp, "\n  ]\n}\n");
+
+    if ( fclose(fp) != 0 )
+    {
+        FATAL_MSG("Unable to write the timing report \"%s\".\n", jsonName);
+        free(jsonName);
+        return FATAL_ERR;
+    }
+
+    printf("Timing report written to %s\n", jsonName);
+    free(jsonName);
+    return RET_SUCCESS;
+}